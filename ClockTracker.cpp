@@ -0,0 +1,229 @@
+/*
+ *      Copyright (C) 2014 Andrew Van Til
+ *      http://babgvant.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "stdafx.h"
+#include "EVRPresenter.h"
+
+// How often the tracker re-reads the clock.
+const LONGLONG CLOCK_SYNC_INTERVAL = 5000000;     // 500 ms
+
+// A prediction further off than this is a discontinuity, not drift. The 
+// tracker then re-anchors instead of correcting.
+const LONGLONG CLOCK_RESYNC_THRESHOLD = 50000;    // 5 ms
+
+// Loop gains for the offset and rate corrections. (Divisors.) Each reading
+// moves the fit only part of the way, which filters jitter in the readings.
+const LONGLONG CLOCK_PHASE_GAIN = 2;
+const double CLOCK_RATE_GAIN = 4.0;
+
+// The estimated rate stays within this fraction of the nominal rate.
+const double CLOCK_MAX_RATE_ERROR = 0.01;
+
+
+ClockTracker::ClockTracker() :
+  m_pClock(NULL),
+  m_pTimer(NULL),
+  m_fRate(1.0f),
+  m_dRate(1.0),
+  m_bRunning(FALSE),
+  m_bAnchored(FALSE),
+  m_hnsAnchorClock(0),
+  m_hnsAnchorSystem(0),
+  m_cQueries(0),
+  m_cClockCalls(0)
+{
+}
+
+ClockTracker::~ClockTracker()
+{
+  SAFE_RELEASE(m_pClock);
+}
+
+//-----------------------------------------------------------------------------
+// SetClock
+//
+// Sets the clock to track, and the timer to extrapolate with. The clock can 
+// be NULL.
+//-----------------------------------------------------------------------------
+
+void ClockTracker::SetClock(IMFClock *pClock, SchedulerTimer *pTimer)
+{
+  AutoLock lock(m_lock);
+
+  CopyComPointer(m_pClock, pClock);
+  m_pTimer = pTimer;
+  m_bAnchored = FALSE;
+}
+
+//-----------------------------------------------------------------------------
+// SetRate
+//
+// Called when the clock rate changes. The next query re-anchors.
+//-----------------------------------------------------------------------------
+
+void ClockTracker::SetRate(float fRate)
+{
+  AutoLock lock(m_lock);
+
+  m_fRate = fRate;
+  m_dRate = fRate;
+  m_bAnchored = FALSE;
+}
+
+//-----------------------------------------------------------------------------
+// SetRunning
+//
+// Called when the clock starts, stops, or pauses.
+//-----------------------------------------------------------------------------
+
+void ClockTracker::SetRunning(BOOL bRunning)
+{
+  AutoLock lock(m_lock);
+
+  m_bRunning = bRunning;
+  m_bAnchored = FALSE;
+}
+
+//-----------------------------------------------------------------------------
+// Invalidate
+//
+// Forces the next query to read the clock. Scheduler::Flush calls it, since
+// a flush usually means a seek.
+//-----------------------------------------------------------------------------
+
+void ClockTracker::Invalidate()
+{
+  AutoLock lock(m_lock);
+  m_bAnchored = FALSE;
+}
+
+//-----------------------------------------------------------------------------
+// GetTime
+//
+// Returns the current presentation time.
+//-----------------------------------------------------------------------------
+
+HRESULT ClockTracker::GetTime(LONGLONG *phnsClockTime)
+{
+  CheckPointer(phnsClockTime, E_POINTER);
+
+  AutoLock lock(m_lock);
+
+  if (m_pClock == NULL || m_pTimer == NULL)
+  {
+    return MF_E_NO_CLOCK;
+  }
+
+  m_cQueries++;
+
+  if (!m_bRunning || m_fRate == 0.0f)
+  {
+    // The clock is not moving; just read it.
+    m_bAnchored = FALSE;
+    return Sync(phnsClockTime);
+  }
+
+  LONGLONG hnsElapsed = m_pTimer->Now() - m_hnsAnchorSystem;
+
+  if (!m_bAnchored || hnsElapsed >= CLOCK_SYNC_INTERVAL || hnsElapsed < 0)
+  {
+    return Sync(phnsClockTime);
+  }
+
+  *phnsClockTime = m_hnsAnchorClock + (LONGLONG)(hnsElapsed * m_dRate);
+  return S_OK;
+}
+
+ULONGLONG ClockTracker::QueryCount()
+{
+  AutoLock lock(m_lock);
+  return m_cQueries;
+}
+
+ULONGLONG ClockTracker::ClockCallCount()
+{
+  AutoLock lock(m_lock);
+  return m_cClockCalls;
+}
+
+//-----------------------------------------------------------------------------
+// Sync
+//
+// Reads the clock and updates the fit. Call with the lock held.
+//-----------------------------------------------------------------------------
+
+HRESULT ClockTracker::Sync(LONGLONG *phnsClockTime)
+{
+  HRESULT hr = S_OK;
+  LONGLONG hnsClockTime = 0;
+  MFTIME hnsClockSystemTime = 0;
+
+  // The clock reports its own system time, which need not share an epoch 
+  // with the timer. Bracket the call with the timer instead.
+  LONGLONG hnsBefore = m_pTimer->Now();
+  hr = m_pClock->GetCorrelatedTime(0, &hnsClockTime, &hnsClockSystemTime);
+  LONGLONG hnsSystemTime = (hnsBefore + m_pTimer->Now()) / 2;
+
+  m_cClockCalls++;
+
+  if (FAILED(hr))
+  {
+    m_bAnchored = FALSE;
+    return hr;
+  }
+
+  LONGLONG hnsAnchorClock = hnsClockTime;
+
+  if (m_bAnchored)
+  {
+    LONGLONG hnsElapsed = hnsSystemTime - m_hnsAnchorSystem;
+    LONGLONG hnsPredicted = m_hnsAnchorClock + (LONGLONG)(hnsElapsed * m_dRate);
+    LONGLONG hnsError = hnsClockTime - hnsPredicted;
+
+    if (_abs64(hnsError) < CLOCK_RESYNC_THRESHOLD && hnsElapsed > 0)
+    {
+      // Drift or jitter: correct the offset and the rate by part of the
+      // observed error.
+      hnsAnchorClock = hnsPredicted + hnsError / CLOCK_PHASE_GAIN;
+      m_dRate += (hnsError / CLOCK_RATE_GAIN) / hnsElapsed;
+
+      double dLimit = fabs(m_fRate) * CLOCK_MAX_RATE_ERROR;
+      if (m_dRate > m_fRate + dLimit)
+      {
+        m_dRate = m_fRate + dLimit;
+      }
+      else if (m_dRate < m_fRate - dLimit)
+      {
+        m_dRate = m_fRate - dLimit;
+      }
+    }
+    else
+    {
+      // Discontinuity: start over from the nominal rate.
+      m_dRate = m_fRate;
+    }
+  }
+
+  m_hnsAnchorClock = hnsAnchorClock;
+  m_hnsAnchorSystem = hnsSystemTime;
+  m_bAnchored = TRUE;
+
+  *phnsClockTime = hnsAnchorClock;
+  return hr;
+}
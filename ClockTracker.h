@@ -0,0 +1,69 @@
+/*
+ *      Copyright (C) 2014 Andrew Van Til
+ *      http://babgvant.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// ClockTracker class
+//
+// Answers "what is the presentation time now?" without calling into the 
+// presentation clock every time.
+//
+// The tracker fits the clock against the system time of a SchedulerTimer (an
+// offset and a rate, corrected like a phase-locked loop) and extrapolates
+// from the timer. It only calls IMFClock::GetCorrelatedTime again once 
+// CLOCK_SYNC_INTERVAL has passed, after an invalidation, or while the clock is
+// not running (paused, stopped, or scrubbing), when extrapolating is pointless.
+//
+// All methods are thread-safe.
+//-----------------------------------------------------------------------------
+
+class ClockTracker
+{
+public:
+  ClockTracker();
+  ~ClockTracker();
+
+  void SetClock(IMFClock *pClock, SchedulerTimer *pTimer);
+  void SetRate(float fRate);
+  void SetRunning(BOOL bRunning);
+  void Invalidate();
+
+  HRESULT GetTime(LONGLONG *phnsClockTime);
+
+  ULONGLONG QueryCount();         // Calls to GetTime.
+  ULONGLONG ClockCallCount();     // Calls into the clock.
+
+private:
+  HRESULT Sync(LONGLONG *phnsClockTime);
+
+  CritSec         m_lock;
+  IMFClock        *m_pClock;
+  SchedulerTimer  *m_pTimer;            // Not owned.
+
+  float           m_fRate;              // Nominal rate, from the clock state sink.
+  double          m_dRate;              // Estimated clock ticks per system tick.
+  BOOL            m_bRunning;
+  BOOL            m_bAnchored;
+  LONGLONG        m_hnsAnchorClock;     // Clock time at the anchor.
+  LONGLONG        m_hnsAnchorSystem;    // System (timer) time at the anchor.
+
+  ULONGLONG       m_cQueries;
+  ULONGLONG       m_cClockCalls;
+};
@@ -13,63 +13,91 @@
 
 #pragma once
 
+#include <new>
+#include <type_traits>
+#include <utility>
 
 namespace MediaFoundationSamples
 {
 
-    // Class template: Re-sizable array. 
+    // Class template: Re-sizable array.
 
-    // To grow or shrink the array, call SetSize(). 
-    // To pre-allocate the array, call Allocate(). 
+    // To grow or shrink the array, call SetSize() or Append().
+    // To pre-allocate the array, call Allocate().
+
+    // T:            Element type.
+    // INLINE_COUNT: Elements stored inside the object itself. The array
+    //               allocates only when it grows past them.
 
     // Notes:
     // Copy constructor and assignment operator are private, to avoid throwing exceptions. (One could easily modify this.)
+    // The array can be moved.
     // It is the caller's responsibility to release the objects in the array. The array's destuctor does not release them.
     // The array does not actually shrink when SetSize is called with a smaller size. Only the reported size changes.
+    // SetSize grows the allocation geometrically, so a series of appends is linear.
+    // New elements are default-constructed. Elements of trivial types (plain data) are left
+    // as they are, like the spare capacity, which is never zero-filled.
+    // Trivially copyable elements are relocated with memcpy; others are moved.
 
-    template <class T>
+    template <class T, DWORD INLINE_COUNT = 0>
     class GrowableArray
     {
     public:
-        GrowableArray() : m_count(0), m_allocated(0), m_pArray(NULL)
+        GrowableArray() : m_count(0), m_allocated(INLINE_COUNT), m_pArray(InlineArray())
         {
-            
+
         }
         virtual ~GrowableArray()
         {
-            SAFE_ARRAY_DELETE(m_pArray);
+            Destroy(0, m_count);
+            FreeArray();
+        }
+
+        GrowableArray(GrowableArray&& r) : m_count(0), m_allocated(INLINE_COUNT), m_pArray(InlineArray())
+        {
+            MoveFrom(r);
+        }
+
+        GrowableArray& operator=(GrowableArray&& r)
+        {
+            if (this != &r)
+            {
+                Destroy(0, m_count);
+                FreeArray();
+
+                m_count = 0;
+                m_allocated = INLINE_COUNT;
+                m_pArray = InlineArray();
+
+                MoveFrom(r);
+            }
+            return *this;
         }
 
         // Allocate: Reserves memory for the array, but does not increase the count.
         HRESULT Allocate(DWORD alloc)
         {
-            HRESULT hr = S_OK;
-            if (alloc > m_allocated)
+            if (alloc <= m_allocated)
             {
-                T *pTmp = new T[alloc];
-                if (pTmp)
-                {
-                    ZeroMemory(pTmp, alloc * sizeof(T));
+                return S_OK;
+            }
 
-                    assert(m_count <= m_allocated);
+            T *pTmp = static_cast<T*>(::operator new(alloc * sizeof(T), std::nothrow));
+            if (pTmp == NULL)
+            {
+                return E_OUTOFMEMORY;
+            }
 
-                    // Copy the elements to the re-allocated array.
-                    for (DWORD i = 0; i < m_count; i++)
-                    {
-                        pTmp[i] = m_pArray[i];
-                    }
+            assert(m_count <= m_allocated);
 
-                    delete [] m_pArray;
+            // Move the elements to the re-allocated array.
+            Relocate(pTmp, m_pArray, m_count);
 
-                    m_pArray = pTmp;
-                    m_allocated = alloc;
-                }
-                else
-                {
-                    hr = E_OUTOFMEMORY;
-                }
-            }
-            return hr;
+            FreeArray();
+
+            m_pArray = pTmp;
+            m_allocated = alloc;
+            return S_OK;
         }
 
         // SetSize: Changes the count, and grows the array if needed.
@@ -80,17 +108,51 @@ namespace MediaFoundationSamples
             HRESULT hr = S_OK;
             if (count > m_allocated)
             {
-                hr = Allocate(count);
+                // Grow by half again, so repeated growth copies each element
+                // only a few times.
+                DWORD alloc = m_allocated + m_allocated / 2;
+                hr = Allocate(count > alloc ? count : alloc);
             }
             if (SUCCEEDED(hr))
             {
+                if (count > m_count && !std::is_trivial<T>::value)
+                {
+                    for (DWORD i = m_count; i < count; i++)
+                    {
+                        new (&m_pArray[i]) T();
+                    }
+                }
+                else if (count < m_count)
+                {
+                    Destroy(count, m_count);
+                }
                 m_count = count;
             }
             return hr;
         }
-        
+
+        // Append: Adds an element at the end.
+        HRESULT Append(const T& item)
+        {
+            if (m_count == m_allocated)
+            {
+                DWORD alloc = m_allocated + m_allocated / 2;
+                HRESULT hr = Allocate(alloc > m_count ? alloc : m_count + 4);
+                if (FAILED(hr))
+                {
+                    return hr;
+                }
+            }
+            new (&m_pArray[m_count]) T(item);
+            m_count++;
+            return S_OK;
+        }
+
         DWORD GetCount() const { return m_count; }
 
+        // Number of elements that fit without reallocating.
+        DWORD GetAllocated() const { return m_allocated; }
+
         // Accessor.
         T& operator[](DWORD index)
         {
@@ -112,11 +174,79 @@ namespace MediaFoundationSamples
         GrowableArray& operator=(const GrowableArray& r);
         GrowableArray(const GrowableArray &r);
 
+        typedef typename std::aligned_storage<sizeof(T), std::alignment_of<T>::value>::type Storage;
+
+        T* InlineArray()
+        {
+            return reinterpret_cast<T*>(m_inline);
+        }
+
+        bool IsInline() const
+        {
+            return m_pArray == reinterpret_cast<const T*>(m_inline);
+        }
+
+        void FreeArray()
+        {
+            if (!IsInline())
+            {
+                ::operator delete(m_pArray);
+            }
+        }
+
+        void Destroy(DWORD first, DWORD last)
+        {
+            for (DWORD i = first; i < last; i++)
+            {
+                m_pArray[i].~T();
+            }
+        }
+
+        // Relocate: Moves count elements to uninitialized memory and ends
+        // the lifetime of the originals.
+        static void Relocate(T *pDest, T *pSrc, DWORD count)
+        {
+            if (std::is_trivially_copyable<T>::value)
+            {
+                if (count > 0)
+                {
+                    memcpy(pDest, pSrc, count * sizeof(T));
+                }
+            }
+            else
+            {
+                for (DWORD i = 0; i < count; i++)
+                {
+                    new (&pDest[i]) T(std::move(pSrc[i]));
+                    pSrc[i].~T();
+                }
+            }
+        }
+
+        // MoveFrom: Takes the elements of r, which is left empty. The heap
+        // array changes hands; inline elements are moved one by one.
+        void MoveFrom(GrowableArray& r)
+        {
+            if (r.IsInline())
+            {
+                Relocate(m_pArray, r.m_pArray, r.m_count);
+            }
+            else
+            {
+                m_pArray = r.m_pArray;
+                m_allocated = r.m_allocated;
+
+                r.m_pArray = r.InlineArray();
+                r.m_allocated = INLINE_COUNT;
+            }
+            m_count = r.m_count;
+            r.m_count = 0;
+        }
+
         T       *m_pArray;
         DWORD   m_count;        // Nominal count.
         DWORD   m_allocated;    // Actual allocation size.
+        Storage m_inline[INLINE_COUNT ? INLINE_COUNT : 1];
     };
 
 };  // namespace MediaFoundationSamples
-
-
@@ -0,0 +1,204 @@
+//-----------------------------------------------------------------------------
+// File: IndexedList.h
+// Desc: Sequence container with positional access.
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+//  Copyright (C) Microsoft Corporation. All rights reserved.
+//-----------------------------------------------------------------------------
+
+#pragma once
+#include "GrowArray.h"
+
+// Notes:
+//
+// The IndexedList class template has the same insert/remove/ItemAt calls as
+// List<>, but keeps the items in one contiguous array. ItemAt is O(1), and
+// InsertAt/RemoveAt move the items after the position, which for the short
+// lists it is meant for (tens of items) is much cheaper than walking nodes.
+// It uses copy semantics, like List<>.
+//
+// UpperBound does a binary search over a list kept in order, so sorted
+// insertion costs O(log n) compares.
+//
+// INLINE_COUNT: Items stored inside the object itself; see GrowableArray.
+
+namespace MediaFoundationSamples
+{
+
+    template <class T, DWORD INLINE_COUNT = 0>
+    class IndexedList
+    {
+    public:
+
+        IndexedList()
+        {
+        }
+        virtual ~IndexedList()
+        {
+        }
+
+        // ItemAt: Returns the item at pos. pos must be less than the count.
+        T ItemAt(DWORD pos) const
+        {
+            return m_items[pos];
+        }
+
+        HRESULT InsertAt(DWORD pos, T item)
+        {
+            DWORD count = m_items.GetCount();
+            if (pos > count)
+            {
+                return E_INVALIDARG;
+            }
+
+            HRESULT hr = m_items.SetSize(count + 1);
+            if (FAILED(hr))
+            {
+                return hr;
+            }
+
+            // Make room at the insertion point.
+            for (DWORD i = count; i > pos; i--)
+            {
+                m_items[i] = std::move(m_items[i - 1]);
+            }
+            m_items[pos] = item;
+
+            return S_OK;
+        }
+
+        // RemoveAt: Removes the item at pos. ppItem can be NULL.
+        HRESULT RemoveAt(DWORD pos, T *ppItem)
+        {
+            DWORD count = m_items.GetCount();
+            if (pos >= count)
+            {
+                return E_INVALIDARG;
+            }
+
+            if (ppItem)
+            {
+                *ppItem = m_items[pos];
+            }
+            for (DWORD i = pos + 1; i < count; i++)
+            {
+                m_items[i - 1] = std::move(m_items[i]);
+            }
+
+            return m_items.SetSize(count - 1);
+        }
+
+        HRESULT InsertBack(T item)
+        {
+            return m_items.Append(item);
+        }
+
+        HRESULT InsertFront(T item)
+        {
+            return InsertAt(0, item);
+        }
+
+        HRESULT RemoveBack(T *ppItem)
+        {
+            if (IsEmpty())
+            {
+                return E_UNEXPECTED;
+            }
+            return RemoveAt(GetCount() - 1, ppItem);
+        }
+
+        HRESULT RemoveFront(T *ppItem)
+        {
+            if (IsEmpty())
+            {
+                return E_UNEXPECTED;
+            }
+            return RemoveAt(0, ppItem);
+        }
+
+        HRESULT GetBack(T *ppItem)
+        {
+            if (IsEmpty())
+            {
+                return E_UNEXPECTED;
+            }
+            *ppItem = m_items[GetCount() - 1];
+            return S_OK;
+        }
+
+        HRESULT GetFront(T *ppItem)
+        {
+            if (IsEmpty())
+            {
+                return E_UNEXPECTED;
+            }
+            *ppItem = m_items[0];
+            return S_OK;
+        }
+
+        // UpperBound: Returns the position after the last item that does not
+        // come after item, given a list sorted by less(a, b). Inserting there
+        // keeps the list sorted, and equal items in insertion order.
+        template <class LESS>
+        DWORD UpperBound(const T& item, LESS less) const
+        {
+            DWORD lo = 0;
+            DWORD hi = m_items.GetCount();
+
+            while (lo < hi)
+            {
+                DWORD mid = lo + (hi - lo) / 2;
+                if (less(item, m_items[mid]))
+                {
+                    hi = mid;
+                }
+                else
+                {
+                    lo = mid + 1;
+                }
+            }
+            return lo;
+        }
+
+        // Reserve: Allocates room for count items, so inserts up to that
+        // count do not allocate.
+        HRESULT Reserve(DWORD count)
+        {
+            return m_items.Allocate(count);
+        }
+
+        DWORD GetCount() const { return m_items.GetCount(); }
+
+        bool IsEmpty() const
+        {
+            return (GetCount() == 0);
+        }
+
+        // Clear: Takes a functor object whose operator()
+        // frees the objects on the list.
+        template <class FN>
+        void Clear(FN& clear_fn)
+        {
+            for (DWORD i = 0; i < m_items.GetCount(); i++)
+            {
+                clear_fn(m_items[i]);
+            }
+            m_items.SetSize(0);
+        }
+
+        // Clear: Clears the list. (Does not delete or release the list items.)
+        void Clear()
+        {
+            m_items.SetSize(0);
+        }
+
+    protected:
+
+        GrowableArray<T, INLINE_COUNT>  m_items;
+    };
+
+};  // namespace MediaFoundationSamples
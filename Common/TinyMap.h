@@ -11,14 +11,17 @@
 //-----------------------------------------------------------------------------
 
 // NOTES:
-// The TinyMap class is designed to hold a small-ish number of elements where
-// look-up performance is not important. (It uses a sorted linked list.)
-// 
+// The TinyMap class is designed to hold a small-ish number of elements.
+// It keeps the pairs in one sorted array: look-ups are a binary search, and
+// enumeration walks contiguous memory. Insert and Remove move the pairs
+// after the position, which for small maps is cheaper than allocating a
+// list node.
+//
 // TinyMap uses "copy semantics" (keys and values are copied into the map).
 // Keys must support the comparison operators.
 
 #pragma once
-#include "linklist.h"
+#include "GrowArray.h"
 
 namespace MediaFoundationSamples
 {
@@ -38,17 +41,51 @@ namespace MediaFoundationSamples
     };
 
     template <class Key, class Value>
-    class TinyMap : List< Pair<Key, Value> >
+    class TinyMap
     {
     protected:
 
         typedef Pair<Key, Value> pair_type;
 
+        static const DWORD LINEAR_SEARCH_MAX = 16;  // Below this, a scan beats a binary search.
+
+        GrowableArray<pair_type>    m_pairs;
+
+        // LowerBound: Returns the index of the first pair whose key is not
+        // less than k, or the count if there is none.
+        DWORD LowerBound(const Key& k) const
+        {
+            DWORD lo = 0;
+            DWORD hi = m_pairs.GetCount();
+
+            if (hi <= LINEAR_SEARCH_MAX)
+            {
+                while (lo < hi && k > m_pairs[lo].key)
+                {
+                    lo++;
+                }
+                return lo;
+            }
+
+            while (lo < hi)
+            {
+                DWORD mid = lo + (hi - lo) / 2;
+                if (k > m_pairs[mid].key)
+                {
+                    lo = mid + 1;
+                }
+                else
+                {
+                    hi = mid;
+                }
+            }
+            return lo;
+        }
+
     public:
 
         TinyMap()
         {
-            Clear();
         }
         virtual ~TinyMap()
         {
@@ -57,182 +94,135 @@ namespace MediaFoundationSamples
         HRESULT Insert(Key k, Value v)
         {
             HRESULT hr = S_OK;
+            DWORD count = m_pairs.GetCount();
+            DWORD index = LowerBound(k);
 
-            Node *pNode = Front();
-            while (TRUE)
+            if (index < count && m_pairs[index].key == k)
             {
-                if (pNode == &m_anchor)
-                {
-                    // Reached the end of the list. Insert at end.
-                    hr = InsertBack(pair_type(k, v));
-                    break;
-                }
-                else if (pNode->item.key == k)
-                {
-                    // Found a duplicate item. Fail.
-                    hr = MF_E_INVALID_KEY; 
-                    break;
-                }
-                else if (pNode->item.key > k)
-                {
-                    // Found a larger key. Insert before this item.
-                    hr = InsertAfter(pair_type(k, v), pNode->prev);
-                    break;
-                }
-                pNode = pNode->next;
+                // Found a duplicate item. Fail.
+                return MF_E_INVALID_KEY;
             }
-            return hr;
+
+            hr = m_pairs.SetSize(count + 1);
+            if (FAILED(hr))
+            {
+                return hr;
+            }
+
+            // Make room at the insertion point.
+            for (DWORD i = count; i > index; i--)
+            {
+                m_pairs[i] = m_pairs[i - 1];
+            }
+            m_pairs[index] = pair_type(k, v);
+
+            return S_OK;
         }
 
 
         HRESULT Remove(Key k)
         {
-            HRESULT hr = E_FAIL;
+            DWORD count = m_pairs.GetCount();
+            DWORD index = LowerBound(k);
 
-            Node *pNode = Front();
-            Node *pToRemove = NULL;
-
-            // Delete the nodes
-            while (TRUE)
+            if (index == count)
             {
-                if (pNode == &m_anchor)
-                {
-                    // Reached the end of the list. 
-                    break;
-                }
-                else if (pNode->item.key == k)
-                {
-                    // Found the node to remove.
-                    pToRemove = pNode; 
-                    break;
-                }
-                else if (pNode->item.key > k)
-                {
-                    // Found a larger key. The item is not on the list.
-                    hr = MF_E_INVALID_KEY;
-                    break;
-                }
-                pNode = pNode->next;
+                // Reached the end of the map.
+                return E_FAIL;
+            }
+            if (!(m_pairs[index].key == k))
+            {
+                // Found a larger key. The item is not in the map.
+                return MF_E_INVALID_KEY;
             }
 
-            if (pToRemove)
+            for (DWORD i = index + 1; i < count; i++)
             {
-                hr = RemoveItem(pToRemove, NULL);
+                m_pairs[i - 1] = m_pairs[i];
             }
+            m_pairs[count - 1] = pair_type();
 
-            return hr;
+            return m_pairs.SetSize(count - 1);
         }
 
         // Find: Search the map for "k" and return the value in pv.
         // pv can be NULL if you don't want to get the value back.
         HRESULT Find(Key k, Value *pv)
         {
-            HRESULT hr = S_OK;
-            BOOL bFound = FALSE;
-
-            pair_type pair;
+            DWORD index = LowerBound(k);
 
-            POSITION pos = List<pair_type>::FrontPosition();
-
-            while (pos != List<pair_type>::EndPosition())
+            if (index < m_pairs.GetCount() && m_pairs[index].key == k)
             {
-                hr = GetItemPos(pos, &pair);
-
-                if (FAILED(hr))
-                {
-                    break;
-                }
-
-                if (pair.key == k)
+                // Found a match
+                if (pv)
                 {
-                    // Found a match
-                    if (pv)
-                    {
-                        *pv = pair.value; 
-                    }
-                    bFound = TRUE;
-                    break;
+                    *pv = m_pairs[index].value;
                 }
-
-                if (pair.key > k)
-                {
-                    // Reached a larger key. Item not found.
-                    break;
-                }
-
-                pos = List<pair_type>::Next(pos);
+                return S_OK;
             }
-            return (bFound ? S_OK : MF_E_INVALID_KEY);
+            return MF_E_INVALID_KEY;
         }
 
         void Clear()
         {
-            List<pair_type>::Clear();
+            for (DWORD i = 0; i < m_pairs.GetCount(); i++)
+            {
+                m_pairs[i] = pair_type();
+            }
+            m_pairs.SetSize(0);
         }
 
         // ClearValues
-        // Clear the list, using a defined function to free the values.
+        // Clear the map, using a defined function to free the values.
         //
-        // clear_fn: Functor object whose operator() frees the *values* on the list.
+        // clear_fn: Functor object whose operator() frees the *values* in the map.
         //
         // NOTE: This function assumes that the keys do not require special handling.
 
         template <class FN>
         void ClearValues(FN& clear_fn)
         {
-            Node *n = m_anchor.next;
-
-            // Delete the nodes
-            while (n != &m_anchor)
+            for (DWORD i = 0; i < m_pairs.GetCount(); i++)
             {
-                clear_fn(n->item.value);
-
-                Node *tmp = n->next;
-                delete n;
-                n = tmp;
+                clear_fn(m_pairs[i].value);
             }
-
-            // Reset the anchor to point at itself
-            m_anchor.next = &m_anchor;
-            m_anchor.prev = &m_anchor;
-
-            m_count = 0;
+            Clear();
         }
 
-        DWORD GetCount() const 
+        DWORD GetCount() const
         {
-            return List<pair_type>::GetCount();
+            return m_pairs.GetCount();
         }
 
-    
+
         ////////// Enumeration methods //////////
 
-        // Object for enumerating the list.
+        // Object for enumerating the map.
         class MAPPOS
         {
             friend class TinyMap;
 
-            typedef List<pair_type>::POSITION LISTPOS;
-
         public:
-            MAPPOS() 
+            MAPPOS() : index(END)
             {
             }
 
             bool operator==(const MAPPOS &p) const
             {
-                return pos == p.pos;
+                return index == p.index;
             }
 
             bool operator!=(const MAPPOS &p) const
             {
-                return pos != p.pos;
+                return index != p.index;
             }
 
         private:
-            LISTPOS pos;
+            static const DWORD END = (DWORD)-1;
+
+            DWORD index;
 
-            MAPPOS(LISTPOS p) : pos(p) 
+            MAPPOS(DWORD i) : index(i)
             {
             }
         };
@@ -240,53 +230,46 @@ namespace MediaFoundationSamples
 
         MAPPOS FrontPosition()
         {
-            return MAPPOS( List<pair_type>::FrontPosition() );
+            return (m_pairs.GetCount() > 0) ? MAPPOS(0) : MAPPOS();
         }
 
         MAPPOS EndPosition() const
         {
-            return MAPPOS( List<pair_type>::EndPosition() );
+            return MAPPOS();
         }
 
         HRESULT GetValue(MAPPOS vals, Value *ppItem)
-        {  
-            HRESULT hr = S_OK;
-
-            pair_type pair;
-
-            hr = List<pair_type>::GetItemPos(vals.pos, &pair);
-
-            if (SUCCEEDED(hr))
+        {
+            if (vals.index >= m_pairs.GetCount())
             {
-                *ppItem = pair.value;
+                return E_FAIL;
             }
 
-            return hr;
+            *ppItem = m_pairs[vals.index].value;
+            return S_OK;
         }
 
 
         HRESULT GetKey(MAPPOS vals, Key *ppItem)
-        {  
-            HRESULT hr = S_OK;
-
-            pair_type pair;
-
-            hr = List<pair_type>::GetItemPos(vals.pos, &pair);
-
-            if (SUCCEEDED(hr))
+        {
+            if (vals.index >= m_pairs.GetCount())
             {
-                *ppItem = pair.key;
+                return E_FAIL;
             }
 
-            return hr;
+            *ppItem = m_pairs[vals.index].key;
+            return S_OK;
         }
 
         MAPPOS Next(const MAPPOS vals)
         {
-            return MAPPOS( List<pair_type>::Next( vals.pos ) );
+            if (vals.index != MAPPOS::END && vals.index + 1 < m_pairs.GetCount())
+            {
+                return MAPPOS(vals.index + 1);
+            }
+            return MAPPOS();
         }
 
-
     };
 
 } // namespace MediaFoundationSamples
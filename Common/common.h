@@ -148,6 +148,7 @@ bool AreComObjectsEqual(T1 *p1, T2 *p2)
 #include "ClassFactory.h"
 #include "critsec.h"
 #include "GrowArray.h"
+#include "IndexedList.h"
 #include "linklist.h"
 #include "mediatype.h"
 #include "propvar.h"
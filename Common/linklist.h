@@ -33,6 +33,11 @@
 
 // The ComPtrList class template derives from List<> and implements a list of COM pointers.
 
+// Node cache: By default every insertion allocates a node and every removal
+// frees it. SetNodeCache(n) makes the list keep up to n removed nodes and 
+// reuse them, and ReserveNodes(n) fills the cache up front, so a list whose
+// size stays within the cache does no heap allocation.
+
 namespace MediaFoundationSamples
 {
 
@@ -88,33 +93,32 @@ namespace MediaFoundationSamples
                 return E_FAIL;
             }
 
-            Node *pNode = new Node(item);
-            if (pNode == NULL)
-            {
-                return E_OUTOFMEMORY;
-            }
-
 			if (pos == 0)
 			{
-				InsertFront(item);
-				return S_OK;
+				return InsertFront(item);
 			}
 
 			if (pos == m_count)
 			{
-				InsertBack(item);
-				return S_OK;
+				return InsertBack(item);
 			}
 
+            Node *pNode = NewNode(item);
+            if (pNode == NULL)
+            {
+                return E_OUTOFMEMORY;
+            }
+
             Node *pTemp = &m_anchor;
             
-			for (DWORD i = 0; i < pos; i++)
+			for (DWORD i = 0; i <= pos; i++)
 			{
 				pTemp = pTemp->next;
 			}
 
             pNode->prev = pTemp->prev;
 			pNode->next = pTemp;
+			pTemp->prev->next = pNode;
 			pTemp->prev = pNode;
 
             m_count++;
@@ -159,6 +163,55 @@ namespace MediaFoundationSamples
         Node    m_anchor;  // Anchor node for the linked list.
         DWORD   m_count;   // Number of items in the list.
 
+        Node    *m_pFreeNodes;      // Removed nodes kept for reuse, linked through next.
+        DWORD   m_cFreeNodes;
+        DWORD   m_cMaxFreeNodes;    // 0: nodes are freed on removal.
+
+        // NewNode: Takes a node from the cache, or allocates one.
+        Node* NewNode(T item)
+        {
+            Node *pNode = m_pFreeNodes;
+            if (pNode)
+            {
+                m_pFreeNodes = pNode->next;
+                m_cFreeNodes--;
+
+                pNode->prev = NULL;
+                pNode->next = NULL;
+                pNode->item = item;
+                return pNode;
+            }
+            return new Node(item);
+        }
+
+        // DeleteNode: Puts a node back in the cache, or frees it.
+        void DeleteNode(Node *pNode)
+        {
+            if (m_cFreeNodes < m_cMaxFreeNodes)
+            {
+                pNode->item = T();
+                pNode->prev = NULL;
+                pNode->next = m_pFreeNodes;
+                m_pFreeNodes = pNode;
+                m_cFreeNodes++;
+            }
+            else
+            {
+                delete pNode;
+            }
+        }
+
+        void FreeNodes(DWORD cKeep)
+        {
+            while (m_cFreeNodes > cKeep)
+            {
+                Node *pNode = m_pFreeNodes;
+                m_pFreeNodes = pNode->next;
+                m_cFreeNodes--;
+                delete pNode;
+            }
+        }
+
         Node* Front() const
         {
             return m_anchor.next;
@@ -176,7 +229,7 @@ namespace MediaFoundationSamples
                 return E_POINTER;
             }
 
-            Node *pNode = new Node(item);
+            Node *pNode = NewNode(item);
             if (pNode == NULL)
             {
                 return E_OUTOFMEMORY;
@@ -232,7 +285,7 @@ namespace MediaFoundationSamples
             pNode->prev->next = pNode->next;
 
             item = pNode->item;
-            delete pNode;
+            DeleteNode(pNode);
 
             m_count--;
 
@@ -252,11 +305,46 @@ namespace MediaFoundationSamples
             m_anchor.prev = &m_anchor;
 
             m_count = 0;
+
+            m_pFreeNodes = NULL;
+            m_cFreeNodes = 0;
+            m_cMaxFreeNodes = 0;
         }
 
         virtual ~List()
         {
             Clear();
+
+            m_cMaxFreeNodes = 0;
+            FreeNodes(0);
+        }
+
+        // SetNodeCache: Keeps up to cMaxNodes removed nodes for reuse.
+        void SetNodeCache(DWORD cMaxNodes)
+        {
+            m_cMaxFreeNodes = cMaxNodes;
+            FreeNodes(cMaxNodes);
+        }
+
+        // ReserveNodes: Fills the node cache so that the list can hold cNodes 
+        // items without allocating. Grows the cache limit if needed.
+        HRESULT ReserveNodes(DWORD cNodes)
+        {
+            if (m_cMaxFreeNodes < cNodes)
+            {
+                m_cMaxFreeNodes = cNodes;
+            }
+
+            while (m_count + m_cFreeNodes < cNodes)
+            {
+                Node *pNode = new Node();
+                if (pNode == NULL)
+                {
+                    return E_OUTOFMEMORY;
+                }
+                DeleteNode(pNode);
+            }
+            return S_OK;
         }
 
         // Insertion functions
@@ -347,7 +435,7 @@ namespace MediaFoundationSamples
                 clear_fn(n->item);
 
                 Node *tmp = n->next;
-                delete n;
+                DeleteNode(n);
                 n = tmp;
             }
 
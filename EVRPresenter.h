@@ -46,15 +46,6 @@ typedef ComPtrList<IMFSample>           VideoSampleList;
 
 // Custom Attributes
 
-// MFSamplePresenter_SampleCounter
-// Data type: UINT32
-//
-// Version number for the video samples. When the presenter increments the version
-// number, all samples with the previous version number are stale and should be
-// discarded.
-static const GUID MFSamplePresenter_SampleCounter = 
-{ 0xb0bb83cc, 0xf10f, 0x4e2e, { 0xaa, 0x2b, 0x29, 0xea, 0x5e, 0x92, 0xef, 0x85 } };
-
 // MFSamplePresenter_SampleSwapChain
 // Data type: IUNKNOWN
 // 
@@ -65,7 +56,21 @@ static const GUID MFSamplePresenter_SampleSwapChain =
 
 // Project headers.
 #include "Helpers.h"
+#include "SchedulerTimer.h"
+#include "FrameTimeline.h"
+#include "PresentPlanner.h"
+#include "ClockTracker.h"
+#include "RobustWindow.h"
+#include "FrameDropPolicy.h"
+#include "LatencyHistogram.h"
+#include "FrameRateDetector.h"
+#include "JitterBuffer.h"
+#include "ThinningPlanner.h"
+#include "SamplePoolSizer.h"
+#include "SubSurfacePool.h"
+#include "ThreadPolicy.h"
 #include "Scheduler.h"
+#include "SchedulerService.h"
 #include "PresentEngine.h"
 #include "Presenter.h"
 
@@ -0,0 +1,119 @@
+/*
+ *      Copyright (C) 2014 Andrew Van Til
+ *      http://babgvant.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "stdafx.h"
+#include "EVRPresenter.h"
+
+//-----------------------------------------------------------------------------
+// LateThresholdPolicy
+//-----------------------------------------------------------------------------
+
+BOOL LateThresholdPolicy::ShouldDrop(const FrameDropContext& context)
+{
+  if (fabsf(context.fRate) > 2)
+  {
+    // Thinned samples are queued well ahead of the clock; that is expected.
+    LONGLONG hnsDistance = context.bThinned ? -context.hnsDelta : _abs64(context.hnsDelta);
+    if (hnsDistance > context.hnsFrameInterval * context.iThreshold)
+    {
+      return TRUE;
+    }
+  }
+
+  if (!context.bDue)
+  {
+    return FALSE;
+  }
+
+  if (context.bSuperseded)
+  {
+    return TRUE;
+  }
+
+  if (!context.bHaveStats || context.cQueued == 0)
+  {
+    return FALSE;
+  }
+
+  // Is this sample late compared to the ones before it?
+  LONGLONG hnsLimit = context.lateness.llMedian + context.lateness.llMad * LATE_OUTLIER_MADS;
+  LONGLONG hnsHighLimit = context.lateness.llP90 + context.hnsFrameInterval / 4;
+  if (hnsLimit < hnsHighLimit)
+  {
+    hnsLimit = hnsHighLimit;
+  }
+
+  return -context.hnsDelta > hnsLimit;
+}
+
+
+//-----------------------------------------------------------------------------
+// QueueDepthPolicy
+//-----------------------------------------------------------------------------
+
+BOOL QueueDepthPolicy::ShouldDrop(const FrameDropContext& context)
+{
+  if (!context.bDue || context.cQueued == 0)
+  {
+    return FALSE;
+  }
+
+  return context.bSuperseded || context.hnsDelta < -(context.hnsFrameInterval / 2);
+}
+
+
+//-----------------------------------------------------------------------------
+// CatchUpPolicy
+//-----------------------------------------------------------------------------
+
+BOOL CatchUpPolicy::ShouldDrop(const FrameDropContext& context)
+{
+  if (!context.bDue)
+  {
+    return FALSE;
+  }
+
+  if (context.bSuperseded)
+  {
+    return TRUE;
+  }
+
+  if (!m_bCatchingUp && context.hnsDelta < -context.hnsFrameInterval)
+  {
+    m_bCatchingUp = TRUE;
+    m_cBurst = 0;
+  }
+
+  if (m_bCatchingUp)
+  {
+    if (context.hnsDelta >= -(context.hnsFrameInterval / 4))
+    {
+      // Back on time.
+      m_bCatchingUp = FALSE;
+    }
+    else if (m_cBurst < context.iThreshold)
+    {
+      m_cBurst++;
+      return TRUE;
+    }
+  }
+
+  m_cBurst = 0;
+  return FALSE;
+}
@@ -0,0 +1,139 @@
+/*
+ *      Copyright (C) 2014 Andrew Van Til
+ *      http://babgvant.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// FrameDropContext
+//
+// What the scheduler knows about a sample when it asks a FrameDropPolicy 
+// whether to drop it.
+//-----------------------------------------------------------------------------
+
+struct FrameDropContext
+{
+  LONGLONG  hnsDelta;           // Time until the presentation time; negative if late.
+  LONGLONG  hnsFrameInterval;   // Duration of each frame.
+  float     fRate;              // Playback rate.
+  DWORD     cQueued;            // Samples waiting behind this one.
+  BOOL      bSuperseded;        // The next sample is already due as well.
+  int       iThreshold;         // EVRCP_SETTING_FRAME_DROP_THRESHOLD, in frames.
+  BOOL      bDue;               // The sample would be presented now if not dropped.
+  BOOL      bThinned;           // Already picked by the trick-play ThinningPlanner.
+
+  // Recent due samples (not counting this one). Valid if bHaveStats.
+  BOOL        bHaveStats;
+  RobustStats lateness;         // hns after the presentation time; negative if early.
+  RobustStats queued;           // cQueued.
+};
+
+
+//-----------------------------------------------------------------------------
+// FrameDropPolicy class
+//
+// Decides which samples the scheduler discards instead of presenting. The
+// scheduler asks once per sample when it is due (bDue), and may also ask 
+// while the sample is still early.
+//
+// Policies are called on the scheduler thread. Reset is called after flushes
+// and rate changes.
+//-----------------------------------------------------------------------------
+
+class FrameDropPolicy
+{
+public:
+  virtual ~FrameDropPolicy() { }
+
+  virtual void Reset() { }
+  virtual BOOL ShouldDrop(const FrameDropContext& context) = 0;
+};
+
+
+//-----------------------------------------------------------------------------
+// LateThresholdPolicy
+//
+// The original behavior. At fast rates (above 2x), drops samples that are
+// more than iThreshold frames away from the clock (only late ones if the 
+// ThinningPlanner already picked the samples). Otherwise drops a due 
+// sample when it is superseded by the next sample, or when it is late 
+// compared to the recent ones: more than LATE_OUTLIER_MADS median absolute
+// deviations beyond the median lateness, and more than a quarter frame 
+// beyond the 90th percentile. A sample with nothing queued behind it is 
+// never dropped as an outlier.
+//-----------------------------------------------------------------------------
+
+const LONGLONG LATE_OUTLIER_MADS = 5;     // About three standard deviations.
+
+class LateThresholdPolicy : public FrameDropPolicy
+{
+public:
+  BOOL ShouldDrop(const FrameDropContext& context);
+};
+
+
+//-----------------------------------------------------------------------------
+// QueueDepthPolicy
+//
+// Drops a due sample that is superseded or more than half a frame late, but
+// only if another sample is already queued behind it. The newest sample is
+// always shown.
+//-----------------------------------------------------------------------------
+
+class QueueDepthPolicy : public FrameDropPolicy
+{
+public:
+  BOOL ShouldDrop(const FrameDropContext& context);
+};
+
+
+//-----------------------------------------------------------------------------
+// CatchUpPolicy
+//
+// Drops superseded samples. Once a due sample is more than a frame late, 
+// drops late samples in a burst
+// until the stream is back on time, so that playback catches up at once
+// instead of running late. Presents one sample after every iThreshold drops,
+// so the picture keeps moving while the burst lasts.
+//-----------------------------------------------------------------------------
+
+class CatchUpPolicy : public FrameDropPolicy
+{
+public:
+  CatchUpPolicy() : m_bCatchingUp(FALSE), m_cBurst(0) { }
+
+  void Reset() { m_bCatchingUp = FALSE; m_cBurst = 0; }
+  BOOL ShouldDrop(const FrameDropContext& context);
+
+private:
+  BOOL  m_bCatchingUp;
+  int   m_cBurst;         // Samples dropped since the last presented one.
+};
+
+
+//-----------------------------------------------------------------------------
+// NeverDropPolicy
+//
+// Presents every sample, however late. For capture.
+//-----------------------------------------------------------------------------
+
+class NeverDropPolicy : public FrameDropPolicy
+{
+public:
+  BOOL ShouldDrop(const FrameDropContext& context) { return FALSE; }
+};
@@ -0,0 +1,197 @@
+/*
+ *      Copyright (C) 2014 Andrew Van Til
+ *      http://babgvant.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "stdafx.h"
+#include "EVRPresenter.h"
+
+// A gap longer than this is a discontinuity, not a frame interval.
+const LONGLONG FRAME_RATE_MAX_INTERVAL = 2000000;   // 200 ms
+
+// Time stamps can be rounded this much (1 ms, as in Matroska).
+const LONGLONG FRAME_RATE_TIMESTAMP_PRECISION = 10000;
+
+// Time the window must span before the first estimate. With time stamps 
+// rounded to 1 ms, the average is then within 250 ppm.
+const LONGLONG FRAME_RATE_MIN_SPAN = 40000000;     // 4 seconds
+
+// Snap to a standard rate within this relative error (parts per million). 
+// 23.976 and 24 fps are 1000 ppm apart.
+const LONGLONG FRAME_RATE_SNAP_PPM = 400;
+
+// Standard frame rates, as frame intervals.
+static const MFRatio g_StandardFrameRates[] =
+{
+  { 24000, 1001 }, { 24, 1 }, { 25, 1 }, { 30000, 1001 }, { 30, 1 }, 
+  { 48, 1 }, { 50, 1 }, { 60000, 1001 }, { 60, 1 }, { 120000, 1001 }, { 120, 1 }
+};
+
+
+FrameRateDetector::FrameRateDetector()
+{
+  Reset();
+}
+
+void FrameRateDetector::Reset()
+{
+  ZeroMemory(m_hnsIntervals, sizeof(m_hnsIntervals));
+  m_cIntervals = 0;
+  m_hnsLastTime = 0;
+  m_bHaveLastTime = FALSE;
+  m_hnsInterval = 0;
+  m_cadence = EVRCP_CADENCE_UNKNOWN;
+}
+
+//-----------------------------------------------------------------------------
+// Discontinuity
+//
+// Called after a seek. Keeps the current estimate, but does not measure an
+// interval across the seek.
+//-----------------------------------------------------------------------------
+
+void FrameRateDetector::Discontinuity()
+{
+  m_cIntervals = 0;
+  m_bHaveLastTime = FALSE;
+}
+
+//-----------------------------------------------------------------------------
+// AddSample
+//
+// Adds the time stamp of the next sample, in presentation order.
+//-----------------------------------------------------------------------------
+
+void FrameRateDetector::AddSample(LONGLONG hnsTime)
+{
+  if (m_bHaveLastTime)
+  {
+    LONGLONG hnsInterval = hnsTime - m_hnsLastTime;
+
+    if (hnsInterval <= 0 || hnsInterval > FRAME_RATE_MAX_INTERVAL)
+    {
+      // Discontinuity. Start over, but keep reporting the last estimate.
+      m_cIntervals = 0;
+    }
+    else
+    {
+      m_hnsIntervals[m_cIntervals++ & (FRAME_RATE_WINDOW - 1)] = hnsInterval;
+      Update();
+    }
+  }
+
+  m_hnsLastTime = hnsTime;
+  m_bHaveLastTime = TRUE;
+}
+
+//-----------------------------------------------------------------------------
+// Update
+//
+// Recomputes the estimate from the window.
+//-----------------------------------------------------------------------------
+
+void FrameRateDetector::Update()
+{
+  DWORD cWindow = (m_cIntervals < FRAME_RATE_WINDOW) ? m_cIntervals : FRAME_RATE_WINDOW;
+
+  LONGLONG hnsSum = 0;
+  LONGLONG hnsMin = MAXLONGLONG;
+  LONGLONG hnsMax = 0;
+
+  for (DWORD i = 0; i < cWindow; i++)
+  {
+    LONGLONG hnsInterval = m_hnsIntervals[i];
+    hnsSum += hnsInterval;
+    if (hnsInterval < hnsMin)
+    {
+      hnsMin = hnsInterval;
+    }
+    if (hnsInterval > hnsMax)
+    {
+      hnsMax = hnsInterval;
+    }
+  }
+
+  if (hnsSum < FRAME_RATE_MIN_SPAN)
+  {
+    return;
+  }
+
+  LONGLONG hnsMean = hnsSum / cWindow;
+
+  // Intervals within this much of each other are the same interval.
+  LONGLONG hnsTolerance = hnsMean / 50;
+  if (hnsTolerance < FRAME_RATE_TIMESTAMP_PRECISION)
+  {
+    hnsTolerance = FRAME_RATE_TIMESTAMP_PRECISION;
+  }
+
+  if (hnsMax - hnsMin <= 2 * hnsTolerance)
+  {
+    m_cadence = EVRCP_CADENCE_CONSTANT;
+  }
+  else
+  {
+    // Telecine: every interval is 3/2.5 or 2/2.5 of the mean, alternating
+    // in a 3:2 (or 2:3) pattern. Anything else is variable.
+    LONGLONG hnsLong = hnsMean * 6 / 5;
+    LONGLONG hnsShort = hnsMean * 4 / 5;
+    BOOL bTelecine = TRUE;
+    BOOL bLastLong = FALSE;
+
+    // Walk the window oldest first, so the pattern can be checked.
+    DWORD iOldest = (m_cIntervals > FRAME_RATE_WINDOW) ? (m_cIntervals & (FRAME_RATE_WINDOW - 1)) : 0;
+
+    for (DWORD i = 0; i < cWindow && bTelecine; i++)
+    {
+      LONGLONG hnsInterval = m_hnsIntervals[(iOldest + i) & (FRAME_RATE_WINDOW - 1)];
+      BOOL bLong = (_abs64(hnsInterval - hnsLong) <= hnsTolerance);
+      BOOL bShort = (_abs64(hnsInterval - hnsShort) <= hnsTolerance);
+
+      // Each long interval must be followed by a short one and vice versa 
+      // (a period of 5 fields). Jittery time stamps that merely mix the 
+      // two lengths are variable.
+      bTelecine = (bLong || bShort) && (i == 0 || bLong != bLastLong);
+      bLastLong = bLong;
+    }
+
+    m_cadence = bTelecine ? EVRCP_CADENCE_TELECINE : EVRCP_CADENCE_VARIABLE;
+
+    // An odd number of telecine intervals has one long or short interval 
+    // too many, which biases the mean by more than the snap tolerance. 
+    // Leave out the oldest.
+    if (bTelecine && (cWindow & 1))
+    {
+      hnsMean = (hnsSum - m_hnsIntervals[iOldest]) / (cWindow - 1);
+    }
+  }
+
+  // Snap to a standard rate. For telecine, the mean is the film rate.
+  m_hnsInterval = hnsMean;
+
+  for (DWORD i = 0; i < ARRAY_SIZE(g_StandardFrameRates); i++)
+  {
+    const MFRatio& fps = g_StandardFrameRates[i];
+    LONGLONG hnsStandard = (LONGLONG)((10000000.0 * fps.Denominator) / fps.Numerator + 0.5);
+
+    if (_abs64(hnsMean - hnsStandard) * 1000000 <= hnsStandard * FRAME_RATE_SNAP_PPM)
+    {
+      m_hnsInterval = hnsStandard;
+      break;
+    }
+  }
+}
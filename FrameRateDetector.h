@@ -0,0 +1,65 @@
+/*
+ *      Copyright (C) 2014 Andrew Van Til
+ *      http://babgvant.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+#include "IEVRCPSettings.h"
+
+const DWORD FRAME_RATE_WINDOW = 256;    // Intervals looked at. Power of two.
+
+//-----------------------------------------------------------------------------
+// FrameRateDetector class
+//
+// Estimates the frame rate of a stream from its sample time stamps, in case
+// the media type's frame rate is missing or wrong.
+//
+// The rate is the average interval over the last FRAME_RATE_WINDOW frames, 
+// snapped to a standard rate when it is close to one. Averaging over several
+// seconds tells 23.976 from 24 fps even with time stamps rounded to 1 ms.
+// The spread of the intervals classifies the cadence as constant, telecine
+// (long and short intervals strictly alternating, as in 3:2 pulldown), or 
+// variable.
+//
+// Not thread-safe.
+//-----------------------------------------------------------------------------
+
+class FrameRateDetector
+{
+public:
+  FrameRateDetector();
+
+  void Reset();
+  void Discontinuity();
+  void AddSample(LONGLONG hnsTime);
+
+  // Returns 0 until enough samples have been seen.
+  LONGLONG FrameInterval() const { return m_hnsInterval; }
+  EVRCPCadence Cadence() const { return m_cadence; }
+
+private:
+  void Update();
+
+  LONGLONG      m_hnsIntervals[FRAME_RATE_WINDOW];
+  DWORD         m_cIntervals;       // Total seen; the window holds the last FRAME_RATE_WINDOW.
+  LONGLONG      m_hnsLastTime;
+  BOOL          m_bHaveLastTime;
+
+  LONGLONG      m_hnsInterval;
+  EVRCPCadence  m_cadence;
+};
@@ -0,0 +1,200 @@
+/*
+ *      Copyright (C) 2014 Andrew Van Til
+ *      http://babgvant.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "stdafx.h"
+#include "EVRPresenter.h"
+
+// Event names, by FrameStage.
+static const char *g_FrameStageNames[FRAME_STAGE_COUNT] =
+{
+  "Mixer ProcessOutput",
+  "ScheduleSample",
+  "Dequeue",
+  "PrepareSample",
+  "PresentSample",
+  "VideoProcessBlt",
+  "PresentEx",
+  "Drop",
+  "OnSampleFree"
+};
+
+FrameTimeline::FrameTimeline() :
+  m_pEvents(NULL),
+  m_iNext(0),
+  m_bEnabled(FALSE),
+  m_pTimer(&m_DefaultTimer)
+{
+}
+
+FrameTimeline::~FrameTimeline()
+{
+  SAFE_ARRAY_DELETE(m_pEvents);
+}
+
+//-----------------------------------------------------------------------------
+// Enable
+//
+// Turns recording on or off. The ring is allocated the first time the 
+// timeline is turned on, and kept until the object is destroyed, because 
+// other threads may still be recording into it.
+//-----------------------------------------------------------------------------
+
+HRESULT FrameTimeline::Enable(BOOL bEnable)
+{
+  AutoLock lock(m_lock);
+
+  if (bEnable && m_pEvents == NULL)
+  {
+    m_pEvents = new Event[FRAME_TIMELINE_EVENTS];
+    if (m_pEvents == NULL)
+    {
+      return E_OUTOFMEMORY;
+    }
+    for (DWORD i = 0; i < FRAME_TIMELINE_EVENTS; i++)
+    {
+      m_pEvents[i].dwSequence.store(0, std::memory_order_relaxed);
+    }
+  }
+
+  m_bEnabled.store(bEnable, std::memory_order_release);
+  return S_OK;
+}
+
+//-----------------------------------------------------------------------------
+// Clear
+//
+// Forgets the recorded events.
+//-----------------------------------------------------------------------------
+
+void FrameTimeline::Clear()
+{
+  AutoLock lock(m_lock);
+
+  if (m_pEvents)
+  {
+    for (DWORD i = 0; i < FRAME_TIMELINE_EVENTS; i++)
+    {
+      m_pEvents[i].dwSequence.store(0, std::memory_order_relaxed);
+    }
+  }
+  m_iNext = 0;
+}
+
+LONGLONG FrameTimeline::SampleTime(IMFSample *pSample)
+{
+  LONGLONG hnsSampleTime = -1;
+
+  if (pSample == NULL || FAILED(pSample->GetSampleTime(&hnsSampleTime)))
+  {
+    return -1;
+  }
+  return hnsSampleTime;
+}
+
+//-----------------------------------------------------------------------------
+// Record
+//
+// Writes one event. The slot's sequence number is cleared while the event 
+// is written, so a reader never takes a half-written event.
+//-----------------------------------------------------------------------------
+
+void FrameTimeline::Record(FrameStage stage, LONGLONG hnsSampleTime, LONGLONG hnsStart, LONGLONG hnsEnd)
+{
+  DWORD index = m_iNext.fetch_add(1, std::memory_order_relaxed);
+  Event& e = m_pEvents[index & (FRAME_TIMELINE_EVENTS - 1)];
+
+  e.dwSequence.store(0, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  e.dwThreadId = GetCurrentThreadId();
+  e.stage = stage;
+  e.hnsSampleTime = hnsSampleTime;
+  e.hnsStart = hnsStart;
+  e.hnsEnd = hnsEnd;
+
+  e.dwSequence.store(index + 1, std::memory_order_release);
+}
+
+//-----------------------------------------------------------------------------
+// WriteChromeTrace
+//
+// Writes the recorded events, oldest first, as a Chrome trace-event JSON 
+// object. Spans are complete ("X") events and instants are "i" events; 
+// times are in microseconds.
+//-----------------------------------------------------------------------------
+
+HRESULT FrameTimeline::WriteChromeTrace(FILE *pFile)
+{
+  CheckPointer(pFile, E_POINTER);
+
+  AutoLock lock(m_lock);
+
+  DWORD iEnd = m_iNext.load(std::memory_order_acquire);
+  DWORD iBegin = (iEnd > FRAME_TIMELINE_EVENTS) ? iEnd - FRAME_TIMELINE_EVENTS : 0;
+  BOOL bFirst = TRUE;
+
+  fprintf(pFile, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+  for (DWORD index = iBegin; m_pEvents && index != iEnd; index++)
+  {
+    const Event& e = m_pEvents[index & (FRAME_TIMELINE_EVENTS - 1)];
+
+    // Copy the event, then make sure it was not rewritten meanwhile.
+    if (e.dwSequence.load(std::memory_order_acquire) != index + 1)
+    {
+      continue;
+    }
+    DWORD dwThreadId = e.dwThreadId;
+    FrameStage stage = e.stage;
+    LONGLONG hnsSampleTime = e.hnsSampleTime;
+    LONGLONG hnsStart = e.hnsStart;
+    LONGLONG hnsEnd = e.hnsEnd;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (e.dwSequence.load(std::memory_order_relaxed) != index + 1 || stage >= FRAME_STAGE_COUNT)
+    {
+      continue;
+    }
+
+    fprintf(pFile, "%s{\"name\":\"%s\",\"cat\":\"frame\",\"pid\":1,\"tid\":%lu,\"ts\":%.1f,",
+      bFirst ? "" : ",\n", g_FrameStageNames[stage], (unsigned long)dwThreadId, hnsStart / 10.0);
+
+    if (hnsEnd > hnsStart)
+    {
+      fprintf(pFile, "\"ph\":\"X\",\"dur\":%.1f,", (hnsEnd - hnsStart) / 10.0);
+    }
+    else
+    {
+      fprintf(pFile, "\"ph\":\"i\",\"s\":\"t\",");
+    }
+
+    if (hnsSampleTime >= 0)
+    {
+      fprintf(pFile, "\"args\":{\"frame_ms\":%.3f}}", hnsSampleTime / 10000.0);
+    }
+    else
+    {
+      fprintf(pFile, "\"args\":{}}");
+    }
+    bFirst = FALSE;
+  }
+
+  fprintf(pFile, "\n]}\n");
+
+  return ferror(pFile) ? E_FAIL : S_OK;
+}
@@ -0,0 +1,137 @@
+/*
+ *      Copyright (C) 2014 Andrew Van Til
+ *      http://babgvant.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+const DWORD FRAME_TIMELINE_EVENTS = 16384;  // Events kept. Power of two.
+
+//-----------------------------------------------------------------------------
+// FrameStage
+//
+// Stages of a frame's trip through the presenter, as recorded by 
+// FrameTimeline.
+//-----------------------------------------------------------------------------
+
+enum FrameStage
+{
+  FRAME_STAGE_MIXER = 0,      // Mixer ProcessOutput (span).
+  FRAME_STAGE_SCHEDULE,       // Scheduler::ScheduleSample.
+  FRAME_STAGE_DEQUEUE,        // The scheduler thread picks the sample up.
+  FRAME_STAGE_PREPARE,        // Present-ahead render stage (span).
+  FRAME_STAGE_PRESENT,        // SchedulerCallback::PresentSample (span).
+  FRAME_STAGE_BLT,            // VideoProcessBlt (span).
+  FRAME_STAGE_FLIP,           // PresentEx (span).
+  FRAME_STAGE_DROP,           // Dropped by the frame-drop policy.
+  FRAME_STAGE_SAMPLE_FREE,    // OnSampleFree.
+  FRAME_STAGE_COUNT
+};
+
+
+//-----------------------------------------------------------------------------
+// FrameTimeline class
+//
+// Opt-in recorder of per-frame stage times, for finding stalls. Events go 
+// into a ring of FRAME_TIMELINE_EVENTS slots that is allocated when the 
+// timeline is first enabled; after that, recording only claims a slot with
+// an atomic increment and never allocates or locks, from any thread. The 
+// oldest events are overwritten.
+//
+// WriteChromeTrace writes the ring as Chrome trace-event JSON, which can be
+// loaded into chrome://tracing or Perfetto. Events that are overwritten 
+// while it runs are skipped.
+//
+// Frames are identified by their sample time; -1 means no sample.
+//-----------------------------------------------------------------------------
+
+class FrameTimeline
+{
+public:
+  FrameTimeline();
+  ~FrameTimeline();
+
+  HRESULT Enable(BOOL bEnable);
+  BOOL    IsEnabled() const { return m_bEnabled.load(std::memory_order_acquire); }
+
+  // Timer for the time stamps; not owned. NULL restores the default.
+  void    SetTimer(SchedulerTimer *pTimer) { m_pTimer = pTimer ? pTimer : &m_DefaultTimer; }
+
+  // Start time of a span, or 0 if the timeline is off.
+  LONGLONG Start() { return IsEnabled() ? m_pTimer->Now() : 0; }
+
+  // Records a span that began at hnsStart (from Start) and ends now.
+  void    End(FrameStage stage, LONGLONG hnsSampleTime, LONGLONG hnsStart)
+  {
+    if (hnsStart != 0 && IsEnabled())
+    {
+      Record(stage, hnsSampleTime, hnsStart, m_pTimer->Now());
+    }
+  }
+
+  void    End(FrameStage stage, IMFSample *pSample, LONGLONG hnsStart)
+  {
+    if (hnsStart != 0 && IsEnabled())
+    {
+      Record(stage, SampleTime(pSample), hnsStart, m_pTimer->Now());
+    }
+  }
+
+  // Records an instant.
+  void    Mark(FrameStage stage, LONGLONG hnsSampleTime)
+  {
+    if (IsEnabled())
+    {
+      LONGLONG hnsNow = m_pTimer->Now();
+      Record(stage, hnsSampleTime, hnsNow, hnsNow);
+    }
+  }
+
+  void    Mark(FrameStage stage, IMFSample *pSample)
+  {
+    if (IsEnabled())
+    {
+      Mark(stage, SampleTime(pSample));
+    }
+  }
+
+  // Time stamp of the sample, or -1.
+  static LONGLONG SampleTime(IMFSample *pSample);
+
+  HRESULT WriteChromeTrace(FILE *pFile);
+  void    Clear();
+
+private:
+  struct Event
+  {
+    std::atomic<DWORD>  dwSequence;   // Index of the event + 1, or 0 while it is written.
+    DWORD               dwThreadId;
+    FrameStage          stage;
+    LONGLONG            hnsSampleTime;
+    LONGLONG            hnsStart;
+    LONGLONG            hnsEnd;
+  };
+
+  void    Record(FrameStage stage, LONGLONG hnsSampleTime, LONGLONG hnsStart, LONGLONG hnsEnd);
+
+  Event               *m_pEvents;       // Allocated by the first Enable; never freed before the destructor.
+  std::atomic<DWORD>  m_iNext;          // Index of the next event.
+  std::atomic<BOOL>   m_bEnabled;
+  SchedulerTimer      *m_pTimer;
+  PrecisionTimer      m_DefaultTimer;
+  CritSec             m_lock;           // Serializes Enable, Clear and WriteChromeTrace.
+};
@@ -41,13 +41,20 @@
  // SamplePool class
  //-----------------------------------------------------------------------------
 
-SamplePool::SamplePool() : m_bInitialized(FALSE), m_cPending(0)
+SamplePool::SamplePool() : m_head(0), m_dwGeneration(0), m_bInitialized(FALSE), m_cPending(0), m_cBusy(0)
 {
-
+  for (DWORD i = 0; i < SAMPLE_POOL_SIZE; i++)
+  {
+    m_slots[i].pSample = NULL;
+    m_slots[i].dwGeneration = 0;
+    m_slots[i].state = SLOT_EMPTY;
+    m_slots[i].iNext = 0;
+  }
 }
 
 SamplePool::~SamplePool()
 {
+  Clear();
 }
 
 
@@ -60,65 +67,163 @@ SamplePool::~SamplePool()
 
 HRESULT SamplePool::GetSample(IMFSample **ppSample)
 {
-  AutoLock lock(m_lock);
+  CheckPointer(ppSample, E_POINTER);
+
+  HRESULT hr = S_OK;
+  DWORD iSlot = 0;
 
-  if (!m_bInitialized)
+  if (!BeginOperation())
   {
-    return MF_E_NOT_INITIALIZED;
+    hr = MF_E_NOT_INITIALIZED;
   }
-
-  if (m_VideoSampleQueue.IsEmpty())
+  else if (!Pop(&iSlot))
   {
-    return MF_E_SAMPLEALLOCATOR_EMPTY;
+    hr = MF_E_SAMPLEALLOCATOR_EMPTY;
   }
+  else
+  {
+    m_slots[iSlot].state.store(SLOT_PENDING, std::memory_order_relaxed);
+    m_cPending.fetch_add(1);
 
-  HRESULT hr = S_OK;
-  IMFSample *pSample = NULL;
+    // The pool's reference goes to the caller.
+    *ppSample = m_slots[iSlot].pSample.load(std::memory_order_relaxed);
+  }
 
-  // Get a sample from the allocated queue.
+  EndOperation();
+  return hr;
+}
 
-  // It doesn't matter if we pull them from the head or tail of the list,
-  // but when we get it back, we want to re-insert it onto the opposite end.
-  // (see ReturnSample)
+//-----------------------------------------------------------------------------
+// ReturnSample
+//
+// Returns a sample to the pool. A sample from before the last Clear is 
+// stale; the method returns S_FALSE and leaves it alone. So does a sample
+// returned while the pool is cleared, since it is about to be stale.
+//-----------------------------------------------------------------------------
 
-  CHECK_HR(hr = m_VideoSampleQueue.RemoveFront(&pSample));
+HRESULT SamplePool::ReturnSample(IMFSample *pSample)
+{
+  CheckPointer(pSample, E_POINTER);
 
-  m_cPending++;
+  HRESULT hr = S_OK;
+  LONG iSlot = -1;
+  LONG state = SLOT_PENDING;
 
-  // Give the sample to the caller.
-  *ppSample = pSample;
-  (*ppSample)->AddRef();
+  if (!BeginOperation())
+  {
+    // The pool was cleared, so every sample is stale.
+    hr = S_FALSE;
+  }
+  else if ((iSlot = FindSlot(pSample)) < 0)
+  {
+    hr = S_FALSE;
+  }
+  else if (!m_slots[iSlot].state.compare_exchange_strong(state, SLOT_FREE))
+  {
+    // Only a sample that is handed out can come back.
+    hr = MF_E_INVALIDREQUEST;
+  }
+  else
+  {
+    pSample->AddRef();
+    m_cPending.fetch_sub(1);
 
-done:
-  SAFE_RELEASE(pSample);
+    Push(iSlot);
+  }
+
+  EndOperation();
   return hr;
 }
 
 //-----------------------------------------------------------------------------
-// ReturnSample
+// AddSample
 //
-// Returns a sample to the pool.
+// Adds a newly allocated sample to the pool. The caller is already using
+// the sample, so it counts as pending until it is returned.
 //-----------------------------------------------------------------------------
 
-HRESULT SamplePool::ReturnSample(IMFSample *pSample)
+HRESULT SamplePool::AddSample(IMFSample *pSample)
 {
-  AutoLock lock(m_lock);
+  CheckPointer(pSample, E_POINTER);
+
+  HRESULT hr = E_OUTOFMEMORY;
 
-  if (!m_bInitialized)
+  if (!BeginOperation())
   {
-    return MF_E_NOT_INITIALIZED;
+    hr = MF_E_NOT_INITIALIZED;
+  }
+  else
+  {
+    for (DWORD i = 0; i < SAMPLE_POOL_SIZE; i++)
+    {
+      LONG state = SLOT_EMPTY;
+      if (m_slots[i].pSample.load(std::memory_order_relaxed) == NULL &&
+          m_slots[i].state.compare_exchange_strong(state, SLOT_PENDING))
+      {
+        m_slots[i].dwGeneration.store(m_dwGeneration.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        m_slots[i].pSample.store(pSample, std::memory_order_release);
+        m_cPending.fetch_add(1);
+        hr = S_OK;
+        break;
+      }
+    }
   }
 
-  HRESULT hr = S_OK;
+  EndOperation();
+  return hr;
+}
 
-  CHECK_HR(hr = m_VideoSampleQueue.InsertBack(pSample));
+//-----------------------------------------------------------------------------
+// DiscardSample
+//
+// Takes back a pending sample without putting it on the available queue.
+// Used when the pool shrinks. Returns S_FALSE for a stale sample.
+//-----------------------------------------------------------------------------
 
-  m_cPending--;
+HRESULT SamplePool::DiscardSample(IMFSample *pSample)
+{
+  CheckPointer(pSample, E_POINTER);
 
-done:
+  HRESULT hr = S_OK;
+  LONG iSlot = -1;
+
+  if (!BeginOperation())
+  {
+    // The pool was cleared, so every sample is stale.
+    hr = S_FALSE;
+  }
+  else if ((iSlot = FindSlot(pSample)) < 0)
+  {
+    hr = S_FALSE;
+  }
+  else if (m_slots[iSlot].state.load() != SLOT_PENDING)
+  {
+    hr = MF_E_INVALIDREQUEST;
+  }
+  else
+  {
+    // Clear the pointer before the slot can be taken by AddSample.
+    m_slots[iSlot].pSample.store(NULL, std::memory_order_relaxed);
+    m_slots[iSlot].state.store(SLOT_EMPTY, std::memory_order_release);
+    m_cPending.fetch_sub(1);
+  }
+
+  EndOperation();
   return hr;
 }
 
+//-----------------------------------------------------------------------------
+// IsCurrent
+//
+// Returns TRUE if the sample belongs to the current generation of the pool.
+// Takes no lock and reads no sample attributes.
+//-----------------------------------------------------------------------------
+
+BOOL SamplePool::IsCurrent(IMFSample *pSample)
+{
+  return (pSample != NULL && FindSlot(pSample) >= 0);
+}
+
 //-----------------------------------------------------------------------------
 // AreSamplesPending
 //
@@ -127,14 +232,12 @@ done:
 
 BOOL SamplePool::AreSamplesPending()
 {
-  AutoLock lock(m_lock);
-
-  if (!m_bInitialized)
+  if (!m_bInitialized.load(std::memory_order_acquire))
   {
     return FALSE;
   }
 
-  return (m_cPending > 0);
+  return (m_cPending.load() > 0);
 }
 
 
@@ -146,33 +249,49 @@ BOOL SamplePool::AreSamplesPending()
 
 HRESULT SamplePool::Initialize(VideoSampleList& samples)
 {
-  AutoLock lock(m_lock);
-
-  if (m_bInitialized)
+  if (m_bInitialized.load(std::memory_order_acquire))
   {
     return MF_E_INVALIDREQUEST;
   }
 
   HRESULT hr = S_OK;
   IMFSample *pSample = NULL;
+  DWORD dwGeneration = m_dwGeneration.load(std::memory_order_relaxed);
+  DWORD cSlots = 0;
 
-  // Move these samples into our allocated queue.
+  // Move these samples into the free slots.
   VideoSampleList::POSITION pos = samples.FrontPosition();
   while (pos != samples.EndPosition())
   {
+    if (cSlots == SAMPLE_POOL_SIZE)
+    {
+      hr = E_OUTOFMEMORY;
+      goto done;
+    }
+
     CHECK_HR(hr = samples.GetItemPos(pos, &pSample));
-    CHECK_HR(hr = m_VideoSampleQueue.InsertBack(pSample));
 
+    // The slot takes the reference from GetItemPos.
+    m_slots[cSlots].dwGeneration.store(dwGeneration, std::memory_order_relaxed);
+    m_slots[cSlots].pSample.store(pSample, std::memory_order_relaxed);
+    m_slots[cSlots].state.store(SLOT_FREE, std::memory_order_relaxed);
+    Push(cSlots);
+    pSample = NULL;
+
+    cSlots++;
     pos = samples.Next(pos);
-    SAFE_RELEASE(pSample);
   }
 
-  m_bInitialized = TRUE;
+  m_bInitialized.store(TRUE);
 
 done:
   samples.Clear();
 
   SAFE_RELEASE(pSample);
+  if (FAILED(hr))
+  {
+    Clear();
+  }
   return hr;
 }
 
@@ -180,18 +299,117 @@ done:
 //-----------------------------------------------------------------------------
 // Clear
 //
-// Releases all samples.
+// Releases the free samples and starts a new generation. Samples that are
+// still in use become stale.
 //-----------------------------------------------------------------------------
 
 HRESULT SamplePool::Clear()
 {
-  HRESULT hr = S_OK;
+  // Calls that start from here on see the pool turned off, or a stale 
+  // sample.
+  m_bInitialized.store(FALSE);
+  m_dwGeneration.fetch_add(1);
+
+  // Let the calls that started earlier finish. A sample they returned is on
+  // the free stack and is released below.
+  while (m_cBusy.load() != 0)
+  {
+    SwitchToThread();
+  }
 
-  AutoLock lock(m_lock);
+  DWORD iSlot = 0;
+  while (Pop(&iSlot))
+  {
+    IMFSample *pSample = m_slots[iSlot].pSample.load(std::memory_order_relaxed);
+    SAFE_RELEASE(pSample);
+  }
+
+  for (DWORD i = 0; i < SAMPLE_POOL_SIZE; i++)
+  {
+    m_slots[i].pSample.store(NULL, std::memory_order_relaxed);
+    m_slots[i].state.store(SLOT_EMPTY, std::memory_order_release);
+  }
 
-  m_VideoSampleQueue.Clear();
-  m_bInitialized = FALSE;
   m_cPending = 0;
   return S_OK;
 }
 
+
+//-----------------------------------------------------------------------------
+// BeginOperation
+//
+// Counts the caller as busy and returns TRUE if the pool is initialized.
+// Call EndOperation afterwards either way. Clear sets the flag before it 
+// reads the count, and this reads the flag after it sets the count, so 
+// Clear either waits for the caller or the caller sees the pool turned off.
+//-----------------------------------------------------------------------------
+
+BOOL SamplePool::BeginOperation()
+{
+  m_cBusy.fetch_add(1);
+  return m_bInitialized.load();
+}
+
+
+//-----------------------------------------------------------------------------
+// FindSlot
+//
+// Returns the slot that holds the sample in the current generation, or -1.
+//-----------------------------------------------------------------------------
+
+LONG SamplePool::FindSlot(IMFSample *pSample)
+{
+  DWORD dwGeneration = m_dwGeneration.load(std::memory_order_acquire);
+
+  for (DWORD i = 0; i < SAMPLE_POOL_SIZE; i++)
+  {
+    if (m_slots[i].pSample.load(std::memory_order_acquire) == pSample &&
+        m_slots[i].dwGeneration.load(std::memory_order_relaxed) == dwGeneration)
+    {
+      return (LONG)i;
+    }
+  }
+  return -1;
+}
+
+
+//-----------------------------------------------------------------------------
+// Push / Pop
+//
+// Treiber stack of free slot indexes. Every successful exchange bumps the 
+// tag, so a head that was popped and pushed back in between does not 
+// compare equal.
+//-----------------------------------------------------------------------------
+
+void SamplePool::Push(DWORD iSlot)
+{
+  ULONGLONG head = m_head.load(std::memory_order_acquire);
+  ULONGLONG next;
+
+  do
+  {
+    m_slots[iSlot].iNext.store((DWORD)head, std::memory_order_relaxed);
+    next = ((((head >> 32) + 1) & 0xFFFFFFFF) << 32) | (iSlot + 1);
+  }
+  while (!m_head.compare_exchange_weak(head, next, std::memory_order_release, std::memory_order_acquire));
+}
+
+BOOL SamplePool::Pop(DWORD *piSlot)
+{
+  ULONGLONG head = m_head.load(std::memory_order_acquire);
+  ULONGLONG next;
+
+  do
+  {
+    DWORD iTop = (DWORD)head;
+    if (iTop == 0)
+    {
+      return FALSE;
+    }
+    *piSlot = iTop - 1;
+    next = ((((head >> 32) + 1) & 0xFFFFFFFF) << 32) | m_slots[iTop - 1].iNext.load(std::memory_order_relaxed);
+  }
+  while (!m_head.compare_exchange_weak(head, next, std::memory_order_acq_rel, std::memory_order_acquire));
+
+  return TRUE;
+}
@@ -17,9 +17,27 @@
 //-----------------------------------------------------------------------------
 // SamplePool class
 //
-// Manages a list of allocated samples.
+// Manages a fixed set of allocated samples. 
+//
+// Free samples are kept on a lock-free stack of slot indexes. The head 
+// carries a tag that changes on every push and pop, so a slot that is popped
+// and pushed again while another thread is in the middle of a pop does not 
+// corrupt the stack.
+//
+// Each slot stores the pool generation it was filled in. Clear starts a new 
+// generation, so samples handed out before it are recognised as stale by 
+// pointer and generation alone.
+//
+// Clear may run at the same time as GetSample, ReturnSample, AddSample and
+// DiscardSample. Those methods count themselves as busy while they touch the
+// slots, and Clear first turns the pool off and starts the new generation,
+// so later calls fail, then waits for the busy count to drop to zero before
+// it empties the slots. The wait is short: none of the methods blocks. Clear
+// and Initialize must still be serialized with each other.
 //-----------------------------------------------------------------------------
 
+const DWORD SAMPLE_POOL_SIZE = 16;  // Slots in the pool.
+
 class SamplePool
 {
 public:
@@ -30,16 +48,41 @@ public:
   HRESULT Clear();
 
   HRESULT GetSample(IMFSample **ppSample);    // Does not block.
-  HRESULT ReturnSample(IMFSample *pSample);
+  HRESULT ReturnSample(IMFSample *pSample);   // Returns S_FALSE for a stale sample.
+  HRESULT AddSample(IMFSample *pSample);      // Adds a sample that is already in use.
+  HRESULT DiscardSample(IMFSample *pSample);  // Takes back a sample without re-using it.
+  BOOL    IsCurrent(IMFSample *pSample);      // FALSE if the sample is stale.
   BOOL    AreSamplesPending();
 
 private:
-  CritSec                     m_lock;
+  enum SlotState
+  {
+    SLOT_EMPTY = 0,
+    SLOT_PENDING,       // Handed out.
+    SLOT_FREE           // On the free stack. The pool holds a reference.
+  };
 
-  VideoSampleList             m_VideoSampleQueue;         // Available queue
+  struct Slot
+  {
+    std::atomic<IMFSample*>   pSample;      // Compared, never dereferenced, unless the slot is free.
+    std::atomic<DWORD>        dwGeneration;
+    std::atomic<LONG>         state;
+    std::atomic<DWORD>        iNext;        // Next free slot + 1, or 0.
+  };
 
-  BOOL                        m_bInitialized;
-  DWORD                       m_cPending;
+  BOOL    BeginOperation();
+  void    EndOperation() { m_cBusy.fetch_sub(1); }
+  LONG    FindSlot(IMFSample *pSample);
+  void    Push(DWORD iSlot);
+  BOOL    Pop(DWORD *piSlot);
+
+  Slot                        m_slots[SAMPLE_POOL_SIZE];
+  std::atomic<ULONGLONG>      m_head;       // Tag in the high DWORD, top slot + 1 in the low DWORD.
+  std::atomic<DWORD>          m_dwGeneration;
+
+  std::atomic<BOOL>           m_bInitialized;
+  std::atomic<LONG>           m_cPending;
+  std::atomic<LONG>           m_cBusy;      // Calls that are using the slots. Clear waits for zero.
 };
 
 
@@ -49,10 +92,8 @@ private:
 //
 // T: COM interface type.
 //
-// This class is used by the scheduler. 
-//
 // Note: This class uses a critical section to protect the state of the queue.
-// With a little work, the scheduler could probably use a lock-free queue.
+// The scheduler uses LockFreeQueue instead.
 //-----------------------------------------------------------------------------
 
 template <class T>
@@ -101,3 +142,346 @@ private:
   ComPtrList<T>   m_list;
 };
 
+
+//-----------------------------------------------------------------------------
+// LockFreeQueue template
+// Bounded single-producer/single-consumer ring of COM interface pointers.
+//
+// T:    COM interface type.
+// SIZE: Capacity of the ring. Must be a power of two.
+//
+// Each item can carry a DWORD tag and a time; the scheduler uses them for the
+// flush generation and the arrival time.
+//
+// This class is used by the scheduler. Exactly one thread may call Queue and
+// exactly one (other) thread may call Dequeue, Peek, and Clear. Count may be
+// called from either thread. No locks are taken and no memory is allocated
+// after construction.
+//
+// The indexes are updated with sequentially consistent operations, so if the
+// producer checks Count() after Queue, and the consumer checks Peek() after
+// PopFront, at least one of them sees the other's update. The scheduler 
+// relies on this to decide when the worker thread must be woken up.
+//-----------------------------------------------------------------------------
+
+template <class T, DWORD SIZE>
+class LockFreeQueue
+{
+  static_assert((SIZE & (SIZE - 1)) == 0, "LockFreeQueue size must be a power of two");
+
+public:
+  LockFreeQueue() : m_head(0), m_tail(0)
+  {
+    ZeroMemory(m_ring, sizeof(m_ring));
+    ZeroMemory(m_tags, sizeof(m_tags));
+    ZeroMemory(m_times, sizeof(m_times));
+  }
+
+  ~LockFreeQueue()
+  {
+    Clear();
+  }
+
+  // Producer: Adds an item to the back of the queue.
+  HRESULT Queue(T *p, DWORD dwTag = 0, LONGLONG llTime = 0)
+  {
+    if (p == NULL)
+    {
+      return E_POINTER;
+    }
+
+    DWORD tail = m_tail.load(std::memory_order_relaxed);
+
+    if (tail - m_head.load(std::memory_order_acquire) == SIZE)
+    {
+      return MF_E_NOTACCEPTING; // Full.
+    }
+
+    p->AddRef();
+    m_ring[tail & (SIZE - 1)] = p;
+    m_tags[tail & (SIZE - 1)] = dwTag;
+    m_times[tail & (SIZE - 1)] = llTime;
+
+    m_tail.store(tail + 1);
+    return S_OK;
+  }
+
+  // Consumer: Removes the front item. Returns S_FALSE if the queue is empty.
+  HRESULT Dequeue(T **pp)
+  {
+    HRESULT hr = Peek(pp);
+
+    if (hr == S_OK)
+    {
+      PopFront();
+    }
+    return hr;
+  }
+
+  // Consumer: Returns the front item without removing it. 
+  // Returns S_FALSE if the queue is empty.
+  HRESULT Peek(T **pp, DWORD *pdwTag = NULL, LONGLONG *pllTime = NULL)
+  {
+    DWORD head = m_head.load(std::memory_order_relaxed);
+
+    if (head == m_tail.load())
+    {
+      *pp = NULL;
+      return S_FALSE;
+    }
+
+    *pp = m_ring[head & (SIZE - 1)];
+    (*pp)->AddRef();
+
+    if (pdwTag)
+    {
+      *pdwTag = m_tags[head & (SIZE - 1)];
+    }
+    if (pllTime)
+    {
+      *pllTime = m_times[head & (SIZE - 1)];
+    }
+    return S_OK;
+  }
+
+  // Consumer: Discards the front item.
+  void PopFront()
+  {
+    DWORD head = m_head.load(std::memory_order_relaxed);
+
+    if (head != m_tail.load(std::memory_order_acquire))
+    {
+      T *p = m_ring[head & (SIZE - 1)];
+      m_ring[head & (SIZE - 1)] = NULL;
+
+      m_head.store(head + 1);
+
+      p->Release();
+    }
+  }
+
+  DWORD Count() const
+  {
+    return m_tail.load() - m_head.load();
+  }
+
+  // Consumer: Discards all items.
+  void Clear()
+  {
+    while (Count() > 0)
+    {
+      PopFront();
+    }
+  }
+
+private:
+  // Keep the producer and consumer indexes on separate cache lines.
+  __declspec(align(64)) std::atomic<DWORD>  m_head;  // Next item to read (consumer).
+  __declspec(align(64)) std::atomic<DWORD>  m_tail;  // Next slot to write (producer).
+  T                                         *m_ring[SIZE];
+  DWORD                                     m_tags[SIZE];
+  LONGLONG                                  m_times[SIZE];
+};
+
+
+//-----------------------------------------------------------------------------
+// TimeOrderedQueue template
+// Bounded min-heap of COM interface pointers, keyed by presentation time.
+//
+// T:    COM interface type.
+// SIZE: Capacity of the heap.
+//
+// Items come out in time order; items with equal times come out in the order
+// they were queued. SetDescending(TRUE) reverses the order, for reverse 
+// playback. 
+//
+// Not thread-safe. The scheduler only uses it on its worker thread.
+//-----------------------------------------------------------------------------
+
+template <class T, DWORD SIZE>
+class TimeOrderedQueue
+{
+  struct Entry
+  {
+    LONGLONG  hnsTime;
+    ULONGLONG seq;      // Queue order, for ties.
+    T         *p;
+  };
+
+public:
+  TimeOrderedQueue() : m_count(0), m_seq(0), m_bDescending(FALSE)
+  {
+    ZeroMemory(m_heap, sizeof(m_heap));
+  }
+
+  ~TimeOrderedQueue()
+  {
+    Clear();
+  }
+
+  HRESULT Queue(T *p, LONGLONG hnsTime)
+  {
+    if (p == NULL)
+    {
+      return E_POINTER;
+    }
+    if (m_count == SIZE)
+    {
+      return MF_E_NOTACCEPTING;
+    }
+
+    p->AddRef();
+
+    Entry e = { hnsTime, m_seq++, p };
+    m_heap[m_count] = e;
+    SiftUp(m_count++);
+    return S_OK;
+  }
+
+  // Returns the first item without removing it. 
+  // Returns S_FALSE if the queue is empty.
+  HRESULT Peek(T **pp, LONGLONG *phnsTime = NULL)
+  {
+    if (m_count == 0)
+    {
+      *pp = NULL;
+      return S_FALSE;
+    }
+
+    *pp = m_heap[0].p;
+    (*pp)->AddRef();
+
+    if (phnsTime)
+    {
+      *phnsTime = m_heap[0].hnsTime;
+    }
+    return S_OK;
+  }
+
+  // Returns the time of the item after the first one.
+  // Returns S_FALSE if there is no such item.
+  HRESULT PeekNextTime(LONGLONG *phnsTime) const
+  {
+    if (m_count < 2)
+    {
+      return S_FALSE;
+    }
+
+    // The second item is one of the root's children.
+    DWORD i = 1;
+    if (m_count > 2 && Before(m_heap[2], m_heap[1]))
+    {
+      i = 2;
+    }
+    *phnsTime = m_heap[i].hnsTime;
+    return S_OK;
+  }
+
+  // Discards the first item.
+  void PopFront()
+  {
+    if (m_count == 0)
+    {
+      return;
+    }
+
+    T *p = m_heap[0].p;
+
+    m_heap[0] = m_heap[--m_count];
+    m_heap[m_count].p = NULL;
+    SiftDown(0);
+
+    p->Release();
+  }
+
+  DWORD Count() const { return m_count; }
+
+  void Clear()
+  {
+    for (DWORD i = 0; i < m_count; i++)
+    {
+      m_heap[i].p->Release();
+      m_heap[i].p = NULL;
+    }
+    m_count = 0;
+  }
+
+  BOOL IsDescending() const { return m_bDescending; }
+
+  void SetDescending(BOOL bDescending)
+  {
+    if (m_bDescending == bDescending)
+    {
+      return;
+    }
+
+    m_bDescending = bDescending;
+
+    // Rebuild the heap for the new order.
+    for (DWORD i = m_count / 2; i-- > 0; )
+    {
+      SiftDown(i);
+    }
+  }
+
+private:
+  BOOL Before(const Entry& a, const Entry& b) const
+  {
+    if (a.hnsTime != b.hnsTime)
+    {
+      return m_bDescending ? (a.hnsTime > b.hnsTime) : (a.hnsTime < b.hnsTime);
+    }
+    return a.seq < b.seq;
+  }
+
+  void SiftUp(DWORD i)
+  {
+    while (i > 0)
+    {
+      DWORD parent = (i - 1) / 2;
+      if (!Before(m_heap[i], m_heap[parent]))
+      {
+        break;
+      }
+      Swap(i, parent);
+      i = parent;
+    }
+  }
+
+  void SiftDown(DWORD i)
+  {
+    for (;;)
+    {
+      DWORD first = i;
+      DWORD left = 2 * i + 1;
+      DWORD right = left + 1;
+
+      if (left < m_count && Before(m_heap[left], m_heap[first]))
+      {
+        first = left;
+      }
+      if (right < m_count && Before(m_heap[right], m_heap[first]))
+      {
+        first = right;
+      }
+      if (first == i)
+      {
+        break;
+      }
+      Swap(i, first);
+      i = first;
+    }
+  }
+
+  void Swap(DWORD i, DWORD j)
+  {
+    Entry e = m_heap[i];
+    m_heap[i] = m_heap[j];
+    m_heap[j] = e;
+  }
+
+  Entry       m_heap[SIZE];
+  DWORD       m_count;
+  ULONGLONG   m_seq;
+  BOOL        m_bDescending;
+};
@@ -9,7 +9,94 @@ enum EVRCPSetting
   EVRCP_SETTING_CORRECT_AR,
   EVRCP_SETTING_REQUEST_OVERLAY,
   EVRCP_SETTING_POSITION_FROM_BOTTOM,
-  EVRCP_SETTING_POSITION_OFFSET
+  EVRCP_SETTING_POSITION_OFFSET,
+  EVRCP_SETTING_HIGH_RES_WAIT,
+  EVRCP_SETTING_VSYNC_PLANNER,
+  EVRCP_SETTING_CADENCE_ERRORS,     // Read-only: cadence errors per minute.
+  EVRCP_SETTING_CLOCK_QUERIES,      // Read-only: presentation time queries.
+  EVRCP_SETTING_CLOCK_CALLS,        // Read-only: queries that read the clock.
+  EVRCP_SETTING_FRAME_DROP_POLICY,  // EVRCPFrameDropPolicy
+  EVRCP_SETTING_FRAME_RATE_DETECTION,
+  EVRCP_SETTING_DETECTED_FRAME_RATE, // Read-only: frames per second, 0 if unknown.
+  EVRCP_SETTING_CONTENT_CADENCE,    // Read-only: EVRCPCadence
+  EVRCP_SETTING_SAMPLE_MEMORY_BUDGET, // Megabytes of video memory for samples.
+  EVRCP_SETTING_SAMPLE_COUNT,       // Read-only: samples allocated.
+  EVRCP_SETTING_TARGET_QUEUE_DEPTH, // Read-only: samples the jitter buffer keeps queued.
+  EVRCP_SETTING_FRAMES_THINNED,     // Read-only: frames skipped during trick play.
+  EVRCP_SETTING_SHARED_SCHEDULER,   // One scheduler thread for all presenters in the process.
+  EVRCP_SETTING_THREAD_PRIORITY,    // EVRCPThreadPriority of the scheduler thread.
+  EVRCP_SETTING_MMCSS,              // Register the scheduler thread with MMCSS.
+  EVRCP_SETTING_THREAD_AFFINITY,    // Processor mask for the scheduler thread; 0 means all.
+  EVRCP_SETTING_AVOID_MIXER_CORE,   // Keep the scheduler thread off the mixer thread's processor.
+  EVRCP_SETTING_PRESENT_AHEAD,      // Render the next frame early; flip it at its presentation time.
+  EVRCP_SETTING_FRAME_TIMELINE,     // Record per-frame stage times.
+  EVRCP_SETTING_FRAME_TIMELINE_FILE, // SetString: writes the recorded timeline to this file (Chrome trace JSON).
+  EVRCP_SETTING_SAMPLE_POOL_SIZE,   // Samples allocated for a new format, and the least the pool keeps. Applies while streaming.
+  EVRCP_SETTING_SAMPLE_MEMORY,      // Read-only: kilobytes of video memory held by samples.
+  EVRCP_SETTING_RANK_MIXER_TYPES,   // Choose the mixer output type by merit instead of taking the first that works.
+  EVRCP_SETTING_SUBTITLE_MEMORY_CAP, // Megabytes of video memory for subtitle surfaces.
+  EVRCP_SETTING_SUBTITLE_MEMORY     // Read-only: kilobytes of video memory held by subtitle surfaces.
+};
+
+enum EVRCPThreadPriority
+{
+  EVRCP_THREAD_PRIORITY_NORMAL = 0, // Default.
+  EVRCP_THREAD_PRIORITY_ABOVE_NORMAL,
+  EVRCP_THREAD_PRIORITY_HIGHEST,
+  EVRCP_THREAD_PRIORITY_TIME_CRITICAL
+};
+
+enum EVRCPCadence
+{
+  EVRCP_CADENCE_UNKNOWN = 0,        // Not enough samples yet.
+  EVRCP_CADENCE_CONSTANT,
+  EVRCP_CADENCE_TELECINE,           // Alternating 3:2 frame durations.
+  EVRCP_CADENCE_VARIABLE
+};
+
+enum EVRCPFrameDropPolicy
+{
+  EVRCP_FRAME_DROP_LATE_THRESHOLD = 0,  // Default.
+  EVRCP_FRAME_DROP_QUEUE_DEPTH,
+  EVRCP_FRAME_DROP_CATCH_UP,
+  EVRCP_FRAME_DROP_NEVER                // For capture.
+};
+
+enum EVRCPHistogram
+{
+  EVRCP_HISTOGRAM_PRESENT_LATENESS = 0, // hns after the presentation time (0 if early).
+  EVRCP_HISTOGRAM_SLEEP_OVERSHOOT,      // hns the scheduler thread woke up after its deadline.
+  EVRCP_HISTOGRAM_QUEUE_DEPTH,          // Samples queued behind each presented sample.
+  EVRCP_HISTOGRAM_PRESENT_DURATION,     // hns spent presenting each sample.
+  EVRCP_HISTOGRAM_PREPARE_DURATION,     // hns spent preparing each sample ahead of time (present-ahead).
+  EVRCP_HISTOGRAM_COUNT
+};
+
+struct EVRCPHistogramStats
+{
+  ULONGLONG cValues;
+  LONGLONG  llMin;
+  LONGLONG  llMax;
+  LONGLONG  llMean;
+  LONGLONG  llP50;
+  LONGLONG  llP90;
+  LONGLONG  llP99;
+  LONGLONG  llP999;
+};
+
+struct EVRCPStats
+{
+  DWORD               cbSize;           // Set by the caller to sizeof(EVRCPStats).
+  DWORD               dwFramesPresented;
+  DWORD               dwFramesDropped;
+  EVRCPHistogramStats histograms[EVRCP_HISTOGRAM_COUNT];
+
+  // Over the last 32 samples that came due. Zero until there are enough.
+  LONGLONG            llLatenessMedian; // hns after the presentation time; negative if early.
+  LONGLONG            llLatenessMad;    // Median absolute deviation of the lateness, hns.
+  LONGLONG            llLatenessP90;    // 90th percentile of the lateness, hns.
+  LONGLONG            llQueuedMedian;   // Samples queued behind each one.
+  LONGLONG            llQueuedMad;
 };
 
 [uuid("D54059EF-CA38-46A5-9123-0249770482EE")]
@@ -32,4 +119,10 @@ interface IEVRCPConfig : public IUnknown
 	STDMETHOD(SetBool)(EVRCPSetting setting, bool value) = 0;
 	STDMETHOD(GetString)(EVRCPSetting setting, LPWSTR value) = 0;
 	STDMETHOD(SetString)(EVRCPSetting setting, LPWSTR value) = 0;
+};
+
+[uuid("ABB3AAD6-5660-4975-B02F-CCA638416FF8")]
+interface IEVRCPStats : public IUnknown
+{
+	STDMETHOD(GetStats)(EVRCPStats *pStats) = 0;
 };
\ No newline at end of file
@@ -0,0 +1,208 @@
+/*
+ *      Copyright (C) 2014 Andrew Van Til
+ *      http://babgvant.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "stdafx.h"
+#include "EVRPresenter.h"
+
+// An arrival gap longer than this is a pause or a seek, not jitter.
+const LONGLONG JITTER_MAX_INTERVAL = 10000000;      // 1 second
+
+
+JitterBufferController::JitterBufferController() :
+  m_cMin(1),
+  m_cMax(1)
+{
+  Reset();
+}
+
+void JitterBufferController::Reset()
+{
+  AutoLock lock(m_lock);
+
+  ZeroMemory(m_hnsIntervals, sizeof(m_hnsIntervals));
+  m_cIntervals = 0;
+  m_hnsLastArrival = 0;
+  m_bHaveLastArrival = FALSE;
+  m_cBoost = 0;
+  m_cSinceUnderrun = 0;
+  m_cIgnoreUnderruns = 0;
+  m_cTarget = m_cMin;
+}
+
+//-----------------------------------------------------------------------------
+// SetLimits
+//
+// Sets the range of the target depth, in samples.
+//-----------------------------------------------------------------------------
+
+void JitterBufferController::SetLimits(DWORD cMin, DWORD cMax)
+{
+  AutoLock lock(m_lock);
+
+  m_cMin = cMin;
+  m_cMax = (cMax > cMin) ? cMax : cMin;
+
+  if (m_cTarget < m_cMin)
+  {
+    m_cTarget = m_cMin;
+  }
+  else if (m_cTarget > m_cMax)
+  {
+    m_cTarget = m_cMax;
+  }
+}
+
+//-----------------------------------------------------------------------------
+// OnArrival
+//
+// Called when the scheduler thread picks up a queued sample.
+//
+// hnsNow:           System time the sample was queued.
+// hnsFrameInterval: Frame duration of the stream.
+//-----------------------------------------------------------------------------
+
+void JitterBufferController::OnArrival(LONGLONG hnsNow, LONGLONG hnsFrameInterval)
+{
+  AutoLock lock(m_lock);
+
+  if (m_bHaveLastArrival)
+  {
+    LONGLONG hnsInterval = hnsNow - m_hnsLastArrival;
+
+    if (hnsInterval >= 0 && hnsInterval <= JITTER_MAX_INTERVAL)
+    {
+      m_hnsIntervals[m_cIntervals++ & (JITTER_WINDOW - 1)] = hnsInterval;
+    }
+  }
+
+  m_hnsLastArrival = hnsNow;
+  m_bHaveLastArrival = TRUE;
+
+  if (m_cIgnoreUnderruns > 0)
+  {
+    m_cIgnoreUnderruns--;
+  }
+  m_cSinceUnderrun++;
+
+  Update(hnsFrameInterval);
+}
+
+//-----------------------------------------------------------------------------
+// OnUnderrun
+//
+// Called when a sample is presented late (or dropped) with no other sample 
+// queued behind it.
+//-----------------------------------------------------------------------------
+
+void JitterBufferController::OnUnderrun()
+{
+  AutoLock lock(m_lock);
+
+  if (m_cIgnoreUnderruns > 0)
+  {
+    return;
+  }
+
+  if (m_cTarget < m_cMax)
+  {
+    m_cBoost++;
+    m_cTarget++;
+  }
+  m_cSinceUnderrun = 0;
+
+  // Give the deeper queue time to fill before counting another underrun.
+  m_cIgnoreUnderruns = m_cTarget;
+}
+
+//-----------------------------------------------------------------------------
+// Discontinuity
+//
+// Called after a seek, pause, or rate change. The queue starts empty, which 
+// is not an underrun, and the gap before the next arrival is not jitter.
+//-----------------------------------------------------------------------------
+
+void JitterBufferController::Discontinuity()
+{
+  AutoLock lock(m_lock);
+
+  m_bHaveLastArrival = FALSE;
+  m_cIgnoreUnderruns = m_cTarget;
+}
+
+DWORD JitterBufferController::TargetDepth()
+{
+  AutoLock lock(m_lock);
+  return m_cTarget;
+}
+
+//-----------------------------------------------------------------------------
+// Update
+//
+// Recomputes the target depth. Call with the lock held.
+//-----------------------------------------------------------------------------
+
+void JitterBufferController::Update(LONGLONG hnsFrameInterval)
+{
+  if (hnsFrameInterval <= 0)
+  {
+    return;
+  }
+
+  DWORD cWindow = (m_cIntervals < JITTER_WINDOW) ? m_cIntervals : JITTER_WINDOW;
+
+  LONGLONG hnsMaxGap = 0;
+  for (DWORD i = 0; i < cWindow; i++)
+  {
+    if (m_hnsIntervals[i] > hnsMaxGap)
+    {
+      hnsMaxGap = m_hnsIntervals[i];
+    }
+  }
+
+  // Frames presented during the longest gap, plus the one on screen.
+  DWORD cNeeded = (DWORD)((hnsMaxGap + hnsFrameInterval - 1) / hnsFrameInterval) + 1;
+
+  if (m_cSinceUnderrun >= JITTER_WINDOW)
+  {
+    // A full window without trouble: give back one frame of latency.
+    if (m_cBoost > 0)
+    {
+      m_cBoost--;
+    }
+    if (m_cTarget > cNeeded + m_cBoost)
+    {
+      m_cTarget--;
+    }
+    m_cSinceUnderrun = 0;
+  }
+
+  if (cNeeded + m_cBoost > m_cTarget)
+  {
+    m_cTarget = cNeeded + m_cBoost;
+  }
+
+  if (m_cTarget < m_cMin)
+  {
+    m_cTarget = m_cMin;
+  }
+  else if (m_cTarget > m_cMax)
+  {
+    m_cTarget = m_cMax;
+  }
+}
@@ -0,0 +1,74 @@
+/*
+ *      Copyright (C) 2014 Andrew Van Til
+ *      http://babgvant.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+const DWORD JITTER_WINDOW = 64;           // Arrival intervals looked at. Power of two.
+
+//-----------------------------------------------------------------------------
+// JitterBufferController class
+//
+// Decides how many samples the presenter should keep queued (and therefore 
+// allocate), between a minimum and a maximum that the presenter derives from
+// its memory budget.
+//
+// The depth covers the longest gap between sample arrivals in the recent 
+// window: a decoder that stalls for four frames and then bursts needs about
+// five queued frames to avoid running dry, while a steady stream needs two.
+// An underrun (a sample presented late with nothing queued behind it) raises 
+// the depth at once. The depth drops by one frame at a time, and only after
+// a full window without an underrun, so steady streams settle back to the
+// minimum latency.
+//
+// All methods are thread-safe. Arrivals and underruns are both reported by
+// the scheduler thread; arrivals carry the time the sample was queued.
+//-----------------------------------------------------------------------------
+
+class JitterBufferController
+{
+public:
+  JitterBufferController();
+
+  void Reset();
+  void SetLimits(DWORD cMin, DWORD cMax);
+
+  void OnArrival(LONGLONG hnsNow, LONGLONG hnsFrameInterval);
+  void OnUnderrun();
+  void Discontinuity();
+
+  DWORD TargetDepth();
+
+private:
+  void Update(LONGLONG hnsFrameInterval);
+
+  CritSec   m_lock;
+
+  DWORD     m_cMin;
+  DWORD     m_cMax;
+  DWORD     m_cTarget;
+
+  LONGLONG  m_hnsIntervals[JITTER_WINDOW];
+  DWORD     m_cIntervals;
+  LONGLONG  m_hnsLastArrival;
+  BOOL      m_bHaveLastArrival;
+
+  DWORD     m_cBoost;                 // Extra depth from underruns.
+  DWORD     m_cSinceUnderrun;         // Arrivals since the last underrun or shrink.
+  DWORD     m_cIgnoreUnderruns;       // Arrivals to wait after a discontinuity.
+};
@@ -0,0 +1,121 @@
+/*
+ *      Copyright (C) 2014 Andrew Van Til
+ *      http://babgvant.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "stdafx.h"
+#include "EVRPresenter.h"
+
+LatencyHistogram::LatencyHistogram()
+{
+  Reset();
+}
+
+void LatencyHistogram::Reset()
+{
+  for (DWORD i = 0; i < HISTOGRAM_BUCKETS; i++)
+  {
+    m_counts[i] = 0;
+  }
+  m_cValues = 0;
+  m_llSum = 0;
+  m_llMin = MAXLONGLONG;
+  m_llMax = 0;
+}
+
+//-----------------------------------------------------------------------------
+// BucketValue
+//
+// Returns the middle of the values counted in a bucket.
+//-----------------------------------------------------------------------------
+
+LONGLONG LatencyHistogram::BucketValue(DWORD index)
+{
+  if (index < 2 * HISTOGRAM_SUB_BUCKETS)
+  {
+    return index;
+  }
+
+  DWORD shift = index / HISTOGRAM_SUB_BUCKETS - 1;
+  LONGLONG llLow = (LONGLONG)(index - shift * HISTOGRAM_SUB_BUCKETS) << shift;
+  return llLow + ((1LL << shift) / 2);
+}
+
+//-----------------------------------------------------------------------------
+// GetStats
+//
+// Summarizes the histogram. Percentiles are accurate to the bucket width.
+//-----------------------------------------------------------------------------
+
+void LatencyHistogram::GetStats(EVRCPHistogramStats *pStats) const
+{
+  ZeroMemory(pStats, sizeof(*pStats));
+
+  // Take a snapshot of the buckets; the total is the sum of the snapshot, so
+  // the percentiles are consistent even if the writer is recording.
+  DWORD counts[HISTOGRAM_BUCKETS];
+  ULONGLONG cTotal = 0;
+
+  for (DWORD i = 0; i < HISTOGRAM_BUCKETS; i++)
+  {
+    counts[i] = m_counts[i].load(std::memory_order_relaxed);
+    cTotal += counts[i];
+  }
+
+  if (cTotal == 0)
+  {
+    return;
+  }
+
+  pStats->cValues = cTotal;
+  pStats->llMin = m_llMin.load(std::memory_order_relaxed);
+  pStats->llMax = m_llMax.load(std::memory_order_relaxed);
+
+  ULONGLONG cValues = m_cValues.load(std::memory_order_relaxed);
+  if (cValues > 0)
+  {
+    pStats->llMean = m_llSum.load(std::memory_order_relaxed) / (LONGLONG)cValues;
+  }
+
+  // Percentiles, in parts per thousand.
+  const ULONGLONG permille[] = { 500, 900, 990, 999 };
+  LONGLONG *results[] = { &pStats->llP50, &pStats->llP90, &pStats->llP99, &pStats->llP999 };
+
+  ULONGLONG cSeen = 0;
+  DWORD p = 0;
+
+  for (DWORD i = 0; i < HISTOGRAM_BUCKETS && p < ARRAY_SIZE(permille); i++)
+  {
+    cSeen += counts[i];
+
+    while (p < ARRAY_SIZE(permille) && cSeen * 1000 >= cTotal * permille[p])
+    {
+      LONGLONG llValue = BucketValue(i);
+
+      // The bucket middle can lie outside the recorded range.
+      if (llValue > pStats->llMax)
+      {
+        llValue = pStats->llMax;
+      }
+      if (llValue < pStats->llMin)
+      {
+        llValue = pStats->llMin;
+      }
+      *results[p++] = llValue;
+    }
+  }
+}
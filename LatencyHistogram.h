@@ -0,0 +1,105 @@
+/*
+ *      Copyright (C) 2014 Andrew Van Til
+ *      http://babgvant.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+#include "IEVRCPSettings.h"
+
+//-----------------------------------------------------------------------------
+// LatencyHistogram class
+//
+// Log-linear (HDR-style) histogram of non-negative values. Values below 
+// 2 * HISTOGRAM_SUB_BUCKETS are counted exactly; above that, each power of two
+// is split into HISTOGRAM_SUB_BUCKETS buckets, so a bucket is at most 1/8 of
+// its value wide. Values are clamped to 32 bits.
+//
+// Record does not lock or allocate. Each histogram must have a single writer
+// thread (the scheduler thread, for the scheduler's histograms); any thread 
+// can read it at any time, and gets a snapshot that may be a few values 
+// behind.
+//-----------------------------------------------------------------------------
+
+const DWORD HISTOGRAM_SUB_BUCKET_BITS = 3;
+const DWORD HISTOGRAM_SUB_BUCKETS = 1 << HISTOGRAM_SUB_BUCKET_BITS;
+const DWORD HISTOGRAM_BUCKETS = (32 - HISTOGRAM_SUB_BUCKET_BITS + 1) * HISTOGRAM_SUB_BUCKETS;
+
+class LatencyHistogram
+{
+public:
+  LatencyHistogram();
+
+  void Record(LONGLONG llValue)
+  {
+    if (llValue < 0)
+    {
+      llValue = 0;
+    }
+    else if (llValue > MAXDWORD)
+    {
+      llValue = MAXDWORD;
+    }
+
+    Bump(m_counts[BucketIndex((DWORD)llValue)]);
+    Bump(m_cValues);
+    m_llSum.store(m_llSum.load(std::memory_order_relaxed) + llValue, std::memory_order_relaxed);
+
+    if (llValue < m_llMin.load(std::memory_order_relaxed))
+    {
+      m_llMin.store(llValue, std::memory_order_relaxed);
+    }
+    if (llValue > m_llMax.load(std::memory_order_relaxed))
+    {
+      m_llMax.store(llValue, std::memory_order_relaxed);
+    }
+  }
+
+  void GetStats(EVRCPHistogramStats *pStats) const;
+
+  // Not safe while the writer is recording.
+  void Reset();
+
+private:
+  static DWORD BucketIndex(DWORD dwValue)
+  {
+    if (dwValue < 2 * HISTOGRAM_SUB_BUCKETS)
+    {
+      return dwValue;
+    }
+
+    DWORD msb = 0;
+    _BitScanReverse(&msb, dwValue);
+    DWORD shift = msb - HISTOGRAM_SUB_BUCKET_BITS;
+    return (shift * HISTOGRAM_SUB_BUCKETS) + (dwValue >> shift);
+  }
+
+  static LONGLONG BucketValue(DWORD index);
+
+  // Single writer: a plain load and store instead of a locked add.
+  template <class T>
+  static void Bump(std::atomic<T>& counter)
+  {
+    counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  }
+
+  std::atomic<DWORD>      m_counts[HISTOGRAM_BUCKETS];
+  std::atomic<ULONGLONG>  m_cValues;
+  std::atomic<LONGLONG>   m_llSum;
+  std::atomic<LONGLONG>   m_llMin;
+  std::atomic<LONGLONG>   m_llMax;
+};
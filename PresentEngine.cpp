@@ -58,15 +58,24 @@ D3DPresentEngine::D3DPresentEngine(HRESULT& hr) :
   , m_iPositionOffset(5)
   , m_bPositionFromBottom(true)
   , m_bProcessSubs(true)
+  , m_cMixerSurfaces(0)
+  , m_pPreparedSample(NULL)
+  , m_pPreparedSurface(NULL)
+  , m_pTimeline(NULL)
+  , m_hnsTimelineSample(-1)
+  , m_nSurfaceWidth(0)
+  , m_nSurfaceHeight(0)
 {
   SetRectEmpty(&m_rcDestRect);
+  SetRectEmpty(&m_rcPreparedTarget);
+  SetRectEmpty(&m_rcPreparedDest);
 
   ZeroMemory(&m_DisplayMode, sizeof(m_DisplayMode));
   ZeroMemory(&m_VideoDesc, sizeof(m_VideoDesc));
   ZeroMemory(&m_BltParams, sizeof(m_BltParams));
   ZeroMemory(&m_Sample, sizeof(m_Sample));
 
-  for (UINT i = 0; i < PRESENTER_BUFFER_COUNT; i++)
+  for (UINT i = 0; i < PRESENTER_MAX_BUFFER_COUNT; i++)
   {
     m_pMixerSurfaces[i] = NULL;
   }
@@ -125,10 +134,11 @@ D3DPresentEngine::D3DPresentEngine(HRESULT& hr) :
   m_DroppedFrames = 0;
   m_GoodFrames = 0;
   m_FramesInQueue = 0;
-  m_AvgTimeDelta = 0;
 
   //pFont = NULL;
 
+  m_SubSurfaces.SetAllocator(this);
+
   hr = InitializeD3D();
 
   if (SUCCEEDED(hr))
@@ -144,6 +154,7 @@ D3DPresentEngine::D3DPresentEngine(HRESULT& hr) :
 
 D3DPresentEngine::~D3DPresentEngine()
 {
+  DiscardPrepared();
   SAFE_RELEASE(m_pDevice);
   SAFE_RELEASE(m_pSurfaceRepaint);
   SAFE_RELEASE(m_pRenderSurface);
@@ -151,7 +162,7 @@ D3DPresentEngine::~D3DPresentEngine()
   SAFE_RELEASE(m_pDeviceManager);
   SAFE_RELEASE(m_pD3D9);
 
-  for (int i = 0; i < PRESENTER_BUFFER_COUNT; i++)
+  for (int i = 0; i < PRESENTER_MAX_BUFFER_COUNT; i++)
   {
     SAFE_RELEASE(m_pMixerSurfaces[i]);
   }
@@ -374,13 +385,18 @@ HRESULT D3DPresentEngine::SetDestinationRect(const RECT& rcDest)
 // CreateVideoSamples
 //-----------------------------------------------------------------------------
 
-HRESULT D3DPresentEngine::CreateVideoSamples(IMFMediaType *pFormat, VideoSampleList& videoSampleQueue)
+HRESULT D3DPresentEngine::CreateVideoSamples(IMFMediaType *pFormat, VideoSampleList& videoSampleQueue, DWORD cSamples)
 {
   if (m_hwnd == NULL)
   {
     return MF_E_INVALIDREQUEST;
   }
 
+  if (cSamples == 0 || cSamples > PRESENTER_MAX_BUFFER_COUNT)
+  {
+    return E_INVALIDARG;
+  }
+
   if (pFormat == NULL)
   {
     return MF_E_UNEXPECTED;
@@ -409,10 +425,13 @@ HRESULT D3DPresentEngine::CreateVideoSamples(IMFMediaType *pFormat, VideoSampleL
   //CHECK_HR(hr = m_pDeviceManager->GetVideoService(hDevice, __uuidof(IDirectXVideoProcessorService), (void**)&pVideoProcessorService));
 
   // Create IDirect3DSurface9 surface
-  CHECK_HR(hr = m_pDXVAVPS->CreateSurface(nWidth, nHeight, PRESENTER_BUFFER_COUNT - 1, VIDEO_RENDER_TARGET_FORMAT, m_VPCaps.InputPool, 0, DXVA_RENDER_TARGET, (IDirect3DSurface9 **)&m_pMixerSurfaces, NULL));
+  CHECK_HR(hr = m_pDXVAVPS->CreateSurface(nWidth, nHeight, cSamples - 1, VIDEO_RENDER_TARGET_FORMAT, m_VPCaps.InputPool, 0, DXVA_RENDER_TARGET, (IDirect3DSurface9 **)&m_pMixerSurfaces, NULL));
+  m_cMixerSurfaces = cSamples;
+  m_nSurfaceWidth = nWidth;
+  m_nSurfaceHeight = nHeight;
 
   // Create the video samples.
-  for (int i = 0; i < PRESENTER_BUFFER_COUNT; i++)
+  for (DWORD i = 0; i < cSamples; i++)
   {
     // Fill it with black.
     CHECK_HR(hr = m_pDevice->ColorFill(m_pMixerSurfaces[i], NULL, clrBlack));
@@ -451,13 +470,101 @@ void D3DPresentEngine::ReleaseResources()
   // Let the derived class release any resources it created.
   OnReleaseResources();
 
+  DiscardPrepared();
   SAFE_RELEASE(m_pSurfaceRepaint);
   SAFE_RELEASE(m_pRenderSurface);
 
-  for (int i = 0; i < PRESENTER_BUFFER_COUNT; i++)
+  for (int i = 0; i < PRESENTER_MAX_BUFFER_COUNT; i++)
   {
     SAFE_RELEASE(m_pMixerSurfaces[i]);
   }
+  m_cMixerSurfaces = 0;
+}
+
+
+//-----------------------------------------------------------------------------
+// CreateVideoSample
+//
+// Creates one more video sample in the current format, when the presenter 
+// grows its pool. Call after CreateVideoSamples.
+//
+// pcbSurface: Receives the bytes of video memory the new surface takes.
+//-----------------------------------------------------------------------------
+
+HRESULT D3DPresentEngine::CreateVideoSample(IMFSample **ppSample, DWORD *pcbSurface)
+{
+  CheckPointer(ppSample, E_POINTER);
+  CheckPointer(pcbSurface, E_POINTER);
+
+  HRESULT     hr = S_OK;
+  D3DCOLOR    clrBlack = D3DCOLOR_ARGB(0xFF, 0x00, 0x00, 0x00);
+  IDirect3DSurface9 *pSurface = NULL;
+
+  AutoLock lock(m_ObjectLock);
+
+  if (m_cMixerSurfaces == 0)
+  {
+    return MF_E_NOT_INITIALIZED;
+  }
+  if (m_cMixerSurfaces == PRESENTER_MAX_BUFFER_COUNT)
+  {
+    return MF_E_SAMPLEALLOCATOR_EMPTY;
+  }
+
+  CHECK_HR(hr = m_pDXVAVPS->CreateSurface(m_nSurfaceWidth, m_nSurfaceHeight, 0, VIDEO_RENDER_TARGET_FORMAT, m_VPCaps.InputPool, 0, DXVA_RENDER_TARGET, &pSurface, NULL));
+  CHECK_HR(hr = m_pDevice->ColorFill(pSurface, NULL, clrBlack));
+  CHECK_HR(hr = MFCreateVideoSampleFromSurface(pSurface, ppSample));
+
+  (*ppSample)->SetUINT32(MFSampleExtension_CleanPoint, 0);
+
+  m_pMixerSurfaces[m_cMixerSurfaces++] = pSurface;
+  pSurface = NULL;
+
+  *pcbSurface = SurfaceBytes();
+
+done:
+  SAFE_RELEASE(pSurface);
+  return hr;
+}
+
+
+//-----------------------------------------------------------------------------
+// ReleaseVideoSample
+//
+// Releases the surface of a sample that the presenter no longer uses, when
+// the pool shrinks. The sample keeps its own reference until it is
+// released. Returns the bytes of video memory released.
+//-----------------------------------------------------------------------------
+
+DWORD D3DPresentEngine::ReleaseVideoSample(IMFSample *pSample)
+{
+  IMFMediaBuffer* pBuffer = NULL;
+  IDirect3DSurface9* pSurface = NULL;
+  DWORD cbReleased = 0;
+
+  AutoLock lock(m_ObjectLock);
+
+  if (SUCCEEDED(pSample->GetBufferByIndex(0, &pBuffer)) &&
+      SUCCEEDED(MFGetService(pBuffer, MR_BUFFER_SERVICE, __uuidof(IDirect3DSurface9), (void**)&pSurface)))
+  {
+    for (DWORD i = 0; i < m_cMixerSurfaces; i++)
+    {
+      if (m_pMixerSurfaces[i] == pSurface)
+      {
+        SAFE_RELEASE(m_pMixerSurfaces[i]);
+
+        // Keep the array packed.
+        m_pMixerSurfaces[i] = m_pMixerSurfaces[--m_cMixerSurfaces];
+        m_pMixerSurfaces[m_cMixerSurfaces] = NULL;
+        cbReleased = SurfaceBytes();
+        break;
+      }
+    }
+  }
+
+  SAFE_RELEASE(pSurface);
+  SAFE_RELEASE(pBuffer);
+  return cbReleased;
 }
 
 
@@ -524,6 +631,43 @@ HRESULT D3DPresentEngine::PresentSurface(IDirect3DSurface9* pSurface)
 {
   //TRACE((L"PresentSurface"));
 
+  RECT target, targetRect;
+
+  HRESULT hr = RenderSurface(pSurface, &target, &targetRect);
+
+  if (hr == S_OK)
+  {
+    LONGLONG hnsFlipStart = m_pTimeline ? m_pTimeline->Start() : 0;
+
+    hr = m_pDevice->PresentEx(&target, &targetRect, m_hwnd, NULL, 0);
+    LOG_MSG_IF_FAILED(L"D3DPresentEngine::PresentSurface m_pDevice->PresentEx failed.", hr);
+
+    if (m_pTimeline)
+    {
+      m_pTimeline->End(FRAME_STAGE_FLIP, m_hnsTimelineSample, hnsFlipStart);
+    }
+  }
+
+  LOG_MSG_IF_FAILED(L"D3DPresentEngine::PresentSurface failed.", hr);
+
+  return hr;
+}
+
+//-----------------------------------------------------------------------------
+// RenderSurface
+//
+// Composites a video frame (and the subtitle, if any) into the back buffer,
+// without presenting it.
+//
+// pSurface:    Pointer to the surface.
+// pTarget:     Receives the source rectangle for PresentEx.
+// pTargetRect: Receives the destination rectangle for PresentEx.
+//
+// Returns S_FALSE if there is nothing to present.
+//-----------------------------------------------------------------------------
+
+HRESULT D3DPresentEngine::RenderSurface(IDirect3DSurface9* pSurface, LPRECT pTarget, LPRECT pTargetRect)
+{
   HRESULT hr = S_OK;
   RECT target, targetRect;
   UINT sampleCount = 1;
@@ -538,10 +682,6 @@ HRESULT D3DPresentEngine::PresentSurface(IDirect3DSurface9* pSurface)
     return E_FAIL;
   }
 
-  D3DSURFACE_DESC desc;
-  ZeroMemory(&desc, sizeof(desc));
-  hr = pSurface->GetDesc(&desc);
-
   //scope the lock just around rect retrival
   {
     // Race condition b/w presentation and the rectangle changing size
@@ -563,7 +703,7 @@ HRESULT D3DPresentEngine::PresentSurface(IDirect3DSurface9* pSurface)
     m_Sample[0].SrcSurface = pSurface;
 
     hr = m_pDevice->GetBackBuffer(0, 0, D3DBACKBUFFER_TYPE_MONO, &m_pRenderSurface);
-    LOG_MSG_IF_FAILED(L"D3DPresentEngine::PresentSurface m_pDevice->GetBackBuffer failed.", hr);
+    LOG_MSG_IF_FAILED(L"D3DPresentEngine::RenderSurface m_pDevice->GetBackBuffer failed.", hr);
     // process the surface
 
     if (SUCCEEDED(hr) && m_pRenderSurface)
@@ -611,27 +751,33 @@ HRESULT D3DPresentEngine::PresentSurface(IDirect3DSurface9* pSurface)
         sampleCount = 2;
       }
 
+      LONGLONG hnsBltStart = m_pTimeline ? m_pTimeline->Start() : 0;
+
       hr = m_pDXVAVP->VideoProcessBlt(m_pRenderSurface, &m_BltParams, m_Sample, sampleCount, NULL);
-      LOG_MSG_IF_FAILED(L"D3DPresentEngine::PresentSurface m_pDXVAVP->VideoProcessBlt failed.", hr);
+      LOG_MSG_IF_FAILED(L"D3DPresentEngine::RenderSurface m_pDXVAVP->VideoProcessBlt failed.", hr);
 			if (!SUCCEEDED(hr))
 			{
 				TRACE((L"Disable subtitle processing"));
 				m_bProcessSubs = false;
 				hr = m_pDXVAVP->VideoProcessBlt(m_pRenderSurface, &m_BltParams, m_Sample, 1, NULL);
-				LOG_MSG_IF_FAILED(L"D3DPresentEngine::PresentSurface m_pDXVAVP->VideoProcessBlt failed.", hr);
+				LOG_MSG_IF_FAILED(L"D3DPresentEngine::RenderSurface m_pDXVAVP->VideoProcessBlt failed.", hr);
 			}
+
+      if (m_pTimeline)
+      {
+        m_pTimeline->End(FRAME_STAGE_BLT, m_hnsTimelineSample, hnsBltStart);
+      }
     }
 
     SAFE_RELEASE(m_pRenderSurface);
 
-    if (SUCCEEDED(hr))
-    {
-      hr = m_pDevice->PresentEx(&target, &targetRect, m_hwnd, NULL, 0);
-      LOG_MSG_IF_FAILED(L"D3DPresentEngine::PresentSurface m_pDevice->PresentEx failed.", hr);
-    }
-
-    LOG_MSG_IF_FAILED(L"D3DPresentEngine::PresentSurface failed.", hr);
-  }  
+    *pTarget = target;
+    *pTargetRect = targetRect;
+  }
+  else
+  {
+    hr = S_FALSE;
+  }
 
   return hr;
 }
@@ -715,42 +861,47 @@ HRESULT D3DPresentEngine::PresentSample(IMFSample* pSample, LONGLONG llTarget, L
   IDirect3DSurface9* pSurface = NULL;
   IDirect3DSwapChain9* pSwapChain = NULL;
   MFTIME sampleDuration = 0;
-  BOOL currentSampleIsTooLate = FALSE;
+  RECT target, targetRect;
 
   m_FramesInQueue = remainingInQueue;
 
-  double lastDelta = m_AvgTimeDelta;
-  if (m_AvgTimeDelta == 0)
+  if (m_pTimeline && m_pTimeline->IsEnabled())
   {
-    m_AvgTimeDelta = timeDelta;
-  }
-  else
-  {
-    m_AvgTimeDelta = (m_AvgTimeDelta + timeDelta) / 2;
+    m_hnsTimelineSample = FrameTimeline::SampleTime(pSample);
   }
 
-  if (pSample != NULL && lastDelta > m_AvgTimeDelta && (lastDelta - m_AvgTimeDelta) > frameDurationDiv4)
-  {
-    //TRACE((L"PresentSample drop frame llTarget=%I64d timeDelta=%I64d remainingInQueue=%I64d frameDurationDiv4=%I64d lastDelta=%f m_AvgTimeDelta=%f\n", llTarget, timeDelta, remainingInQueue, frameDurationDiv4, lastDelta, m_AvgTimeDelta));
-    m_DroppedFrames++;
-    currentSampleIsTooLate = TRUE;
-  }
-  else
+  // If this sample is already in the back buffer, only the flip is left.
+  // Anything else overwrites the back buffer, so the ready frame is gone.
+  if (TakePreparedSample(pSample, &pSurface, &target, &targetRect))
   {
+    LONGLONG hnsFlipStart = m_pTimeline ? m_pTimeline->Start() : 0;
+
     m_GoodFrames++;
+
+    CHECK_HR(hr = m_pDevice->PresentEx(&target, &targetRect, m_hwnd, NULL, 0));
+
+    if (m_pTimeline)
+    {
+      m_pTimeline->End(FRAME_STAGE_FLIP, m_hnsTimelineSample, hnsFlipStart);
+    }
+
+    CopyComPointer(m_pSurfaceRepaint, pSurface);
+    goto done;
   }
 
-  if (pSample && (!currentSampleIsTooLate || !m_pSurfaceRepaint))
+  if (pSample)
   {
+    m_GoodFrames++;
+
     // Get the buffer from the sample.
     CHECK_HR(hr = pSample->GetBufferByIndex(0, &pBuffer));
 
     // Get the surface from the buffer.
     CHECK_HR(hr = MFGetService(pBuffer, MR_BUFFER_SERVICE, __uuidof(IDirect3DSurface9), (void**)&pSurface));
     CHECK_HR(hr = pSample->GetSampleDuration(&sampleDuration));
-    //TRACE((L"PresentSample llTarget=%I64d timeDelta=%I64d remainingInQueue=%I64d frameDurationDiv4=%I64d sampleDuration=%I64d lastDelta=%f m_AvgTimeDelta=%f", llTarget, timeDelta, remainingInQueue, frameDurationDiv4, sampleDuration, lastDelta, m_AvgTimeDelta));
+    //TRACE((L"PresentSample llTarget=%I64d timeDelta=%I64d remainingInQueue=%I64d frameDurationDiv4=%I64d sampleDuration=%I64d", llTarget, timeDelta, remainingInQueue, frameDurationDiv4, sampleDuration));
   }
-  else if (m_pSurfaceRepaint && !currentSampleIsTooLate)
+  else if (m_pSurfaceRepaint)
   {
     // Redraw from the last surface.
     pSurface = m_pSurfaceRepaint;
@@ -759,14 +910,7 @@ HRESULT D3DPresentEngine::PresentSample(IMFSample* pSample, LONGLONG llTarget, L
 
   if (pSurface)
   {
-    D3DSURFACE_DESC d;
-    CHECK_HR(hr = pSurface->GetDesc(&d));
-
-    m_SampleWidth = d.Width;
-    m_SampleHeight = d.Height;
-
-    m_Sample[0].SrcRect.right = d.Width;
-    m_Sample[0].SrcRect.bottom = d.Height;
+    CHECK_HR(hr = SetSourceSurface(pSurface));
 
     // Get the swap chain from the surface.
 //        CHECK_HR(hr = pSurface->GetContainer(__uuidof(IDirect3DSwapChain9), (LPVOID*)&pSwapChain));
@@ -811,6 +955,185 @@ done:
   return hr;
 }
 
+//-----------------------------------------------------------------------------
+// PrepareSample
+//
+// Present-ahead render stage. Composites the sample into the back buffer, 
+// to be flipped by the PresentSample call for the same sample. The ready 
+// frame keeps the subtitle that was current when it was rendered.
+//-----------------------------------------------------------------------------
+
+HRESULT D3DPresentEngine::PrepareSample(IMFSample* pSample)
+{
+  HRESULT hr = S_OK;
+  IDirect3DSurface9* pSurface = NULL;
+  RECT target, targetRect;
+
+  CheckPointer(pSample, E_POINTER);
+
+  DiscardPrepared();
+
+  if (m_pTimeline && m_pTimeline->IsEnabled())
+  {
+    m_hnsTimelineSample = FrameTimeline::SampleTime(pSample);
+  }
+
+  CHECK_HR(hr = GetSampleSurface(pSample, &pSurface));
+  CHECK_HR(hr = SetSourceSurface(pSurface));
+  CHECK_HR(hr = RenderSurface(pSurface, &target, &targetRect));
+
+  if (hr == S_OK)
+  {
+    AutoLock lock(m_ObjectLock);
+
+    m_pPreparedSample = pSample;
+    m_pPreparedSample->AddRef();
+    m_pPreparedSurface = pSurface;
+    m_pPreparedSurface->AddRef();
+    m_rcPreparedTarget = target;
+    m_rcPreparedDest = targetRect;
+  }
+
+done:
+  SAFE_RELEASE(pSurface);
+  return hr;
+}
+
+//-----------------------------------------------------------------------------
+// DiscardPrepared
+//
+// Forgets the frame rendered by PrepareSample.
+//-----------------------------------------------------------------------------
+
+void D3DPresentEngine::DiscardPrepared()
+{
+  AutoLock lock(m_ObjectLock);
+
+  SAFE_RELEASE(m_pPreparedSample);
+  SAFE_RELEASE(m_pPreparedSurface);
+}
+
+//-----------------------------------------------------------------------------
+// TakePreparedSample
+//
+// Returns TRUE (and the prepared surface and rectangles) if pSample is the 
+// sample in the back buffer and the destination rectangle has not changed 
+// since it was rendered. Either way, the prepared frame is forgotten.
+//-----------------------------------------------------------------------------
+
+BOOL D3DPresentEngine::TakePreparedSample(IMFSample* pSample, IDirect3DSurface9** ppSurface, LPRECT pTarget, LPRECT pTargetRect)
+{
+  AutoLock lock(m_ObjectLock);
+
+  BOOL bReady = (pSample != NULL && pSample == m_pPreparedSample && EqualRect(&m_rcPreparedDest, &m_rcDestRect));
+
+  if (bReady)
+  {
+    *ppSurface = m_pPreparedSurface;
+    m_pPreparedSurface = NULL;
+    *pTarget = m_rcPreparedTarget;
+    *pTargetRect = m_rcPreparedDest;
+  }
+
+  SAFE_RELEASE(m_pPreparedSample);
+  SAFE_RELEASE(m_pPreparedSurface);
+
+  return bReady;
+}
+
+//-----------------------------------------------------------------------------
+// GetSampleSurface
+//
+// Returns the Direct3D surface that holds a sample's video frame.
+//-----------------------------------------------------------------------------
+
+HRESULT D3DPresentEngine::GetSampleSurface(IMFSample* pSample, IDirect3DSurface9** ppSurface)
+{
+  HRESULT hr = S_OK;
+  IMFMediaBuffer* pBuffer = NULL;
+
+  CHECK_HR(hr = pSample->GetBufferByIndex(0, &pBuffer));
+  CHECK_HR(hr = MFGetService(pBuffer, MR_BUFFER_SERVICE, __uuidof(IDirect3DSurface9), (void**)ppSurface));
+
+done:
+  SAFE_RELEASE(pBuffer);
+  return hr;
+}
+
+//-----------------------------------------------------------------------------
+// SetSourceSurface
+//
+// Sets the source rectangle for the video processor from the surface size.
+//-----------------------------------------------------------------------------
+
+HRESULT D3DPresentEngine::SetSourceSurface(IDirect3DSurface9* pSurface)
+{
+  D3DSURFACE_DESC d;
+  HRESULT hr = pSurface->GetDesc(&d);
+
+  if (SUCCEEDED(hr))
+  {
+    m_SampleWidth = d.Width;
+    m_SampleHeight = d.Height;
+
+    m_Sample[0].SrcRect.right = d.Width;
+    m_Sample[0].SrcRect.bottom = d.Height;
+  }
+  return hr;
+}
+
+//-----------------------------------------------------------------------------
+// OnSampleDropped
+//
+// Called by the scheduler instead of PresentSample when its frame-drop policy
+// discards a sample. The previous frame stays on screen.
+//-----------------------------------------------------------------------------
+
+void D3DPresentEngine::OnSampleDropped(IMFSample* pSample, LONGLONG llTarget, LONGLONG timeDelta, LONGLONG remainingInQueue)
+{
+  //TRACE((L"OnSampleDropped llTarget=%I64d timeDelta=%I64d remainingInQueue=%I64d", llTarget, timeDelta, remainingInQueue));
+  m_FramesInQueue = remainingInQueue;
+  m_DroppedFrames++;
+}
+
+//-----------------------------------------------------------------------------
+// GetTimeSinceVsync
+//
+// Estimates how long ago the current vertical blank started, from the 
+// position of the raster. Used by the scheduler to phase-lock to the display.
+//-----------------------------------------------------------------------------
+
+HRESULT D3DPresentEngine::GetTimeSinceVsync(LONGLONG *phnsSinceVsync)
+{
+  CheckPointer(phnsSinceVsync, E_POINTER);
+
+  HRESULT hr = S_OK;
+  D3DRASTER_STATUS status;
+
+  AutoLock lock(m_ObjectLock);
+
+  if (m_pDevice == NULL || m_DisplayMode.RefreshRate == 0 || m_DisplayMode.Height == 0)
+  {
+    return MF_E_NOT_INITIALIZED;
+  }
+
+  CHECK_HR(hr = m_pDevice->GetRasterStatus(0, &status));
+
+  if (status.InVBlank)
+  {
+    *phnsSinceVsync = 0;
+  }
+  else
+  {
+    // The scan line runs from 0 to the height of the display during the 
+    // active part of each refresh interval. (The blanking period is ignored.)
+    *phnsSinceVsync = (LONGLONG)status.ScanLine * 10000000 / ((LONGLONG)m_DisplayMode.Height * m_DisplayMode.RefreshRate);
+  }
+
+done:
+  return hr;
+}
+
 
 
 //-----------------------------------------------------------------------------
@@ -965,6 +1288,9 @@ HRESULT D3DPresentEngine::CreateD3DDevice()
   // Reset the D3DDeviceManager with the new device 
   CHECK_HR(hr = m_pDeviceManager->ResetDevice(pDevice, m_DeviceResetToken));
 
+  // Subtitle surfaces belong to the old device.
+  m_SubSurfaces.Clear();
+
   SAFE_RELEASE(m_pDXVAVPS);
   SAFE_RELEASE(m_pDXVAVP);
 
@@ -51,7 +51,9 @@
  //-----------------------------------------------------------------------------
 
 #define MSDK_MEMCPY_VAR(dstVarName, src, count) memcpy_s(&(dstVarName), sizeof(dstVarName), (src), (count))
-const DWORD PRESENTER_BUFFER_COUNT = 3;
+const DWORD PRESENTER_BUFFER_COUNT = 3;         // Default samples allocated for a new format.
+const DWORD PRESENTER_MAX_BUFFER_COUNT = 12;    // Upper limit as the jitter buffer grows.
+static_assert(PRESENTER_MAX_BUFFER_COUNT <= SAMPLE_POOL_SIZE, "The sample pool must hold every sample");
 
 #define MSDK_ALIGN16(value)                      (((value + 15) >> 4) << 4) // round up to a multiple of 16
 #define MSDK_ALIGN32(value)                      (((value + 31) >> 5) << 5) // round up to a multiple of 32
@@ -74,7 +76,7 @@ const BYTE DEFAULT_PLANAR_ALPHA_VALUE = 0xFF;
 extern "C" const GUID __declspec(selectany) DXVA2_VideoProcProgressiveDevice =
 { 0x5a54a0c9, 0xc7ec, 0x4bd9,{ 0x8e, 0xde, 0xf3, 0xc7, 0x5d, 0xc4, 0x39, 0x3b } };
 
-class D3DPresentEngine : public SchedulerCallback
+class D3DPresentEngine : public SchedulerCallback, public SampleAllocator, public SubSurfaceAllocator
 {
 public:
 
@@ -105,11 +107,24 @@ public:
   HRESULT SetDestinationRect(const RECT& rcDest);
   RECT    GetDestinationRect() const { return m_rcDestRect; };
 
-  HRESULT CreateVideoSamples(IMFMediaType *pFormat, VideoSampleList& videoSampleQueue);
+  HRESULT CreateVideoSamples(IMFMediaType *pFormat, VideoSampleList& videoSampleQueue, DWORD cSamples);
+  HRESULT CreateVideoSample(IMFSample **ppSample, DWORD *pcbSurface);
+  DWORD   ReleaseVideoSample(IMFSample *pSample);
+  DWORD   SurfaceBytes() const { return m_nSurfaceWidth * m_nSurfaceHeight * 4; }
   void    ReleaseResources();
 
   HRESULT CheckDeviceState(DeviceState *pState);
   HRESULT PresentSample(IMFSample* pSample, LONGLONG llTarget, LONGLONG timeDelta, LONGLONG remainingInQueue, LONGLONG frameDurationDiv4);
+  void    OnSampleDropped(IMFSample* pSample, LONGLONG llTarget, LONGLONG timeDelta, LONGLONG remainingInQueue);
+  HRESULT GetTimeSinceVsync(LONGLONG *phnsSinceVsync);
+  HRESULT PrepareSample(IMFSample* pSample);
+  void    DiscardPrepared();
+
+  // Stage timeline for the blt and flip spans; not owned.
+  void    SetTimeline(FrameTimeline *pTimeline) { m_pTimeline = pTimeline; }
+
+  DWORD   FramesPresented() const { return m_GoodFrames; }
+  DWORD   FramesDropped() const { return m_DroppedFrames; }
 
   UINT    RefreshRate() const { return m_DisplayMode.RefreshRate; }
   UINT    Width() const { return m_DisplayMode.Width; }
@@ -130,6 +145,11 @@ public:
       else
         return E_INVALIDARG;
       break;
+    case EVRCP_SETTING_SUBTITLE_MEMORY_CAP:
+      if (value <= 0)
+        return E_INVALIDARG;
+      hr = m_SubSurfaces.SetMemoryCap((DWORD)value);
+      break;
     default:
       hr = E_NOTIMPL;
       break;
@@ -144,6 +164,12 @@ public:
     case EVRCP_SETTING_POSITION_OFFSET:
       *value = m_iPositionOffset;
       break;
+    case EVRCP_SETTING_SUBTITLE_MEMORY_CAP:
+      *value = (int)m_SubSurfaces.GetMemoryCap();
+      break;
+    case EVRCP_SETTING_SUBTITLE_MEMORY:
+      *value = (int)(m_SubSurfaces.Bytes() / 1024);
+      break;
     default:
       hr = E_NOTIMPL;
       break;
@@ -188,6 +214,7 @@ public:
   void SetSubtitle(IDirect3DSurface9 *pSurfaceSubtitle, const RECT& src, const RECT& dst) {
     AutoLock lock(m_SubtitleLock);
 
+    m_SubSurfaces.ReturnSurface(m_pSurfaceSubtitle);
     SAFE_RELEASE(m_pSurfaceSubtitle);
     if (pSurfaceSubtitle)
     {
@@ -197,11 +224,31 @@ public:
     }
   }
 
+  // GetSubSurface: Returns a pooled surface of at least Width x Height for a
+  // subtitle bitmap. Pass it to SetSubtitle, which keeps the reference and 
+  // recycles the previous surface; if it is not used, return it with
+  // ReturnSubSurface and release it.
+  HRESULT GetSubSurface(UINT Width, UINT Height, IDirect3DSurface9** ppSurface)
+  {
+    return m_SubSurfaces.GetSurface(Width, Height, ppSurface);
+  }
+
+  void ReturnSubSurface(IDirect3DSurface9* pSurface)
+  {
+    m_SubSurfaces.ReturnSurface(pSurface);
+  }
+
+  // SubSurfaceAllocator
   HRESULT CreateSubSurface(UINT Width, UINT Height, IDirect3DSurface9** ppSurface)
   {
     return CreateSurface(Width, Height, m_VideoSubFormat, ppSurface);
   }
 
+  DWORD SubSurfaceBytes(UINT Width, UINT Height)
+  {
+    return Width * Height * 4;  // m_VideoSubFormat is D3DFMT_A8R8G8B8.
+  }
+
 
 protected:
   HRESULT InitializeD3D();
@@ -215,6 +262,10 @@ protected:
   virtual void    OnReleaseResources() { }
 
   virtual HRESULT PresentSurface(IDirect3DSurface9* pSurface);
+  virtual HRESULT RenderSurface(IDirect3DSurface9* pSurface, LPRECT pTarget, LPRECT pTargetRect);
+  HRESULT SetSourceSurface(IDirect3DSurface9* pSurface);
+  HRESULT GetSampleSurface(IMFSample* pSample, IDirect3DSurface9** ppSurface);
+  BOOL    TakePreparedSample(IMFSample* pSample, IDirect3DSurface9** ppSurface, LPRECT pTarget, LPRECT pTargetRect);
   virtual HRESULT PresentSwapChain(IDirect3DSwapChain9* pSwapChain, IDirect3DSurface9* pSurface);
   virtual void    PaintFrameWithGDI();
   virtual void    BlackBackBuffer();
@@ -242,11 +293,11 @@ protected:
   IDirect3DDeviceManager9     *m_pDeviceManager;        // Direct3D device manager.
   IDirect3DSurface9           *m_pSurfaceRepaint;       // Surface for repaint requests.
   IDirect3DSurface9           *m_pSurfaceSubtitle;       // Surface for repaint requests.
+  SubSurfacePool              m_SubSurfaces;            // Recycles subtitle surfaces.
 
   int m_DroppedFrames;
   int m_GoodFrames;
   int m_FramesInQueue;
-  double m_AvgTimeDelta;
 
   // various structures for DXVA2 calls
   DXVA2_VideoDesc                 m_VideoDesc;
@@ -256,7 +307,20 @@ protected:
   IDirectXVideoProcessorService   *m_pDXVAVPS;            // Service required to create video processors
   IDirectXVideoProcessor          *m_pDXVAVP;
   IDirect3DSurface9               *m_pRenderSurface;      // The surface which is passed to render
-  IDirect3DSurface9               *m_pMixerSurfaces[PRESENTER_BUFFER_COUNT]; // The surfaces, which are used by mixer
+  IDirect3DSurface9               *m_pMixerSurfaces[PRESENTER_MAX_BUFFER_COUNT]; // The surfaces, which are used by mixer
+  DWORD                           m_cMixerSurfaces;
+
+  // Present-ahead: the sample rendered into the back buffer by PrepareSample,
+  // waiting to be flipped. Protected by m_ObjectLock.
+  IMFSample                       *m_pPreparedSample;
+  IDirect3DSurface9               *m_pPreparedSurface;
+  RECT                            m_rcPreparedTarget;    // Rectangles to pass to PresentEx.
+  RECT                            m_rcPreparedDest;
+
+  FrameTimeline                   *m_pTimeline;
+  LONGLONG                        m_hnsTimelineSample;   // Time stamp of the frame being rendered, for the timeline.
+  UINT                            m_nSurfaceWidth;
+  UINT                            m_nSurfaceHeight;
   DXVA2_VideoProcessorCaps        m_VPCaps = { 0 };
 
 private: // disallow copy and assign
@@ -0,0 +1,263 @@
+/*
+ *      Copyright (C) 2014 Andrew Van Til
+ *      http://babgvant.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "stdafx.h"
+#include "EVRPresenter.h"
+
+// How far (in slots) a frame's due time may drift from its ideal slot before
+// the cadence is moved.
+const double PLANNER_RESYNC_SLOTS = 0.75;
+
+// Observed vsyncs further than this fraction of a refresh interval from the
+// prediction are treated as outliers.
+const LONGLONG PLANNER_VSYNC_OUTLIER_DIV = 4;
+
+// Loop gains for the phase and the interval. (Divisors.)
+const LONGLONG PLANNER_PHASE_GAIN = 8;
+const LONGLONG PLANNER_FREQ_GAIN = 4;
+
+// Longest gap between observed vsyncs that still updates the interval.
+const LONGLONG PLANNER_MAX_VSYNC_GAP = 10000000;   // 1 second
+
+PresentPlanner::PresentPlanner() :
+  m_hnsNominalRefresh(0),
+  m_hnsRefresh(0),
+  m_hnsVsync(0),
+  m_bVsyncValid(FALSE),
+  m_bVsyncObserved(FALSE),
+  m_hnsFrameInterval(0)
+{
+  ResetCadence();
+}
+
+//-----------------------------------------------------------------------------
+// Reset
+//
+// Forgets the cadence, for example after a flush. The refresh estimate is 
+// kept.
+//-----------------------------------------------------------------------------
+
+void PresentPlanner::Reset()
+{
+  ResetCadence();
+}
+
+void PresentPlanner::ResetCadence()
+{
+  m_bCadenceLocked = FALSE;
+  m_dIdealSlot = 0;
+  m_llSlotBase = 0;
+  m_cCadenceErrors = 0;
+  m_hnsFirstPlanned = 0;
+  m_hnsLastPlanned = 0;
+}
+
+//-----------------------------------------------------------------------------
+// SetRefreshRate
+//
+// Sets the nominal refresh rate of the display, in Hz. Zero disables the 
+// planner.
+//-----------------------------------------------------------------------------
+
+void PresentPlanner::SetRefreshRate(UINT uRefreshRate)
+{
+  LONGLONG hnsRefresh = (uRefreshRate > 1 ? 10000000 / uRefreshRate : 0);
+
+  if (hnsRefresh != m_hnsNominalRefresh)
+  {
+    m_hnsNominalRefresh = hnsRefresh;
+    m_hnsRefresh = hnsRefresh;
+    m_bVsyncValid = FALSE;
+    m_bVsyncObserved = FALSE;
+    ResetCadence();
+  }
+}
+
+void PresentPlanner::SetFrameInterval(LONGLONG hnsFrameInterval)
+{
+  if (hnsFrameInterval != m_hnsFrameInterval)
+  {
+    m_hnsFrameInterval = hnsFrameInterval;
+    ResetCadence();
+  }
+}
+
+//-----------------------------------------------------------------------------
+// OnVsync
+//
+// Feeds an observed vsync time into the phase-locked loop.
+//-----------------------------------------------------------------------------
+
+void PresentPlanner::OnVsync(LONGLONG hnsVsyncTime)
+{
+  if (m_hnsNominalRefresh == 0)
+  {
+    return;
+  }
+
+  if (!m_bVsyncValid || !m_bVsyncObserved)
+  {
+    // First real vsync. A free-running guess can be off by more than the
+    // outlier limit, so take the phase as is.
+    m_hnsVsync = hnsVsyncTime;
+    m_bVsyncValid = TRUE;
+    m_bVsyncObserved = TRUE;
+    return;
+  }
+
+  LONGLONG hnsElapsed = hnsVsyncTime - m_hnsVsync;
+  LONGLONG llCount = (hnsElapsed + m_hnsRefresh / 2) / m_hnsRefresh;
+  if (hnsElapsed < 0)
+  {
+    llCount = (hnsElapsed - m_hnsRefresh / 2) / m_hnsRefresh;
+  }
+
+  LONGLONG hnsError = hnsVsyncTime - (m_hnsVsync + llCount * m_hnsRefresh);
+
+  if (_abs64(hnsError) > m_hnsRefresh / PLANNER_VSYNC_OUTLIER_DIV)
+  {
+    return;
+  }
+
+  // Correct the interval, spreading the error over the elapsed vsyncs.
+  if (llCount > 0 && hnsElapsed < PLANNER_MAX_VSYNC_GAP)
+  {
+    m_hnsRefresh += hnsError / (llCount * PLANNER_FREQ_GAIN);
+
+    // Stay within 1% of the nominal rate.
+    LONGLONG hnsLimit = m_hnsNominalRefresh / 100;
+    if (m_hnsRefresh > m_hnsNominalRefresh + hnsLimit)
+    {
+      m_hnsRefresh = m_hnsNominalRefresh + hnsLimit;
+    }
+    else if (m_hnsRefresh < m_hnsNominalRefresh - hnsLimit)
+    {
+      m_hnsRefresh = m_hnsNominalRefresh - hnsLimit;
+    }
+  }
+
+  // Move the phase reference up to this vsync, correcting part of the error.
+  m_hnsVsync += llCount * m_hnsRefresh + hnsError / PLANNER_PHASE_GAIN;
+}
+
+//-----------------------------------------------------------------------------
+// PlanFrame
+//
+// Assigns the next frame to a vsync slot. Call once per frame, in 
+// presentation order.
+//
+// hnsDueTime: System time when the frame is due according to its time stamp.
+//
+// Returns the system time of the vsync at which the frame should appear.
+//-----------------------------------------------------------------------------
+
+LONGLONG PresentPlanner::PlanFrame(LONGLONG hnsDueTime)
+{
+  if (!IsActive())
+  {
+    return hnsDueTime;
+  }
+
+  if (!m_bVsyncValid)
+  {
+    // No vsync observed yet. Free-run from the first frame.
+    m_hnsVsync = hnsDueTime;
+    m_bVsyncValid = TRUE;
+  }
+
+  double dRatio = (double)m_hnsFrameInterval / m_hnsRefresh;
+  LONGLONG llSlot = 0;
+
+  if (!m_bCadenceLocked)
+  {
+    m_llSlotBase = m_hnsVsync;
+    m_dIdealSlot = (double)(hnsDueTime - m_llSlotBase) / m_hnsRefresh;
+    m_hnsFirstPlanned = hnsDueTime;
+    m_bCadenceLocked = TRUE;
+
+    llSlot = (LONGLONG)floor(m_dIdealSlot + 0.5);
+  }
+  else
+  {
+    // Snap the slot base onto the current vsync estimate, so that phase 
+    // corrections from OnVsync move the whole cadence.
+    LONGLONG hnsOffset = m_llSlotBase - m_hnsVsync;
+    LONGLONG llSlots = (LONGLONG)floor((double)hnsOffset / m_hnsRefresh + 0.5);
+    m_llSlotBase = m_hnsVsync + llSlots * m_hnsRefresh;
+
+    // Where the frame would land by its time stamp, and where the cadence
+    // puts it. Both are measured from the same vsync, using the current 
+    // refresh estimate.
+    double dActual = (double)(hnsDueTime - m_llSlotBase) / m_hnsRefresh;
+    double dIdeal = m_dIdealSlot + dRatio;
+    double dDrift = dActual - dIdeal;
+
+    BOOL bBroken = FALSE;
+
+    if (fabs(dDrift) > PLANNER_RESYNC_SLOTS)
+    {
+      // Move the cadence by whole slots, keeping its phase. This repeats or
+      // skips a vsync.
+      dIdeal += floor(dDrift + 0.5);
+      bBroken = TRUE;
+    }
+
+    m_dIdealSlot = dIdeal;
+    llSlot = (LONGLONG)floor(m_dIdealSlot + 0.5);
+
+    // A stable cadence only ever steps by floor(ratio) or ceil(ratio) slots.
+    // (The last frame's slot is slot 0.)
+    if (llSlot < (LONGLONG)floor(dRatio) || llSlot > (LONGLONG)ceil(dRatio))
+    {
+      bBroken = TRUE;
+    }
+
+    if (bBroken)
+    {
+      m_cCadenceErrors++;
+    }
+  }
+
+  // Keep the numbers small: re-base on the assigned slot.
+  m_llSlotBase += llSlot * m_hnsRefresh;
+  m_dIdealSlot -= llSlot;
+
+  m_hnsLastPlanned = hnsDueTime;
+
+  return m_llSlotBase;
+}
+
+//-----------------------------------------------------------------------------
+// CadenceErrorsPerMinute
+//
+// Returns the cadence error rate since the cadence was last reset.
+//-----------------------------------------------------------------------------
+
+DWORD PresentPlanner::CadenceErrorsPerMinute() const
+{
+  LONGLONG hnsElapsed = m_hnsLastPlanned - m_hnsFirstPlanned;
+
+  // Don't extrapolate from less than a second of playback.
+  if (hnsElapsed < 10000000)
+  {
+    return 0;
+  }
+
+  return (DWORD)((LONGLONG)m_cCadenceErrors * 600000000 / hnsElapsed);
+}
@@ -0,0 +1,80 @@
+/*
+ *      Copyright (C) 2014 Andrew Van Til
+ *      http://babgvant.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// PresentPlanner class
+//
+// Assigns each frame to a vsync slot of the display, so that frames whose
+// rate does not match the refresh rate get a stable pulldown cadence (for 
+// example 3:2 for 23.976 fps on a 60 Hz display) instead of slipping between
+// slots at random.
+//
+// The planner keeps an estimate of the refresh interval and of the time of a
+// recent vsync. Both start from the nominal refresh rate and are refined by a
+// phase-locked loop from observed vsync times (OnVsync).
+//
+// Frames are placed on an ideal slot position that advances by exactly 
+// (frame interval / refresh interval) per frame, and rounded to a whole slot.
+// Only when the frame's due time drifts more than PLANNER_RESYNC_SLOTS away 
+// from that position (clock drift, discontinuity) does the planner move the
+// position by whole slots, which is counted as a cadence error.
+//
+// All times are system times in 100-nanosecond units.
+//-----------------------------------------------------------------------------
+
+class PresentPlanner
+{
+public:
+  PresentPlanner();
+
+  void Reset();
+
+  void SetRefreshRate(UINT uRefreshRate);
+  void SetFrameInterval(LONGLONG hnsFrameInterval);
+
+  void OnVsync(LONGLONG hnsVsyncTime);
+
+  BOOL IsActive() const { return m_hnsNominalRefresh > 0 && m_hnsFrameInterval > 0; }
+  LONGLONG RefreshInterval() const { return m_hnsRefresh; }
+
+  LONGLONG PlanFrame(LONGLONG hnsDueTime);
+
+  DWORD CadenceErrors() const { return m_cCadenceErrors; }
+  DWORD CadenceErrorsPerMinute() const;
+
+private:
+  void ResetCadence();
+
+  LONGLONG    m_hnsNominalRefresh;    // From the display mode.
+  LONGLONG    m_hnsRefresh;           // Estimated refresh interval.
+  LONGLONG    m_hnsVsync;             // Estimated time of a recent vsync.
+  BOOL        m_bVsyncValid;
+  BOOL        m_bVsyncObserved;       // m_hnsVsync came from OnVsync, not a free-running guess.
+  LONGLONG    m_hnsFrameInterval;
+
+  BOOL        m_bCadenceLocked;
+  double      m_dIdealSlot;           // Ideal slot of the last frame, relative to m_llSlotBase.
+  LONGLONG    m_llSlotBase;           // Vsync assigned to the last frame.
+
+  DWORD       m_cCadenceErrors;
+  LONGLONG    m_hnsFirstPlanned;      // Due time of the first planned frame.
+  LONGLONG    m_hnsLastPlanned;       // Due time of the last planned frame.
+};
@@ -214,6 +214,10 @@ HRESULT EVRCustomPresenter::QueryInterface(REFIID riid, void ** ppv)
   {
     *ppv = static_cast<IEVRCPConfig*>(this);
   }
+  else if (riid == __uuidof(IEVRCPStats))
+  {
+    *ppv = static_cast<IEVRCPStats*>(this);
+  }
   else if (riid == __uuidof(IEVRTrustedVideoPlugin))
   {
     *ppv = static_cast<IEVRTrustedVideoPlugin*>(this);
@@ -631,6 +635,7 @@ HRESULT EVRCustomPresenter::OnClockStart(MFTIME hnsSystemTime, LONGLONG llClockS
   CHECK_HR(hr = CheckShutdown());
 
   m_RenderState = RENDER_STATE_STARTED;
+  m_scheduler.SetClockRunning(TRUE);
 
   // Check if the clock is already active (not stopped). 
   if (IsActive())
@@ -678,6 +683,7 @@ HRESULT EVRCustomPresenter::OnClockRestart(MFTIME hnsSystemTime)
   assert(m_RenderState == RENDER_STATE_PAUSED);
 
   m_RenderState = RENDER_STATE_STARTED;
+  m_scheduler.SetClockRunning(TRUE);
 
   // Possibly we are in the middle of frame-stepping OR we have samples waiting 
   // in the frame-step queue. Deal with these two cases first:
@@ -709,6 +715,7 @@ HRESULT EVRCustomPresenter::OnClockStop(MFTIME hnsSystemTime)
   if (m_RenderState != RENDER_STATE_STOPPED)
   {
     m_RenderState = RENDER_STATE_STOPPED;
+    m_scheduler.SetClockRunning(FALSE);
     Flush();
 
     // If we are in the middle of frame-stepping, cancel it now.
@@ -739,8 +746,9 @@ HRESULT EVRCustomPresenter::OnClockPause(MFTIME hnsSystemTime)
   // We cannot pause the clock after shutdown.
   CHECK_HR(hr = CheckShutdown());
 
-  // Set the state. (No other actions are necessary.)
+  // Set the state. The scheduler's clock tracker stops extrapolating.
   m_RenderState = RENDER_STATE_PAUSED;
+  m_scheduler.SetClockRunning(FALSE);
 
 done:
   return hr;
@@ -1136,7 +1144,7 @@ EVRCustomPresenter::EVRCustomPresenter(HRESULT& hr) :
   , m_bEndStreaming(FALSE)
   , m_bPrerolled(FALSE)
   , m_fRate(1.0f)
-  , m_TokenCounter(0)
+  , m_PoolSizer(&m_SamplePool)
   , m_SampleFreeCB(this, &EVRCustomPresenter::OnSampleFree)
   /*	, m_iWidth(0)
     , m_iHeight(0)*/
@@ -1161,6 +1169,7 @@ EVRCustomPresenter::EVRCustomPresenter(HRESULT& hr) :
   , m_rtTimePerFrame(0)
   , m_pEvr(NULL)
   , m_bCorrectAR(true)
+  , m_bRankMixerTypes(false)
 {
   hr = S_OK;
 
@@ -1168,6 +1177,9 @@ EVRCustomPresenter::EVRCustomPresenter(HRESULT& hr) :
   ZeroMemory(&m_VideoAR, sizeof(m_VideoAR));
   ZeroMemory(&context, sizeof(context));
 
+  // Frame-stepping queues a sample per step; reuse the list nodes.
+  m_FrameStep.samples.SetNodeCache(PRESENTER_MAX_BUFFER_COUNT);
+
   TCHAR szFilename[MAX_PATH + 1] = { 0 };
   int major;
   int minor;
@@ -1211,6 +1223,8 @@ EVRCustomPresenter::EVRCustomPresenter(HRESULT& hr) :
   CHECK_HR(hr);
 
   m_scheduler.SetCallback(m_pD3DPresentEngine);
+  m_PoolSizer.SetAllocator(m_pD3DPresentEngine);
+  m_pD3DPresentEngine->SetTimeline(m_scheduler.GetTimeline());
 
 done:
   if (FAILED(hr))
@@ -1371,9 +1385,10 @@ STDMETHODIMP EVRCustomPresenter::DeliverFrame(REFERENCE_TIME start, REFERENCE_TI
 
             if (SUCCEEDED(hr = subtitleFrame->GetClipRect(&clipRect)))
             {
-              IDirect3DSurface9   * pSurface;
+              IDirect3DSurface9   * pSurface = NULL;
 
-              if (SUCCEEDED(hr = m_pD3DPresentEngine->CreateSubSurface(sz.cx, sz.cy, &pSurface)))
+              // The pooled surface can be larger than the bitmap; only srcRect is filled and shown.
+              if (SUCCEEDED(hr = m_pD3DPresentEngine->GetSubSurface(sz.cx, sz.cy, &pSurface)))
               {
                 RECT srcRect = { 0, 0, sz.cx, sz.cy };
                 D3DLOCKED_RECT lkRect;
@@ -1429,13 +1444,20 @@ STDMETHODIMP EVRCustomPresenter::DeliverFrame(REFERENCE_TIME start, REFERENCE_TI
                     TRACE((L"SetSubtitle: Src t: %d b: %d l: %d r: %d Dst  t: %d b: %d l: %d r: %d", srcRect.top, srcRect.bottom, srcRect.left, srcRect.right, dstRect.top, dstRect.bottom, dstRect.left, dstRect.right));
 
                     m_pD3DPresentEngine->SetSubtitle(pSurface, srcRect, dstRect);
+                    pSurface = NULL;
                     m_bSubtitleSet = true;
 
                     m_lastSubtitleId = id;
                   }
                 }
               }
-              //SAFE_RELEASE(pSurface);
+
+              // SetSubtitle keeps the surface. If it was not reached, recycle it.
+              if (pSurface)
+              {
+                m_pD3DPresentEngine->ReturnSubSurface(pSurface);
+                SAFE_RELEASE(pSurface);
+              }
             }
           }
         }
@@ -1804,10 +1826,50 @@ HRESULT GetMediaTypeMerit(IMFMediaType* pType, int* pMerit)
   return hr;
 }
 
+// Mixer output type with its merit, for ranking.
+struct RankedMediaType
+{
+  IMFMediaType *pType;
+  int           merit;
+};
+
+// Orders ranked types by descending merit.
+static bool HigherMerit(const RankedMediaType& a, const RankedMediaType& b)
+{
+  return a.merit > b.merit;
+}
+
+//-----------------------------------------------------------------------------
+// AddRankedMediaType
+//
+// Inserts a type into a list sorted by merit, after any type of equal merit
+// so that the mixer's order breaks ties. The list holds a reference.
+//-----------------------------------------------------------------------------
+
+static HRESULT AddRankedMediaType(IndexedList<RankedMediaType> *pTypes, IMFMediaType *pType)
+{
+  RankedMediaType ranked = { pType, 0 };
+
+  HRESULT hr = GetMediaTypeMerit(pType, &ranked.merit);
+  if (SUCCEEDED(hr))
+  {
+    hr = pTypes->InsertAt(pTypes->UpperBound(ranked, HigherMerit), ranked);
+  }
+  if (SUCCEEDED(hr))
+  {
+    pType->AddRef();
+  }
+  return hr;
+}
+
 //-----------------------------------------------------------------------------
 // RenegotiateMediaType
 //
 // Attempts to set an output type on the mixer.
+//
+// By default the first type that works is used. With mixer type ranking on,
+// every type the mixer accepts is collected and they are tried in order of
+// merit.
 //-----------------------------------------------------------------------------
 
 HRESULT EVRCustomPresenter::RenegotiateMediaType()
@@ -1827,7 +1889,7 @@ HRESULT EVRCustomPresenter::RenegotiateMediaType()
     return MF_E_INVALIDREQUEST;
   }
 
-  List<IMFMediaType*> ValidMixerTypes;
+  IndexedList<RankedMediaType> ValidMixerTypes;
 
   // Get the mixer's input type
 //  hr = m_pMixer->GetInputCurrentType(0, &pType);
@@ -1881,6 +1943,16 @@ HRESULT EVRCustomPresenter::RenegotiateMediaType()
       hr = m_pMixer->SetOutputType(0, pOptimalType, MFT_SET_TYPE_TEST_ONLY);
     }
 
+    // With ranking on, keep the type and pick one after the mixer runs out.
+    if (m_bRankMixerTypes)
+    {
+      if (SUCCEEDED(hr))
+      {
+        hr = AddRankedMediaType(&ValidMixerTypes, pOptimalType);
+      }
+      SAFE_RELEASE(pOptimalType);
+      continue;
+    }
 
     // Step 5. Try to set the media type on ourselves.
     if (SUCCEEDED(hr))
@@ -1906,31 +1978,6 @@ HRESULT EVRCustomPresenter::RenegotiateMediaType()
       {
         SetMediaType(NULL);
       }
-
-
-      /*int Merit = 0;
-      if (SUCCEEDED(hr)) {
-        hr = GetMediaTypeMerit(pOptimalType, &Merit);
-      }
-
-      if (SUCCEEDED(hr)) {
-        size_t nTypes = ValidMixerTypes.GetCount();
-        size_t iInsertPos = 0;
-        for (size_t i = 0; i < nTypes; ++i) {
-          int ThisMerit;
-
-          GetMediaTypeMerit(ValidMixerTypes.ItemAt(i), &ThisMerit);
-
-          if (Merit > ThisMerit) {
-            iInsertPos = i;
-            break;
-          } else {
-            iInsertPos = i + 1;
-          }
-        }
-
-        ValidMixerTypes.InsertAt(iInsertPos, pOptimalType);
-      }*/
     }
 
 
@@ -1943,34 +1990,33 @@ HRESULT EVRCustomPresenter::RenegotiateMediaType()
 
   //TODO: set input video frame size and recreate VPP
 
-  //DWORD nValidTypes = ValidMixerTypes.GetCount();
-
-  //for (size_t i = 0; i < nValidTypes; ++i) {
-  //	pOptimalType = NULL;
- //       // Step 3. Adjust the mixer's type to match our requirements.
- //       pOptimalType = ValidMixerTypes.ItemAt(i);
+  // Try the ranked types, best first.
+  for (DWORD i = 0; !bFoundMediaType && i < ValidMixerTypes.GetCount(); i++)
+  {
+    IMFMediaType *pRankedType = ValidMixerTypes.ItemAt(i).pType;
 
- //       // Step 5. Try to set the media type on ourselves.
- //       hr = SetMediaType(pOptimalType);
+    hr = SetMediaType(pRankedType);
+    if (SUCCEEDED(hr))
+    {
+      hr = m_pMixer->SetOutputType(0, pRankedType, 0);
 
- //       // Step 6. Set output media type on mixer.
- //       if (SUCCEEDED(hr)) {
- //           hr = m_pMixer->SetOutputType(0, pOptimalType, 0);
+      // If something went wrong, clear the media type.
+      if (FAILED(hr))
+      {
+        SetMediaType(NULL);
+      }
+    }
 
- //           // If something went wrong, clear the media type.
- //           if (FAILED(hr)) {
- //               SetMediaType(nullptr);
- //           } else {
- //               break;
- //           }
- //       }
- //   }
+    if (SUCCEEDED(hr))
+    {
+      bFoundMediaType = TRUE;
+    }
+  }
 
-  //while (ValidMixerTypes.GetCount() > 0)
-  //{
-  //	ValidMixerTypes.GetFront(&pOptimalType);
-  //	SAFE_RELEASE(pOptimalType);
-  //}
+  for (DWORD i = 0; i < ValidMixerTypes.GetCount(); i++)
+  {
+    ValidMixerTypes.ItemAt(i).pType->Release();
+  }
 
   SAFE_RELEASE(pMixerType);
   SAFE_RELEASE(pOptimalType);
@@ -1994,7 +2040,7 @@ HRESULT EVRCustomPresenter::Flush()
   // The scheduler might have samples that are waiting for
   // their presentation time. Tell the scheduler to flush.
 
-  // This call blocks until the scheduler threads discards all scheduled samples.
+  // This call does not block. Samples scheduled before it are not presented.
   m_scheduler.Flush();
 
   // Flush the frame-step queue.
@@ -2612,9 +2658,7 @@ HRESULT EVRCustomPresenter::SetMediaType(IMFMediaType *pMediaType)
   HRESULT hr = S_OK;
   MFRatio fps = { 0, 0 };
   VideoSampleList sampleQueue;
-
-
-  IMFSample *pSample = NULL;
+  DWORD cSamples = 0;
 
   // Cannot set the media type after shutdown.
   CHECK_HR(hr = CheckShutdown());
@@ -2633,26 +2677,13 @@ HRESULT EVRCustomPresenter::SetMediaType(IMFMediaType *pMediaType)
   // Initialize the presenter engine with the new media type.
   // The presenter engine allocates the samples. 
 
-  CHECK_HR(hr = m_pD3DPresentEngine->CreateVideoSamples(pMediaType, sampleQueue));
-
-  // Mark each sample with our token counter. If this batch of samples becomes
-  // invalid, we increment the counter, so that we know they should be discarded. 
-  for (VideoSampleList::POSITION pos = sampleQueue.FrontPosition();
-  pos != sampleQueue.EndPosition();
-    pos = sampleQueue.Next(pos))
-  {
-    CHECK_HR(hr = sampleQueue.GetItemPos(pos, &pSample));
-    if (pSample != NULL)
-    {
-      CHECK_HR(hr = pSample->SetUINT32(MFSamplePresenter_SampleCounter, m_TokenCounter));
-
-      SAFE_RELEASE(pSample);
-    }
-  }
+  cSamples = m_PoolSizer.GetPoolSize();
+  CHECK_HR(hr = m_pD3DPresentEngine->CreateVideoSamples(pMediaType, sampleQueue, cSamples));
 
-
-  // Add the samples to the sample pool.
+  // Add the samples to the sample pool. If this batch of samples becomes 
+  // invalid, the pool is cleared, and it recognises the old samples as stale.
   CHECK_HR(hr = m_SamplePool.Initialize(sampleQueue));
+  m_PoolSizer.OnAllocated(cSamples, m_pD3DPresentEngine->SurfaceBytes());
 
   // Set the frame rate on the scheduler. 
   if (SUCCEEDED(GetFrameRate(pMediaType, &fps)) && (fps.Numerator != 0) && (fps.Denominator != 0))
@@ -2669,6 +2700,12 @@ HRESULT EVRCustomPresenter::SetMediaType(IMFMediaType *pMediaType)
     m_rtTimePerFrame = (REFERENCE_TIME)10000000.0 / ((double)g_DefaultFrameRate.Numerator / g_DefaultFrameRate.Denominator);
   }
 
+  // The device was (re)created for this format, so the display mode is current.
+  m_scheduler.SetRefreshRate(m_pD3DPresentEngine->RefreshRate());
+
+  // The surface size is known now, so the memory budget can be applied.
+  UpdateSampleLimits();
+
   // Store the media type.
   assert(pMediaType != NULL);
   m_pMediaType = pMediaType;
@@ -2805,7 +2842,7 @@ HRESULT EVRCustomPresenter::ProcessOutput()
   HRESULT     hr = S_OK;
   DWORD       dwStatus = 0;
   LONGLONG    mixerStartTime = 0, mixerEndTime = 0;
-  MFTIME      systemTime = 0;
+  LONGLONG    hnsMixerStart = 0;
   BOOL        bRepaint = m_bRepaint; // Temporarily store this state flag.  
 
   MFT_OUTPUT_DATA_BUFFER dataBuffer;
@@ -2834,7 +2871,12 @@ HRESULT EVRCustomPresenter::ProcessOutput()
   hr = m_SamplePool.GetSample(&pSample);
   if (hr == MF_E_SAMPLEALLOCATOR_EMPTY)
   {
-    return S_FALSE; // No free samples. We'll try again when a sample is released.
+    // Grow the pool if the jitter buffer or the pool size wants more samples.
+    if (m_PoolSizer.Grow(TargetSampleCount(), &pSample) != S_OK)
+    {
+      return S_FALSE; // No free samples. We'll try again when a sample is released.
+    }
+    hr = S_OK;
   }
   CHECK_HR(hr);   // Fail on any other error code.
 
@@ -2843,7 +2885,7 @@ HRESULT EVRCustomPresenter::ProcessOutput()
   assert(pSample != NULL);
 
   // (If the following assertion fires, it means we are not managing the sample pool correctly.)
-  assert(MFGetAttributeUINT32(pSample, MFSamplePresenter_SampleCounter, (UINT32)-1) == m_TokenCounter);
+  assert(m_SamplePool.IsCurrent(pSample));
 
   if (m_bRepaint)
   {
@@ -2860,7 +2902,7 @@ HRESULT EVRCustomPresenter::ProcessOutput()
     if (m_pClock)
     {
       // Latency: Record the starting time for the ProcessOutput operation. 
-      (void)m_pClock->GetCorrelatedTime(0, &mixerStartTime, &systemTime);
+      (void)GetClockTime(&mixerStartTime);
     }
   }
 
@@ -2869,12 +2911,19 @@ HRESULT EVRCustomPresenter::ProcessOutput()
   dataBuffer.pSample = pSample;
   dataBuffer.dwStatus = 0;
 
+  hnsMixerStart = m_scheduler.GetTimeline()->Start();
+
   hr = m_pMixer->ProcessOutput(0, 1, &dataBuffer, &dwStatus);
 
+  m_scheduler.GetTimeline()->End(FRAME_STAGE_MIXER, SUCCEEDED(hr) ? pSample : NULL, hnsMixerStart);
+
+  // Lets the scheduler thread keep off the processor the mixer runs on.
+  m_scheduler.SetMixerProcessor(GetCurrentProcessorNumber());
+
   if (FAILED(hr))
   {
-    // Return the sample to the pool.
-    HRESULT hr2 = m_SamplePool.ReturnSample(pSample);
+    // Return the sample to the pool, or free it if the pool shrank.
+    HRESULT hr2 = m_PoolSizer.ReturnSample(pSample, TargetSampleCount());
     if (FAILED(hr2))
     {
       CHECK_HR(hr = hr2);
@@ -2901,6 +2950,15 @@ HRESULT EVRCustomPresenter::ProcessOutput()
   {
     MFTIME nsSampleTime;
 
+    // Trick play: At high rates, only evenly spaced frames are shown. Skip
+    // the others before blending subtitles or scheduling them.
+    if (!bRepaint && (m_FrameStep.state == FRAMESTEP_NONE) && (m_RenderState == RENDER_STATE_STARTED) &&
+        SUCCEEDED(pSample->GetSampleTime(&nsSampleTime)) && !m_scheduler.ShouldShowSample(nsSampleTime))
+    {
+      CHECK_HR(hr = m_PoolSizer.ReturnSample(pSample, TargetSampleCount()));
+      goto done;
+    }
+
     if (SUCCEEDED(hr = pSample->GetSampleTime(&nsSampleTime)))
     {
       m_rtStart = g_tSegmentStart + nsSampleTime;
@@ -2916,7 +2974,7 @@ HRESULT EVRCustomPresenter::ProcessOutput()
       // Latency: Record the ending time for the ProcessOutput operation,
       // and notify the EVR of the latency. 
 
-      (void)m_pClock->GetCorrelatedTime(0, &mixerEndTime, &systemTime);
+      (void)GetClockTime(&mixerEndTime);
 
       LONGLONG latencyTime = mixerEndTime - mixerStartTime;
       NotifyEvent(EC_PROCESSING_LATENCY, (LONG_PTR)&latencyTime, 0);
@@ -3105,25 +3163,41 @@ done:
 
 void EVRCustomPresenter::ReleaseResources()
 {
-  // Increment the token counter to indicate that all existing video samples
+  Flush();
+
+  // Clearing the pool starts a new generation, so all existing video samples
   // are "stale." As these samples get released, we'll dispose of them. 
   //
-  // Note: The token counter is required because the samples are shared
-  // between more than one thread, and they are returned to the presenter 
-  // through an asynchronous callback (OnSampleFree). Without the token, we
-  // might accidentally re-use a stale sample after the ReleaseResources
-  // method returns.
-
-  m_TokenCounter++;
-
-  Flush();
+  // Note: The generation is required because the samples are shared between
+  // more than one thread, and they are returned to the presenter through an
+  // asynchronous callback (OnSampleFree). Without it, we might accidentally
+  // re-use a stale sample after the ReleaseResources method returns.
 
   m_SamplePool.Clear();
+  m_PoolSizer.Reset();
 
   m_pD3DPresentEngine->ReleaseResources();
 }
 
 
+//-----------------------------------------------------------------------------
+// UpdateSampleLimits
+//
+// Sets the range of the jitter buffer depth. The pool never shrinks below 
+// the configured pool size, and never grows past the memory budget.
+//-----------------------------------------------------------------------------
+
+void EVRCustomPresenter::UpdateSampleLimits()
+{
+  DWORD cMin = 0, cMax = 0;
+
+  m_PoolSizer.GetLimits(&cMin, &cMax);
+
+  // One sample is always being mixed or shown, so it does not count as queued.
+  m_scheduler.SetQueueDepthLimits(cMin - 1, cMax - 1);
+}
+
+
 //-----------------------------------------------------------------------------
 // OnSampleFree
 //
@@ -3142,6 +3216,8 @@ HRESULT EVRCustomPresenter::OnSampleFree(IMFAsyncResult *pResult)
   CHECK_HR(hr = pResult->GetObject(&pObject));
   CHECK_HR(hr = pObject->QueryInterface(__uuidof(IMFSample), (void**)&pSample));
 
+  m_scheduler.GetTimeline()->Mark(FRAME_STAGE_SAMPLE_FREE, pSample);
+
   // If this sample was submitted for a frame-step, then the frame step is complete.
   if (m_FrameStep.state == FRAMESTEP_SCHEDULED)
   {
@@ -3159,24 +3235,20 @@ HRESULT EVRCustomPresenter::OnSampleFree(IMFAsyncResult *pResult)
     // need for the second QI.
   }
 
-  m_ObjectLock.Lock();
+  // Return the sample to the sample pool, or free it if the pool shrank. 
+  // Neither needs the object lock, and the pool tolerates a Clear from
+  // another thread. A stale sample (S_FALSE) is simply dropped.
+  hr = m_PoolSizer.ReturnSample(pSample, TargetSampleCount());
+  CHECK_HR(hr);
 
-  if (MFGetAttributeUINT32(pSample, MFSamplePresenter_SampleCounter, (UINT32)-1) == m_TokenCounter)
+  if (hr == S_OK)
   {
-    // Return the sample to the sample pool.
-    hr = m_SamplePool.ReturnSample(pSample);
-    if (FAILED(hr))
-    {
-      m_ObjectLock.Unlock();
-      CHECK_HR(hr);
-    }
+    AutoLock lock(m_ObjectLock);
 
     // Now that a free sample is available, process more data if possible.
     (void)ProcessOutputLoop();
   }
 
-  m_ObjectLock.Unlock();
-
 done:
   if (FAILED(hr))
   {
@@ -3437,8 +3509,6 @@ HRESULT ClearDesiredSampleTime(IMFSample *pSample)
   // This works around the fact that IMFDesiredSample::Clear() removes all of the
   // attributes from the sample. 
 
-  UINT32 counter = MFGetAttributeUINT32(pSample, MFSamplePresenter_SampleCounter, (UINT32)-1);
-
   (void)pSample->GetUnknown(MFSamplePresenter_SampleSwapChain, IID_IUnknown, (void**)&pUnkSwapChain);
 
   hr = pSample->QueryInterface(__uuidof(IMFDesiredSample), (void**)&pDesired);
@@ -3447,8 +3517,6 @@ HRESULT ClearDesiredSampleTime(IMFSample *pSample)
     // This method has no return value.
     (void)pDesired->Clear();
 
-    CHECK_HR(hr = pSample->SetUINT32(MFSamplePresenter_SampleCounter, counter));
-
     if (pUnkSwapChain)
     {
       CHECK_HR(hr = pSample->SetUnknown(MFSamplePresenter_SampleSwapChain, pUnkSwapChain));
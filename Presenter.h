@@ -135,7 +135,8 @@ class EVRCustomPresenter :
   public IEVRCPSettings,
   public ISubRenderConsumer2,
   public IEVRTrustedVideoPlugin,
-  public IEVRCPConfig
+  public IEVRCPConfig,
+  public IEVRCPStats
 {
 
 public:
@@ -334,7 +335,45 @@ public:
     case EVRCP_SETTING_FRAME_DROP_THRESHOLD:
       m_scheduler.SetFrameDropThreshold(value);
       break;
+    case EVRCP_SETTING_FRAME_DROP_POLICY:
+      hr = m_scheduler.SetFrameDropPolicy(value);
+      break;
+    case EVRCP_SETTING_SAMPLE_MEMORY_BUDGET:
+      if (value <= 0)
+      {
+        hr = E_INVALIDARG;
+        break;
+      }
+      hr = m_PoolSizer.SetMemoryBudget((DWORD)value);
+      UpdateSampleLimits();
+      break;
+    case EVRCP_SETTING_SAMPLE_POOL_SIZE:
+      if (value <= 0)
+      {
+        hr = E_INVALIDARG;
+        break;
+      }
+      hr = m_PoolSizer.SetPoolSize((DWORD)value);
+      UpdateSampleLimits();
+      break;
+    case EVRCP_SETTING_THREAD_PRIORITY:
+    case EVRCP_SETTING_THREAD_AFFINITY:
+      {
+        ThreadPolicySettings policy;
+        m_scheduler.GetThreadPolicy(&policy);
+        if (setting == EVRCP_SETTING_THREAD_PRIORITY)
+        {
+          policy.iPriority = value;
+        }
+        else
+        {
+          policy.dwAffinityMask = (DWORD)value;
+        }
+        hr = m_scheduler.SetThreadPolicy(policy);
+      }
+      break;
     case EVRCP_SETTING_POSITION_OFFSET:
+    case EVRCP_SETTING_SUBTITLE_MEMORY_CAP:
       hr = m_pD3DPresentEngine->SetInt(setting, value);
       break;
     default:
@@ -356,9 +395,52 @@ public:
     case EVRCP_SETTING_FRAME_DROP_THRESHOLD:
       *value = m_scheduler.GetFrameDropThreshold();
       break;
+    case EVRCP_SETTING_FRAME_DROP_POLICY:
+      *value = m_scheduler.GetFrameDropPolicy();
+      break;
     case EVRCP_SETTING_POSITION_OFFSET:
+    case EVRCP_SETTING_SUBTITLE_MEMORY_CAP:
+    case EVRCP_SETTING_SUBTITLE_MEMORY:
       m_pD3DPresentEngine->GetInt(setting, value);
       break;
+    case EVRCP_SETTING_CADENCE_ERRORS:
+      *value = (int)m_scheduler.GetCadenceErrorsPerMinute();
+      break;
+    case EVRCP_SETTING_CLOCK_QUERIES:
+      *value = (int)m_scheduler.GetClockQueryCount();
+      break;
+    case EVRCP_SETTING_CLOCK_CALLS:
+      *value = (int)m_scheduler.GetClockCallCount();
+      break;
+    case EVRCP_SETTING_CONTENT_CADENCE:
+      *value = m_scheduler.GetContentCadence();
+      break;
+    case EVRCP_SETTING_SAMPLE_MEMORY_BUDGET:
+      *value = (int)m_PoolSizer.GetMemoryBudget();
+      break;
+    case EVRCP_SETTING_SAMPLE_COUNT:
+      *value = (int)m_PoolSizer.Count();
+      break;
+    case EVRCP_SETTING_SAMPLE_POOL_SIZE:
+      *value = (int)m_PoolSizer.GetPoolSize();
+      break;
+    case EVRCP_SETTING_SAMPLE_MEMORY:
+      *value = (int)(m_PoolSizer.Bytes() / 1024);
+      break;
+    case EVRCP_SETTING_TARGET_QUEUE_DEPTH:
+      *value = (int)m_scheduler.GetTargetQueueDepth();
+      break;
+    case EVRCP_SETTING_FRAMES_THINNED:
+      *value = (int)m_scheduler.GetThinnedFrameCount();
+      break;
+    case EVRCP_SETTING_THREAD_PRIORITY:
+    case EVRCP_SETTING_THREAD_AFFINITY:
+      {
+        ThreadPolicySettings policy;
+        m_scheduler.GetThreadPolicy(&policy);
+        *value = (setting == EVRCP_SETTING_THREAD_PRIORITY) ? policy.iPriority : (int)policy.dwAffinityMask;
+      }
+      break;
     default:
       hr = E_NOTIMPL;
       break;
@@ -390,6 +472,9 @@ public:
     case EVRCP_SETTING_SUBTITLE_ALPHA:
       *value = m_fBitmapAlpha;
       break;
+    case EVRCP_SETTING_DETECTED_FRAME_RATE:
+      *value = m_scheduler.GetDetectedFrameRate();
+      break;
     default:
       hr = E_NOTIMPL;
       break;
@@ -405,9 +490,46 @@ public:
     case EVRCP_SETTING_USE_MF_TIME_CALC:
       m_scheduler.SetUseMfTimeCalc(value);
       break;
+    case EVRCP_SETTING_HIGH_RES_WAIT:
+      m_scheduler.SetHighResolutionWait(value);
+      break;
+    case EVRCP_SETTING_SHARED_SCHEDULER:
+      m_scheduler.SetSharedThread(value);
+      break;
+    case EVRCP_SETTING_PRESENT_AHEAD:
+      m_scheduler.SetPresentAhead(value);
+      break;
+    case EVRCP_SETTING_FRAME_TIMELINE:
+      hr = m_scheduler.GetTimeline()->Enable(value);
+      break;
+    case EVRCP_SETTING_MMCSS:
+    case EVRCP_SETTING_AVOID_MIXER_CORE:
+      {
+        ThreadPolicySettings policy;
+        m_scheduler.GetThreadPolicy(&policy);
+        if (setting == EVRCP_SETTING_MMCSS)
+        {
+          policy.bMmcss = value;
+        }
+        else
+        {
+          policy.bAvoidMixerCore = value;
+        }
+        hr = m_scheduler.SetThreadPolicy(policy);
+      }
+      break;
+    case EVRCP_SETTING_VSYNC_PLANNER:
+      m_scheduler.SetUseVsyncPlanner(value);
+      break;
+    case EVRCP_SETTING_FRAME_RATE_DETECTION:
+      m_scheduler.SetFrameRateDetection(value);
+      break;
     case EVRCP_SETTING_CORRECT_AR:
       m_bCorrectAR = value;
       break;
+    case EVRCP_SETTING_RANK_MIXER_TYPES:
+      m_bRankMixerTypes = value;
+      break;
     case EVRCP_SETTING_REQUEST_OVERLAY:
     case EVRCP_SETTING_POSITION_FROM_BOTTOM:
       hr = m_pD3DPresentEngine->SetBool(setting, value);
@@ -428,9 +550,38 @@ public:
     case EVRCP_SETTING_USE_MF_TIME_CALC:
       *value = m_scheduler.GetUseMfTimeCalc();
       break;
+    case EVRCP_SETTING_HIGH_RES_WAIT:
+      *value = m_scheduler.GetHighResolutionWait();
+      break;
+    case EVRCP_SETTING_SHARED_SCHEDULER:
+      *value = m_scheduler.GetSharedThread();
+      break;
+    case EVRCP_SETTING_PRESENT_AHEAD:
+      *value = m_scheduler.GetPresentAhead();
+      break;
+    case EVRCP_SETTING_FRAME_TIMELINE:
+      *value = m_scheduler.GetTimeline()->IsEnabled() ? true : false;
+      break;
+    case EVRCP_SETTING_MMCSS:
+    case EVRCP_SETTING_AVOID_MIXER_CORE:
+      {
+        ThreadPolicySettings policy;
+        m_scheduler.GetThreadPolicy(&policy);
+        *value = (setting == EVRCP_SETTING_MMCSS) ? policy.bMmcss : policy.bAvoidMixerCore;
+      }
+      break;
+    case EVRCP_SETTING_VSYNC_PLANNER:
+      *value = m_scheduler.GetUseVsyncPlanner();
+      break;
+    case EVRCP_SETTING_FRAME_RATE_DETECTION:
+      *value = m_scheduler.GetFrameRateDetection();
+      break;
     case EVRCP_SETTING_CORRECT_AR:
       *value = m_bCorrectAR;
       break;
+    case EVRCP_SETTING_RANK_MIXER_TYPES:
+      *value = m_bRankMixerTypes;
+      break;
     case EVRCP_SETTING_REQUEST_OVERLAY:
     case EVRCP_SETTING_POSITION_FROM_BOTTOM:
       m_pD3DPresentEngine->GetBool(setting, value);
@@ -447,6 +598,20 @@ public:
 
     switch (setting)
     {
+    case EVRCP_SETTING_FRAME_TIMELINE_FILE:
+      {
+        CheckPointer(value, E_POINTER);
+
+        FILE *pFile = NULL;
+        if (_wfopen_s(&pFile, value, L"w") != 0 || pFile == NULL)
+        {
+          hr = E_FAIL;
+          break;
+        }
+        hr = m_scheduler.GetTimeline()->WriteChromeTrace(pFile);
+        fclose(pFile);
+      }
+      break;
     default:
       hr = E_NOTIMPL;
       break;
@@ -467,6 +632,20 @@ public:
     return hr;
   }
 
+  //IEVRCPStats
+  STDMETHODIMP GetStats(EVRCPStats *pStats) {
+    CheckPointer(pStats, E_POINTER);
+    if (pStats->cbSize < sizeof(EVRCPStats))
+    {
+      return E_INVALIDARG;
+    }
+
+    pStats->dwFramesPresented = m_pD3DPresentEngine->FramesPresented();
+    pStats->dwFramesDropped = m_pD3DPresentEngine->FramesDropped();
+    m_scheduler.GetStats(pStats);
+    return S_OK;
+  }
+
 protected:
   EVRCustomPresenter(HRESULT& hr);
   virtual ~EVRCustomPresenter();
@@ -498,6 +677,22 @@ protected:
   // IsScrubbing: Scrubbing occurs when the frame rate is 0.
   inline BOOL IsScrubbing() const { return m_fRate == 0.0f; }
 
+  // GetClockTime: Returns the presentation time. Uses the scheduler's clock
+  // tracker while the scheduler runs, so that it rarely calls the clock.
+  HRESULT GetClockTime(LONGLONG *phnsClockTime)
+  {
+    if (SUCCEEDED(m_scheduler.GetClockTime(phnsClockTime)))
+    {
+      return S_OK;
+    }
+    if (m_pClock == NULL)
+    {
+      return MF_E_NO_CLOCK;
+    }
+    MFTIME hnsSystemTime = 0;
+    return m_pClock->GetCorrelatedTime(0, phnsClockTime, &hnsSystemTime);
+  }
+
   // NotifyEvent: Send an event to the EVR through its IMediaEventSink interface.
   void NotifyEvent(long EventCode, LONG_PTR Param1, LONG_PTR Param2)
   {
@@ -532,6 +727,8 @@ protected:
   HRESULT DeliverSample(IMFSample *pSample, BOOL bRepaint);
   HRESULT TrackSample(IMFSample *pSample);
   void    ReleaseResources();
+  void    UpdateSampleLimits();
+  DWORD   TargetSampleCount() { return m_scheduler.GetTargetQueueDepth() + 1; }
 
   // Frame-stepping
   HRESULT PrepareFrameStep(DWORD cSteps);
@@ -580,7 +777,7 @@ protected:
   // Samples and scheduling
   Scheduler                   m_scheduler;            // Manages scheduling of samples.
   SamplePool                  m_SamplePool;           // Pool of allocated samples.
-  DWORD                       m_TokenCounter;         // Counter. Incremented whenever we create new samples.
+  SamplePoolSizer             m_PoolSizer;            // Grows and shrinks the pool.
 
   // Rendering state
   BOOL                        m_bSampleNotify;        // Did the mixer signal it has an input sample?
@@ -623,6 +820,7 @@ protected:
   //IPin *				m_pEvrPin;
   REFERENCE_TIME		          m_rtTimePerFrame;
   bool				                m_bCorrectAR;
+  bool				                m_bRankMixerTypes;
 };
 
 
@@ -0,0 +1,112 @@
+/*
+ *      Copyright (C) 2014 Andrew Van Til
+ *      http://babgvant.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "stdafx.h"
+#include "EVRPresenter.h"
+
+void RobustWindow::Reset()
+{
+  m_cValues = 0;
+}
+
+void RobustWindow::Add(LONGLONG llValue)
+{
+  m_values[m_cValues % ROBUST_WINDOW] = llValue;
+  m_cValues++;
+
+  // Wrap without losing the "window is full" state.
+  if (m_cValues == 2 * ROBUST_WINDOW)
+  {
+    m_cValues = ROBUST_WINDOW;
+  }
+}
+
+//-----------------------------------------------------------------------------
+// GetStats
+//
+// Median and 90th percentile of the window, and the median of the absolute 
+// deviations from the median.
+//-----------------------------------------------------------------------------
+
+BOOL RobustWindow::GetStats(RobustStats *pStats) const
+{
+  LONGLONG values[ROBUST_WINDOW];
+  DWORD count = Count();
+
+  ZeroMemory(pStats, sizeof(*pStats));
+
+  if (count < ROBUST_MIN_VALUES)
+  {
+    return FALSE;
+  }
+
+  for (DWORD i = 0; i < count; i++)
+  {
+    values[i] = m_values[i];
+  }
+  Sort(values, count);
+
+  pStats->llMedian = Median(values, count);
+  pStats->llP90 = values[(count * 9) / 10];
+
+  for (DWORD i = 0; i < count; i++)
+  {
+    values[i] = _abs64(m_values[i] - pStats->llMedian);
+  }
+  Sort(values, count);
+
+  pStats->llMad = Median(values, count);
+  return TRUE;
+}
+
+//-----------------------------------------------------------------------------
+// Sort
+//
+// Insertion sort; the window is small.
+//-----------------------------------------------------------------------------
+
+void RobustWindow::Sort(LONGLONG *pValues, DWORD count)
+{
+  for (DWORD i = 1; i < count; i++)
+  {
+    LONGLONG llValue = pValues[i];
+    DWORD j = i;
+    while (j > 0 && pValues[j - 1] > llValue)
+    {
+      pValues[j] = pValues[j - 1];
+      j--;
+    }
+    pValues[j] = llValue;
+  }
+}
+
+//-----------------------------------------------------------------------------
+// Median
+//
+// Middle value of a sorted array, or the mean of the middle two.
+//-----------------------------------------------------------------------------
+
+LONGLONG RobustWindow::Median(const LONGLONG *pSorted, DWORD count)
+{
+  if (count & 1)
+  {
+    return pSorted[count / 2];
+  }
+  return (pSorted[count / 2 - 1] + pSorted[count / 2]) / 2;
+}
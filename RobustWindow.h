@@ -0,0 +1,68 @@
+/*
+ *      Copyright (C) 2014 Andrew Van Til
+ *      http://babgvant.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+const DWORD ROBUST_WINDOW = 32;           // Values looked at. Power of two.
+const DWORD ROBUST_MIN_VALUES = 8;        // Values needed before the statistics are valid.
+
+//-----------------------------------------------------------------------------
+// RobustStats
+//-----------------------------------------------------------------------------
+
+struct RobustStats
+{
+  LONGLONG  llMedian;
+  LONGLONG  llMad;                        // Median absolute deviation.
+  LONGLONG  llP90;                        // 90th percentile.
+};
+
+
+//-----------------------------------------------------------------------------
+// RobustWindow class
+//
+// Median, median absolute deviation (MAD) and 90th percentile of the last 
+// ROBUST_WINDOW values. Unlike a running mean, none of them moves much for a
+// few outliers. The MAD collapses to zero when most values are equal, as in
+// a bimodal series (3:2 pulldown lateness), but the 90th percentile still 
+// covers the upper mode.
+//
+// Does not allocate. Not thread-safe; the owner locks.
+//-----------------------------------------------------------------------------
+
+class RobustWindow
+{
+public:
+  RobustWindow() { Reset(); }
+
+  void Reset();
+  void Add(LONGLONG llValue);
+
+  DWORD Count() const { return m_cValues < ROBUST_WINDOW ? m_cValues : ROBUST_WINDOW; }
+
+  // Returns FALSE (and zeros) until the window has ROBUST_MIN_VALUES values.
+  BOOL GetStats(RobustStats *pStats) const;
+
+private:
+  static void     Sort(LONGLONG *pValues, DWORD count);
+  static LONGLONG Median(const LONGLONG *pSorted, DWORD count);
+
+  LONGLONG  m_values[ROBUST_WINDOW];
+  DWORD     m_cValues;                    // Values added since the reset.
+};
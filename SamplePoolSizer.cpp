@@ -0,0 +1,249 @@
+/*
+ *      Copyright (C) 2014 Andrew Van Til
+ *      http://babgvant.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "stdafx.h"
+#include "EVRPresenter.h"
+
+const DWORD SAMPLE_POOL_MIN_SIZE = 2;       // One sample being shown, one being mixed.
+const DWORD DEFAULT_SAMPLE_MEMORY_BUDGET = 128;
+
+SamplePoolSizer::SamplePoolSizer(SamplePool *pPool)
+  : m_pPool(pPool)
+  , m_pAllocator(NULL)
+  , m_cPoolSize(PRESENTER_BUFFER_COUNT)
+  , m_dwMemoryBudget(DEFAULT_SAMPLE_MEMORY_BUDGET)
+  , m_cSamples(0)
+  , m_cbSurface(0)
+  , m_cbTotal(0)
+{
+}
+
+void SamplePoolSizer::SetAllocator(SampleAllocator *pAllocator)
+{
+  AutoLock lock(m_lock);
+  m_pAllocator = pAllocator;
+}
+
+//-----------------------------------------------------------------------------
+// SetPoolSize
+//
+// Sets the samples allocated for a new format. While streaming, the pool 
+// grows to the new size as it runs empty; the jitter buffer lets it shrink.
+//-----------------------------------------------------------------------------
+
+HRESULT SamplePoolSizer::SetPoolSize(DWORD cSamples)
+{
+  if (cSamples < SAMPLE_POOL_MIN_SIZE || cSamples > PRESENTER_MAX_BUFFER_COUNT)
+  {
+    return E_INVALIDARG;
+  }
+
+  AutoLock lock(m_lock);
+  m_cPoolSize = cSamples;
+  return S_OK;
+}
+
+DWORD SamplePoolSizer::GetPoolSize()
+{
+  AutoLock lock(m_lock);
+  return m_cPoolSize;
+}
+
+HRESULT SamplePoolSizer::SetMemoryBudget(DWORD dwMegabytes)
+{
+  if (dwMegabytes == 0)
+  {
+    return E_INVALIDARG;
+  }
+
+  AutoLock lock(m_lock);
+  m_dwMemoryBudget = dwMegabytes;
+  return S_OK;
+}
+
+DWORD SamplePoolSizer::GetMemoryBudget()
+{
+  AutoLock lock(m_lock);
+  return m_dwMemoryBudget;
+}
+
+//-----------------------------------------------------------------------------
+// GetLimits
+//
+// Returns the range of the pool size. The memory budget never takes the 
+// maximum below the configured pool size.
+//-----------------------------------------------------------------------------
+
+void SamplePoolSizer::GetLimits(DWORD *pcMin, DWORD *pcMax)
+{
+  AutoLock lock(m_lock);
+  Limits(pcMin, pcMax);
+}
+
+void SamplePoolSizer::Limits(DWORD *pcMin, DWORD *pcMax)
+{
+  DWORD cMax = PRESENTER_MAX_BUFFER_COUNT;
+
+  if (m_cbSurface > 0)
+  {
+    ULONGLONG cFit = ((ULONGLONG)m_dwMemoryBudget * 1024 * 1024) / m_cbSurface;
+    if (cFit < cMax)
+    {
+      cMax = (DWORD)cFit;
+    }
+  }
+  if (cMax < m_cPoolSize)
+  {
+    cMax = m_cPoolSize;
+  }
+
+  *pcMin = m_cPoolSize;
+  *pcMax = cMax;
+}
+
+//-----------------------------------------------------------------------------
+// OnAllocated
+//
+// Called after the present engine allocated the samples for a new format.
+//-----------------------------------------------------------------------------
+
+void SamplePoolSizer::OnAllocated(DWORD cSamples, DWORD cbSurface)
+{
+  AutoLock lock(m_lock);
+
+  m_cSamples = cSamples;
+  m_cbSurface = cbSurface;
+  m_cbTotal = (ULONGLONG)cSamples * cbSurface;
+}
+
+//-----------------------------------------------------------------------------
+// Reset
+//
+// Called when the present engine released all samples.
+//-----------------------------------------------------------------------------
+
+void SamplePoolSizer::Reset()
+{
+  AutoLock lock(m_lock);
+
+  m_cSamples = 0;
+  m_cbSurface = 0;
+  m_cbTotal = 0;
+}
+
+//-----------------------------------------------------------------------------
+// Grow
+//
+// Allocates one more sample and adds it to the pool, already in use by the
+// caller. Returns S_FALSE if the pool already holds cTarget samples or has
+// reached its limit.
+//-----------------------------------------------------------------------------
+
+HRESULT SamplePoolSizer::Grow(DWORD cTarget, IMFSample **ppSample)
+{
+  CheckPointer(ppSample, E_POINTER);
+
+  HRESULT hr = S_OK;
+  IMFSample *pSample = NULL;
+  DWORD cbSurface = 0;
+  DWORD cMin = 0, cMax = 0;
+
+  AutoLock lock(m_lock);
+
+  if (m_pAllocator == NULL || m_cSamples == 0)
+  {
+    return MF_E_NOT_INITIALIZED;
+  }
+
+  Limits(&cMin, &cMax);
+  if (cTarget < cMin)
+  {
+    cTarget = cMin;
+  }
+  if (m_cSamples >= cTarget || m_cSamples >= cMax)
+  {
+    return S_FALSE;
+  }
+
+  CHECK_HR(hr = m_pAllocator->CreateVideoSample(&pSample, &cbSurface));
+  CHECK_HR(hr = m_pPool->AddSample(pSample));
+
+  m_cSamples++;
+  m_cbTotal += cbSurface;
+
+  *ppSample = pSample;
+  pSample = NULL;
+
+done:
+  if (pSample != NULL)
+  {
+    m_pAllocator->ReleaseVideoSample(pSample);
+    SAFE_RELEASE(pSample);
+  }
+  return hr;
+}
+
+//-----------------------------------------------------------------------------
+// ReturnSample
+//
+// Takes back a sample that is no longer in use. If the pool holds more than
+// cTarget samples (and more than the pool size), the sample is freed 
+// instead of re-used. Returns S_FALSE for a stale sample.
+//-----------------------------------------------------------------------------
+
+HRESULT SamplePoolSizer::ReturnSample(IMFSample *pSample, DWORD cTarget)
+{
+  HRESULT hr = S_OK;
+
+  AutoLock lock(m_lock);
+
+  if (cTarget < m_cPoolSize)
+  {
+    cTarget = m_cPoolSize;
+  }
+
+  if (m_pAllocator != NULL && m_cSamples > cTarget)
+  {
+    hr = m_pPool->DiscardSample(pSample);
+    if (hr == S_OK)
+    {
+      DWORD cbSurface = m_pAllocator->ReleaseVideoSample(pSample);
+
+      m_cSamples--;
+      m_cbTotal = (m_cbTotal > cbSurface) ? m_cbTotal - cbSurface : 0;
+    }
+  }
+  else
+  {
+    hr = m_pPool->ReturnSample(pSample);
+  }
+  return hr;
+}
+
+DWORD SamplePoolSizer::Count()
+{
+  AutoLock lock(m_lock);
+  return m_cSamples;
+}
+
+ULONGLONG SamplePoolSizer::Bytes()
+{
+  AutoLock lock(m_lock);
+  return m_cbTotal;
+}
@@ -0,0 +1,96 @@
+/*
+ *      Copyright (C) 2014 Andrew Van Til
+ *      http://babgvant.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// SampleAllocator class
+//
+// Creates and frees the video samples of the pool, one surface at a time.
+// Implemented by the present engine.
+//-----------------------------------------------------------------------------
+
+class SampleAllocator
+{
+public:
+  virtual ~SampleAllocator() { }
+
+  // Creates a sample in the current format. pcbSurface receives the bytes 
+  // of video memory that its surface takes.
+  virtual HRESULT CreateVideoSample(IMFSample **ppSample, DWORD *pcbSurface) = 0;
+
+  // Frees the surface of a sample. Returns the bytes released.
+  virtual DWORD   ReleaseVideoSample(IMFSample *pSample) = 0;
+};
+
+
+//-----------------------------------------------------------------------------
+// SamplePoolSizer class
+//
+// Decides how many samples the pool holds, and grows or shrinks it one 
+// sample at a time while streaming, so a new size never needs the whole set
+// to be reallocated.
+//
+// The pool holds at least the configured pool size. The jitter buffer can 
+// ask for more, up to the memory budget (and PRESENTER_MAX_BUFFER_COUNT). 
+// The memory of every surface is counted as it is created and freed.
+//
+// The presenter reports the samples allocated for a new format with 
+// OnAllocated, calls Grow when the pool runs empty, and hands every freed
+// sample to ReturnSample. All methods are thread-safe.
+//-----------------------------------------------------------------------------
+
+class SamplePoolSizer
+{
+public:
+  SamplePoolSizer(SamplePool *pPool);
+
+  void    SetAllocator(SampleAllocator *pAllocator);
+
+  HRESULT SetPoolSize(DWORD cSamples);
+  DWORD   GetPoolSize();
+  HRESULT SetMemoryBudget(DWORD dwMegabytes);
+  DWORD   GetMemoryBudget();
+
+  void    GetLimits(DWORD *pcMin, DWORD *pcMax);
+
+  void    OnAllocated(DWORD cSamples, DWORD cbSurface);
+  void    Reset();
+
+  HRESULT Grow(DWORD cTarget, IMFSample **ppSample);
+  HRESULT ReturnSample(IMFSample *pSample, DWORD cTarget);
+
+  DWORD     Count();
+  ULONGLONG Bytes();
+
+private:
+  void    Limits(DWORD *pcMin, DWORD *pcMax);
+
+  CritSec           m_lock;
+
+  SamplePool        *m_pPool;
+  SampleAllocator   *m_pAllocator;
+
+  DWORD             m_cPoolSize;        // Samples allocated for a new format, and the minimum.
+  DWORD             m_dwMemoryBudget;   // Megabytes.
+
+  DWORD             m_cSamples;         // Samples allocated, free or in use.
+  DWORD             m_cbSurface;        // Size of one surface in the current format.
+  ULONGLONG         m_cbTotal;          // Video memory of all surfaces.
+};
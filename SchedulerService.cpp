@@ -0,0 +1,333 @@
+/*
+ *      Copyright (C) 2014 Andrew Van Til
+ *      http://babgvant.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "stdafx.h"
+#include "EVRPresenter.h"
+
+CritSec SchedulerService::s_lock;
+SchedulerService *SchedulerService::s_pInstance = NULL;
+
+SchedulerService::SchedulerService() :
+  m_iNextTurn(0),
+  m_hServiceThread(NULL),
+  m_hWakeEvent(NULL),
+  m_bExit(FALSE)
+{
+}
+
+SchedulerService::~SchedulerService()
+{
+  Stop();
+}
+
+
+//-----------------------------------------------------------------------------
+// Attach (static method)
+//
+// Adds a scheduler to the shared service, and starts the service if this is
+// the first one.
+//
+// policy:      Thread policy for the service thread, if it is started.
+// phThread:    Receives the service thread. Not owned by the caller.
+// phWakeEvent: Receives the event that wakes the service thread. Not owned
+//              by the caller.
+//-----------------------------------------------------------------------------
+
+HRESULT SchedulerService::Attach(Scheduler *pScheduler, const ThreadPolicySettings& policy, HANDLE *phThread, HANDLE *phWakeEvent)
+{
+  CheckPointer(pScheduler, E_POINTER);
+  CheckPointer(phThread, E_POINTER);
+  CheckPointer(phWakeEvent, E_POINTER);
+
+  HRESULT hr = S_OK;
+
+  AutoLock lock(s_lock);
+
+  if (s_pInstance == NULL)
+  {
+    s_pInstance = new SchedulerService();
+    if (s_pInstance == NULL)
+    {
+      CHECK_HR(hr = E_OUTOFMEMORY);
+    }
+
+    hr = s_pInstance->Start(policy);
+    if (FAILED(hr))
+    {
+      delete s_pInstance;
+      s_pInstance = NULL;
+      CHECK_HR(hr);
+    }
+  }
+
+  CHECK_HR(hr = s_pInstance->AddScheduler(pScheduler));
+
+  *phThread = s_pInstance->m_hServiceThread;
+  *phWakeEvent = s_pInstance->m_hWakeEvent;
+
+done:
+  return hr;
+}
+
+
+//-----------------------------------------------------------------------------
+// Detach (static method)
+//
+// Removes a scheduler from the shared service. When this method returns, the
+// service thread is not using the scheduler and never will again. Stops the
+// service if this was the last scheduler.
+//-----------------------------------------------------------------------------
+
+void SchedulerService::Detach(Scheduler *pScheduler)
+{
+  AutoLock lock(s_lock);
+
+  if (s_pInstance == NULL)
+  {
+    return;
+  }
+
+  if (s_pInstance->RemoveScheduler(pScheduler))
+  {
+    delete s_pInstance;
+    s_pInstance = NULL;
+  }
+}
+
+
+//-----------------------------------------------------------------------------
+// Start
+//
+// Starts the service thread.
+//-----------------------------------------------------------------------------
+
+HRESULT SchedulerService::Start(const ThreadPolicySettings& policy)
+{
+  HRESULT hr = S_OK;
+
+  m_PolicySettings = policy;
+
+  m_hWakeEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+  if (m_hWakeEvent == NULL)
+  {
+    CHECK_HR(hr = HRESULT_FROM_WIN32(GetLastError()));
+  }
+
+  // One timer resolution request for all the schedulers.
+  timeBeginPeriod(1);
+
+  m_bExit = FALSE;
+  m_hServiceThread = CreateThread(NULL, 0, ServiceThreadProc, (LPVOID)this, 0, NULL);
+  if (m_hServiceThread == NULL)
+  {
+    hr = HRESULT_FROM_WIN32(GetLastError());
+    timeEndPeriod(1);
+  }
+
+done:
+  return hr;
+}
+
+
+//-----------------------------------------------------------------------------
+// Stop
+//
+// Stops the service thread.
+//-----------------------------------------------------------------------------
+
+void SchedulerService::Stop()
+{
+  if (m_hServiceThread)
+  {
+    m_bExit = TRUE;
+    SetEvent(m_hWakeEvent);
+    WaitForSingleObject(m_hServiceThread, INFINITE);
+
+    CloseHandle(m_hServiceThread);
+    m_hServiceThread = NULL;
+
+    timeEndPeriod(1);
+  }
+
+  if (m_hWakeEvent)
+  {
+    CloseHandle(m_hWakeEvent);
+    m_hWakeEvent = NULL;
+  }
+}
+
+
+//-----------------------------------------------------------------------------
+// AddScheduler / RemoveScheduler / IsAttached
+//
+// RemoveScheduler returns TRUE if no schedulers are left. IsAttached must be
+// called with m_lock held.
+//-----------------------------------------------------------------------------
+
+HRESULT SchedulerService::AddScheduler(Scheduler *pScheduler)
+{
+  AutoLock lock(m_lock);
+
+  HRESULT hr = m_Schedulers.Append(pScheduler);
+
+  // Let the service thread pick up the new scheduler's deadline.
+  SetEvent(m_hWakeEvent);
+  return hr;
+}
+
+BOOL SchedulerService::RemoveScheduler(Scheduler *pScheduler)
+{
+  AutoLock lock(m_lock);
+
+  DWORD cSchedulers = m_Schedulers.GetCount();
+  for (DWORD i = 0; i < cSchedulers; i++)
+  {
+    if (m_Schedulers[i] == pScheduler)
+    {
+      // Keep the turn order of the other schedulers.
+      for (DWORD j = i + 1; j < cSchedulers; j++)
+      {
+        m_Schedulers[j - 1] = m_Schedulers[j];
+      }
+      m_Schedulers.SetSize(--cSchedulers);
+      break;
+    }
+  }
+
+  if (m_iNextTurn >= cSchedulers)
+  {
+    m_iNextTurn = 0;
+  }
+  return (cSchedulers == 0);
+}
+
+BOOL SchedulerService::IsAttached(Scheduler *pScheduler)
+{
+  for (DWORD i = 0; i < m_Schedulers.GetCount(); i++)
+  {
+    if (m_Schedulers[i] == pScheduler)
+    {
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+
+//-----------------------------------------------------------------------------
+// ServiceThreadProc (static method)
+//-----------------------------------------------------------------------------
+
+DWORD WINAPI SchedulerService::ServiceThreadProc(LPVOID lpParameter)
+{
+  SchedulerService* pService = reinterpret_cast<SchedulerService*>(lpParameter);
+  if (pService == NULL)
+  {
+    return -1;
+  }
+  return pService->ServiceThreadProcPrivate();
+}
+
+//-----------------------------------------------------------------------------
+// ServiceThreadProcPrivate
+//
+// Waits for the earliest deadline (or a request), then gives each scheduler
+// a turn.
+//-----------------------------------------------------------------------------
+
+DWORD SchedulerService::ServiceThreadProcPrivate()
+{
+  HRESULT hrPolicy = m_Policy.Apply(m_PolicySettings);
+  LOG_MSG_IF_FAILED(L"SchedulerService: thread policy not fully applied", hrPolicy);
+
+  while (!m_bExit)
+  {
+    DWORD dwTimeout = INFINITE;
+    DWORD dwResult = WAIT_TIMEOUT;
+    Scheduler *pEarliest = NULL;
+
+    {
+      AutoLock lock(m_lock);
+
+      // Find the scheduler that needs the thread first.
+      LONGLONG hnsEarliest = SCHEDULER_SLEEP_FOREVER;
+      for (DWORD i = 0; i < m_Schedulers.GetCount(); i++)
+      {
+        LONGLONG hnsWait = m_Schedulers[i]->TimeUntilService();
+        if (hnsWait < hnsEarliest)
+        {
+          hnsEarliest = hnsWait;
+          pEarliest = m_Schedulers[i];
+        }
+      }
+
+      if (pEarliest)
+      {
+        dwTimeout = (hnsEarliest <= 0) ? 0 : pEarliest->ServiceCoarseTimeout();
+      }
+    }
+
+    if (dwTimeout != 0)
+    {
+      dwResult = WaitForSingleObject(m_hWakeEvent, dwTimeout);
+    }
+
+    if (m_bExit)
+    {
+      break;
+    }
+
+    LONGLONG hnsDeadline = 0;
+    {
+      AutoLock lock(m_lock);
+
+      if (dwResult == WAIT_TIMEOUT && pEarliest && IsAttached(pEarliest))
+      {
+        hnsDeadline = pEarliest->ServiceDeadline();
+      }
+    }
+
+    // Finish waiting for the deadline. The scheduler may detach meanwhile,
+    // so only the deadline is used here, not the scheduler.
+    if (hnsDeadline != 0)
+    {
+      m_Timer.WaitUntil(hnsDeadline);
+    }
+
+    if (m_bExit)
+    {
+      break;
+    }
+
+    AutoLock lock(m_lock);
+
+    DWORD cSchedulers = m_Schedulers.GetCount();
+    for (DWORD i = 0; i < cSchedulers; i++)
+    {
+      m_Schedulers[(m_iNextTurn + i) % cSchedulers]->ServiceTurn();
+    }
+    if (cSchedulers > 0)
+    {
+      m_iNextTurn = (m_iNextTurn + 1) % cSchedulers;
+    }
+  }
+
+  m_Policy.Revert();
+  return 0;
+}
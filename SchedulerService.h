@@ -0,0 +1,82 @@
+/*
+ *      Copyright (C) 2014 Andrew Van Til
+ *      http://babgvant.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+class Scheduler;
+
+//-----------------------------------------------------------------------------
+// SchedulerService class
+//
+// A worker thread shared by every Scheduler in the process that asks for it
+// (EVRCP_SETTING_SHARED_SCHEDULER), for players that run many presenters at
+// once. It replaces one thread, one wake event and one timeBeginPeriod call
+// per presenter.
+//
+// The thread waits for the earliest deadline of all attached schedulers, or
+// until one of them signals the shared wake event. Each pass then gives 
+// every scheduler with a request or a passed deadline one turn, starting 
+// one scheduler further along each time. A turn handles at most 
+// SCHEDULER_SERVICE_TURN_SAMPLES samples, so a scheduler that is catching up
+// cannot hold back the others.
+//
+// The final precise wait for a deadline is done without holding the service
+// lock, so attaching or detaching a scheduler is never held up by the spin.
+//
+// The service starts with the first attached scheduler and stops when the
+// last one detaches. Its thread runs with the thread policy of the first 
+// scheduler.
+//-----------------------------------------------------------------------------
+
+const DWORD SCHEDULER_SERVICE_TURN_SAMPLES = 1;
+
+class SchedulerService
+{
+public:
+  static HRESULT Attach(Scheduler *pScheduler, const ThreadPolicySettings& policy, HANDLE *phThread, HANDLE *phWakeEvent);
+  static void    Detach(Scheduler *pScheduler);
+
+private:
+  SchedulerService();
+  ~SchedulerService();
+
+  HRESULT Start(const ThreadPolicySettings& policy);
+  void    Stop();
+
+  HRESULT AddScheduler(Scheduler *pScheduler);
+  BOOL    RemoveScheduler(Scheduler *pScheduler);
+  BOOL    IsAttached(Scheduler *pScheduler);
+
+  static DWORD WINAPI ServiceThreadProc(LPVOID lpParameter);
+  DWORD   ServiceThreadProcPrivate();
+
+  static CritSec            s_lock;         // Protects s_pInstance.
+  static SchedulerService   *s_pInstance;
+
+  CritSec                   m_lock;         // Held while a pass services the schedulers.
+  GrowableArray<Scheduler*> m_Schedulers;
+  DWORD                     m_iNextTurn;    // Scheduler that goes first in the next pass.
+
+  HANDLE                    m_hServiceThread;
+  HANDLE                    m_hWakeEvent;
+  std::atomic<BOOL>         m_bExit;
+  ThreadPolicySettings      m_PolicySettings;
+  ThreadPolicy              m_Policy;       // Service thread only.
+  PrecisionTimer            m_Timer;        // Service thread only.
+};
@@ -0,0 +1,113 @@
+/*
+ *      Copyright (C) 2014 Andrew Van Til
+ *      http://babgvant.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "stdafx.h"
+#include "EVRPresenter.h"
+
+// How long before the deadline the precision timer stops sleeping in the
+// kernel. This must cover the timer period set by timeBeginPeriod(1) plus 
+// the usual wakeup latency.
+const LONGLONG PRECISION_SPIN_WINDOW = 20000;   // 2 ms
+
+// Below this much time remaining, the precision timer stops giving up its
+// time slice and spins.
+const LONGLONG PRECISION_YIELD_WINDOW = 2000;   // 200 us
+
+
+//-----------------------------------------------------------------------------
+// CoarseTimer
+//-----------------------------------------------------------------------------
+
+LONGLONG CoarseTimer::Now()
+{
+  return MFGetSystemTime();
+}
+
+DWORD CoarseTimer::CoarseTimeout(LONGLONG hnsDeadline)
+{
+  LONGLONG hnsWait = hnsDeadline - Now();
+
+  if (hnsWait <= 0)
+  {
+    return 0;
+  }
+  return (DWORD)MFTimeToMsec(hnsWait);
+}
+
+
+//-----------------------------------------------------------------------------
+// PrecisionTimer
+//-----------------------------------------------------------------------------
+
+PrecisionTimer::PrecisionTimer() : m_llFrequency(0)
+{
+  LARGE_INTEGER freq;
+  if (QueryPerformanceFrequency(&freq))
+  {
+    m_llFrequency = freq.QuadPart;
+  }
+}
+
+LONGLONG PrecisionTimer::Now()
+{
+  LARGE_INTEGER counter;
+
+  if (m_llFrequency == 0 || !QueryPerformanceCounter(&counter))
+  {
+    return MFGetSystemTime();
+  }
+
+  // Split the conversion to avoid overflowing 64 bits.
+  LONGLONG llSeconds = counter.QuadPart / m_llFrequency;
+  LONGLONG llRemainder = counter.QuadPart % m_llFrequency;
+
+  return llSeconds * 10000000 + (llRemainder * 10000000) / m_llFrequency;
+}
+
+DWORD PrecisionTimer::CoarseTimeout(LONGLONG hnsDeadline)
+{
+  LONGLONG hnsWait = hnsDeadline - Now() - PRECISION_SPIN_WINDOW;
+
+  if (hnsWait <= 0)
+  {
+    return 0;
+  }
+  return (DWORD)MFTimeToMsec(hnsWait);
+}
+
+void PrecisionTimer::WaitUntil(LONGLONG hnsDeadline)
+{
+  LONGLONG hnsRemaining = 0;
+
+  while ((hnsRemaining = hnsDeadline - Now()) > 0)
+  {
+    if (hnsRemaining > PRECISION_YIELD_WINDOW)
+    {
+      // Let other threads run, but stay ready.
+      if (!SwitchToThread())
+      {
+        Sleep(0);
+      }
+    }
+    else
+    {
+      YieldProcessor();
+    }
+  }
+}
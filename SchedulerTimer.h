@@ -0,0 +1,84 @@
+/*
+ *      Copyright (C) 2014 Andrew Van Til
+ *      http://babgvant.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// SchedulerTimer class
+//
+// Abstracts how the scheduler thread reads the system time and waits for a
+// presentation deadline. All times are in 100-nanosecond units.
+//
+// The scheduler thread waits in two steps: First it blocks in the kernel for
+// CoarseTimeout() milliseconds (or until it is woken up), then it calls 
+// WaitUntil() to finish the wait.
+//-----------------------------------------------------------------------------
+
+class SchedulerTimer
+{
+public:
+  virtual ~SchedulerTimer() {}
+
+  // Returns the current system time.
+  virtual LONGLONG Now() = 0;
+
+  // Returns how long the scheduler thread should block in the kernel, in 
+  // milliseconds, before calling WaitUntil for the same deadline.
+  virtual DWORD CoarseTimeout(LONGLONG hnsDeadline) = 0;
+
+  // Finishes waiting for the deadline.
+  virtual void WaitUntil(LONGLONG hnsDeadline) = 0;
+};
+
+
+//-----------------------------------------------------------------------------
+// CoarseTimer class
+//
+// Waits with millisecond precision only. The deadline is truncated to whole
+// milliseconds and WaitUntil returns immediately.
+//-----------------------------------------------------------------------------
+
+class CoarseTimer : public SchedulerTimer
+{
+public:
+  LONGLONG Now();
+  DWORD CoarseTimeout(LONGLONG hnsDeadline);
+  void WaitUntil(LONGLONG hnsDeadline) { }
+};
+
+
+//-----------------------------------------------------------------------------
+// PrecisionTimer class
+//
+// Sleeps until shortly before the deadline, then yields and spins on the 
+// performance counter until the deadline is reached.
+//-----------------------------------------------------------------------------
+
+class PrecisionTimer : public SchedulerTimer
+{
+public:
+  PrecisionTimer();
+
+  LONGLONG Now();
+  DWORD CoarseTimeout(LONGLONG hnsDeadline);
+  void WaitUntil(LONGLONG hnsDeadline);
+
+private:
+  LONGLONG  m_llFrequency;    // Performance counter frequency.
+};
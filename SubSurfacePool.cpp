@@ -0,0 +1,333 @@
+/*
+ *      Copyright (C) 2014 Andrew Van Til
+ *      http://babgvant.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "stdafx.h"
+#include "EVRPresenter.h"
+
+const DWORD SUB_SURFACE_MIN_STEP = 16;            // Bucket granularity of small sizes, in pixels.
+const DWORD SUB_SURFACE_MAX_FREE = 8;             // Free surfaces kept for reuse.
+const DWORD SUB_SURFACE_MAX_WASTE = 2;            // A reused surface is at most this many times the bucket's area.
+const DWORD DEFAULT_SUB_SURFACE_MEMORY_CAP = 128; // Megabytes.
+
+SubSurfacePool::SubSurfacePool()
+  : m_pAllocator(NULL)
+  , m_dwMemoryCap(DEFAULT_SUB_SURFACE_MEMORY_CAP)
+  , m_cFree(0)
+  , m_dwUseCounter(0)
+  , m_cbTotal(0)
+{
+}
+
+SubSurfacePool::~SubSurfacePool()
+{
+  // Surfaces still in use keep the caller's reference.
+  for (DWORD i = 0; i < m_surfaces.GetCount(); i++)
+  {
+    SAFE_RELEASE(m_surfaces[i].pSurface);
+  }
+}
+
+void SubSurfacePool::SetAllocator(SubSurfaceAllocator *pAllocator)
+{
+  AutoLock lock(m_lock);
+  m_pAllocator = pAllocator;
+}
+
+HRESULT SubSurfacePool::SetMemoryCap(DWORD dwMegabytes)
+{
+  if (dwMegabytes == 0)
+  {
+    return E_INVALIDARG;
+  }
+
+  AutoLock lock(m_lock);
+  m_dwMemoryCap = dwMegabytes;
+  Trim();
+  return S_OK;
+}
+
+DWORD SubSurfacePool::GetMemoryCap()
+{
+  AutoLock lock(m_lock);
+  return m_dwMemoryCap;
+}
+
+//-----------------------------------------------------------------------------
+// BucketSize
+//
+// Rounds a surface size up to its bucket. Each dimension is rounded to an
+// eighth of the power of two below it, so a bucket is at most 12.5% wider
+// and taller than the sizes it holds.
+//-----------------------------------------------------------------------------
+
+void SubSurfacePool::BucketSize(UINT *pWidth, UINT *pHeight)
+{
+  UINT *pSizes[] = { pWidth, pHeight };
+
+  for (int i = 0; i < 2; i++)
+  {
+    UINT size = *pSizes[i];
+    UINT step = SUB_SURFACE_MIN_STEP;
+    while (step * 16 <= size)
+    {
+      step *= 2;
+    }
+    *pSizes[i] = (size + step - 1) & ~(step - 1);
+  }
+}
+
+//-----------------------------------------------------------------------------
+// GetSurface
+//
+// Returns a surface of at least Width x Height: the smallest free one that
+// fits and is no more than SUB_SURFACE_MAX_WASTE times the bucket's area,
+// otherwise a new one of the bucket's size, after releasing free surfaces
+// as needed to stay under the memory cap.
+//
+// Returns E_OUTOFMEMORY if the surfaces in use leave no room for it.
+//-----------------------------------------------------------------------------
+
+HRESULT SubSurfacePool::GetSurface(UINT Width, UINT Height, IDirect3DSurface9 **ppSurface)
+{
+  CheckPointer(ppSurface, E_POINTER);
+
+  if (Width == 0 || Height == 0)
+  {
+    return E_INVALIDARG;
+  }
+
+  BucketSize(&Width, &Height);
+
+  AutoLock lock(m_lock);
+
+  if (m_pAllocator == NULL)
+  {
+    return MF_E_NOT_INITIALIZED;
+  }
+
+  ULONGLONG cPixels = (ULONGLONG)Width * Height;
+  ULONGLONG cBestPixels = cPixels * SUB_SURFACE_MAX_WASTE;
+  DWORD iBest = m_surfaces.GetCount();
+
+  for (DWORD i = 0; i < m_surfaces.GetCount(); i++)
+  {
+    const SubSurface& s = m_surfaces[i];
+    if (s.bFree && s.Width >= Width && s.Height >= Height)
+    {
+      ULONGLONG cSurfacePixels = (ULONGLONG)s.Width * s.Height;
+      if (cSurfacePixels <= cBestPixels)
+      {
+        cBestPixels = cSurfacePixels;
+        iBest = i;
+      }
+      if (cSurfacePixels == cPixels)
+      {
+        break;
+      }
+    }
+  }
+
+  if (iBest < m_surfaces.GetCount())
+  {
+    SubSurface& s = m_surfaces[iBest];
+    s.bFree = FALSE;
+    m_cFree--;
+
+    *ppSurface = s.pSurface;
+    (*ppSurface)->AddRef();
+    return S_OK;
+  }
+
+  // Make room for a new surface, least recently used first.
+  DWORD cbSurface = m_pAllocator->SubSurfaceBytes(Width, Height);
+  ULONGLONG cbCap = (ULONGLONG)m_dwMemoryCap * 1024 * 1024;
+
+  while (m_cbTotal + cbSurface > cbCap && EvictFree())
+  {
+  }
+  if (m_cbTotal + cbSurface > cbCap)
+  {
+    return E_OUTOFMEMORY;
+  }
+
+  SubSurface s = { NULL, Width, Height, cbSurface, 0, FALSE, FALSE };
+
+  HRESULT hr = m_pAllocator->CreateSubSurface(Width, Height, &s.pSurface);
+  if (FAILED(hr))
+  {
+    return hr;
+  }
+
+  hr = m_surfaces.Append(s);
+  if (FAILED(hr))
+  {
+    SAFE_RELEASE(s.pSurface);
+    return hr;
+  }
+
+  m_cbTotal += cbSurface;
+
+  *ppSurface = s.pSurface;
+  (*ppSurface)->AddRef();
+  return S_OK;
+}
+
+//-----------------------------------------------------------------------------
+// ReturnSurface
+//
+// Puts a surface from GetSurface back in the pool. Does not release the
+// caller's reference. Surfaces the pool did not create are ignored.
+//-----------------------------------------------------------------------------
+
+void SubSurfacePool::ReturnSurface(IDirect3DSurface9 *pSurface)
+{
+  if (pSurface == NULL)
+  {
+    return;
+  }
+
+  AutoLock lock(m_lock);
+
+  for (DWORD i = 0; i < m_surfaces.GetCount(); i++)
+  {
+    SubSurface& s = m_surfaces[i];
+    if (s.pSurface == pSurface && !s.bFree)
+    {
+      if (s.bStale)
+      {
+        Remove(i);
+      }
+      else
+      {
+        s.bFree = TRUE;
+        s.dwLastUse = ++m_dwUseCounter;
+        m_cFree++;
+        Trim();
+      }
+      return;
+    }
+  }
+}
+
+//-----------------------------------------------------------------------------
+// Clear
+//
+// Releases the free surfaces, and marks the ones in use to be released when
+// they are returned. Call when the device is replaced.
+//-----------------------------------------------------------------------------
+
+void SubSurfacePool::Clear()
+{
+  AutoLock lock(m_lock);
+
+  DWORD i = m_surfaces.GetCount();
+  while (i-- > 0)
+  {
+    if (m_surfaces[i].bFree)
+    {
+      Remove(i);
+    }
+    else
+    {
+      m_surfaces[i].bStale = TRUE;
+    }
+  }
+}
+
+DWORD SubSurfacePool::Count()
+{
+  AutoLock lock(m_lock);
+  return m_surfaces.GetCount();
+}
+
+ULONGLONG SubSurfacePool::Bytes()
+{
+  AutoLock lock(m_lock);
+  return m_cbTotal;
+}
+
+//-----------------------------------------------------------------------------
+// Remove
+//
+// Releases the pool's reference to surface i and drops it from the array.
+// Caller holds the lock.
+//-----------------------------------------------------------------------------
+
+void SubSurfacePool::Remove(DWORD i)
+{
+  DWORD cSurfaces = m_surfaces.GetCount();
+
+  assert(i < cSurfaces);
+
+  if (m_surfaces[i].bFree)
+  {
+    m_cFree--;
+  }
+  m_cbTotal -= m_surfaces[i].cbSurface;
+  SAFE_RELEASE(m_surfaces[i].pSurface);
+
+  // Keep the array packed.
+  m_surfaces[i] = m_surfaces[cSurfaces - 1];
+  m_surfaces.SetSize(cSurfaces - 1);
+}
+
+//-----------------------------------------------------------------------------
+// EvictFree
+//
+// Releases the least recently used free surface. Returns FALSE if there is 
+// none. Caller holds the lock.
+//-----------------------------------------------------------------------------
+
+BOOL SubSurfacePool::EvictFree()
+{
+  DWORD iOldest = m_surfaces.GetCount();
+
+  for (DWORD i = 0; i < m_surfaces.GetCount(); i++)
+  {
+    if (m_surfaces[i].bFree && 
+        (iOldest == m_surfaces.GetCount() || (LONG)(m_surfaces[i].dwLastUse - m_surfaces[iOldest].dwLastUse) < 0))
+    {
+      iOldest = i;
+    }
+  }
+
+  if (iOldest == m_surfaces.GetCount())
+  {
+    return FALSE;
+  }
+
+  Remove(iOldest);
+  return TRUE;
+}
+
+//-----------------------------------------------------------------------------
+// Trim
+//
+// Releases free surfaces until the pool is under the memory cap and keeps
+// no more than SUB_SURFACE_MAX_FREE. Caller holds the lock.
+//-----------------------------------------------------------------------------
+
+void SubSurfacePool::Trim()
+{
+  ULONGLONG cbCap = (ULONGLONG)m_dwMemoryCap * 1024 * 1024;
+
+  while ((m_cbTotal > cbCap || m_cFree > SUB_SURFACE_MAX_FREE) && EvictFree())
+  {
+  }
+}
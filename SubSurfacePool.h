@@ -0,0 +1,105 @@
+/*
+ *      Copyright (C) 2014 Andrew Van Til
+ *      http://babgvant.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// SubSurfaceAllocator class
+//
+// Creates the subtitle surfaces of the pool. Implemented by the present 
+// engine.
+//-----------------------------------------------------------------------------
+
+class SubSurfaceAllocator
+{
+public:
+  virtual ~SubSurfaceAllocator() { }
+
+  // Creates a subtitle surface of exactly Width x Height.
+  virtual HRESULT CreateSubSurface(UINT Width, UINT Height, IDirect3DSurface9 **ppSurface) = 0;
+
+  // Returns the bytes of video memory a Width x Height surface takes.
+  virtual DWORD   SubSurfaceBytes(UINT Width, UINT Height) = 0;
+};
+
+
+//-----------------------------------------------------------------------------
+// SubSurfacePool class
+//
+// Recycles the surfaces that subtitle bitmaps are copied into. New surfaces
+// are rounded up to bucket sizes, and a bitmap reuses the smallest free 
+// surface it fits in, if that is not much larger; the caller copies and 
+// blits only the bitmap's rectangle.
+//
+// The pool keeps a reference to every surface it created, free or in use,
+// and counts their bytes exactly. It never holds more than the memory cap: 
+// the least recently used free surfaces are released first, and a surface 
+// that cannot fit is not created.
+//
+// GetSurface returns a surface with a reference for the caller. When done 
+// with it, call ReturnSurface and then release that reference. All methods
+// are thread-safe.
+//-----------------------------------------------------------------------------
+
+class SubSurfacePool
+{
+public:
+  SubSurfacePool();
+  ~SubSurfacePool();
+
+  void    SetAllocator(SubSurfaceAllocator *pAllocator);
+
+  HRESULT SetMemoryCap(DWORD dwMegabytes);
+  DWORD   GetMemoryCap();
+
+  HRESULT GetSurface(UINT Width, UINT Height, IDirect3DSurface9 **ppSurface);
+  void    ReturnSurface(IDirect3DSurface9 *pSurface);
+  void    Clear();
+
+  DWORD     Count();
+  ULONGLONG Bytes();
+
+  static void BucketSize(UINT *pWidth, UINT *pHeight);
+
+private:
+  struct SubSurface
+  {
+    IDirect3DSurface9 *pSurface;
+    UINT    Width;          // Bucket size.
+    UINT    Height;
+    DWORD   cbSurface;
+    DWORD   dwLastUse;      // When it was last returned, to find the least recently used.
+    BOOL    bFree;
+    BOOL    bStale;         // Created on a device that has been replaced; freed when returned.
+  };
+
+  void    Remove(DWORD i);
+  BOOL    EvictFree();
+  void    Trim();
+
+  CritSec                     m_lock;
+
+  SubSurfaceAllocator         *m_pAllocator;
+  GrowableArray<SubSurface>   m_surfaces;
+
+  DWORD                       m_dwMemoryCap;      // Megabytes.
+  DWORD                       m_cFree;            // Free surfaces kept for reuse.
+  DWORD                       m_dwUseCounter;
+  ULONGLONG                   m_cbTotal;          // Video memory of all surfaces, free or in use.
+};
@@ -0,0 +1,302 @@
+/*
+ *      Copyright (C) 2014 Andrew Van Til
+ *      http://babgvant.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "stdafx.h"
+#include "EVRPresenter.h"
+#include "TestHarness.h"
+
+//-----------------------------------------------------------------------------
+// FrameDropPolicy tests
+//
+// Lateness series run through a policy the way the scheduler does it: each
+// sample is judged against the statistics of the due samples before it,
+// then added to the window. A drop in a series with no real late frame is a
+// spurious drop.
+//-----------------------------------------------------------------------------
+
+const LONGLONG DROP_TEST_FRAME = 166833;    // 60 fps.
+const DWORD DROP_TEST_FRAMES = 10000;
+
+enum DropTestSeries
+{
+  DropTestGaussian2ms,      // 1 ms late, standard deviation 2 ms.
+  DropTestGaussian4ms,      // 1 ms late, standard deviation 4 ms.
+  DropTestBimodal,          // 0 or 8 ms late in turn.
+  DropTestCadence23,        // 8 ms late for 2 of every 5 frames.
+  DropTestSpikes            // 1 ms late, and 25 ms more for about 3% of frames.
+};
+
+struct DropTestRun
+{
+  DWORD cDrops;
+  DWORD cSpikes;
+  DWORD cSpikesDropped;
+};
+
+// Deterministic noise: about normal, mean 0, standard deviation 1.
+static double NextNoise(DWORD *pdwSeed)
+{
+  double sum = 0;
+  for (int i = 0; i < 12; i++)
+  {
+    *pdwSeed = *pdwSeed * 1103515245 + 12345;
+    sum += ((*pdwSeed >> 8) & 0xFFFF) / 65536.0;
+  }
+  return sum - 6;
+}
+
+static DropTestRun RunSeries(FrameDropPolicy *pPolicy, DropTestSeries series)
+{
+  DropTestRun run = { 0 };
+  RobustWindow window;
+  DWORD dwSeed = 42;
+
+  for (DWORD i = 0; i < DROP_TEST_FRAMES; i++)
+  {
+    double msLate = 0;
+    BOOL bSpike = FALSE;
+
+    switch (series)
+    {
+    case DropTestGaussian2ms:
+      msLate = 1 + 2 * NextNoise(&dwSeed);
+      break;
+
+    case DropTestGaussian4ms:
+      msLate = 1 + 4 * NextNoise(&dwSeed);
+      break;
+
+    case DropTestBimodal:
+      msLate = ((i & 1) ? 8 : 0) + 0.5 * NextNoise(&dwSeed);
+      break;
+
+    case DropTestCadence23:
+      msLate = ((i % 5) < 2 ? 8 : 0) + 0.5 * NextNoise(&dwSeed);
+      break;
+
+    case DropTestSpikes:
+      msLate = 1 + 0.5 * NextNoise(&dwSeed);
+      dwSeed = dwSeed * 1103515245 + 12345;
+      if (((dwSeed >> 8) & 0xFFFF) % 100 < 3)
+      {
+        msLate += 25;
+        bSpike = TRUE;
+      }
+      break;
+    }
+
+    FrameDropContext context = { 0 };
+    context.hnsDelta = -(LONGLONG)(msLate * 10000);
+    context.hnsFrameInterval = DROP_TEST_FRAME;
+    context.fRate = 1;
+    context.cQueued = 2;
+    context.iThreshold = 5;
+    context.bDue = TRUE;
+    context.bHaveStats = window.GetStats(&context.lateness);
+
+    BOOL bDrop = pPolicy->ShouldDrop(context);
+    window.Add(-context.hnsDelta);
+
+    if (bDrop)
+    {
+      run.cDrops++;
+    }
+    if (bSpike)
+    {
+      run.cSpikes++;
+      if (bDrop)
+      {
+        run.cSpikesDropped++;
+      }
+    }
+  }
+  return run;
+}
+
+TEST_CASE(FrameDropPolicy_LateThresholdNoise)
+{
+  LateThresholdPolicy policy;
+
+  // Noise well inside a frame: at most one spurious drop in 1000 frames.
+  DropTestRun run = RunSeries(&policy, DropTestGaussian2ms);
+  CHECK(run.cDrops <= DROP_TEST_FRAMES / 1000);
+
+  // Noise of a quarter frame: at most one in 200.
+  run = RunSeries(&policy, DropTestGaussian4ms);
+  CHECK(run.cDrops <= DROP_TEST_FRAMES / 200);
+}
+
+TEST_CASE(FrameDropPolicy_LateThresholdBimodal)
+{
+  LateThresholdPolicy policy;
+
+  // The MAD of a two-valued series is about the noise on each value; only
+  // the 90th percentile keeps the late mode from being dropped.
+  DropTestRun run = RunSeries(&policy, DropTestBimodal);
+  CHECK(run.cDrops == 0);
+
+  run = RunSeries(&policy, DropTestCadence23);
+  CHECK(run.cDrops == 0);
+}
+
+TEST_CASE(FrameDropPolicy_LateThresholdSpikes)
+{
+  LateThresholdPolicy policy;
+
+  DropTestRun run = RunSeries(&policy, DropTestSpikes);
+  REQUIRE(run.cSpikes > DROP_TEST_FRAMES / 50);
+
+  // Nearly every spike is dropped, and nothing else is.
+  CHECK(run.cSpikesDropped >= run.cSpikes * 95 / 100);
+  CHECK(run.cDrops == run.cSpikesDropped);
+}
+
+// A context for a due sample 20 ms late after a run of samples 1 ms late.
+static FrameDropContext LateContext()
+{
+  RobustWindow window;
+  for (DWORD i = 0; i < ROBUST_WINDOW; i++)
+  {
+    window.Add(10000 + (i % 3) * 1000);
+  }
+
+  FrameDropContext context = { 0 };
+  context.hnsDelta = -200000;
+  context.hnsFrameInterval = DROP_TEST_FRAME;
+  context.fRate = 1;
+  context.cQueued = 2;
+  context.iThreshold = 5;
+  context.bDue = TRUE;
+  context.bHaveStats = window.GetStats(&context.lateness);
+  return context;
+}
+
+TEST_CASE(FrameDropPolicy_LateThresholdConditions)
+{
+  LateThresholdPolicy policy;
+  FrameDropContext context = LateContext();
+  REQUIRE(context.bHaveStats);
+  CHECK(policy.ShouldDrop(context));
+
+  // Not yet due.
+  context = LateContext();
+  context.bDue = FALSE;
+  CHECK(!policy.ShouldDrop(context));
+
+  // Nothing queued behind it.
+  context = LateContext();
+  context.cQueued = 0;
+  CHECK(!policy.ShouldDrop(context));
+
+  // No statistics yet.
+  context = LateContext();
+  context.bHaveStats = FALSE;
+  CHECK(!policy.ShouldDrop(context));
+
+  // Superseded samples are dropped, whatever the statistics.
+  context = LateContext();
+  context.hnsDelta = 0;
+  context.cQueued = 0;
+  context.bHaveStats = FALSE;
+  context.bSuperseded = TRUE;
+  CHECK(policy.ShouldDrop(context));
+
+  // At fast rates, samples far from the clock are dropped even if early,
+  // unless the thinning planner picked them.
+  context = LateContext();
+  context.fRate = 4;
+  context.bDue = FALSE;
+  context.hnsDelta = DROP_TEST_FRAME * 6;
+  CHECK(policy.ShouldDrop(context));
+  context.bThinned = TRUE;
+  CHECK(!policy.ShouldDrop(context));
+}
+
+TEST_CASE(FrameDropPolicy_QueueDepth)
+{
+  QueueDepthPolicy policy;
+  FrameDropContext context = LateContext();
+
+  // Within half a frame.
+  context.hnsDelta = -(DROP_TEST_FRAME / 2);
+  CHECK(!policy.ShouldDrop(context));
+
+  context.hnsDelta = -(DROP_TEST_FRAME / 2) - 1;
+  CHECK(policy.ShouldDrop(context));
+
+  // The newest sample is always shown.
+  context.cQueued = 0;
+  context.bSuperseded = TRUE;
+  CHECK(!policy.ShouldDrop(context));
+
+  context.cQueued = 1;
+  context.hnsDelta = 0;
+  CHECK(policy.ShouldDrop(context));
+}
+
+TEST_CASE(FrameDropPolicy_CatchUp)
+{
+  CatchUpPolicy policy;
+  FrameDropContext context = LateContext();
+  context.iThreshold = 3;
+
+  // Less than a frame late does not start a burst.
+  context.hnsDelta = -DROP_TEST_FRAME;
+  CHECK(!policy.ShouldDrop(context));
+
+  // A burst drops iThreshold samples, then presents one.
+  context.hnsDelta = -2 * DROP_TEST_FRAME;
+  DWORD cDrops = 0;
+  for (DWORD i = 0; i < 8; i++)
+  {
+    BOOL bDrop = policy.ShouldDrop(context);
+    CHECK(bDrop == ((i % 4) != 3));
+    cDrops += bDrop;
+  }
+  CHECK(cDrops == 6);
+
+  // Half a frame late is still not caught up.
+  context.hnsDelta = -(DROP_TEST_FRAME / 2);
+  CHECK(policy.ShouldDrop(context));
+
+  // Back within a quarter frame ends the burst.
+  context.hnsDelta = -(DROP_TEST_FRAME / 4);
+  CHECK(!policy.ShouldDrop(context));
+  context.hnsDelta = -(DROP_TEST_FRAME / 2);
+  CHECK(!policy.ShouldDrop(context));
+
+  // Reset ends it as well.
+  context.hnsDelta = -2 * DROP_TEST_FRAME;
+  CHECK(policy.ShouldDrop(context));
+  policy.Reset();
+  context.hnsDelta = -(DROP_TEST_FRAME / 2);
+  CHECK(!policy.ShouldDrop(context));
+}
+
+TEST_CASE(FrameDropPolicy_Never)
+{
+  NeverDropPolicy policy;
+
+  DropTestRun run = RunSeries(&policy, DropTestSpikes);
+  CHECK(run.cDrops == 0);
+
+  FrameDropContext context = LateContext();
+  context.bSuperseded = TRUE;
+  CHECK(!policy.ShouldDrop(context));
+}
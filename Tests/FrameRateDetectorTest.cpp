@@ -0,0 +1,227 @@
+/*
+ *      Copyright (C) 2014 Andrew Van Til
+ *      http://babgvant.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "stdafx.h"
+#include "EVRPresenter.h"
+#include "TestHarness.h"
+
+//-----------------------------------------------------------------------------
+// FrameRateDetector tests
+//
+// Synthetic time stamp streams. Most are rounded to 1 ms, as Matroska time
+// stamps are, which is the hard case for telling 23.976 from 24 fps.
+//-----------------------------------------------------------------------------
+
+// Time stamp of frame i at fps, optionally rounded to 1 ms.
+static LONGLONG FrameTime(DWORD i, const MFRatio& fps, BOOL bRoundToMs)
+{
+  LONGLONG hnsTime = (LONGLONG)((double)i * fps.Denominator * 10000000 / fps.Numerator + 0.5);
+
+  if (bRoundToMs)
+  {
+    hnsTime = (hnsTime + 5000) / 10000 * 10000;
+  }
+  return hnsTime;
+}
+
+// Adds frames iFirst to iLast - 1 of a constant-rate stream that starts at
+// hnsStart.
+static void FeedConstantRate(FrameRateDetector *pDetector, UINT32 uNumerator, UINT32 uDenominator, DWORD iFirst, DWORD iLast, BOOL bRoundToMs, LONGLONG hnsStart = 0)
+{
+  MFRatio fps = { uNumerator, uDenominator };
+
+  for (DWORD i = iFirst; i < iLast; i++)
+  {
+    pDetector->AddSample(hnsStart + FrameTime(i, fps, bRoundToMs));
+  }
+}
+
+TEST_CASE(FrameRateDetector_Film23976)
+{
+  FrameRateDetector detector;
+
+  // Ten seconds, rounded to 1 ms.
+  FeedConstantRate(&detector, 24000, 1001, 0, 240, TRUE);
+  CHECK(detector.FrameInterval() == 417083);
+  CHECK(detector.Cadence() == EVRCP_CADENCE_CONSTANT);
+
+  // Exact time stamps give the same answer.
+  detector.Reset();
+  FeedConstantRate(&detector, 24000, 1001, 0, 240, FALSE);
+  CHECK(detector.FrameInterval() == 417083);
+  CHECK(detector.Cadence() == EVRCP_CADENCE_CONSTANT);
+}
+
+TEST_CASE(FrameRateDetector_Film24)
+{
+  FrameRateDetector detector;
+
+  FeedConstantRate(&detector, 24, 1, 0, 240, TRUE);
+  CHECK(detector.FrameInterval() == 416667);
+  CHECK(detector.Cadence() == EVRCP_CADENCE_CONSTANT);
+}
+
+TEST_CASE(FrameRateDetector_Video2997)
+{
+  FrameRateDetector detector;
+
+  FeedConstantRate(&detector, 30000, 1001, 0, 300, TRUE);
+  CHECK(detector.FrameInterval() == 333667);
+  CHECK(detector.Cadence() == EVRCP_CADENCE_CONSTANT);
+}
+
+TEST_CASE(FrameRateDetector_NotEnoughSamples)
+{
+  FrameRateDetector detector;
+
+  // Under the four seconds needed for an estimate.
+  FeedConstantRate(&detector, 24, 1, 0, 60, TRUE);
+  CHECK(detector.FrameInterval() == 0);
+  CHECK(detector.Cadence() == EVRCP_CADENCE_UNKNOWN);
+}
+
+// Film telecined to 59.94 fields per second: frames last 3 and 2 field
+// pairs of a 29.97 stream, in turn, for an average of 23.976 fps.
+static void FeedTelecine(FrameRateDetector *pDetector, DWORD cFrames, BOOL bRoundToMs)
+{
+  MFRatio fields = { 60000, 1001 };
+  DWORD iField = 0;
+
+  for (DWORD i = 0; i < cFrames; i++)
+  {
+    pDetector->AddSample(FrameTime(iField, fields, bRoundToMs));
+    iField += (i % 2) ? 2 : 3;
+  }
+}
+
+TEST_CASE(FrameRateDetector_Telecine)
+{
+  FrameRateDetector detector;
+
+  FeedTelecine(&detector, 240, TRUE);
+  CHECK(detector.Cadence() == EVRCP_CADENCE_TELECINE);
+  CHECK(detector.FrameInterval() == 417083);
+
+  // After the window wraps, with the oldest interval at either phase.
+  detector.Reset();
+  FeedTelecine(&detector, 1000, TRUE);
+  CHECK(detector.Cadence() == EVRCP_CADENCE_TELECINE);
+  CHECK(detector.FrameInterval() == 417083);
+
+  detector.Reset();
+  FeedTelecine(&detector, 1001, TRUE);
+  CHECK(detector.Cadence() == EVRCP_CADENCE_TELECINE);
+  CHECK(detector.FrameInterval() == 417083);
+
+  // Once there is an estimate, it holds on every frame, whether the window
+  // has an odd or even number of intervals.
+  MFRatio fields = { 60000, 1001 };
+  DWORD iField = 0;
+  DWORD cWrong = 0;
+
+  detector.Reset();
+  for (DWORD i = 0; i < 600; i++)
+  {
+    detector.AddSample(FrameTime(iField, fields, TRUE));
+    iField += (i % 2) ? 2 : 3;
+
+    if (detector.FrameInterval() != 0 && detector.FrameInterval() != 417083)
+    {
+      cWrong++;
+    }
+  }
+  CHECK(cWrong == 0);
+}
+
+TEST_CASE(FrameRateDetector_NotTelecine)
+{
+  MFRatio fields = { 60000, 1001 };
+  FrameRateDetector detector;
+
+  // 2:3:3:2 has the same lengths as 3:2 but does not alternate.
+  DWORD iField = 0;
+  for (DWORD i = 0; i < 240; i++)
+  {
+    detector.AddSample(FrameTime(iField, fields, TRUE));
+    iField += (i % 4 == 0 || i % 4 == 3) ? 2 : 3;
+  }
+  CHECK(detector.Cadence() == EVRCP_CADENCE_VARIABLE);
+
+  // Nor does a random mix of the two lengths.
+  detector.Reset();
+  DWORD dwSeed = 2;
+  iField = 0;
+  for (DWORD i = 0; i < 240; i++)
+  {
+    detector.AddSample(FrameTime(iField, fields, TRUE));
+    dwSeed = dwSeed * 1103515245 + 12345;
+    iField += ((dwSeed >> 16) & 1) ? 3 : 2;
+  }
+  CHECK(detector.Cadence() == EVRCP_CADENCE_VARIABLE);
+}
+
+TEST_CASE(FrameRateDetector_VariableFrameRate)
+{
+  MFRatio fps = { 30000, 1001 };
+  FrameRateDetector detector;
+
+  // Frames last one to three frame times of 29.97 fps, as in a screen
+  // capture that skips frames.
+  DWORD dwSeed = 1;
+  DWORD iFrame = 0;
+  for (DWORD i = 0; i < 300; i++)
+  {
+    detector.AddSample(FrameTime(iFrame, fps, TRUE));
+    dwSeed = dwSeed * 1103515245 + 12345;
+    iFrame += 1 + (dwSeed >> 16) % 3;
+  }
+
+  CHECK(detector.Cadence() == EVRCP_CADENCE_VARIABLE);
+
+  // The estimate is the mean interval, which is not a standard rate.
+  LONGLONG hnsInterval = detector.FrameInterval();
+  CHECK(hnsInterval > 333667 * 3 / 2 && hnsInterval < 333667 * 5 / 2);
+}
+
+TEST_CASE(FrameRateDetector_Discontinuity)
+{
+  FrameRateDetector detector;
+
+  FeedConstantRate(&detector, 24, 1, 0, 240, TRUE);
+  CHECK(detector.FrameInterval() == 416667);
+
+  // A seek keeps the estimate until the new position has enough samples.
+  detector.Discontinuity();
+  FeedConstantRate(&detector, 25, 1, 0, 50, TRUE, 600000000);
+  CHECK(detector.FrameInterval() == 416667);
+
+  FeedConstantRate(&detector, 25, 1, 50, 150, TRUE, 600000000);
+  CHECK(detector.FrameInterval() == 400000);
+  CHECK(detector.Cadence() == EVRCP_CADENCE_CONSTANT);
+
+  // A jump in the time stamps is a discontinuity, not a long interval: 
+  // three seconds on either side of it are not enough for an estimate.
+  detector.Reset();
+  FeedConstantRate(&detector, 24000, 1001, 0, 72, TRUE);
+  FeedConstantRate(&detector, 24000, 1001, 0, 72, TRUE, 900000000);
+  CHECK(detector.FrameInterval() == 0);
+  FeedConstantRate(&detector, 24000, 1001, 72, 144, TRUE, 900000000);
+  CHECK(detector.FrameInterval() == 417083);
+  CHECK(detector.Cadence() == EVRCP_CADENCE_CONSTANT);
+}
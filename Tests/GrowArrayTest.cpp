@@ -0,0 +1,290 @@
+/*
+ *      Copyright (C) 2014 Andrew Van Til
+ *      http://babgvant.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "stdafx.h"
+#include "EVRPresenter.h"
+#include "TestHarness.h"
+
+//-----------------------------------------------------------------------------
+// GrowableArray tests (Common/GrowArray.h)
+//
+// CountedItem counts its constructions, copies, moves and destructions, so
+// the tests can check that growth moves elements instead of copying them,
+// that every element constructed is destroyed exactly once, and that inline
+// storage does not allocate.
+//-----------------------------------------------------------------------------
+
+class CountedItem
+{
+public:
+  CountedItem() : m_value(0) { s_cConstructed++; s_cLive++; }
+  CountedItem(int value) : m_value(value) { s_cConstructed++; s_cLive++; }
+  CountedItem(const CountedItem& r) : m_value(r.m_value) { s_cCopied++; s_cLive++; }
+  CountedItem(CountedItem&& r) : m_value(r.m_value) { r.m_value = -1; s_cMoved++; s_cLive++; }
+  ~CountedItem() { s_cLive--; }
+
+  CountedItem& operator=(const CountedItem& r) { m_value = r.m_value; return *this; }
+
+  int Value() const { return m_value; }
+
+  static void ResetCounts() { s_cConstructed = s_cCopied = s_cMoved = 0; }
+
+  static LONG s_cConstructed;   // Default and value constructions.
+  static LONG s_cCopied;
+  static LONG s_cMoved;
+  static LONG s_cLive;          // Constructed and not yet destroyed.
+
+private:
+  int m_value;
+};
+
+LONG CountedItem::s_cConstructed = 0;
+LONG CountedItem::s_cCopied = 0;
+LONG CountedItem::s_cMoved = 0;
+LONG CountedItem::s_cLive = 0;
+
+// Fills the array with 0..count-1.
+template <DWORD N>
+static HRESULT FillArray(GrowableArray<CountedItem, N>& array, int count)
+{
+  HRESULT hr = S_OK;
+  for (int i = 0; i < count && SUCCEEDED(hr); i++)
+  {
+    hr = array.Append(CountedItem(i));
+  }
+  return hr;
+}
+
+template <DWORD N>
+static BOOL ArrayHolds(GrowableArray<CountedItem, N>& array, int count)
+{
+  if (array.GetCount() != (DWORD)count)
+  {
+    return FALSE;
+  }
+  for (int i = 0; i < count; i++)
+  {
+    if (array[i].Value() != i)
+    {
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+TEST_CASE(GrowArray_SetSizeConstructsAndDestroys)
+{
+  LONG cLive = CountedItem::s_cLive;
+  {
+    GrowableArray<CountedItem> array;
+    CountedItem::ResetCounts();
+
+    REQUIRE(array.SetSize(10) == S_OK);
+    CHECK(CountedItem::s_cConstructed == 10);
+    CHECK(CountedItem::s_cLive == cLive + 10);
+
+    // Shrinking destroys the elements past the new count; the allocation
+    // stays.
+    DWORD cAllocated = array.GetAllocated();
+    REQUIRE(array.SetSize(4) == S_OK);
+    CHECK(CountedItem::s_cLive == cLive + 4);
+    CHECK(array.GetAllocated() == cAllocated);
+
+    // Growing within the allocation constructs only the new elements.
+    CountedItem::ResetCounts();
+    LONG cAllocations = AllocationCount();
+    REQUIRE(array.SetSize(8) == S_OK);
+    CHECK(CountedItem::s_cConstructed == 4);
+    CHECK(CountedItem::s_cMoved == 0);
+    CHECK(AllocationCount() == cAllocations);
+  }
+
+  // The destructor destroys the count, not the allocation.
+  CHECK(CountedItem::s_cLive == cLive);
+}
+
+TEST_CASE(GrowArray_GrowthMovesElements)
+{
+  LONG cLive = CountedItem::s_cLive;
+  {
+    GrowableArray<CountedItem> array;
+    CountedItem::ResetCounts();
+
+    const int count = 1000;
+    LONG cAllocations = AllocationCount();
+    REQUIRE(FillArray(array, count) == S_OK);
+    CHECK(ArrayHolds(array, count));
+
+    // Each Append copies its argument once; relocation moves and never
+    // copies.
+    CHECK(CountedItem::s_cCopied == count);
+    CHECK(CountedItem::s_cLive == cLive + count);
+
+    // Geometric growth: few allocations, and each element is moved only a
+    // few times on average.
+    CHECK(AllocationCount() - cAllocations < 20);
+    CHECK(CountedItem::s_cMoved < 3 * count);
+
+    // Allocate moves every element exactly once.
+    CountedItem::ResetCounts();
+    REQUIRE(array.Allocate(array.GetAllocated() * 2) == S_OK);
+    CHECK(CountedItem::s_cMoved == count);
+    CHECK(CountedItem::s_cCopied == 0);
+    CHECK(CountedItem::s_cLive == cLive + count);
+    CHECK(ArrayHolds(array, count));
+
+    // Allocating less than there is does nothing.
+    CountedItem::ResetCounts();
+    CHECK(array.Allocate(10) == S_OK);
+    CHECK(CountedItem::s_cMoved == 0);
+  }
+  CHECK(CountedItem::s_cLive == cLive);
+}
+
+TEST_CASE(GrowArray_TrivialElements)
+{
+  GrowableArray<DWORD> array;
+
+  // Plain data is relocated with memcpy.
+  for (DWORD i = 0; i < 1000; i++)
+  {
+    REQUIRE(array.Append(i * 3) == S_OK);
+  }
+  REQUIRE(array.Allocate(4000) == S_OK);
+
+  DWORD cWrong = 0;
+  for (DWORD i = 0; i < 1000; i++)
+  {
+    cWrong += (array[i] != i * 3);
+  }
+  CHECK(cWrong == 0);
+  CHECK(array.Ptr() == &array[0]);
+}
+
+TEST_CASE(GrowArray_InlineStorage)
+{
+  LONG cLive = CountedItem::s_cLive;
+  {
+    GrowableArray<CountedItem, 4> array;
+    CHECK(array.GetAllocated() == 4);
+
+    // Up to the inline count, nothing is allocated.
+    LONG cAllocations = AllocationCount();
+    REQUIRE(FillArray(array, 4) == S_OK);
+    CHECK(AllocationCount() == cAllocations);
+
+    // The fifth element moves the four inline ones to the heap.
+    CountedItem::ResetCounts();
+    REQUIRE(array.Append(CountedItem(4)) == S_OK);
+    CHECK(AllocationCount() - cAllocations == 1);
+    CHECK(CountedItem::s_cMoved == 4);
+    CHECK(CountedItem::s_cLive == cLive + 5);
+    CHECK(ArrayHolds(array, 5));
+  }
+  CHECK(CountedItem::s_cLive == cLive);
+}
+
+TEST_CASE(GrowArray_MoveHeapArray)
+{
+  LONG cLive = CountedItem::s_cLive;
+  {
+    GrowableArray<CountedItem, 2> source;
+    REQUIRE(FillArray(source, 10) == S_OK);
+    CountedItem *pElements = source.Ptr();
+
+    // A heap array changes hands without touching the elements.
+    CountedItem::ResetCounts();
+    LONG cAllocations = AllocationCount();
+    GrowableArray<CountedItem, 2> target(std::move(source));
+
+    CHECK(target.Ptr() == pElements);
+    CHECK(CountedItem::s_cMoved == 0);
+    CHECK(CountedItem::s_cCopied == 0);
+    CHECK(AllocationCount() == cAllocations);
+    CHECK(ArrayHolds(target, 10));
+
+    // The source is empty and back on its inline storage.
+    CHECK(source.GetCount() == 0);
+    CHECK(source.GetAllocated() == 2);
+    CHECK(source.Ptr() != pElements);
+    CHECK(CountedItem::s_cLive == cLive + 10);
+
+    // And can be used again.
+    REQUIRE(FillArray(source, 2) == S_OK);
+    CHECK(AllocationCount() == cAllocations);
+  }
+  CHECK(CountedItem::s_cLive == cLive);
+}
+
+TEST_CASE(GrowArray_MoveInlineArray)
+{
+  LONG cLive = CountedItem::s_cLive;
+  {
+    GrowableArray<CountedItem, 4> source;
+    REQUIRE(FillArray(source, 3) == S_OK);
+
+    // Inline elements are moved one by one, and the originals destroyed.
+    CountedItem::ResetCounts();
+    GrowableArray<CountedItem, 4> target(std::move(source));
+
+    CHECK(CountedItem::s_cMoved == 3);
+    CHECK(CountedItem::s_cCopied == 0);
+    CHECK(CountedItem::s_cLive == cLive + 3);
+    CHECK(source.GetCount() == 0);
+    CHECK(target.Ptr() != source.Ptr());
+    CHECK(ArrayHolds(target, 3));
+  }
+  CHECK(CountedItem::s_cLive == cLive);
+}
+
+TEST_CASE(GrowArray_MoveAssignment)
+{
+  LONG cLive = CountedItem::s_cLive;
+  {
+    GrowableArray<CountedItem, 4> target;
+    REQUIRE(FillArray(target, 20) == S_OK);
+
+    GrowableArray<CountedItem, 4> inlineSource;
+    REQUIRE(FillArray(inlineSource, 2) == S_OK);
+
+    GrowableArray<CountedItem, 4> heapSource;
+    REQUIRE(FillArray(heapSource, 6) == S_OK);
+    CHECK(CountedItem::s_cLive == cLive + 28);
+
+    // The target's own elements are destroyed first.
+    target = std::move(inlineSource);
+    CHECK(CountedItem::s_cLive == cLive + 8);
+    CHECK(ArrayHolds(target, 2));
+    CHECK(inlineSource.GetCount() == 0);
+
+    // From the heap, the array changes hands.
+    CountedItem *pElements = heapSource.Ptr();
+    target = std::move(heapSource);
+    CHECK(CountedItem::s_cLive == cLive + 6);
+    CHECK(target.Ptr() == pElements);
+    CHECK(ArrayHolds(target, 6));
+    CHECK(heapSource.GetCount() == 0);
+
+    // Moving an array onto itself keeps it.
+    GrowableArray<CountedItem, 4>& alias = target;
+    target = std::move(alias);
+    CHECK(ArrayHolds(target, 6));
+  }
+  CHECK(CountedItem::s_cLive == cLive);
+}
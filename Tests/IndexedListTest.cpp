@@ -0,0 +1,251 @@
+/*
+ *      Copyright (C) 2014 Andrew Van Til
+ *      http://babgvant.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "stdafx.h"
+#include "EVRPresenter.h"
+#include "TestHarness.h"
+
+//-----------------------------------------------------------------------------
+// IndexedList tests (Common/IndexedList.h)
+//-----------------------------------------------------------------------------
+
+template <DWORD N>
+static BOOL IndexedListEquals(const IndexedList<int, N>& list, const int *pItems, DWORD cItems)
+{
+  if (list.GetCount() != cItems)
+  {
+    return FALSE;
+  }
+  for (DWORD i = 0; i < cItems; i++)
+  {
+    if (list.ItemAt(i) != pItems[i])
+    {
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+TEST_CASE(IndexedList_InsertAt)
+{
+  IndexedList<int> list;
+
+  CHECK(list.InsertAt(0, 2) == S_OK);     // Empty list.
+  CHECK(list.InsertAt(1, 5) == S_OK);     // Back.
+  CHECK(list.InsertAt(0, 0) == S_OK);     // Front.
+  CHECK(list.InsertAt(1, 1) == S_OK);     // Middle, next to the front.
+  CHECK(list.InsertAt(3, 4) == S_OK);     // Middle, next to the back.
+  CHECK(list.InsertAt(3, 3) == S_OK);     // Middle.
+
+  static const int expected[] = { 0, 1, 2, 3, 4, 5 };
+  CHECK(IndexedListEquals(list, expected, ARRAY_SIZE(expected)));
+
+  // Past the end.
+  CHECK(list.InsertAt(7, 7) == E_INVALIDARG);
+  CHECK(list.GetCount() == 6);
+
+  CHECK(list.InsertFront(-1) == S_OK);
+  CHECK(list.InsertBack(6) == S_OK);
+
+  int item = 0;
+  CHECK(list.GetFront(&item) == S_OK && item == -1);
+  CHECK(list.GetBack(&item) == S_OK && item == 6);
+  CHECK(list.GetCount() == 8);
+}
+
+TEST_CASE(IndexedList_RemoveAt)
+{
+  IndexedList<int> list;
+  for (int i = 0; i < 8; i++)
+  {
+    list.InsertBack(i);
+  }
+
+  int item = -1;
+  CHECK(list.RemoveAt(0, &item) == S_OK && item == 0);      // Front.
+  CHECK(list.RemoveAt(6, &item) == S_OK && item == 7);      // Back.
+  CHECK(list.RemoveAt(1, &item) == S_OK && item == 2);      // Next to the front.
+  CHECK(list.RemoveAt(3, &item) == S_OK && item == 5);      // Middle.
+  CHECK(list.RemoveAt(3, NULL) == S_OK);                    // Back, without the item.
+
+  static const int expected[] = { 1, 3, 4 };
+  CHECK(IndexedListEquals(list, expected, ARRAY_SIZE(expected)));
+
+  // Past the end.
+  CHECK(list.RemoveAt(3, &item) == E_INVALIDARG);
+
+  CHECK(list.RemoveFront(&item) == S_OK && item == 1);
+  CHECK(list.RemoveBack(&item) == S_OK && item == 4);
+  CHECK(list.RemoveBack(&item) == S_OK && item == 3);
+  CHECK(list.IsEmpty());
+
+  // Empty list.
+  CHECK(list.RemoveFront(&item) == E_UNEXPECTED);
+  CHECK(list.RemoveBack(&item) == E_UNEXPECTED);
+  CHECK(list.GetFront(&item) == E_UNEXPECTED);
+  CHECK(list.GetBack(&item) == E_UNEXPECTED);
+  CHECK(list.RemoveAt(0, &item) == E_INVALIDARG);
+}
+
+TEST_CASE(IndexedList_RandomPositions)
+{
+  // Random inserts and removes, compared with a plain array.
+  const DWORD cMax = 64;
+  int model[cMax];
+  DWORD cModel = 0;
+  IndexedList<int, 8> list;
+
+  DWORD dwSeed = 3;
+  DWORD cMismatches = 0;
+
+  for (int i = 0; i < 5000; i++)
+  {
+    dwSeed = dwSeed * 1103515245 + 12345;
+    DWORD r = dwSeed >> 16;
+
+    if (cModel < cMax && (cModel == 0 || r % 2 == 0))
+    {
+      DWORD pos = (r / 2) % (cModel + 1);
+      cMismatches += (list.InsertAt(pos, i) != S_OK);
+      for (DWORD j = cModel; j > pos; j--)
+      {
+        model[j] = model[j - 1];
+      }
+      model[pos] = i;
+      cModel++;
+    }
+    else
+    {
+      DWORD pos = (r / 2) % cModel;
+      int item = -1;
+      cMismatches += (list.RemoveAt(pos, &item) != S_OK || item != model[pos]);
+      for (DWORD j = pos + 1; j < cModel; j++)
+      {
+        model[j - 1] = model[j];
+      }
+      cModel--;
+    }
+
+    cMismatches += !IndexedListEquals(list, model, cModel);
+  }
+  CHECK(cMismatches == 0);
+}
+
+struct RankedItem
+{
+  int merit;
+  int order;                  // Insertion order.
+};
+
+static bool LowerMerit(const RankedItem& a, const RankedItem& b)
+{
+  return a.merit < b.merit;
+}
+
+static bool HigherMerit(const RankedItem& a, const RankedItem& b)
+{
+  return a.merit > b.merit;
+}
+
+TEST_CASE(IndexedList_UpperBound)
+{
+  IndexedList<RankedItem> list;
+  RankedItem item = { 5, 0 };
+
+  CHECK(list.UpperBound(item, LowerMerit) == 0);
+
+  // Sorted insertion, with ties. Equal items keep their insertion order.
+  DWORD dwSeed = 11;
+  for (int i = 0; i < 200; i++)
+  {
+    dwSeed = dwSeed * 1103515245 + 12345;
+    item.merit = (dwSeed >> 16) % 20;
+    item.order = i;
+    REQUIRE(list.InsertAt(list.UpperBound(item, LowerMerit), item) == S_OK);
+  }
+
+  DWORD cOutOfOrder = 0;
+  for (DWORD i = 1; i < list.GetCount(); i++)
+  {
+    RankedItem prev = list.ItemAt(i - 1);
+    RankedItem next = list.ItemAt(i);
+    if (prev.merit > next.merit || (prev.merit == next.merit && prev.order > next.order))
+    {
+      cOutOfOrder++;
+    }
+  }
+  CHECK(cOutOfOrder == 0);
+
+  // The bound is past every equal item, and before every greater one.
+  item.merit = 7;
+  DWORD pos = list.UpperBound(item, LowerMerit);
+  CHECK(pos > 0 && list.ItemAt(pos - 1).merit <= 7);
+  CHECK(pos < list.GetCount() && list.ItemAt(pos).merit > 7);
+
+  item.merit = -1;
+  CHECK(list.UpperBound(item, LowerMerit) == 0);
+  item.merit = 20;
+  CHECK(list.UpperBound(item, LowerMerit) == list.GetCount());
+
+  // Descending order, as the mixer type ranking uses.
+  IndexedList<RankedItem> ranked;
+  static const int merits[] = { 1, 3, 2, 3, 0, 1 };
+  for (DWORD i = 0; i < ARRAY_SIZE(merits); i++)
+  {
+    item.merit = merits[i];
+    item.order = (int)i;
+    REQUIRE(ranked.InsertAt(ranked.UpperBound(item, HigherMerit), item) == S_OK);
+  }
+
+  static const int expectedOrder[] = { 1, 3, 2, 0, 5, 4 };
+  DWORD cWrong = 0;
+  for (DWORD i = 0; i < ARRAY_SIZE(expectedOrder); i++)
+  {
+    cWrong += (ranked.ItemAt(i).order != expectedOrder[i]);
+  }
+  CHECK(cWrong == 0);
+}
+
+TEST_CASE(IndexedList_ReserveAndClear)
+{
+  LONG cLive = TestObject::LiveCount();
+  {
+    IndexedList<IUnknown*> list;
+    REQUIRE(list.Reserve(16) == S_OK);
+
+    IUnknown *pObjects[16];
+    for (DWORD i = 0; i < 16; i++)
+    {
+      pObjects[i] = TestObject::Create(i);
+    }
+
+    // Inserts within the reservation do not allocate.
+    LONG cBefore = AllocationCount();
+    for (DWORD i = 0; i < 16; i++)
+    {
+      CHECK(list.InsertAt(list.GetCount() / 2, pObjects[i]) == S_OK);
+    }
+    CHECK(AllocationCount() == cBefore);
+
+    ComAutoRelease release;
+    list.Clear(release);
+    CHECK(list.IsEmpty());
+  }
+  CHECK(TestObject::LiveCount() == cLive);
+}
@@ -0,0 +1,214 @@
+/*
+ *      Copyright (C) 2014 Andrew Van Til
+ *      http://babgvant.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "stdafx.h"
+#include "EVRPresenter.h"
+#include "TestHarness.h"
+
+//-----------------------------------------------------------------------------
+// JitterBufferController tests
+//
+// Replays sample arrival times through OnArrival, as the scheduler thread
+// reports them, and follows the target depth.
+//-----------------------------------------------------------------------------
+
+const LONGLONG JITTER_TEST_FRAME = 417083;
+
+// Arrivals of a decoder that delivers one frame per frame interval.
+static void ArriveSteady(JitterBufferController *pJitter, LONGLONG *phnsNow, DWORD cFrames)
+{
+  for (DWORD i = 0; i < cFrames; i++)
+  {
+    *phnsNow += JITTER_TEST_FRAME;
+    pJitter->OnArrival(*phnsNow, JITTER_TEST_FRAME);
+  }
+}
+
+// Arrivals of a decoder that stalls for cBurst frame intervals, then
+// delivers cBurst frames at once.
+static void ArriveBursty(JitterBufferController *pJitter, LONGLONG *phnsNow, DWORD cBursts, DWORD cBurst)
+{
+  for (DWORD i = 0; i < cBursts; i++)
+  {
+    *phnsNow += cBurst * JITTER_TEST_FRAME;
+    for (DWORD j = 0; j < cBurst; j++)
+    {
+      pJitter->OnArrival(*phnsNow, JITTER_TEST_FRAME);
+    }
+  }
+}
+
+TEST_CASE(JitterBuffer_SteadyStreamStaysShallow)
+{
+  JitterBufferController jitter;
+  jitter.SetLimits(2, 10);
+  CHECK(jitter.TargetDepth() == 2);
+
+  LONGLONG hnsNow = 0;
+  ArriveSteady(&jitter, &hnsNow, 500);
+
+  // One frame on screen and one queued.
+  CHECK(jitter.TargetDepth() == 2);
+}
+
+TEST_CASE(JitterBuffer_BurstyStreamCoversTheGap)
+{
+  JitterBufferController jitter;
+  jitter.SetLimits(2, 10);
+
+  LONGLONG hnsNow = 0;
+  ArriveSteady(&jitter, &hnsNow, 10);
+
+  // Four-frame stalls need four frames queued plus the one on screen, as
+  // soon as the first stall is seen.
+  ArriveBursty(&jitter, &hnsNow, 1, 4);
+  CHECK(jitter.TargetDepth() == 5);
+
+  // And for as long as the stalls go on.
+  ArriveBursty(&jitter, &hnsNow, 100, 4);
+  CHECK(jitter.TargetDepth() == 5);
+
+  // Longer stalls than the limit allows are capped.
+  ArriveBursty(&jitter, &hnsNow, 10, 12);
+  CHECK(jitter.TargetDepth() == 10);
+}
+
+TEST_CASE(JitterBuffer_ShrinksOneFramePerWindow)
+{
+  JitterBufferController jitter;
+  jitter.SetLimits(2, 10);
+
+  LONGLONG hnsNow = 0;
+  ArriveBursty(&jitter, &hnsNow, 50, 5);
+  REQUIRE(jitter.TargetDepth() == 6);
+
+  // The stream turns steady. The depth comes down one frame at a time, a
+  // full window apart, once the stall has left the window.
+  DWORD cLast = jitter.TargetDepth();
+  DWORD iLastShrink = 0;
+  DWORD cShrinks = 0;
+  DWORD cBadSteps = 0;
+  DWORD cMinSpacing = MAXDWORD;
+
+  for (DWORD i = 1; i <= 20 * JITTER_WINDOW; i++)
+  {
+    ArriveSteady(&jitter, &hnsNow, 1);
+
+    DWORD cTarget = jitter.TargetDepth();
+    if (cTarget != cLast)
+    {
+      if (cTarget != cLast - 1)
+      {
+        cBadSteps++;
+      }
+      if (cShrinks > 0 && i - iLastShrink < cMinSpacing)
+      {
+        cMinSpacing = i - iLastShrink;
+      }
+      iLastShrink = i;
+      cShrinks++;
+      cLast = cTarget;
+    }
+  }
+
+  CHECK(cBadSteps == 0);
+  CHECK(cShrinks == 4);
+  CHECK(cMinSpacing == JITTER_WINDOW);
+  CHECK(jitter.TargetDepth() == 2);
+}
+
+TEST_CASE(JitterBuffer_UnderrunRaisesDepth)
+{
+  JitterBufferController jitter;
+  jitter.SetLimits(2, 4);
+
+  LONGLONG hnsNow = 0;
+  ArriveSteady(&jitter, &hnsNow, 100);
+  REQUIRE(jitter.TargetDepth() == 2);
+
+  // An underrun adds a frame at once.
+  jitter.OnUnderrun();
+  CHECK(jitter.TargetDepth() == 3);
+
+  // Another one before the deeper queue had a chance to fill is ignored.
+  ArriveSteady(&jitter, &hnsNow, 1);
+  jitter.OnUnderrun();
+  CHECK(jitter.TargetDepth() == 3);
+
+  // After that, underruns count again, up to the maximum.
+  ArriveSteady(&jitter, &hnsNow, 3);
+  jitter.OnUnderrun();
+  CHECK(jitter.TargetDepth() == 4);
+  ArriveSteady(&jitter, &hnsNow, 4);
+  jitter.OnUnderrun();
+  CHECK(jitter.TargetDepth() == 4);
+
+  // A steady stream gives the extra frames back, one window at a time.
+  ArriveSteady(&jitter, &hnsNow, JITTER_WINDOW);
+  CHECK(jitter.TargetDepth() == 3);
+  ArriveSteady(&jitter, &hnsNow, JITTER_WINDOW);
+  CHECK(jitter.TargetDepth() == 2);
+}
+
+TEST_CASE(JitterBuffer_DiscontinuityIsNotJitter)
+{
+  JitterBufferController jitter;
+  jitter.SetLimits(2, 10);
+
+  LONGLONG hnsNow = 0;
+  ArriveSteady(&jitter, &hnsNow, 100);
+
+  // A seek: the queue starts empty, and the gap before the next sample is
+  // not a decoder stall.
+  jitter.Discontinuity();
+  hnsNow += 5000000;
+  ArriveSteady(&jitter, &hnsNow, 1);
+  jitter.OnUnderrun();
+  CHECK(jitter.TargetDepth() == 2);
+
+  ArriveSteady(&jitter, &hnsNow, 100);
+  CHECK(jitter.TargetDepth() == 2);
+
+  // A pause longer than a second is not counted either, even without a
+  // Discontinuity call.
+  hnsNow += 20000000;
+  ArriveSteady(&jitter, &hnsNow, 1);
+  CHECK(jitter.TargetDepth() == 2);
+}
+
+TEST_CASE(JitterBuffer_Limits)
+{
+  JitterBufferController jitter;
+  jitter.SetLimits(3, 8);
+  CHECK(jitter.TargetDepth() == 3);
+
+  LONGLONG hnsNow = 0;
+  ArriveBursty(&jitter, &hnsNow, 10, 6);
+  CHECK(jitter.TargetDepth() == 7);
+
+  // New limits clamp the current target.
+  jitter.SetLimits(3, 5);
+  CHECK(jitter.TargetDepth() == 5);
+  jitter.SetLimits(6, 5);
+  CHECK(jitter.TargetDepth() == 6);
+
+  jitter.SetLimits(2, 10);
+  jitter.Reset();
+  CHECK(jitter.TargetDepth() == 2);
+}
@@ -0,0 +1,255 @@
+/*
+ *      Copyright (C) 2014 Andrew Van Til
+ *      http://babgvant.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "stdafx.h"
+#include "EVRPresenter.h"
+#include "TestHarness.h"
+
+//-----------------------------------------------------------------------------
+// List and ComPtrList tests (Common/linklist.h)
+//
+// Node allocations are counted with AllocationCount: without a node cache
+// every insertion allocates exactly one node, and with one the steady state
+// allocates nothing.
+//-----------------------------------------------------------------------------
+
+// Returns TRUE if the list holds the cItems values in order.
+static BOOL ListEquals(List<int>& list, const int *pItems, DWORD cItems)
+{
+  if (list.GetCount() != cItems)
+  {
+    return FALSE;
+  }
+  for (DWORD i = 0; i < cItems; i++)
+  {
+    if (list.ItemAt(i) != pItems[i])
+    {
+      return FALSE;
+    }
+  }
+
+  // Walk it backwards as well, to check the prev links.
+  List<int> copy;
+  int item = 0;
+  while (SUCCEEDED(list.RemoveBack(&item)))
+  {
+    copy.InsertFront(item);
+  }
+  BOOL bEqual = (copy.GetCount() == cItems);
+  while (SUCCEEDED(copy.RemoveFront(&item)))
+  {
+    list.InsertBack(item);
+  }
+  return bEqual;
+}
+
+TEST_CASE(LinkList_InsertAtPosition)
+{
+  List<int> list;
+
+  CHECK(list.InsertAt(0, 2) == S_OK);     // Empty list.
+  CHECK(list.InsertAt(1, 4) == S_OK);     // Back.
+  CHECK(list.InsertAt(0, 0) == S_OK);     // Front.
+  CHECK(list.InsertAt(1, 1) == S_OK);     // Middle, next to the front.
+  CHECK(list.InsertAt(3, 3) == S_OK);     // Middle, next to the back.
+
+  static const int expected[] = { 0, 1, 2, 3, 4 };
+  CHECK(ListEquals(list, expected, ARRAY_SIZE(expected)));
+
+  // Past the end.
+  CHECK(list.InsertAt(6, 6) == E_FAIL);
+  CHECK(list.GetCount() == 5);
+
+  int item = 0;
+  CHECK(list.RemoveFront(&item) == S_OK && item == 0);
+  CHECK(list.RemoveBack(&item) == S_OK && item == 4);
+  CHECK(list.InsertAt(2, 5) == S_OK);
+
+  static const int expected2[] = { 1, 2, 5, 3 };
+  CHECK(ListEquals(list, expected2, ARRAY_SIZE(expected2)));
+}
+
+TEST_CASE(LinkList_InsertAtAllocatesOneNode)
+{
+  List<int> list;
+
+  // One node per insertion, wherever it goes. InsertAt used to allocate a
+  // node before falling back to InsertFront or InsertBack, and leak it.
+  for (int i = 0; i < 8; i++)
+  {
+    DWORD pos = (i % 3 == 0) ? 0 : (i % 3 == 1) ? list.GetCount() : list.GetCount() / 2;
+
+    LONG cBefore = AllocationCount();
+    CHECK(list.InsertAt(pos, i) == S_OK);
+    CHECK(AllocationCount() - cBefore == 1);
+  }
+  CHECK(list.GetCount() == 8);
+
+  // A failed insertion allocates nothing.
+  LONG cBefore = AllocationCount();
+  CHECK(list.InsertAt(list.GetCount() + 1, 0) == E_FAIL);
+  CHECK(AllocationCount() == cBefore);
+}
+
+TEST_CASE(LinkList_NoCacheAllocatesPerInsert)
+{
+  List<int> list;
+
+  LONG cBefore = AllocationCount();
+  for (int i = 0; i < 100; i++)
+  {
+    list.InsertBack(i);
+    list.RemoveFront(NULL);
+  }
+  CHECK(AllocationCount() - cBefore == 100);
+}
+
+TEST_CASE(LinkList_NodeCacheSteadyState)
+{
+  List<int> list;
+  list.SetNodeCache(4);
+
+  // Warm up: the first pass allocates the nodes.
+  for (int i = 0; i < 4; i++)
+  {
+    list.InsertBack(i);
+  }
+  list.Clear();
+
+  // After that, insertions and removals of up to four items reuse them,
+  // at either end and in the middle.
+  LONG cBefore = AllocationCount();
+  for (int round = 0; round < 10000; round++)
+  {
+    list.InsertBack(1);
+    list.InsertFront(0);
+    list.InsertAt(1, 2);
+    list.InsertAt(list.GetCount(), 3);
+
+    int item = 0;
+    list.RemoveFront(&item);
+    list.RemoveBack(&item);
+    list.RemoveFront(&item);
+    list.RemoveBack(&item);
+  }
+  CHECK(AllocationCount() == cBefore);
+  CHECK(list.IsEmpty());
+
+  // A fifth item needs a new node.
+  for (int i = 0; i < 5; i++)
+  {
+    list.InsertBack(i);
+  }
+  CHECK(AllocationCount() - cBefore == 1);
+
+  static const int expected[] = { 0, 1, 2, 3, 4 };
+  CHECK(ListEquals(list, expected, ARRAY_SIZE(expected)));
+}
+
+TEST_CASE(LinkList_ReserveNodes)
+{
+  List<int> list;
+  REQUIRE(list.ReserveNodes(6) == S_OK);
+
+  LONG cBefore = AllocationCount();
+  for (int round = 0; round < 1000; round++)
+  {
+    for (int i = 0; i < 6; i++)
+    {
+      list.InsertFront(i);
+    }
+    list.Clear();
+  }
+  CHECK(AllocationCount() == cBefore);
+
+  // Reserving again does not allocate nodes the cache already has.
+  for (int i = 0; i < 3; i++)
+  {
+    list.InsertBack(i);
+  }
+  REQUIRE(list.ReserveNodes(6) == S_OK);
+  CHECK(AllocationCount() == cBefore);
+
+  // Shrinking the cache frees the spare nodes, so the next insertions
+  // allocate again.
+  list.Clear();
+  list.SetNodeCache(2);
+  for (int i = 0; i < 3; i++)
+  {
+    list.InsertBack(i);
+  }
+  CHECK(AllocationCount() - cBefore == 1);
+}
+
+TEST_CASE(LinkList_ComPtrListNodeCache)
+{
+  const DWORD cObjects = 4;
+  TestObject *pObjects[cObjects];
+  for (DWORD i = 0; i < cObjects; i++)
+  {
+    pObjects[i] = TestObject::Create(i);
+  }
+  LONG cLive = TestObject::LiveCount();
+  {
+    ComPtrList<IUnknown> list;
+    list.SetNodeCache(cObjects);
+
+    for (DWORD i = 0; i < cObjects; i++)
+    {
+      list.InsertBack(pObjects[i]);
+    }
+    list.Clear();
+
+    // The frame-step pattern: queue a few samples, then hand them out.
+    LONG cBefore = AllocationCount();
+    for (int round = 0; round < 10000; round++)
+    {
+      for (DWORD i = 0; i < cObjects; i++)
+      {
+        list.InsertBack(pObjects[i]);
+      }
+      for (DWORD i = 0; i < cObjects; i++)
+      {
+        IUnknown *pUnk = NULL;
+        list.RemoveFront(&pUnk);
+        CHECK(pUnk == pObjects[i]);
+        SAFE_RELEASE(pUnk);
+      }
+    }
+    CHECK(AllocationCount() == cBefore);
+
+    // Cached nodes do not hold references.
+    for (DWORD i = 0; i < cObjects; i++)
+    {
+      CHECK(RefCount(pObjects[i]) == 1);
+    }
+
+    // Items left in the list are released with it.
+    list.InsertBack(pObjects[0]);
+    list.InsertBack(pObjects[1]);
+    CHECK(RefCount(pObjects[0]) == 2);
+  }
+
+  for (DWORD i = 0; i < cObjects; i++)
+  {
+    CHECK(RefCount(pObjects[i]) == 1);
+    SAFE_RELEASE(pObjects[i]);
+  }
+  CHECK(TestObject::LiveCount() == cLive - (LONG)cObjects);
+}
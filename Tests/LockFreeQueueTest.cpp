@@ -0,0 +1,196 @@
+/*
+ *      Copyright (C) 2014 Andrew Van Til
+ *      http://babgvant.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "stdafx.h"
+#include "EVRPresenter.h"
+#include "TestHarness.h"
+
+typedef LockFreeQueue<IUnknown, 8> SmallQueue;
+
+TEST_CASE(LockFreeQueue_FifoOrderAndTags)
+{
+  LONG cLive = TestObject::LiveCount();
+  {
+    SmallQueue queue;
+
+    for (DWORD i = 0; i < 5; i++)
+    {
+      TestObject *pObj = TestObject::Create(i);
+      CHECK(queue.Queue(pObj, 100 + i, 1000 + i) == S_OK);
+      pObj->Release();
+    }
+    CHECK(queue.Count() == 5);
+
+    for (DWORD i = 0; i < 5; i++)
+    {
+      IUnknown *pUnk = NULL;
+      DWORD dwTag = 0;
+      LONGLONG llTime = 0;
+
+      REQUIRE(queue.Peek(&pUnk, &dwTag, &llTime) == S_OK);
+      CHECK(static_cast<TestObject*>(pUnk)->Value() == i);
+      CHECK(dwTag == 100 + i);
+      CHECK(llTime == 1000 + i);
+      pUnk->Release();
+
+      queue.PopFront();
+    }
+
+    IUnknown *pUnk = NULL;
+    CHECK(queue.Peek(&pUnk) == S_FALSE);
+    CHECK(pUnk == NULL);
+    CHECK(queue.Count() == 0);
+  }
+  CHECK(TestObject::LiveCount() == cLive);
+}
+
+TEST_CASE(LockFreeQueue_FullAndClear)
+{
+  LONG cLive = TestObject::LiveCount();
+  {
+    SmallQueue queue;
+    TestObject *pObj = TestObject::Create();
+
+    CHECK(queue.Queue(NULL) == E_POINTER);
+
+    for (DWORD i = 0; i < 8; i++)
+    {
+      CHECK(queue.Queue(pObj) == S_OK);
+    }
+    CHECK(queue.Queue(pObj) == MF_E_NOTACCEPTING);
+    CHECK(queue.Count() == 8);
+
+    // Wrap around: free two slots and fill them again.
+    IUnknown *pUnk = NULL;
+    CHECK(queue.Dequeue(&pUnk) == S_OK);
+    SAFE_RELEASE(pUnk);
+    CHECK(queue.Dequeue(&pUnk) == S_OK);
+    SAFE_RELEASE(pUnk);
+    CHECK(queue.Queue(pObj) == S_OK);
+    CHECK(queue.Queue(pObj) == S_OK);
+    CHECK(queue.Queue(pObj) == MF_E_NOTACCEPTING);
+
+    queue.Clear();
+    CHECK(queue.Count() == 0);
+
+    // Clear released every reference the queue held.
+    CHECK(pObj->Release() == 0);
+  }
+  CHECK(TestObject::LiveCount() == cLive);
+}
+
+
+//-----------------------------------------------------------------------------
+// Stress test
+//
+// One producer thread and one consumer thread, as in the scheduler. The
+// producer signals an auto-reset event when its Queue made the queue
+// non-empty (Count() == 1), and the consumer only waits on the event after
+// Peek found the queue empty. Every item must arrive once, in order, with
+// its own tag and time, and the consumer must never wait for a wake-up that
+// was lost.
+//-----------------------------------------------------------------------------
+
+const DWORD STRESS_ITEMS = 200000;
+const DWORD STRESS_LOST_WAKEUP_MS = 5000;
+
+struct QueueStressContext
+{
+  LockFreeQueue<IUnknown, SCHEDULER_QUEUE_SIZE>  queue;
+  HANDLE                                          hWakeEvent;
+  DWORD                                           cSignals;
+};
+
+static DWORD WINAPI QueueStressProducer(LPVOID pv)
+{
+  QueueStressContext *pContext = static_cast<QueueStressContext*>(pv);
+
+  for (DWORD i = 0; i < STRESS_ITEMS; i++)
+  {
+    TestObject *pObj = TestObject::Create(i);
+
+    while (pContext->queue.Queue(pObj, i, (LONGLONG)i * 3) != S_OK)
+    {
+      // Full. Let the consumer catch up.
+      SwitchToThread();
+    }
+    pObj->Release();
+
+    if (pContext->queue.Count() == 1)
+    {
+      pContext->cSignals++;
+      SetEvent(pContext->hWakeEvent);
+    }
+  }
+  return 0;
+}
+
+TEST_CASE(LockFreeQueue_StressOneProducerOneConsumer)
+{
+  LONG cLive = TestObject::LiveCount();
+
+  QueueStressContext *pContext = new QueueStressContext();
+  pContext->hWakeEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+  pContext->cSignals = 0;
+  REQUIRE(pContext->hWakeEvent != NULL);
+
+  DWORD cReceived = 0;
+  DWORD cOutOfOrder = 0;
+  DWORD cLostWakeups = 0;
+  {
+    TestThread producer(QueueStressProducer, pContext);
+    REQUIRE(producer.IsRunning());
+
+    while (cReceived < STRESS_ITEMS)
+    {
+      IUnknown *pUnk = NULL;
+      DWORD dwTag = 0;
+      LONGLONG llTime = 0;
+
+      if (pContext->queue.Peek(&pUnk, &dwTag, &llTime) != S_OK)
+      {
+        if (WaitForSingleObject(pContext->hWakeEvent, STRESS_LOST_WAKEUP_MS) == WAIT_TIMEOUT)
+        {
+          cLostWakeups++;
+          break;
+        }
+        continue;
+      }
+
+      if (static_cast<TestObject*>(pUnk)->Value() != cReceived || dwTag != cReceived || llTime != (LONGLONG)cReceived * 3)
+      {
+        cOutOfOrder++;
+      }
+      pUnk->Release();
+      pContext->queue.PopFront();
+      cReceived++;
+    }
+  }
+
+  CHECK(cLostWakeups == 0);
+  CHECK(cOutOfOrder == 0);
+  CHECK(cReceived == STRESS_ITEMS);
+  CHECK(pContext->queue.Count() == 0);
+  CHECK(pContext->cSignals > 0);
+
+  CloseHandle(pContext->hWakeEvent);
+  delete pContext;
+
+  CHECK(TestObject::LiveCount() == cLive);
+}
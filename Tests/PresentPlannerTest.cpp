@@ -0,0 +1,212 @@
+/*
+ *      Copyright (C) 2014 Andrew Van Til
+ *      http://babgvant.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "stdafx.h"
+#include "EVRPresenter.h"
+#include "TestHarness.h"
+
+//-----------------------------------------------------------------------------
+// PresentPlanner tests
+//
+// A 23.976 fps stream on a 60 Hz display. The display's vsyncs are fed to
+// OnVsync as they pass, and each frame is planned when it is due, as the
+// scheduler does. The planned slots must step 3, 2, 3, 2 ... vsyncs apart.
+//-----------------------------------------------------------------------------
+
+const LONGLONG PLANNER_TEST_START = 10000000;
+
+struct CadenceRun
+{
+  DWORD   cFrames;
+  DWORD   cSteps[5];          // Planned slot steps of 0..3 vsyncs; [4] is anything else.
+  DWORD   cRepeatedSteps;     // Steps equal to the step before.
+  DWORD   cMinRepeatGap;      // Fewest frames between two repeated steps.
+  DWORD   cOffGrid;           // Planned times more than 1/8 vsync from an actual vsync.
+};
+
+// Time of vsync n. Exact 60 Hz, optionally jittered by up to +/- hnsJitter.
+static LONGLONG VsyncTime(LONGLONG n, LONGLONG hnsJitter, DWORD *pdwSeed)
+{
+  LONGLONG hnsTime = PLANNER_TEST_START + n * 10000000 / 60;
+
+  if (hnsJitter > 0)
+  {
+    *pdwSeed = *pdwSeed * 1103515245 + 12345;
+    hnsTime += (LONGLONG)((*pdwSeed >> 8) % (DWORD)(2 * hnsJitter + 1)) - hnsJitter;
+  }
+  return hnsTime;
+}
+
+// Due time of frame i of a 24000/1001 stream.
+static LONGLONG FilmDueTime(DWORD i)
+{
+  return PLANNER_TEST_START + 5000 + (LONGLONG)i * 10000000 * 1001 / 24000;
+}
+
+static void RunFilmCadence(PresentPlanner *pPlanner, DWORD cFrames, LONGLONG hnsJitter, CadenceRun *pRun)
+{
+  ZeroMemory(pRun, sizeof(*pRun));
+  pRun->cMinRepeatGap = MAXDWORD;
+
+  DWORD dwSeed = 1;
+  LONGLONG n = 0;
+  LONGLONG llLastSlot = 0;
+  LONGLONG llLastStep = -1;
+  DWORD iLastRepeat = 0;
+
+  for (DWORD i = 0; i < cFrames; i++)
+  {
+    LONGLONG hnsDue = FilmDueTime(i);
+
+    while (PLANNER_TEST_START + n * 10000000 / 60 <= hnsDue)
+    {
+      pPlanner->OnVsync(VsyncTime(n, hnsJitter, &dwSeed));
+      n++;
+    }
+
+    LONGLONG hnsPlanned = pPlanner->PlanFrame(hnsDue);
+
+    // Which vsync is that?
+    LONGLONG llSlot = ((hnsPlanned - PLANNER_TEST_START) * 60 + 5000000) / 10000000;
+    LONGLONG hnsOffset = hnsPlanned - (PLANNER_TEST_START + llSlot * 10000000 / 60);
+    if (_abs64(hnsOffset) > 10000000 / 60 / 8)
+    {
+      pRun->cOffGrid++;
+    }
+
+    if (i > 0)
+    {
+      LONGLONG llStep = llSlot - llLastSlot;
+      pRun->cSteps[(llStep >= 0 && llStep < 4) ? llStep : 4]++;
+
+      if (llStep == llLastStep)
+      {
+        if (pRun->cRepeatedSteps > 0 && i - iLastRepeat < pRun->cMinRepeatGap)
+        {
+          pRun->cMinRepeatGap = i - iLastRepeat;
+        }
+        pRun->cRepeatedSteps++;
+        iLastRepeat = i;
+      }
+      llLastStep = llStep;
+    }
+    llLastSlot = llSlot;
+  }
+
+  pRun->cFrames = cFrames;
+}
+
+TEST_CASE(PresentPlanner_FilmOn60HzSteps32)
+{
+  PresentPlanner planner;
+  planner.SetRefreshRate(60);
+  planner.SetFrameInterval(417083);
+  REQUIRE(planner.IsActive());
+
+  // Ten minutes of film.
+  CadenceRun run;
+  RunFilmCadence(&planner, 14386, 0, &run);
+
+  CHECK(run.cOffGrid == 0);
+  CHECK(run.cSteps[0] == 0);
+  CHECK(run.cSteps[1] == 0);
+  CHECK(run.cSteps[4] == 0);
+
+  // Half of the steps are 3 vsyncs and half are 2.
+  CHECK(run.cSteps[2] + run.cSteps[3] == run.cFrames - 1);
+  CHECK(_abs64((LONGLONG)run.cSteps[2] - run.cSteps[3]) <= (LONGLONG)run.cFrames / 100);
+
+  // 23.976 is not quite 24, so the 3:2 pattern slips by half a vsync every
+  // 200 frames, which repeats a step. Any other repeat is a broken cadence.
+  CHECK(run.cRepeatedSteps > 0);
+  CHECK(run.cRepeatedSteps <= run.cFrames / 190);
+  CHECK(run.cMinRepeatGap >= 190);
+
+  CHECK(planner.CadenceErrors() == 0);
+  CHECK(planner.CadenceErrorsPerMinute() == 0);
+}
+
+TEST_CASE(PresentPlanner_FilmOn60HzWithVsyncJitter)
+{
+  PresentPlanner planner;
+  planner.SetRefreshRate(60);
+  planner.SetFrameInterval(417083);
+
+  // Ten minutes, with vsync times observed up to 0.2 ms early or late. Near
+  // a slip the jitter may flip the rounding of a slot, which repeats a few
+  // more steps, but the cadence must hold.
+  CadenceRun run;
+  RunFilmCadence(&planner, 14386, 2000, &run);
+
+  CHECK(run.cOffGrid == 0);
+  CHECK(run.cSteps[2] + run.cSteps[3] == run.cFrames - 1);
+  CHECK(run.cRepeatedSteps <= run.cFrames / 100);
+  CHECK(planner.CadenceErrors() == 0);
+  CHECK(planner.CadenceErrorsPerMinute() == 0);
+}
+
+TEST_CASE(PresentPlanner_DiscontinuityCountsCadenceErrors)
+{
+  PresentPlanner planner;
+  planner.SetRefreshRate(60);
+  planner.SetFrameInterval(417083);
+
+  // Just under a minute of film with the time stamps jumping a frame ahead
+  // once.
+  LONGLONG hnsSkew = 0;
+  DWORD cFrames = 1414;
+
+  for (DWORD i = 0; i < cFrames; i++)
+  {
+    if (i == cFrames / 2)
+    {
+      hnsSkew = 417083;
+    }
+    planner.PlanFrame(FilmDueTime(i) + hnsSkew);
+
+    // Less than a second of playback is not extrapolated.
+    if (i == 10)
+    {
+      CHECK(planner.CadenceErrorsPerMinute() == 0);
+    }
+  }
+
+  CHECK(planner.CadenceErrors() == 1);
+  CHECK(planner.CadenceErrorsPerMinute() == 1);
+
+  // Reset forgets the errors.
+  planner.Reset();
+  CHECK(planner.CadenceErrors() == 0);
+  CHECK(planner.CadenceErrorsPerMinute() == 0);
+}
+
+TEST_CASE(PresentPlanner_InactiveReturnsDueTime)
+{
+  PresentPlanner planner;
+  CHECK(!planner.IsActive());
+  CHECK(planner.PlanFrame(123456) == 123456);
+
+  planner.SetFrameInterval(417083);
+  CHECK(!planner.IsActive());
+  CHECK(planner.PlanFrame(654321) == 654321);
+
+  planner.SetRefreshRate(60);
+  CHECK(planner.IsActive());
+  CHECK(planner.RefreshInterval() == 10000000 / 60);
+}
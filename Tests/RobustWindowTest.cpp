@@ -0,0 +1,130 @@
+/*
+ *      Copyright (C) 2014 Andrew Van Til
+ *      http://babgvant.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "stdafx.h"
+#include "EVRPresenter.h"
+#include "TestHarness.h"
+
+//-----------------------------------------------------------------------------
+// RobustWindow tests
+//-----------------------------------------------------------------------------
+
+TEST_CASE(RobustWindow_NeedsMinimumValues)
+{
+  RobustWindow window;
+  RobustStats stats;
+
+  for (DWORD i = 0; i < ROBUST_MIN_VALUES - 1; i++)
+  {
+    window.Add(100);
+  }
+  CHECK(window.Count() == ROBUST_MIN_VALUES - 1);
+  CHECK(!window.GetStats(&stats));
+  CHECK(stats.llMedian == 0 && stats.llMad == 0 && stats.llP90 == 0);
+
+  window.Add(100);
+  CHECK(window.GetStats(&stats));
+  CHECK(stats.llMedian == 100);
+
+  window.Reset();
+  CHECK(window.Count() == 0);
+  CHECK(!window.GetStats(&stats));
+}
+
+TEST_CASE(RobustWindow_MedianMadAndP90)
+{
+  RobustWindow window;
+  RobustStats stats;
+
+  // 1..10, added out of order.
+  static const LONGLONG values[] = { 7, 3, 10, 1, 9, 2, 8, 5, 4, 6 };
+  for (DWORD i = 0; i < ARRAY_SIZE(values); i++)
+  {
+    window.Add(values[i]);
+  }
+
+  REQUIRE(window.GetStats(&stats));
+  CHECK(stats.llMedian == 5);     // (5 + 6) / 2, rounded down.
+  CHECK(stats.llP90 == 10);       // values[9] of the sorted ten.
+
+  // Deviations from 5, sorted: 0, 1, 1, 2, 2, 3, 3, 4, 4, 5.
+  CHECK(stats.llMad == 2);
+
+  // An odd count has a single middle value.
+  window.Add(11);
+  REQUIRE(window.GetStats(&stats));
+  CHECK(stats.llMedian == 6);
+}
+
+TEST_CASE(RobustWindow_OnlyTheLastWindowCounts)
+{
+  RobustWindow window;
+  RobustStats stats;
+
+  for (DWORD i = 0; i < 1000; i++)
+  {
+    window.Add(1000000);
+  }
+  for (DWORD i = 0; i < ROBUST_WINDOW; i++)
+  {
+    window.Add(i);
+  }
+
+  CHECK(window.Count() == ROBUST_WINDOW);
+  REQUIRE(window.GetStats(&stats));
+  CHECK(stats.llMedian == (ROBUST_WINDOW / 2 - 1 + ROBUST_WINDOW / 2) / 2);
+  CHECK(stats.llP90 < ROBUST_WINDOW);
+}
+
+TEST_CASE(RobustWindow_OutliersDoNotMoveTheMedian)
+{
+  RobustWindow window;
+  RobustStats stats;
+
+  // Lateness of about 1 ms, with three spikes of 50 ms.
+  for (DWORD i = 0; i < ROBUST_WINDOW; i++)
+  {
+    window.Add((i % 10 == 5) ? 500000 : 10000 + (i % 3) * 1000);
+  }
+
+  REQUIRE(window.GetStats(&stats));
+  CHECK(stats.llMedian >= 10000 && stats.llMedian <= 12000);
+  CHECK(stats.llMad <= 1000);
+  CHECK(stats.llP90 <= 12000);
+}
+
+TEST_CASE(RobustWindow_Bimodal)
+{
+  RobustWindow window;
+  RobustStats stats;
+
+  // 3:2 pulldown: two of every five frames are shown a vsync later.
+  for (DWORD i = 0; i < ROBUST_WINDOW; i++)
+  {
+    window.Add((i % 5) < 2 ? 166833 : 0);
+  }
+
+  REQUIRE(window.GetStats(&stats));
+
+  // Most values are equal, so the MAD collapses, but the 90th percentile
+  // still covers the upper mode.
+  CHECK(stats.llMedian == 0);
+  CHECK(stats.llMad == 0);
+  CHECK(stats.llP90 == 166833);
+}
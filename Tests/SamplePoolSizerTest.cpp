@@ -0,0 +1,333 @@
+/*
+ *      Copyright (C) 2014 Andrew Van Til
+ *      http://babgvant.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "stdafx.h"
+#include "EVRPresenter.h"
+#include "TestHarness.h"
+
+//-----------------------------------------------------------------------------
+// SamplePoolSizer tests
+//
+// MockSampleAllocator stands in for the present engine. It keeps a
+// reference to every sample it creates and counts the surfaces it creates
+// and frees, so the tests can check the sizer's sample count and memory
+// against what was really allocated.
+//-----------------------------------------------------------------------------
+
+const DWORD SIZER_TEST_SURFACE = 1920 * 1080 * 4;
+const DWORD SIZER_TEST_MAX_SAMPLES = 256;
+
+class MockSampleAllocator : public SampleAllocator
+{
+public:
+  MockSampleAllocator() : m_cCreated(0), m_cReleased(0), m_bFail(FALSE)
+  {
+    ZeroMemory(m_pSamples, sizeof(m_pSamples));
+  }
+
+  ~MockSampleAllocator()
+  {
+    for (DWORD i = 0; i < m_cCreated; i++)
+    {
+      SAFE_RELEASE(m_pSamples[i]);
+    }
+  }
+
+  HRESULT CreateVideoSample(IMFSample **ppSample, DWORD *pcbSurface)
+  {
+    if (m_bFail || m_cCreated == SIZER_TEST_MAX_SAMPLES)
+    {
+      return E_OUTOFMEMORY;
+    }
+
+    HRESULT hr = MFCreateSample(ppSample);
+    if (SUCCEEDED(hr))
+    {
+      m_pSamples[m_cCreated] = *ppSample;
+      m_pSamples[m_cCreated]->AddRef();
+      m_cCreated++;
+      *pcbSurface = SIZER_TEST_SURFACE;
+    }
+    return hr;
+  }
+
+  DWORD ReleaseVideoSample(IMFSample *pSample)
+  {
+    m_cReleased++;
+    return SIZER_TEST_SURFACE;
+  }
+
+  // Surfaces created and not yet freed.
+  DWORD Surfaces() const { return m_cCreated - m_cReleased; }
+
+  // Samples still referenced by something other than the allocator.
+  DWORD SamplesInUse()
+  {
+    DWORD cInUse = 0;
+    for (DWORD i = 0; i < m_cCreated; i++)
+    {
+      cInUse += (RefCount(m_pSamples[i]) > 1);
+    }
+    return cInUse;
+  }
+
+  DWORD       m_cCreated;
+  DWORD       m_cReleased;
+  BOOL        m_bFail;
+
+private:
+  IMFSample   *m_pSamples[SIZER_TEST_MAX_SAMPLES];
+};
+
+// Allocates the samples for a new format, as the presenter does on a format
+// change.
+static HRESULT StartPool(SamplePool *pPool, SamplePoolSizer *pSizer, MockSampleAllocator *pAllocator, DWORD cSamples)
+{
+  HRESULT hr = S_OK;
+  VideoSampleList list;
+  IMFSample *pSample = NULL;
+  DWORD cbSurface = 0;
+
+  for (DWORD i = 0; i < cSamples; i++)
+  {
+    CHECK_HR(hr = pAllocator->CreateVideoSample(&pSample, &cbSurface));
+    CHECK_HR(hr = list.InsertBack(pSample));
+    SAFE_RELEASE(pSample);
+  }
+  CHECK_HR(hr = pPool->Initialize(list));
+
+  pSizer->OnAllocated(cSamples, cbSurface);
+
+done:
+  SAFE_RELEASE(pSample);
+  return hr;
+}
+
+// Takes every free sample out of the pool, as the mixer does when it runs
+// ahead of the display. Returns the number taken.
+static DWORD DrainPool(SamplePool *pPool, IMFSample **ppSamples, DWORD cMax)
+{
+  DWORD cTaken = 0;
+  while (cTaken < cMax && pPool->GetSample(&ppSamples[cTaken]) == S_OK)
+  {
+    cTaken++;
+  }
+  return cTaken;
+}
+
+// Gives samples back through the sizer, as OnSampleFree does, and releases
+// the caller's references.
+static DWORD ReturnSamples(SamplePoolSizer *pSizer, IMFSample **ppSamples, DWORD cSamples, DWORD cTarget)
+{
+  DWORD cFailed = 0;
+  for (DWORD i = 0; i < cSamples; i++)
+  {
+    cFailed += (pSizer->ReturnSample(ppSamples[i], cTarget) != S_OK);
+    SAFE_RELEASE(ppSamples[i]);
+  }
+  return cFailed;
+}
+
+TEST_CASE(SamplePoolSizer_GrowToTarget)
+{
+  MockSampleAllocator allocator;
+  {
+    SamplePool pool;
+    SamplePoolSizer sizer(&pool);
+    IMFSample *pSamples[SAMPLE_POOL_SIZE] = { 0 };
+
+    // Nothing to grow before the format is set.
+    CHECK(sizer.Grow(5, &pSamples[0]) == MF_E_NOT_INITIALIZED);
+
+    sizer.SetAllocator(&allocator);
+    REQUIRE(StartPool(&pool, &sizer, &allocator, PRESENTER_BUFFER_COUNT) == S_OK);
+    CHECK(sizer.Count() == PRESENTER_BUFFER_COUNT);
+    CHECK(sizer.Bytes() == (ULONGLONG)PRESENTER_BUFFER_COUNT * SIZER_TEST_SURFACE);
+
+    // The pool runs empty and the jitter buffer asks for five samples.
+    DWORD cTaken = DrainPool(&pool, pSamples, SAMPLE_POOL_SIZE);
+    CHECK(cTaken == PRESENTER_BUFFER_COUNT);
+
+    while (sizer.Grow(5, &pSamples[cTaken]) == S_OK)
+    {
+      CHECK(pool.IsCurrent(pSamples[cTaken]));
+      cTaken++;
+    }
+    CHECK(cTaken == 5);
+    CHECK(sizer.Count() == 5);
+    CHECK(allocator.Surfaces() == 5);
+    CHECK(sizer.Bytes() == 5ULL * SIZER_TEST_SURFACE);
+
+    // A target below the pool size does not grow it either.
+    CHECK(sizer.Grow(1, &pSamples[cTaken]) == S_FALSE);
+
+    // Grown samples are in use, and go back to the pool like the others.
+    CHECK(ReturnSamples(&sizer, pSamples, cTaken, 5) == 0);
+    CHECK(DrainPool(&pool, pSamples, SAMPLE_POOL_SIZE) == 5);
+    CHECK(ReturnSamples(&sizer, pSamples, 5, 5) == 0);
+    CHECK(sizer.Count() == 5);
+  }
+
+  // The pool released every sample.
+  CHECK(allocator.SamplesInUse() == 0);
+}
+
+TEST_CASE(SamplePoolSizer_GrowWithinLimits)
+{
+  MockSampleAllocator allocator;
+  {
+    SamplePool pool;
+    SamplePoolSizer sizer(&pool);
+    IMFSample *pSamples[SAMPLE_POOL_SIZE] = { 0 };
+
+    sizer.SetAllocator(&allocator);
+
+    // Room for six surfaces.
+    REQUIRE(sizer.SetMemoryBudget(6 * SIZER_TEST_SURFACE / (1024 * 1024) + 1) == S_OK);
+    REQUIRE(StartPool(&pool, &sizer, &allocator, PRESENTER_BUFFER_COUNT) == S_OK);
+
+    DWORD cMin = 0, cMax = 0;
+    sizer.GetLimits(&cMin, &cMax);
+    CHECK(cMin == PRESENTER_BUFFER_COUNT);
+    CHECK(cMax == 6);
+
+    DWORD cTaken = DrainPool(&pool, pSamples, SAMPLE_POOL_SIZE);
+    while (sizer.Grow(PRESENTER_MAX_BUFFER_COUNT, &pSamples[cTaken]) == S_OK)
+    {
+      cTaken++;
+    }
+    CHECK(cTaken == 6);
+    CHECK(allocator.Surfaces() == 6);
+
+    // A failed allocation leaves the count alone.
+    REQUIRE(sizer.SetMemoryBudget(1024) == S_OK);
+    allocator.m_bFail = TRUE;
+    IMFSample *pFailed = NULL;
+    CHECK(sizer.Grow(PRESENTER_MAX_BUFFER_COUNT, &pFailed) == E_OUTOFMEMORY);
+    CHECK(pFailed == NULL);
+    CHECK(sizer.Count() == 6);
+    allocator.m_bFail = FALSE;
+
+    // Without a budget limit, the maximum buffer count applies.
+    while (sizer.Grow(SAMPLE_POOL_SIZE, &pSamples[cTaken]) == S_OK)
+    {
+      cTaken++;
+    }
+    CHECK(cTaken == PRESENTER_MAX_BUFFER_COUNT);
+
+    // The budget never takes the maximum below the pool size.
+    REQUIRE(sizer.SetMemoryBudget(1) == S_OK);
+    sizer.GetLimits(&cMin, &cMax);
+    CHECK(cMax == PRESENTER_BUFFER_COUNT);
+
+    CHECK(ReturnSamples(&sizer, pSamples, cTaken, PRESENTER_MAX_BUFFER_COUNT) == 0);
+  }
+  CHECK(allocator.SamplesInUse() == 0);
+}
+
+TEST_CASE(SamplePoolSizer_ReturnShrinks)
+{
+  MockSampleAllocator allocator;
+  {
+    SamplePool pool;
+    SamplePoolSizer sizer(&pool);
+    IMFSample *pSamples[SAMPLE_POOL_SIZE] = { 0 };
+
+    sizer.SetAllocator(&allocator);
+    REQUIRE(StartPool(&pool, &sizer, &allocator, 8) == S_OK);
+    REQUIRE(DrainPool(&pool, pSamples, SAMPLE_POOL_SIZE) == 8);
+
+    // The target drops to five: the first three samples back are freed.
+    for (DWORD i = 0; i < 3; i++)
+    {
+      CHECK(sizer.ReturnSample(pSamples[i], 5) == S_OK);
+      CHECK(!pool.IsCurrent(pSamples[i]));
+      CHECK(allocator.m_cReleased == i + 1);
+      CHECK(sizer.Count() == 7 - i);
+      CHECK(sizer.Bytes() == (ULONGLONG)(7 - i) * SIZER_TEST_SURFACE);
+      SAFE_RELEASE(pSamples[i]);
+    }
+
+    // The rest go back to the pool.
+    CHECK(ReturnSamples(&sizer, pSamples + 3, 2, 5) == 0);
+    CHECK(allocator.m_cReleased == 3);
+
+    // A target below the pool size shrinks only to the pool size.
+    REQUIRE(sizer.SetPoolSize(4) == S_OK);
+    CHECK(ReturnSamples(&sizer, pSamples + 5, 3, 0) == 0);
+    CHECK(sizer.Count() == 4);
+    CHECK(allocator.Surfaces() == 4);
+
+    // The pool holds the four samples left.
+    CHECK(DrainPool(&pool, pSamples, SAMPLE_POOL_SIZE) == 4);
+    CHECK(ReturnSamples(&sizer, pSamples, 4, 4) == 0);
+    CHECK(DrainPool(&pool, pSamples, SAMPLE_POOL_SIZE) == 4);
+
+    // After the pool is cleared, returned samples are stale: they are not
+    // freed again or counted.
+    pool.Clear();
+    sizer.Reset();
+    for (DWORD i = 0; i < 4; i++)
+    {
+      CHECK(sizer.ReturnSample(pSamples[i], 0) == S_FALSE);
+      SAFE_RELEASE(pSamples[i]);
+    }
+    CHECK(allocator.m_cReleased == 4);
+    CHECK(sizer.Count() == 0);
+    CHECK(sizer.Bytes() == 0);
+  }
+  CHECK(allocator.SamplesInUse() == 0);
+}
+
+TEST_CASE(SamplePoolSizer_GrowAndShrinkCycles)
+{
+  MockSampleAllocator allocator;
+  {
+    SamplePool pool;
+    SamplePoolSizer sizer(&pool);
+    IMFSample *pSamples[SAMPLE_POOL_SIZE] = { 0 };
+
+    sizer.SetAllocator(&allocator);
+    REQUIRE(StartPool(&pool, &sizer, &allocator, PRESENTER_BUFFER_COUNT) == S_OK);
+
+    // The jitter buffer target moves up and down; the pool follows it one
+    // sample at a time, and the counts match the allocator's.
+    DWORD dwSeed = 5;
+    DWORD cMismatches = 0;
+    for (DWORD round = 0; round < 40; round++)
+    {
+      dwSeed = dwSeed * 1103515245 + 12345;
+      DWORD cTarget = PRESENTER_BUFFER_COUNT + (dwSeed >> 16) % (PRESENTER_MAX_BUFFER_COUNT - PRESENTER_BUFFER_COUNT + 1);
+
+      DWORD cTaken = DrainPool(&pool, pSamples, SAMPLE_POOL_SIZE);
+      while (sizer.Grow(cTarget, &pSamples[cTaken]) == S_OK)
+      {
+        cTaken++;
+      }
+      cMismatches += (ReturnSamples(&sizer, pSamples, cTaken, cTarget) != 0);
+
+      cMismatches += (sizer.Count() != cTarget);
+      cMismatches += (sizer.Count() != allocator.Surfaces());
+      cMismatches += (sizer.Bytes() != (ULONGLONG)allocator.Surfaces() * SIZER_TEST_SURFACE);
+    }
+    CHECK(cMismatches == 0);
+    CHECK(allocator.m_cReleased > 0);
+  }
+  CHECK(allocator.SamplesInUse() == 0);
+}
@@ -0,0 +1,300 @@
+/*
+ *      Copyright (C) 2014 Andrew Van Til
+ *      http://babgvant.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "stdafx.h"
+#include "EVRPresenter.h"
+#include "TestHarness.h"
+
+const DWORD POOL_TEST_SAMPLES = 6;
+
+// Creates cSamples samples. ppSamples keeps a reference to each, and the
+// list gets another one for SamplePool::Initialize.
+static HRESULT CreatePoolSamples(DWORD cSamples, IMFSample **ppSamples, VideoSampleList *pList)
+{
+  HRESULT hr = S_OK;
+
+  for (DWORD i = 0; i < cSamples; i++)
+  {
+    CHECK_HR(hr = MFCreateSample(&ppSamples[i]));
+    CHECK_HR(hr = pList->InsertBack(ppSamples[i]));
+  }
+
+done:
+  return hr;
+}
+
+TEST_CASE(SamplePool_GetReturnAndClear)
+{
+  IMFSample *samples[POOL_TEST_SAMPLES] = { 0 };
+  IMFSample *pOut[POOL_TEST_SAMPLES] = { 0 };
+  {
+    SamplePool pool;
+    VideoSampleList list;
+
+    CHECK(pool.GetSample(&pOut[0]) == MF_E_NOT_INITIALIZED);
+
+    REQUIRE(CreatePoolSamples(POOL_TEST_SAMPLES, samples, &list) == S_OK);
+    REQUIRE(pool.Initialize(list) == S_OK);
+    CHECK(list.IsEmpty());
+    CHECK(pool.Initialize(list) == MF_E_INVALIDREQUEST);
+
+    // Hand out every sample.
+    for (DWORD i = 0; i < POOL_TEST_SAMPLES; i++)
+    {
+      REQUIRE(pool.GetSample(&pOut[i]) == S_OK);
+      CHECK(pOut[i] != NULL);
+      CHECK(pool.IsCurrent(pOut[i]));
+    }
+    IMFSample *pExtra = NULL;
+    CHECK(pool.GetSample(&pExtra) == MF_E_SAMPLEALLOCATOR_EMPTY);
+    CHECK(pool.AreSamplesPending());
+
+    // Return half of them. A sample cannot come back twice.
+    for (DWORD i = 0; i < POOL_TEST_SAMPLES / 2; i++)
+    {
+      CHECK(pool.ReturnSample(pOut[i]) == S_OK);
+      CHECK(pool.ReturnSample(pOut[i]) == MF_E_INVALIDREQUEST);
+      SAFE_RELEASE(pOut[i]);
+    }
+
+    // The rest become stale.
+    CHECK(pool.Clear() == S_OK);
+    CHECK(!pool.AreSamplesPending());
+    for (DWORD i = POOL_TEST_SAMPLES / 2; i < POOL_TEST_SAMPLES; i++)
+    {
+      CHECK(!pool.IsCurrent(pOut[i]));
+      CHECK(pool.ReturnSample(pOut[i]) == S_FALSE);
+      CHECK(pool.DiscardSample(pOut[i]) == S_FALSE);
+      SAFE_RELEASE(pOut[i]);
+    }
+  }
+
+  // The pool released every reference it held.
+  for (DWORD i = 0; i < POOL_TEST_SAMPLES; i++)
+  {
+    if (samples[i])
+    {
+      CHECK(RefCount(samples[i]) == 1);
+      SAFE_RELEASE(samples[i]);
+    }
+  }
+}
+
+TEST_CASE(SamplePool_AddAndDiscard)
+{
+  IMFSample *samples[SAMPLE_POOL_SIZE + 1] = { 0 };
+  {
+    SamplePool pool;
+    VideoSampleList list;
+
+    REQUIRE(CreatePoolSamples(2, samples, &list) == S_OK);
+    REQUIRE(pool.Initialize(list) == S_OK);
+
+    // Grow to the slot limit. Added samples start out in use.
+    for (DWORD i = 2; i < SAMPLE_POOL_SIZE + 1; i++)
+    {
+      REQUIRE(MFCreateSample(&samples[i]) == S_OK);
+    }
+    for (DWORD i = 2; i < SAMPLE_POOL_SIZE; i++)
+    {
+      CHECK(pool.AddSample(samples[i]) == S_OK);
+    }
+    CHECK(pool.AddSample(samples[SAMPLE_POOL_SIZE]) == E_OUTOFMEMORY);
+    CHECK(pool.AreSamplesPending());
+
+    // Shrink by one: the slot is free for the next AddSample.
+    CHECK(pool.DiscardSample(samples[2]) == S_OK);
+    CHECK(!pool.IsCurrent(samples[2]));
+    CHECK(pool.DiscardSample(samples[2]) == S_FALSE);
+    CHECK(pool.AddSample(samples[SAMPLE_POOL_SIZE]) == S_OK);
+
+    // A free sample cannot be discarded.
+    IMFSample *pSample = NULL;
+    REQUIRE(pool.GetSample(&pSample) == S_OK);
+    CHECK(pool.ReturnSample(pSample) == S_OK);
+    CHECK(pool.DiscardSample(pSample) == MF_E_INVALIDREQUEST);
+    SAFE_RELEASE(pSample);
+  }
+
+  for (DWORD i = 0; i < SAMPLE_POOL_SIZE + 1; i++)
+  {
+    if (samples[i])
+    {
+      CHECK(RefCount(samples[i]) == 1);
+      SAFE_RELEASE(samples[i]);
+    }
+  }
+}
+
+
+//-----------------------------------------------------------------------------
+// Stress test
+//
+// Worker threads take samples from the pool and give them back, as the
+// mixer thread and the sample-free callbacks do, while the main thread
+// clears the pool and fills it with new samples over and over, as
+// ReleaseResources and a format change do. A sample returned while the pool
+// is cleared must not end up on the free stack of the next generation:
+// GetSample must never hand out NULL or a stale sample, every generation
+// must hand out exactly the samples it was given, and every reference the
+// pool took must be released.
+//-----------------------------------------------------------------------------
+
+const DWORD POOL_STRESS_WORKERS = 3;
+const DWORD POOL_STRESS_ROUNDS = 5000;
+
+struct PoolStressContext
+{
+  SamplePool          pool;
+  std::atomic<BOOL>   bStop;
+  std::atomic<LONG>   cNull;          // GetSample returned S_OK with no sample.
+  std::atomic<LONG>   cBadResult;     // ReturnSample failed.
+  std::atomic<LONG>   cReturned;
+};
+
+static DWORD WINAPI PoolStressWorker(LPVOID pv)
+{
+  PoolStressContext *pContext = static_cast<PoolStressContext*>(pv);
+  DWORD i = 0;
+
+  while (!pContext->bStop.load())
+  {
+    IMFSample *pSample = NULL;
+
+    if (pContext->pool.GetSample(&pSample) != S_OK)
+    {
+      SwitchToThread();
+      continue;
+    }
+
+    if (pSample == NULL)
+    {
+      pContext->cNull++;
+      continue;
+    }
+
+    // Hold on to some samples a little longer, so the clear can catch them
+    // in use.
+    if (++i % 4 == 0)
+    {
+      SwitchToThread();
+    }
+
+    HRESULT hr = pContext->pool.ReturnSample(pSample);
+    if (hr == S_OK)
+    {
+      pContext->cReturned++;
+    }
+    else if (hr != S_FALSE)
+    {
+      pContext->cBadResult++;
+    }
+    SAFE_RELEASE(pSample);
+  }
+  return 0;
+}
+
+TEST_CASE(SamplePool_StressClearWhileReturning)
+{
+  const DWORD cSamples = POOL_STRESS_ROUNDS * POOL_TEST_SAMPLES;
+
+  IMFSample **ppSamples = new IMFSample*[cSamples];
+  ZeroMemory(ppSamples, sizeof(IMFSample*) * cSamples);
+
+  PoolStressContext *pContext = new PoolStressContext();
+  pContext->bStop = FALSE;
+  pContext->cNull = 0;
+  pContext->cBadResult = 0;
+  pContext->cReturned = 0;
+
+  DWORD cInitFailures = 0;
+  DWORD cDrained = 0;
+  {
+    VideoSampleList list;
+    REQUIRE(CreatePoolSamples(POOL_TEST_SAMPLES, ppSamples, &list) == S_OK);
+    REQUIRE(pContext->pool.Initialize(list) == S_OK);
+
+    TestThread *pWorkers[POOL_STRESS_WORKERS];
+    for (DWORD i = 0; i < POOL_STRESS_WORKERS; i++)
+    {
+      pWorkers[i] = new TestThread(PoolStressWorker, pContext);
+      CHECK(pWorkers[i]->IsRunning());
+    }
+
+    for (DWORD iRound = 1; iRound < POOL_STRESS_ROUNDS; iRound++)
+    {
+      SwitchToThread();
+
+      pContext->pool.Clear();
+
+      if (CreatePoolSamples(POOL_TEST_SAMPLES, ppSamples + iRound * POOL_TEST_SAMPLES, &list) != S_OK ||
+          pContext->pool.Initialize(list) != S_OK)
+      {
+        cInitFailures++;
+      }
+    }
+
+    pContext->bStop = TRUE;
+    for (DWORD i = 0; i < POOL_STRESS_WORKERS; i++)
+    {
+      delete pWorkers[i];
+    }
+
+    // The last generation holds exactly its own samples.
+    IMFSample *pSample = NULL;
+    while (cDrained <= POOL_TEST_SAMPLES && pContext->pool.GetSample(&pSample) == S_OK)
+    {
+      BOOL bOwn = FALSE;
+      for (DWORD i = (POOL_STRESS_ROUNDS - 1) * POOL_TEST_SAMPLES; i < cSamples; i++)
+      {
+        bOwn |= (pSample == ppSamples[i]);
+      }
+      CHECK(bOwn);
+
+      // GetSample handed over the pool's reference.
+      SAFE_RELEASE(pSample);
+      cDrained++;
+    }
+    pContext->pool.Clear();
+  }
+
+  CHECK(cInitFailures == 0);
+  CHECK(pContext->cNull == 0);
+  CHECK(pContext->cBadResult == 0);
+  CHECK(pContext->cReturned > 0);
+  CHECK(cDrained == POOL_TEST_SAMPLES);
+
+  // Every sample is back to the test's own reference.
+  DWORD cLeaked = 0;
+  for (DWORD i = 0; i < cSamples; i++)
+  {
+    if (ppSamples[i])
+    {
+      if (RefCount(ppSamples[i]) != 1)
+      {
+        cLeaked++;
+      }
+      SAFE_RELEASE(ppSamples[i]);
+    }
+  }
+  CHECK(cLeaked == 0);
+
+  delete [] ppSamples;
+  delete pContext;
+}
@@ -0,0 +1,475 @@
+/*
+ *      Copyright (C) 2014 Andrew Van Til
+ *      http://babgvant.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "stdafx.h"
+#include "EVRPresenter.h"
+#include "TestHarness.h"
+
+//-----------------------------------------------------------------------------
+// SubSurfacePool tests
+//
+// TestSurface is a Direct3D surface with no device behind it: it knows its
+// size and the device generation it was created on, and counts the live
+// surfaces. MockSubSurfaceAllocator creates them, and Reset stands for a
+// device reset.
+//-----------------------------------------------------------------------------
+
+class TestSurface : public IDirect3DSurface9
+{
+public:
+  TestSurface(UINT Width, UINT Height, DWORD dwDevice)
+    : m_cRef(1), m_Width(Width), m_Height(Height), m_dwDevice(dwDevice)
+  {
+    InterlockedIncrement(&s_cLive);
+  }
+
+  static LONG LiveCount() { return s_cLive; }
+
+  UINT  Width() const { return m_Width; }
+  UINT  Height() const { return m_Height; }
+  DWORD Device() const { return m_dwDevice; }
+
+  // IUnknown
+  STDMETHODIMP QueryInterface(REFIID riid, void **ppv)
+  {
+    if (ppv == NULL)
+    {
+      return E_POINTER;
+    }
+    if (riid == __uuidof(IUnknown) || riid == __uuidof(IDirect3DSurface9))
+    {
+      *ppv = static_cast<IDirect3DSurface9*>(this);
+      AddRef();
+      return S_OK;
+    }
+    *ppv = NULL;
+    return E_NOINTERFACE;
+  }
+
+  STDMETHODIMP_(ULONG) AddRef()
+  {
+    return InterlockedIncrement(&m_cRef);
+  }
+
+  STDMETHODIMP_(ULONG) Release()
+  {
+    ULONG cRef = InterlockedDecrement(&m_cRef);
+    if (cRef == 0)
+    {
+      delete this;
+    }
+    return cRef;
+  }
+
+  // IDirect3DResource9
+  STDMETHODIMP GetDevice(IDirect3DDevice9 **ppDevice) { return E_NOTIMPL; }
+  STDMETHODIMP SetPrivateData(REFGUID refguid, CONST void *pData, DWORD SizeOfData, DWORD Flags) { return E_NOTIMPL; }
+  STDMETHODIMP GetPrivateData(REFGUID refguid, void *pData, DWORD *pSizeOfData) { return E_NOTIMPL; }
+  STDMETHODIMP FreePrivateData(REFGUID refguid) { return E_NOTIMPL; }
+  STDMETHODIMP_(DWORD) SetPriority(DWORD PriorityNew) { return 0; }
+  STDMETHODIMP_(DWORD) GetPriority() { return 0; }
+  STDMETHODIMP_(void) PreLoad() { }
+  STDMETHODIMP_(D3DRESOURCETYPE) GetType() { return D3DRTYPE_SURFACE; }
+
+  // IDirect3DSurface9
+  STDMETHODIMP GetContainer(REFIID riid, void **ppContainer) { return E_NOTIMPL; }
+  STDMETHODIMP LockRect(D3DLOCKED_RECT *pLockedRect, CONST RECT *pRect, DWORD Flags) { return E_NOTIMPL; }
+  STDMETHODIMP UnlockRect() { return E_NOTIMPL; }
+  STDMETHODIMP GetDC(HDC *phdc) { return E_NOTIMPL; }
+  STDMETHODIMP ReleaseDC(HDC hdc) { return E_NOTIMPL; }
+
+  STDMETHODIMP GetDesc(D3DSURFACE_DESC *pDesc)
+  {
+    ZeroMemory(pDesc, sizeof(*pDesc));
+    pDesc->Format = D3DFMT_A8R8G8B8;
+    pDesc->Type = D3DRTYPE_SURFACE;
+    pDesc->Pool = D3DPOOL_DEFAULT;
+    pDesc->Width = m_Width;
+    pDesc->Height = m_Height;
+    return S_OK;
+  }
+
+private:
+  virtual ~TestSurface() { InterlockedDecrement(&s_cLive); }
+
+  static LONG volatile  s_cLive;
+
+  LONG volatile         m_cRef;
+  UINT                  m_Width;
+  UINT                  m_Height;
+  DWORD                 m_dwDevice;
+};
+
+LONG volatile TestSurface::s_cLive = 0;
+
+class MockSubSurfaceAllocator : public SubSurfaceAllocator
+{
+public:
+  MockSubSurfaceAllocator() : m_cCreated(0), m_dwDevice(1), m_bFail(FALSE) { }
+
+  HRESULT CreateSubSurface(UINT Width, UINT Height, IDirect3DSurface9 **ppSurface)
+  {
+    if (m_bFail)
+    {
+      return D3DERR_OUTOFVIDEOMEMORY;
+    }
+    *ppSurface = new TestSurface(Width, Height, m_dwDevice);
+    m_cCreated++;
+    return S_OK;
+  }
+
+  DWORD SubSurfaceBytes(UINT Width, UINT Height)
+  {
+    return Width * Height * 4;
+  }
+
+  // A new device: surfaces from before are no good.
+  void Reset() { m_dwDevice++; }
+
+  DWORD   m_cCreated;
+  DWORD   m_dwDevice;
+  BOOL    m_bFail;
+};
+
+static TestSurface* AsTestSurface(IDirect3DSurface9 *pSurface)
+{
+  return static_cast<TestSurface*>(pSurface);
+}
+
+TEST_CASE(SubSurfacePool_BucketSize)
+{
+  struct { UINT size; UINT bucket; } cases[] =
+  {
+    { 1, 16 }, { 16, 16 }, { 17, 32 }, { 255, 256 }, { 256, 256 }, { 257, 288 },
+    { 1000, 1024 }, { 1920, 1920 }, { 1921, 2048 },
+  };
+
+  for (DWORD i = 0; i < ARRAY_SIZE(cases); i++)
+  {
+    UINT Width = cases[i].size;
+    UINT Height = 40;
+    SubSurfacePool::BucketSize(&Width, &Height);
+    CHECK(Width == cases[i].bucket);
+    CHECK(Height == 48);
+  }
+
+  // A bucket is never smaller, and is less than 16 pixels or an eighth
+  // larger than the size.
+  DWORD cWrong = 0;
+  for (UINT size = 1; size <= 4096; size++)
+  {
+    UINT Width = size;
+    UINT Height = size;
+    SubSurfacePool::BucketSize(&Width, &Height);
+
+    UINT extra = Width - size;
+    cWrong += (Width < size || Width != Height || (extra >= 16 && extra * 8 >= size));
+  }
+  CHECK(cWrong == 0);
+}
+
+TEST_CASE(SubSurfacePool_ReuseWithinBucket)
+{
+  MockSubSurfaceAllocator allocator;
+  LONG cLive = TestSurface::LiveCount();
+  {
+    SubSurfacePool pool;
+    IDirect3DSurface9 *pSurface = NULL;
+
+    CHECK(pool.GetSurface(100, 40, &pSurface) == MF_E_NOT_INITIALIZED);
+    pool.SetAllocator(&allocator);
+    CHECK(pool.GetSurface(0, 40, &pSurface) == E_INVALIDARG);
+
+    // New surfaces are created at the bucket size.
+    REQUIRE(pool.GetSurface(100, 40, &pSurface) == S_OK);
+    CHECK(AsTestSurface(pSurface)->Width() == 112 && AsTestSurface(pSurface)->Height() == 48);
+    CHECK(pool.Count() == 1);
+    CHECK(pool.Bytes() == 112 * 48 * 4);
+
+    // Once returned, any size in the bucket reuses it.
+    IDirect3DSurface9 *pFirst = pSurface;
+    pool.ReturnSurface(pSurface);
+    SAFE_RELEASE(pSurface);
+
+    REQUIRE(pool.GetSurface(110, 45, &pSurface) == S_OK);
+    CHECK(pSurface == pFirst);
+    CHECK(allocator.m_cCreated == 1);
+
+    // A surface in use is not handed out twice.
+    IDirect3DSurface9 *pSecond = NULL;
+    REQUIRE(pool.GetSurface(110, 45, &pSecond) == S_OK);
+    CHECK(pSecond != pFirst);
+    CHECK(allocator.m_cCreated == 2);
+
+    pool.ReturnSurface(pSurface);
+    pool.ReturnSurface(pSecond);
+    SAFE_RELEASE(pSurface);
+    SAFE_RELEASE(pSecond);
+
+    // Returning a surface twice, or one the pool does not know, is ignored.
+    pool.ReturnSurface(pFirst);
+    IDirect3DSurface9 *pForeign = new TestSurface(16, 16, allocator.m_dwDevice);
+    pool.ReturnSurface(pForeign);
+    SAFE_RELEASE(pForeign);
+    CHECK(pool.Count() == 2);
+  }
+
+  // The pool released every surface.
+  CHECK(TestSurface::LiveCount() == cLive);
+}
+
+TEST_CASE(SubSurfacePool_SmallestFit)
+{
+  MockSubSurfaceAllocator allocator;
+  LONG cLive = TestSurface::LiveCount();
+  {
+    SubSurfacePool pool;
+    pool.SetAllocator(&allocator);
+
+    IDirect3DSurface9 *pLarge = NULL;
+    IDirect3DSurface9 *pSmall = NULL;
+    IDirect3DSurface9 *pHuge = NULL;
+    REQUIRE(pool.GetSurface(200, 80, &pLarge) == S_OK);     // 208 x 80
+    REQUIRE(pool.GetSurface(100, 40, &pSmall) == S_OK);     // 112 x 48
+    REQUIRE(pool.GetSurface(512, 512, &pHuge) == S_OK);
+    pool.ReturnSurface(pLarge);
+    pool.ReturnSurface(pSmall);
+    pool.ReturnSurface(pHuge);
+
+    // The smallest free surface that fits.
+    IDirect3DSurface9 *pFit = NULL;
+    REQUIRE(pool.GetSurface(90, 30, &pFit) == S_OK);
+    CHECK(pFit == pSmall);
+
+    // With the small one in use, the next fit is at most twice the area of
+    // the bucket (96 x 32 here), so neither free surface is used.
+    IDirect3DSurface9 *pSurface = NULL;
+    REQUIRE(pool.GetSurface(90, 30, &pSurface) == S_OK);
+    CHECK(pSurface != pLarge && pSurface != pHuge);
+    CHECK(allocator.m_cCreated == 4);
+    pool.ReturnSurface(pSurface);
+    SAFE_RELEASE(pSurface);
+
+    // The large one is within twice the area of its own bucket.
+    REQUIRE(pool.GetSurface(160, 80, &pSurface) == S_OK);
+    CHECK(pSurface == pLarge);
+    pool.ReturnSurface(pSurface);
+    SAFE_RELEASE(pSurface);
+
+    pool.ReturnSurface(pFit);
+    SAFE_RELEASE(pFit);
+
+    SAFE_RELEASE(pLarge);
+    SAFE_RELEASE(pSmall);
+    SAFE_RELEASE(pHuge);
+  }
+  CHECK(TestSurface::LiveCount() == cLive);
+}
+
+TEST_CASE(SubSurfacePool_EvictsLeastRecentlyUsed)
+{
+  MockSubSurfaceAllocator allocator;
+  LONG cLive = TestSurface::LiveCount();
+  {
+    SubSurfacePool pool;
+    pool.SetAllocator(&allocator);
+    REQUIRE(pool.SetMemoryCap(1) == S_OK);
+
+    // Four 256 x 256 surfaces fill the megabyte. Returned in the order
+    // C, A, D, B.
+    IDirect3DSurface9 *pSurfaces[4] = { 0 };
+    for (DWORD i = 0; i < 4; i++)
+    {
+      REQUIRE(pool.GetSurface(256, 256, &pSurfaces[i]) == S_OK);
+    }
+    CHECK(pool.Bytes() == 1024 * 1024);
+
+    // None is free, so there is no room for another.
+    IDirect3DSurface9 *pSurface = NULL;
+    CHECK(pool.GetSurface(16, 16, &pSurface) == E_OUTOFMEMORY);
+    CHECK(pool.Count() == 4);
+
+    static const DWORD returnOrder[] = { 2, 0, 3, 1 };
+    for (DWORD i = 0; i < 4; i++)
+    {
+      pool.ReturnSurface(pSurfaces[returnOrder[i]]);
+    }
+
+    // A surface that none of them fits evicts the least recently used
+    // ones, as many as it needs.
+    for (DWORD i = 0; i < 4; i++)
+    {
+      CHECK(RefCount(pSurfaces[i]) == 2);
+    }
+    REQUIRE(pool.GetSurface(384, 384, &pSurface) == S_OK);      // 576 KB
+    CHECK(RefCount(pSurfaces[2]) == 1);
+    CHECK(RefCount(pSurfaces[0]) == 1);
+    CHECK(RefCount(pSurfaces[3]) == 1);
+    CHECK(RefCount(pSurfaces[1]) == 2);
+    CHECK(pool.Count() == 2);
+    CHECK(pool.Bytes() == 384 * 384 * 4 + 256 * 256 * 4);
+    pool.ReturnSurface(pSurface);
+    SAFE_RELEASE(pSurface);
+
+    // A bitmap that fits the survivor still reuses it.
+    IDirect3DSurface9 *pB = NULL;
+    REQUIRE(pool.GetSurface(256, 256, &pB) == S_OK);
+    CHECK(pB == pSurfaces[1]);
+    pool.ReturnSurface(pB);
+    SAFE_RELEASE(pB);
+
+    for (DWORD i = 0; i < 4; i++)
+    {
+      SAFE_RELEASE(pSurfaces[i]);
+    }
+  }
+  CHECK(TestSurface::LiveCount() == cLive);
+}
+
+TEST_CASE(SubSurfacePool_TrimOnLowerCap)
+{
+  MockSubSurfaceAllocator allocator;
+  LONG cLive = TestSurface::LiveCount();
+  {
+    SubSurfacePool pool;
+    pool.SetAllocator(&allocator);
+    REQUIRE(pool.SetMemoryCap(2) == S_OK);
+    CHECK(pool.SetMemoryCap(0) == E_INVALIDARG);
+    CHECK(pool.GetMemoryCap() == 2);
+
+    // Eight 256 x 256 surfaces fill two megabytes. Returned in reverse.
+    IDirect3DSurface9 *pSurfaces[8] = { 0 };
+    for (DWORD i = 0; i < 8; i++)
+    {
+      REQUIRE(pool.GetSurface(256, 256, &pSurfaces[i]) == S_OK);
+    }
+    for (DWORD i = 8; i-- > 0; )
+    {
+      pool.ReturnSurface(pSurfaces[i]);
+    }
+
+    // Halving the cap releases the four returned first.
+    REQUIRE(pool.SetMemoryCap(1) == S_OK);
+    CHECK(pool.Count() == 4);
+    CHECK(pool.Bytes() == 1024 * 1024);
+
+    for (DWORD i = 0; i < 8; i++)
+    {
+      CHECK(RefCount(pSurfaces[i]) == (i < 4 ? 2UL : 1UL));
+      SAFE_RELEASE(pSurfaces[i]);
+    }
+  }
+  CHECK(TestSurface::LiveCount() == cLive);
+}
+
+TEST_CASE(SubSurfacePool_KeepsFewFreeSurfaces)
+{
+  MockSubSurfaceAllocator allocator;
+  LONG cLive = TestSurface::LiveCount();
+  {
+    SubSurfacePool pool;
+    pool.SetAllocator(&allocator);
+
+    // Twelve sizes from different buckets, all returned: only the eight
+    // most recently used stay.
+    IDirect3DSurface9 *pSurfaces[12] = { 0 };
+    for (DWORD i = 0; i < 12; i++)
+    {
+      REQUIRE(pool.GetSurface(64 + 64 * i, 64, &pSurfaces[i]) == S_OK);
+    }
+    for (DWORD i = 0; i < 12; i++)
+    {
+      pool.ReturnSurface(pSurfaces[i]);
+    }
+    CHECK(pool.Count() == 8);
+
+    ULONGLONG cbExpected = 0;
+    for (DWORD i = 0; i < 12; i++)
+    {
+      CHECK(RefCount(pSurfaces[i]) == (i < 4 ? 1UL : 2UL));
+      if (i >= 4)
+      {
+        cbExpected += allocator.SubSurfaceBytes(64 + 64 * i, 64);
+      }
+      SAFE_RELEASE(pSurfaces[i]);
+    }
+    CHECK(pool.Bytes() == cbExpected);
+  }
+  CHECK(TestSurface::LiveCount() == cLive);
+}
+
+TEST_CASE(SubSurfacePool_StaleAfterDeviceReset)
+{
+  MockSubSurfaceAllocator allocator;
+  LONG cLive = TestSurface::LiveCount();
+  IDirect3DSurface9 *pKept = NULL;
+  {
+    SubSurfacePool pool;
+    pool.SetAllocator(&allocator);
+
+    IDirect3DSurface9 *pInUse = NULL;
+    IDirect3DSurface9 *pFree = NULL;
+    REQUIRE(pool.GetSurface(300, 60, &pInUse) == S_OK);
+    REQUIRE(pool.GetSurface(300, 60, &pFree) == S_OK);
+    pool.ReturnSurface(pFree);
+    SAFE_RELEASE(pFree);
+
+    // The device is replaced. Free surfaces go at once; the one in use is
+    // still counted until it comes back.
+    allocator.Reset();
+    pool.Clear();
+    CHECK(pool.Count() == 1);
+    CHECK(TestSurface::LiveCount() == cLive + 1);
+
+    // A new request never gets a surface from the old device.
+    IDirect3DSurface9 *pSurface = NULL;
+    REQUIRE(pool.GetSurface(300, 60, &pSurface) == S_OK);
+    CHECK(AsTestSurface(pSurface)->Device() == allocator.m_dwDevice);
+    CHECK(pool.Count() == 2);
+
+    // The stale surface is released when it is returned, not reused.
+    pool.ReturnSurface(pInUse);
+    CHECK(RefCount(pInUse) == 1);
+    SAFE_RELEASE(pInUse);
+    CHECK(pool.Count() == 1);
+    CHECK(pool.Bytes() == allocator.SubSurfaceBytes(320, 64));
+
+    pool.ReturnSurface(pSurface);
+    SAFE_RELEASE(pSurface);
+
+    DWORD cCreated = allocator.m_cCreated;
+    REQUIRE(pool.GetSurface(300, 60, &pKept) == S_OK);
+    CHECK(AsTestSurface(pKept)->Device() == allocator.m_dwDevice);
+    CHECK(allocator.m_cCreated == cCreated);
+
+    // A failed allocation adds nothing.
+    allocator.m_bFail = TRUE;
+    IDirect3DSurface9 *pFailed = NULL;
+    CHECK(pool.GetSurface(300, 60, &pFailed) == D3DERR_OUTOFVIDEOMEMORY);
+    CHECK(pFailed == NULL);
+    CHECK(pool.Count() == 1);
+
+  }
+
+  // A surface still in use when the pool goes keeps the caller's reference.
+  CHECK(TestSurface::LiveCount() == cLive + 1);
+  CHECK(RefCount(pKept) == 1);
+  SAFE_RELEASE(pKept);
+  CHECK(TestSurface::LiveCount() == cLive);
+}
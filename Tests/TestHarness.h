@@ -0,0 +1,180 @@
+/*
+ *      Copyright (C) 2014 Andrew Van Til
+ *      http://babgvant.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// Test harness for EVRPresenterTests.
+//
+// TEST_CASE(name) defines a test function and registers it when the program
+// starts. TestMain runs every registered test (or the ones whose name
+// contains the command-line argument) and returns the number of failed
+// tests, so the post-build step fails the build when a test fails.
+//
+// CHECK records a failure and lets the test continue. REQUIRE records a
+// failure and returns from the test, for checks that later code depends on.
+//-----------------------------------------------------------------------------
+
+typedef void (*TestProc)();
+
+struct TestCase
+{
+  const char  *pszName;
+  TestProc    pfnTest;
+  TestCase    *pNext;
+};
+
+class TestRegistry
+{
+public:
+  static void Register(TestCase *pCase);
+  static int  RunAll(const char *pszFilter);
+  static void Fail(const char *pszFile, int line, const char *pszExpr);
+};
+
+struct TestRegistrar
+{
+  TestRegistrar(TestCase *pCase) { TestRegistry::Register(pCase); }
+};
+
+#define TEST_CASE(name) \
+  static void name(); \
+  static TestCase name##_case = { #name, name, NULL }; \
+  static TestRegistrar name##_registrar(&name##_case); \
+  static void name()
+
+#define CHECK(expr) \
+  do { if (!(expr)) { TestRegistry::Fail(__FILE__, __LINE__, #expr); } } while (0)
+
+#define REQUIRE(expr) \
+  do { if (!(expr)) { TestRegistry::Fail(__FILE__, __LINE__, #expr); return; } } while (0)
+
+
+//-----------------------------------------------------------------------------
+// TestObject class
+//
+// Minimal COM object for the containers that hold interface pointers.
+// LiveCount() is the number of objects not yet destroyed, so a test can
+// check that a container released every reference it took.
+//-----------------------------------------------------------------------------
+
+class TestObject : public IUnknown
+{
+public:
+  static TestObject* Create(DWORD dwValue = 0) { return new TestObject(dwValue); }
+  static LONG LiveCount() { return s_cLive; }
+
+  STDMETHODIMP QueryInterface(REFIID riid, void **ppv)
+  {
+    if (ppv == NULL)
+    {
+      return E_POINTER;
+    }
+    if (riid == __uuidof(IUnknown))
+    {
+      *ppv = static_cast<IUnknown*>(this);
+      AddRef();
+      return S_OK;
+    }
+    *ppv = NULL;
+    return E_NOINTERFACE;
+  }
+
+  STDMETHODIMP_(ULONG) AddRef()
+  {
+    return InterlockedIncrement(&m_cRef);
+  }
+
+  STDMETHODIMP_(ULONG) Release()
+  {
+    ULONG cRef = InterlockedDecrement(&m_cRef);
+    if (cRef == 0)
+    {
+      delete this;
+    }
+    return cRef;
+  }
+
+  DWORD Value() const { return m_dwValue; }
+
+private:
+  TestObject(DWORD dwValue) : m_cRef(1), m_dwValue(dwValue) { InterlockedIncrement(&s_cLive); }
+  virtual ~TestObject() { InterlockedDecrement(&s_cLive); }
+
+  static LONG volatile  s_cLive;
+
+  LONG volatile         m_cRef;
+  DWORD                 m_dwValue;
+};
+
+
+// Returns the reference count of a COM object.
+inline ULONG RefCount(IUnknown *pUnk)
+{
+  pUnk->AddRef();
+  return pUnk->Release();
+}
+
+
+//-----------------------------------------------------------------------------
+// AllocationCount
+//
+// Number of calls to the global operator new since the program started. The
+// test program replaces operator new and delete to count them, so a test can
+// check that a container does no heap allocation in its steady state.
+//-----------------------------------------------------------------------------
+
+LONG AllocationCount();
+
+
+//-----------------------------------------------------------------------------
+// TestThread class
+//
+// Runs a function on a second thread, for the tests that exercise the
+// thread-safety contracts. Join waits for it to finish.
+//-----------------------------------------------------------------------------
+
+class TestThread
+{
+public:
+  TestThread(LPTHREAD_START_ROUTINE pfnProc, LPVOID pContext) : m_hThread(NULL)
+  {
+    m_hThread = CreateThread(NULL, 0, pfnProc, pContext, 0, NULL);
+  }
+
+  ~TestThread()
+  {
+    Join();
+  }
+
+  BOOL IsRunning() const { return m_hThread != NULL; }
+
+  void Join()
+  {
+    if (m_hThread)
+    {
+      WaitForSingleObject(m_hThread, INFINITE);
+      CloseHandle(m_hThread);
+      m_hThread = NULL;
+    }
+  }
+
+private:
+  HANDLE  m_hThread;
+};
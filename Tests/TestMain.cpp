@@ -0,0 +1,164 @@
+/*
+ *      Copyright (C) 2014 Andrew Van Til
+ *      http://babgvant.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "stdafx.h"
+#include "EVRPresenter.h"
+#include "TestHarness.h"
+
+#include <new>
+
+LONG volatile TestObject::s_cLive = 0;
+
+static LONG volatile s_cAllocations = 0;
+
+void* operator new(size_t cb)
+{
+  InterlockedIncrement(&s_cAllocations);
+
+  void *p = malloc(cb ? cb : 1);
+  if (p == NULL)
+  {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void* operator new[](size_t cb)
+{
+  return operator new(cb);
+}
+
+void* operator new(size_t cb, const std::nothrow_t&)
+{
+  InterlockedIncrement(&s_cAllocations);
+  return malloc(cb ? cb : 1);
+}
+
+void* operator new[](size_t cb, const std::nothrow_t& nothrow)
+{
+  return operator new(cb, nothrow);
+}
+
+void operator delete(void *p)
+{
+  free(p);
+}
+
+void operator delete[](void *p)
+{
+  free(p);
+}
+
+void operator delete(void *p, size_t)
+{
+  free(p);
+}
+
+void operator delete[](void *p, size_t)
+{
+  free(p);
+}
+
+void operator delete(void *p, const std::nothrow_t&)
+{
+  free(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t&)
+{
+  free(p);
+}
+
+LONG AllocationCount()
+{
+  return s_cAllocations;
+}
+
+static TestCase *s_pFirst = NULL;       // Registered tests, in order.
+static TestCase *s_pLast = NULL;
+static DWORD    s_cCurrentFailures = 0; // Failed checks in the running test.
+
+void TestRegistry::Register(TestCase *pCase)
+{
+  pCase->pNext = NULL;
+  if (s_pLast)
+  {
+    s_pLast->pNext = pCase;
+  }
+  else
+  {
+    s_pFirst = pCase;
+  }
+  s_pLast = pCase;
+}
+
+void TestRegistry::Fail(const char *pszFile, int line, const char *pszExpr)
+{
+  printf("%s(%d): check failed: %s\n", pszFile, line, pszExpr);
+  s_cCurrentFailures++;
+}
+
+int TestRegistry::RunAll(const char *pszFilter)
+{
+  int cRun = 0;
+  int cFailed = 0;
+
+  for (TestCase *pCase = s_pFirst; pCase; pCase = pCase->pNext)
+  {
+    if (pszFilter && strstr(pCase->pszName, pszFilter) == NULL)
+    {
+      continue;
+    }
+
+    printf("[ RUN    ] %s\n", pCase->pszName);
+
+    s_cCurrentFailures = 0;
+    pCase->pfnTest();
+    cRun++;
+
+    if (s_cCurrentFailures > 0)
+    {
+      printf("[ FAILED ] %s\n", pCase->pszName);
+      cFailed++;
+    }
+    else
+    {
+      printf("[     OK ] %s\n", pCase->pszName);
+    }
+  }
+
+  printf("%d tests run, %d failed.\n", cRun, cFailed);
+  return cFailed;
+}
+
+int main(int argc, char *argv[])
+{
+  // Some tests use Media Foundation samples.
+  HRESULT hr = MFStartup(MF_VERSION, MFSTARTUP_LITE);
+  if (FAILED(hr))
+  {
+    printf("MFStartup failed: 0x%08lX\n", hr);
+    return 1;
+  }
+
+  int cFailed = TestRegistry::RunAll(argc > 1 ? argv[1] : NULL);
+
+  MFShutdown();
+  return cFailed;
+}
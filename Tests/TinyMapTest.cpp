@@ -0,0 +1,251 @@
+/*
+ *      Copyright (C) 2014 Andrew Van Til
+ *      http://babgvant.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "stdafx.h"
+#include "EVRPresenter.h"
+#include "TestHarness.h"
+
+//-----------------------------------------------------------------------------
+// TinyMap tests (Common/TinyMap.h)
+//
+// A differential test runs random Insert, Remove, Find and Clear calls on a
+// TinyMap and on a reference model (a value and a flag per key), and
+// compares the results and the enumeration order. The key range switches
+// between small and large, so the map runs both the linear search and the
+// binary search.
+//-----------------------------------------------------------------------------
+
+const DWORD MAP_TEST_KEYS = 100;
+const DWORD MAP_TEST_OPERATIONS = 20000;
+
+struct MapModel
+{
+  BOOL  bPresent[MAP_TEST_KEYS];
+  int   values[MAP_TEST_KEYS];
+  DWORD cPairs;
+};
+
+// Result of TinyMap::Remove for a key the model does not hold: E_FAIL past
+// the largest key, MF_E_INVALID_KEY otherwise.
+static HRESULT ModelMissingResult(const MapModel& model, int key)
+{
+  for (DWORD k = key; k < MAP_TEST_KEYS; k++)
+  {
+    if (model.bPresent[k])
+    {
+      return MF_E_INVALID_KEY;
+    }
+  }
+  return E_FAIL;
+}
+
+// Enumerates the map and compares it with the model. Returns TRUE if they
+// hold the same pairs, in key order.
+static BOOL MapEqualsModel(TinyMap<int, int>& map, const MapModel& model)
+{
+  if (map.GetCount() != model.cPairs)
+  {
+    return FALSE;
+  }
+
+  TinyMap<int, int>::MAPPOS pos = map.FrontPosition();
+  for (DWORD k = 0; k < MAP_TEST_KEYS; k++)
+  {
+    if (!model.bPresent[k])
+    {
+      continue;
+    }
+
+    int key = -1;
+    int value = -1;
+    if (pos == map.EndPosition() ||
+        map.GetKey(pos, &key) != S_OK ||
+        map.GetValue(pos, &value) != S_OK ||
+        key != (int)k ||
+        value != model.values[k])
+    {
+      return FALSE;
+    }
+    pos = map.Next(pos);
+  }
+  return pos == map.EndPosition();
+}
+
+TEST_CASE(TinyMap_Differential)
+{
+  TinyMap<int, int> map;
+  MapModel model;
+  ZeroMemory(&model, sizeof(model));
+
+  DWORD dwSeed = 7;
+  DWORD cMismatches = 0;
+  DWORD cMaxPairs = 0;
+  DWORD cKeys = MAP_TEST_KEYS;
+
+  for (DWORD i = 0; i < MAP_TEST_OPERATIONS; i++)
+  {
+    // Every 2000 operations, switch between 12 keys (linear search) and the
+    // full range (binary search once the map holds more than 16 pairs).
+    if (i % 2000 == 0)
+    {
+      cKeys = (i / 2000) % 2 ? 12 : MAP_TEST_KEYS;
+      if (cKeys < MAP_TEST_KEYS)
+      {
+        for (DWORD k = cKeys; k < MAP_TEST_KEYS; k++)
+        {
+          if (model.bPresent[k])
+          {
+            map.Remove(k);
+            model.bPresent[k] = FALSE;
+            model.cPairs--;
+          }
+        }
+      }
+    }
+
+    dwSeed = dwSeed * 1103515245 + 12345;
+    int key = (dwSeed >> 16) % cKeys;
+    int value = (int)(dwSeed & 0xFFFF);
+
+    dwSeed = dwSeed * 1103515245 + 12345;
+    DWORD op = (dwSeed >> 16) % 100;
+
+    if (op < 45)
+    {
+      HRESULT hr = map.Insert(key, value);
+      if (model.bPresent[key])
+      {
+        cMismatches += (hr != MF_E_INVALID_KEY);
+      }
+      else
+      {
+        cMismatches += (hr != S_OK);
+        model.bPresent[key] = TRUE;
+        model.values[key] = value;
+        model.cPairs++;
+      }
+    }
+    else if (op < 80)
+    {
+      HRESULT hr = map.Remove(key);
+      if (model.bPresent[key])
+      {
+        cMismatches += (hr != S_OK);
+        model.bPresent[key] = FALSE;
+        model.cPairs--;
+      }
+      else
+      {
+        cMismatches += (hr != ModelMissingResult(model, key));
+      }
+    }
+    else if (op < 99)
+    {
+      int found = -1;
+      HRESULT hr = map.Find(key, &found);
+      if (model.bPresent[key])
+      {
+        cMismatches += (hr != S_OK || found != model.values[key]);
+      }
+      else
+      {
+        cMismatches += (hr != MF_E_INVALID_KEY || found != -1);
+      }
+      cMismatches += (map.Find(key, NULL) != hr);
+    }
+    else
+    {
+      map.Clear();
+      ZeroMemory(&model, sizeof(model));
+    }
+
+    if (model.cPairs > cMaxPairs)
+    {
+      cMaxPairs = model.cPairs;
+    }
+
+    if (i % 100 == 0 && !MapEqualsModel(map, model))
+    {
+      cMismatches++;
+    }
+  }
+
+  CHECK(cMismatches == 0);
+  CHECK(MapEqualsModel(map, model));
+
+  // The large phases got well past the linear search.
+  CHECK(cMaxPairs > 2 * 16);
+}
+
+TEST_CASE(TinyMap_Enumeration)
+{
+  TinyMap<int, int> map;
+
+  // Empty map.
+  CHECK(map.FrontPosition() == map.EndPosition());
+  int item = 0;
+  CHECK(map.GetKey(map.EndPosition(), &item) == E_FAIL);
+  CHECK(map.GetValue(map.EndPosition(), &item) == E_FAIL);
+  CHECK(map.Remove(1) == E_FAIL);
+
+  // Inserted in reverse, enumerated in order.
+  for (int k = 40; k > 0; k--)
+  {
+    CHECK(map.Insert(k, -k) == S_OK);
+  }
+
+  int cPairs = 0;
+  int lastKey = 0;
+  for (TinyMap<int, int>::MAPPOS pos = map.FrontPosition(); pos != map.EndPosition(); pos = map.Next(pos))
+  {
+    int key = 0;
+    int value = 0;
+    CHECK(map.GetKey(pos, &key) == S_OK);
+    CHECK(map.GetValue(pos, &value) == S_OK);
+    CHECK(key == lastKey + 1 && value == -key);
+    lastKey = key;
+    cPairs++;
+  }
+  CHECK(cPairs == 40);
+  CHECK(map.Next(map.EndPosition()) == map.EndPosition());
+}
+
+TEST_CASE(TinyMap_ClearValues)
+{
+  LONG cLive = TestObject::LiveCount();
+  {
+    TinyMap<int, IUnknown*> map;
+    for (int k = 0; k < 20; k++)
+    {
+      CHECK(map.Insert(k, TestObject::Create(k)) == S_OK);
+    }
+    CHECK(TestObject::LiveCount() == cLive + 20);
+
+    // Removing a pair does not release its value.
+    IUnknown *pUnk = NULL;
+    REQUIRE(map.Find(5, &pUnk) == S_OK);
+    CHECK(map.Remove(5) == S_OK);
+    SAFE_RELEASE(pUnk);
+
+    ComAutoRelease release;
+    map.ClearValues(release);
+    CHECK(map.GetCount() == 0);
+  }
+  CHECK(TestObject::LiveCount() == cLive);
+}
@@ -0,0 +1,153 @@
+/*
+ *      Copyright (C) 2014 Andrew Van Til
+ *      http://babgvant.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "stdafx.h"
+#include "EVRPresenter.h"
+
+ThinningPlanner::ThinningPlanner() :
+  m_fRate(1.0f),
+  m_hnsFrameInterval(0),
+  m_hnsDisplayInterval(0),
+  m_hnsStep(0),
+  m_cSkipped(0)
+{
+  Reset();
+}
+
+//-----------------------------------------------------------------------------
+// Reset
+//
+// Forgets the grid, for example after a flush. The next frame is shown and
+// starts a new grid.
+//-----------------------------------------------------------------------------
+
+void ThinningPlanner::Reset()
+{
+  m_bHaveSlot = FALSE;
+  m_hnsAnchor = 0;
+  m_hnsNextSlot = 0;
+}
+
+void ThinningPlanner::SetRate(float fRate)
+{
+  m_fRate = fRate;
+  UpdateStep();
+}
+
+void ThinningPlanner::SetFrameInterval(LONGLONG hnsFrameInterval)
+{
+  m_hnsFrameInterval = hnsFrameInterval;
+  UpdateStep();
+}
+
+void ThinningPlanner::SetDisplayInterval(LONGLONG hnsDisplayInterval)
+{
+  m_hnsDisplayInterval = hnsDisplayInterval;
+  UpdateStep();
+}
+
+//-----------------------------------------------------------------------------
+// UpdateStep
+//
+// Calculates the grid spacing. Without a known refresh rate, the shown 
+// frames are spaced one source frame interval apart in system time.
+//-----------------------------------------------------------------------------
+
+void ThinningPlanner::UpdateStep()
+{
+  float fSpeed = fabsf(m_fRate);
+
+  m_hnsStep = 0;
+  if (fSpeed > THINNING_MIN_RATE && m_hnsFrameInterval > 0)
+  {
+    LONGLONG hnsOutput = m_hnsDisplayInterval > 0 ? m_hnsDisplayInterval : m_hnsFrameInterval;
+    m_hnsStep = (LONGLONG)(hnsOutput * fSpeed);
+
+    if (m_hnsStep <= m_hnsFrameInterval)
+    {
+      // Every frame fits on its own slot.
+      m_hnsStep = 0;
+    }
+  }
+  Reset();
+}
+
+//-----------------------------------------------------------------------------
+// SelectFrame
+//
+// Returns TRUE if the frame with this presentation time should be shown.
+//-----------------------------------------------------------------------------
+
+BOOL ThinningPlanner::SelectFrame(LONGLONG hnsSampleTime)
+{
+  if (!IsActive())
+  {
+    return TRUE;
+  }
+
+  // Distance past the slot, in the direction of playback.
+  LONGLONG hnsPast = hnsSampleTime - m_hnsNextSlot;
+  LONGLONG hnsStep = m_hnsStep;
+  if (m_fRate < 0)
+  {
+    hnsPast = -hnsPast;
+    hnsStep = -hnsStep;
+  }
+
+  if (!m_bHaveSlot || hnsPast >= m_hnsStep || hnsPast < -m_hnsStep)
+  {
+    // First frame, or the stream jumped by more than a slot: Start over here.
+    m_hnsAnchor = hnsSampleTime;
+    m_hnsNextSlot = hnsSampleTime + hnsStep;
+    m_bHaveSlot = TRUE;
+    return TRUE;
+  }
+
+  if (hnsPast < -(m_hnsFrameInterval / 2))
+  {
+    // The next slot is closer to a later frame.
+    m_cSkipped++;
+    return FALSE;
+  }
+
+  // Advance from the slot rather than from the frame, so that rounding to 
+  // whole frames does not add up.
+  m_hnsNextSlot += hnsStep;
+  return TRUE;
+}
+
+//-----------------------------------------------------------------------------
+// SlotTime
+//
+// Returns the presentation time of the slot that a shown frame was picked 
+// for. Frames are picked within half a frame of their slot, so the nearest
+// slot is the right one.
+//-----------------------------------------------------------------------------
+
+LONGLONG ThinningPlanner::SlotTime(LONGLONG hnsSampleTime) const
+{
+  if (!IsActive() || !m_bHaveSlot)
+  {
+    return hnsSampleTime;
+  }
+
+  LONGLONG hnsOffset = hnsSampleTime - m_hnsAnchor;
+  LONGLONG llSlot = (_abs64(hnsOffset) + m_hnsStep / 2) / m_hnsStep;
+  return m_hnsAnchor + (hnsOffset < 0 ? -llSlot : llSlot) * m_hnsStep;
+}
@@ -0,0 +1,81 @@
+/*
+ *      Copyright (C) 2014 Andrew Van Til
+ *      http://babgvant.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+// Thinning starts above this playback rate. Below it, every frame is shown.
+const float THINNING_MIN_RATE = 2.0f;
+
+//-----------------------------------------------------------------------------
+// ThinningPlanner class
+//
+// Picks which frames to show during fast playback (trick play), so that the
+// shown frames are evenly spaced at the display rate instead of in bursts.
+//
+// At rate r, one refresh interval of system time covers r refresh intervals
+// of presentation time. The planner lays a grid of slots that far apart over
+// the presentation times, and shows the first frame that reaches each slot
+// (within half a frame). All other frames are skipped. If the stream jumps
+// past a slot, for example because the decoder skipped frames, the grid is 
+// moved to the new frame.
+//
+// A shown frame is presented at its slot (SlotTime) rather than at its own
+// time stamp, so the shown frames stay one refresh interval apart even 
+// though the source frames do not fall on the grid.
+//
+// The presenter asks the planner as soon as a frame comes out of the mixer,
+// so skipped frames cost no subtitle blending or scheduling.
+//
+// All times are presentation times in 100-nanosecond units. For reverse 
+// playback, the grid runs backward.
+//-----------------------------------------------------------------------------
+
+class ThinningPlanner
+{
+public:
+  ThinningPlanner();
+
+  void Reset();
+
+  void SetRate(float fRate);
+  void SetFrameInterval(LONGLONG hnsFrameInterval);
+  void SetDisplayInterval(LONGLONG hnsDisplayInterval);
+
+  BOOL IsActive() const { return m_hnsStep > 0; }
+  LONGLONG Step() const { return m_hnsStep; }
+
+  BOOL SelectFrame(LONGLONG hnsSampleTime);
+  LONGLONG SlotTime(LONGLONG hnsSampleTime) const;
+
+  DWORD FramesSkipped() const { return m_cSkipped; }
+
+private:
+  void UpdateStep();
+
+  float       m_fRate;
+  LONGLONG    m_hnsFrameInterval;
+  LONGLONG    m_hnsDisplayInterval;
+  LONGLONG    m_hnsStep;              // Grid spacing; 0 when not thinning.
+
+  BOOL        m_bHaveSlot;
+  LONGLONG    m_hnsAnchor;            // Presentation time of the first slot.
+  LONGLONG    m_hnsNextSlot;          // Presentation time of the next slot.
+
+  DWORD       m_cSkipped;
+};
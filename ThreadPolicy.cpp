@@ -0,0 +1,185 @@
+/*
+ *      Copyright (C) 2014 Andrew Van Til
+ *      http://babgvant.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "stdafx.h"
+#include "EVRPresenter.h"
+
+// Win32 priority for each EVRCPThreadPriority.
+static const int g_ThreadPriorities[] =
+{
+  THREAD_PRIORITY_NORMAL,
+  THREAD_PRIORITY_ABOVE_NORMAL,
+  THREAD_PRIORITY_HIGHEST,
+  THREAD_PRIORITY_TIME_CRITICAL
+};
+
+ThreadPolicy::ThreadPolicy() :
+  m_hThread(NULL),
+  m_hMmcss(NULL),
+  m_dwMmcssTaskIndex(0),
+  m_dwAllowedMask(0),
+  m_dwAvoided(MAXDWORD),
+  m_bAvoidMixerCore(FALSE)
+{
+}
+
+ThreadPolicy::~ThreadPolicy()
+{
+  Revert();
+}
+
+
+//-----------------------------------------------------------------------------
+// Apply
+//
+// Applies the settings to the calling thread. A setting that cannot be 
+// applied is skipped; the method returns the first error.
+//-----------------------------------------------------------------------------
+
+HRESULT ThreadPolicy::Apply(const ThreadPolicySettings& settings)
+{
+  HRESULT hr = S_OK;
+  DWORD_PTR dwProcessMask = 0;
+  DWORD_PTR dwSystemMask = 0;
+
+  m_hThread = GetCurrentThread();
+  m_bAvoidMixerCore = settings.bAvoidMixerCore;
+  m_dwAvoided = MAXDWORD;
+
+  if (settings.iPriority < EVRCP_THREAD_PRIORITY_NORMAL || settings.iPriority > EVRCP_THREAD_PRIORITY_TIME_CRITICAL)
+  {
+    return E_INVALIDARG;
+  }
+
+  if (!SetThreadPriority(m_hThread, g_ThreadPriorities[settings.iPriority]))
+  {
+    hr = HRESULT_FROM_WIN32(GetLastError());
+  }
+
+  if (settings.bMmcss && m_hMmcss == NULL)
+  {
+    m_dwMmcssTaskIndex = 0;
+    m_hMmcss = AvSetMmThreadCharacteristicsW(L"Playback", &m_dwMmcssTaskIndex);
+    if (m_hMmcss)
+    {
+      AvSetMmThreadPriority(m_hMmcss, AVRT_PRIORITY_HIGH);
+    }
+    else if (SUCCEEDED(hr))
+    {
+      hr = HRESULT_FROM_WIN32(GetLastError());
+    }
+  }
+
+  // Processors the thread may use.
+  m_dwAllowedMask = 0;
+  if (GetProcessAffinityMask(GetCurrentProcess(), &dwProcessMask, &dwSystemMask))
+  {
+    m_dwAllowedMask = dwProcessMask;
+  }
+
+  if (settings.dwAffinityMask != 0)
+  {
+    DWORD_PTR dwMask = m_dwAllowedMask ? (m_dwAllowedMask & settings.dwAffinityMask) : settings.dwAffinityMask;
+
+    if (dwMask == 0 || !SetThreadAffinityMask(m_hThread, dwMask))
+    {
+      if (SUCCEEDED(hr))
+      {
+        hr = (dwMask == 0) ? E_INVALIDARG : HRESULT_FROM_WIN32(GetLastError());
+      }
+    }
+    else
+    {
+      m_dwAllowedMask = dwMask;
+    }
+  }
+
+  return hr;
+}
+
+
+//-----------------------------------------------------------------------------
+// Revert
+//
+// Leaves MMCSS and restores the normal priority. Call on the same thread as
+// Apply.
+//-----------------------------------------------------------------------------
+
+void ThreadPolicy::Revert()
+{
+  if (m_hMmcss)
+  {
+    AvRevertMmThreadCharacteristics(m_hMmcss);
+    m_hMmcss = NULL;
+  }
+
+  if (m_hThread)
+  {
+    SetThreadPriority(m_hThread, THREAD_PRIORITY_NORMAL);
+    m_hThread = NULL;
+  }
+}
+
+
+//-----------------------------------------------------------------------------
+// AvoidProcessor
+//
+// Called with the processor the mixer thread last ran on. If the thread 
+// prefers that processor, moves its ideal processor to the next allowed 
+// one.
+//-----------------------------------------------------------------------------
+
+void ThreadPolicy::AvoidProcessor(DWORD dwProcessor)
+{
+  if (!m_bAvoidMixerCore || m_hThread == NULL || dwProcessor == m_dwAvoided)
+  {
+    return;
+  }
+  m_dwAvoided = dwProcessor;
+
+  const DWORD cBits = sizeof(DWORD_PTR) * 8;
+  if (dwProcessor >= cBits)
+  {
+    return;
+  }
+
+  DWORD_PTR dwOthers = m_dwAllowedMask & ~((DWORD_PTR)1 << dwProcessor);
+  if (dwOthers == 0)
+  {
+    return;   // Only one processor to run on.
+  }
+
+  // Query the current ideal processor without changing it.
+  DWORD dwIdeal = SetThreadIdealProcessor(m_hThread, MAXIMUM_PROCESSORS);
+  if (dwIdeal != dwProcessor && dwIdeal != (DWORD)-1)
+  {
+    return;
+  }
+
+  // Next allowed processor after the mixer's.
+  for (DWORD i = 1; i < cBits; i++)
+  {
+    DWORD dwCandidate = (dwProcessor + i) % cBits;
+    if (dwOthers & ((DWORD_PTR)1 << dwCandidate))
+    {
+      SetThreadIdealProcessor(m_hThread, dwCandidate);
+      break;
+    }
+  }
+}
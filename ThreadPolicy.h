@@ -0,0 +1,72 @@
+/*
+ *      Copyright (C) 2014 Andrew Van Til
+ *      http://babgvant.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+// ThreadPolicySettings
+//
+// How a scheduler thread runs (set through IEVRCPConfig).
+//-----------------------------------------------------------------------------
+
+struct ThreadPolicySettings
+{
+  int       iPriority;          // EVRCPThreadPriority
+  bool      bMmcss;             // Register with MMCSS as a "Playback" task.
+  DWORD     dwAffinityMask;     // Processors the thread may run on; 0 means all.
+  bool      bAvoidMixerCore;    // Prefer a processor the mixer thread is not using.
+};
+
+
+//-----------------------------------------------------------------------------
+// ThreadPolicy class
+//
+// Applies ThreadPolicySettings to the calling thread, and undoes them when 
+// the thread is done (Revert, or the destructor).
+//
+// MMCSS raises the thread into the real-time priority range without 
+// administrator rights, and overrides iPriority while the thread is 
+// registered. If MMCSS is not available (the service is disabled), the 
+// thread keeps iPriority.
+//
+// Avoiding the mixer core only moves the thread's ideal processor, which 
+// is a hint to the Windows scheduler; it never pins the thread.
+//-----------------------------------------------------------------------------
+
+class ThreadPolicy
+{
+public:
+  ThreadPolicy();
+  ~ThreadPolicy();
+
+  HRESULT Apply(const ThreadPolicySettings& settings);
+  void    Revert();
+
+  void    AvoidProcessor(DWORD dwProcessor);
+
+  BOOL    IsMmcssRegistered() const { return m_hMmcss != NULL; }
+
+private:
+  HANDLE    m_hThread;            // Pseudo-handle of the thread the policy applies to.
+  HANDLE    m_hMmcss;             // MMCSS task handle.
+  DWORD     m_dwMmcssTaskIndex;
+  DWORD_PTR m_dwAllowedMask;      // Processors the thread may use.
+  DWORD     m_dwAvoided;          // Processor last avoided, or MAXDWORD.
+  BOOL      m_bAvoidMixerCore;
+};
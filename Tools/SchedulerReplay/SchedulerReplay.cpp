@@ -0,0 +1,470 @@
+/*
+ *      Copyright (C) 2014 Andrew Van Til
+ *      http://babgvant.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+//-----------------------------------------------------------------------------
+// SchedulerReplay
+//
+// Feeds a stream of sample time stamps through the Scheduler, with a
+// VirtualClock on a VirtualTimer, and prints what the scheduler decided for
+// each frame. A SimulatedPresenter stands in for the present engine, with a
+// settable render and flip cost. No window, device or playback graph is 
+// needed, and virtual time only moves when the scheduler or the simulated
+// presenter waits, so a replay of minutes of video takes well under a 
+// second.
+//
+// Usage: SchedulerReplay [options] [file]
+//
+// file holds one sample time stamp per line, in 100-ns units; lines that
+// start with # are skipped. Without a file, a synthetic stream is used.
+// See PrintUsage for the options.
+//
+// Output: One CSV line per frame (frame, sample time, present time, delta,
+// queue depth, decision), then a summary that includes how many flips the 
+// simulated presenter finished after their deadline.
+//-----------------------------------------------------------------------------
+
+#include "stdafx.h"
+#include "EVRPresenter.h"
+#include "VirtualClock.h"
+
+const DWORD REPLAY_NO_EVENT = MAXDWORD;
+
+struct ReplayOptions
+{
+  MFRatio     fps;            // Frame rate of the synthetic stream and the media type.
+  DWORD       cFrames;        // Length of the synthetic stream.
+  float       fRate;          // Playback rate.
+  LONG        lDriftPpm;      // Clock drift.
+  LONGLONG    hnsJitter;      // Clock read jitter.
+  DWORD       dwSeed;         // Jitter seed.
+  DWORD       cDepth;         // Samples the decoder keeps queued ahead of the scheduler.
+  UINT        uRefreshRate;   // Display refresh rate, for the vsync planner and the simulated display. 0 = off.
+  LONGLONG    hnsRenderCost;  // Simulated time to render a frame.
+  LONGLONG    hnsFlipCost;    // Simulated time to flip a frame.
+  BOOL        bPresentAhead;  // Render the next frame while waiting for it.
+  DWORD       dwPauseFrame;   // Pause after this frame is delivered.
+  LONGLONG    hnsPause;       // How long to stay paused.
+  DWORD       dwSeekFrame;    // Seek after this frame is delivered.
+  LONGLONG    hnsSeekTo;      // Where to seek to.
+  BOOL        bSummaryOnly;
+  const char  *pszFile;
+};
+
+static void PrintUsage()
+{
+  printf(
+    "Usage: SchedulerReplay [options] [file]\n"
+    "\n"
+    "  fps=N/D          Frame rate (default 24000/1001)\n"
+    "  frames=N         Frames in the synthetic stream (default 240)\n"
+    "  rate=F           Playback rate (default 1.0)\n"
+    "  drift=PPM        Clock drift in parts per million (default 0)\n"
+    "  jitter=HNS       Clock read jitter, in 100-ns units (default 0)\n"
+    "  seed=N           Jitter seed (default 1)\n"
+    "  depth=N          Samples queued ahead of the scheduler (default 3)\n"
+    "  refresh=HZ       Display refresh rate for the vsync planner and the\n"
+    "                   simulated display (default 0, off)\n"
+    "  render=HNS       Simulated render cost per frame, in 100-ns units (default 0)\n"
+    "  flip=HNS         Simulated flip cost per frame, in 100-ns units (default 0)\n"
+    "  ahead            Render each frame ahead while waiting for it (present-ahead)\n"
+    "  pause=FRAME:HNS  Pause the clock for HNS after FRAME is delivered\n"
+    "  seek=FRAME:HNS   Flush and seek the clock to HNS after FRAME is delivered;\n"
+    "                   the following time stamps are shifted to start at HNS\n"
+    "  summary          Print only the summary\n"
+    "  help             Print this text\n"
+    "\n"
+    "file: One time stamp (100-ns units) per line. Lines starting with # are skipped.\n");
+}
+
+static BOOL ParseOptions(int argc, char *argv[], ReplayOptions *pOptions)
+{
+  pOptions->fps.Numerator = 24000;
+  pOptions->fps.Denominator = 1001;
+  pOptions->cFrames = 240;
+  pOptions->fRate = 1.0f;
+  pOptions->lDriftPpm = 0;
+  pOptions->hnsJitter = 0;
+  pOptions->dwSeed = 1;
+  pOptions->cDepth = 3;
+  pOptions->uRefreshRate = 0;
+  pOptions->hnsRenderCost = 0;
+  pOptions->hnsFlipCost = 0;
+  pOptions->bPresentAhead = FALSE;
+  pOptions->dwPauseFrame = REPLAY_NO_EVENT;
+  pOptions->hnsPause = 0;
+  pOptions->dwSeekFrame = REPLAY_NO_EVENT;
+  pOptions->hnsSeekTo = 0;
+  pOptions->bSummaryOnly = FALSE;
+  pOptions->pszFile = NULL;
+
+  for (int i = 1; i < argc; i++)
+  {
+    const char *arg = argv[i];
+    BOOL bOk = TRUE;
+
+    if (strcmp(arg, "help") == 0 || strcmp(arg, "/?") == 0)
+    {
+      return FALSE;
+    }
+    else if (strncmp(arg, "fps=", 4) == 0)
+    {
+      bOk = (sscanf(arg + 4, "%u/%u", &pOptions->fps.Numerator, &pOptions->fps.Denominator) == 2) && pOptions->fps.Denominator != 0;
+    }
+    else if (strncmp(arg, "frames=", 7) == 0)
+    {
+      bOk = (sscanf(arg + 7, "%lu", &pOptions->cFrames) == 1);
+    }
+    else if (strncmp(arg, "rate=", 5) == 0)
+    {
+      bOk = (sscanf(arg + 5, "%f", &pOptions->fRate) == 1) && pOptions->fRate != 0.0f;
+    }
+    else if (strncmp(arg, "drift=", 6) == 0)
+    {
+      bOk = (sscanf(arg + 6, "%ld", &pOptions->lDriftPpm) == 1);
+    }
+    else if (strncmp(arg, "jitter=", 7) == 0)
+    {
+      bOk = (sscanf(arg + 7, "%lld", &pOptions->hnsJitter) == 1);
+    }
+    else if (strncmp(arg, "seed=", 5) == 0)
+    {
+      bOk = (sscanf(arg + 5, "%lu", &pOptions->dwSeed) == 1);
+    }
+    else if (strncmp(arg, "depth=", 6) == 0)
+    {
+      bOk = (sscanf(arg + 6, "%lu", &pOptions->cDepth) == 1) && pOptions->cDepth > 0 && pOptions->cDepth < SCHEDULER_QUEUE_SIZE;
+    }
+    else if (strncmp(arg, "refresh=", 8) == 0)
+    {
+      bOk = (sscanf(arg + 8, "%u", &pOptions->uRefreshRate) == 1);
+    }
+    else if (strncmp(arg, "render=", 7) == 0)
+    {
+      bOk = (sscanf(arg + 7, "%lld", &pOptions->hnsRenderCost) == 1) && pOptions->hnsRenderCost >= 0;
+    }
+    else if (strncmp(arg, "flip=", 5) == 0)
+    {
+      bOk = (sscanf(arg + 5, "%lld", &pOptions->hnsFlipCost) == 1) && pOptions->hnsFlipCost >= 0;
+    }
+    else if (strcmp(arg, "ahead") == 0)
+    {
+      pOptions->bPresentAhead = TRUE;
+    }
+    else if (strncmp(arg, "pause=", 6) == 0)
+    {
+      bOk = (sscanf(arg + 6, "%lu:%lld", &pOptions->dwPauseFrame, &pOptions->hnsPause) == 2);
+    }
+    else if (strncmp(arg, "seek=", 5) == 0)
+    {
+      bOk = (sscanf(arg + 5, "%lu:%lld", &pOptions->dwSeekFrame, &pOptions->hnsSeekTo) == 2);
+    }
+    else if (strcmp(arg, "summary") == 0)
+    {
+      pOptions->bSummaryOnly = TRUE;
+    }
+    else if (pOptions->pszFile == NULL && strchr(arg, '=') == NULL)
+    {
+      pOptions->pszFile = arg;
+    }
+    else
+    {
+      bOk = FALSE;
+    }
+
+    if (!bOk)
+    {
+      printf("Bad option: %s\n\n", arg);
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+//-----------------------------------------------------------------------------
+// LoadTimeStamps
+//
+// Reads the time stamps from the file, or makes a synthetic stream.
+//-----------------------------------------------------------------------------
+
+static HRESULT LoadTimeStamps(const ReplayOptions& options, GrowableArray<LONGLONG> *pTimes)
+{
+  HRESULT hr = S_OK;
+
+  if (options.pszFile == NULL)
+  {
+    for (DWORD i = 0; i < options.cFrames; i++)
+    {
+      // Round each time stamp on its own, as a demuxer would, instead of
+      // adding up a rounded frame duration.
+      LONGLONG hnsTime = (LONGLONG)((double)i * options.fps.Denominator * 10000000 / options.fps.Numerator + 0.5);
+      CHECK_HR(hr = pTimes->Append(hnsTime));
+    }
+  }
+  else
+  {
+    FILE *pFile = fopen(options.pszFile, "r");
+    if (pFile == NULL)
+    {
+      printf("Cannot open %s\n", options.pszFile);
+      return E_FAIL;
+    }
+
+    char line[128];
+    while (SUCCEEDED(hr) && fgets(line, sizeof(line), pFile))
+    {
+      LONGLONG hnsTime = 0;
+      if (line[0] != '#' && sscanf(line, "%lld", &hnsTime) == 1)
+      {
+        hr = pTimes->Append(hnsTime);
+      }
+    }
+    fclose(pFile);
+  }
+
+done:
+  return hr;
+}
+
+//-----------------------------------------------------------------------------
+// WaitForFrames
+//
+// Waits until the scheduler has presented or dropped cFrames samples. The
+// scheduler thread advances the virtual time, so this only yields.
+//-----------------------------------------------------------------------------
+
+static void WaitForFrames(SchedulerRecorder *pRecorder, DWORD cFrames)
+{
+  while (pRecorder->GetCount() < cFrames)
+  {
+    SwitchToThread();
+  }
+}
+
+static HRESULT CreateReplaySample(LONGLONG hnsTime, LONGLONG hnsDuration, IMFSample **ppSample)
+{
+  HRESULT hr = S_OK;
+  IMFSample *pSample = NULL;
+
+  CHECK_HR(hr = MFCreateSample(&pSample));
+  CHECK_HR(hr = pSample->SetSampleTime(hnsTime));
+  CHECK_HR(hr = pSample->SetSampleDuration(hnsDuration));
+
+  *ppSample = pSample;
+  (*ppSample)->AddRef();
+
+done:
+  SAFE_RELEASE(pSample);
+  return hr;
+}
+
+//-----------------------------------------------------------------------------
+// Replay
+//
+// Runs the stream through a scheduler. Mirrors what the presenter does:
+// trick-play frames are thinned before they are scheduled, and the clock
+// state sink calls are made around pauses and seeks.
+//-----------------------------------------------------------------------------
+
+static HRESULT Replay(const ReplayOptions& options, const GrowableArray<LONGLONG>& times, SchedulerRecorder *pRecorder, VirtualTimer *pTimer, DWORD *pcThinned)
+{
+  HRESULT hr = S_OK;
+  VirtualClock *pClock = NULL;
+  IMFSample *pSample = NULL;
+  BOOL bStarted = FALSE;
+  DWORD cDelivered = 0;
+  LONGLONG hnsOffset = 0;
+  UINT64 hnsPerFrame = 0;
+
+  Scheduler *pScheduler = new Scheduler();
+  if (pScheduler == NULL)
+  {
+    return E_OUTOFMEMORY;
+  }
+
+  CHECK_HR(hr = MFFrameRateToAverageTimePerFrame(options.fps.Numerator, options.fps.Denominator, &hnsPerFrame));
+  CHECK_HR(hr = VirtualClock::CreateInstance(pTimer, &pClock));
+
+  pClock->SetDrift(options.lDriftPpm);
+  pClock->SetJitter(options.hnsJitter, options.dwSeed);
+  CHECK_HR(hr = pClock->SetRate(options.fRate));
+
+  pScheduler->SetCallback(pRecorder);
+  pScheduler->SetTimer(pTimer);
+  pScheduler->SetFrameRate(options.fps);
+  pScheduler->SetRefreshRate(options.uRefreshRate);
+  pScheduler->SetUseVsyncPlanner(options.uRefreshRate != 0);
+  pScheduler->SetClockRate(options.fRate);
+  pScheduler->SetPresentAhead(options.bPresentAhead != FALSE);
+
+  CHECK_HR(hr = pClock->Start());
+  CHECK_HR(hr = pScheduler->StartScheduler(pClock));
+  bStarted = TRUE;
+  pScheduler->SetClockRunning(TRUE);
+
+  for (DWORD i = 0; i < times.GetCount(); i++)
+  {
+    LONGLONG hnsTime = times[i] + hnsOffset;
+
+    if (!pScheduler->ShouldShowSample(hnsTime))
+    {
+      (*pcThinned)++;
+    }
+    else
+    {
+      // Stay at most cDepth samples ahead of the scheduler, like a decoder
+      // limited by the sample pool.
+      if (cDelivered >= options.cDepth)
+      {
+        WaitForFrames(pRecorder, cDelivered - options.cDepth + 1);
+      }
+
+      CHECK_HR(hr = CreateReplaySample(hnsTime, (LONGLONG)hnsPerFrame, &pSample));
+      CHECK_HR(hr = pScheduler->ScheduleSample(pSample, FALSE));
+      SAFE_RELEASE(pSample);
+      cDelivered++;
+    }
+
+    if (i == options.dwPauseFrame)
+    {
+      WaitForFrames(pRecorder, cDelivered);
+
+      CHECK_HR(hr = pClock->Pause());
+      pScheduler->SetClockRunning(FALSE);
+
+      pTimer->Advance(options.hnsPause);
+
+      CHECK_HR(hr = pClock->Start());
+      pScheduler->SetClockRunning(TRUE);
+    }
+
+    if (i == options.dwSeekFrame && i + 1 < times.GetCount())
+    {
+      WaitForFrames(pRecorder, cDelivered);
+
+      CHECK_HR(hr = pScheduler->Flush());
+      CHECK_HR(hr = pClock->Seek(options.hnsSeekTo));
+      hnsOffset = options.hnsSeekTo - times[i + 1];
+    }
+  }
+
+  WaitForFrames(pRecorder, cDelivered);
+
+done:
+  if (bStarted)
+  {
+    pScheduler->StopScheduler();
+  }
+  SAFE_RELEASE(pSample);
+  SAFE_RELEASE(pClock);
+  delete pScheduler;
+  return hr;
+}
+
+static void PrintResults(const ReplayOptions& options, SchedulerRecorder *pRecorder, SimulatedPresenter *pPresenter, DWORD cThinned)
+{
+  DWORD cPresented = 0;
+  DWORD cDropped = 0;
+  DWORD cLate = 0;
+  LONGLONG hnsMaxLate = 0;
+
+  if (!options.bSummaryOnly)
+  {
+    printf("frame,sample_time,present_time,delta,queued,decision\n");
+  }
+
+  for (DWORD i = 0; i < pRecorder->GetCount(); i++)
+  {
+    SchedulerFrameRecord r;
+    if (FAILED(pRecorder->GetRecord(i, &r)))
+    {
+      break;
+    }
+
+    if (r.bDropped)
+    {
+      cDropped++;
+    }
+    else
+    {
+      cPresented++;
+      if (r.hnsDelta < 0)
+      {
+        cLate++;
+        if (-r.hnsDelta > hnsMaxLate)
+        {
+          hnsMaxLate = -r.hnsDelta;
+        }
+      }
+    }
+
+    if (!options.bSummaryOnly)
+    {
+      printf("%lu,%lld,%lld,%lld,%lld,%s\n", i, r.hnsSampleTime, r.hnsPresentTime, r.hnsDelta, r.cQueued, r.bDropped ? "dropped" : "presented");
+    }
+  }
+
+  printf("# frames=%lu presented=%lu dropped=%lu thinned=%lu late=%lu max_late_hns=%lld\n",
+    pRecorder->GetCount(), cPresented, cDropped, cThinned, cLate, hnsMaxLate);
+
+  EVRCPHistogramStats flip;
+  pPresenter->GetFlipLateness(&flip);
+
+  printf("# flipped=%lu flipped_ahead=%lu flips_late=%lu flip_late_p50_hns=%lld flip_late_p99_hns=%lld flip_late_max_hns=%lld\n",
+    pPresenter->FramesFlipped(), pPresenter->FramesFlippedAhead(), pPresenter->FramesLate(), flip.llP50, flip.llP99, flip.llMax);
+}
+
+int main(int argc, char *argv[])
+{
+  ReplayOptions options;
+  GrowableArray<LONGLONG> times;
+  DWORD cThinned = 0;
+
+  if (!ParseOptions(argc, argv, &options))
+  {
+    PrintUsage();
+    return 2;
+  }
+
+  HRESULT hr = MFStartup(MF_VERSION, MFSTARTUP_LITE);
+  if (FAILED(hr))
+  {
+    printf("MFStartup failed: 0x%08lX\n", hr);
+    return 1;
+  }
+
+  hr = LoadTimeStamps(options, &times);
+  if (SUCCEEDED(hr))
+  {
+    VirtualTimer timer(0);
+    LONGLONG hnsVsyncInterval = (options.uRefreshRate > 0 ? 10000000 / options.uRefreshRate : 0);
+    SimulatedPresenter presenter(&timer, options.hnsRenderCost, options.hnsFlipCost, hnsVsyncInterval);
+    SchedulerRecorder recorder(&timer, &presenter);
+
+    hr = Replay(options, times, &recorder, &timer, &cThinned);
+    PrintResults(options, &recorder, &presenter, cThinned);
+  }
+
+  if (FAILED(hr))
+  {
+    printf("Replay failed: 0x%08lX\n", hr);
+  }
+
+  MFShutdown();
+  return FAILED(hr) ? 1 : 0;
+}
@@ -0,0 +1,477 @@
+/*
+ *      Copyright (C) 2014 Andrew Van Til
+ *      http://babgvant.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "stdafx.h"
+#include "EVRPresenter.h"
+#include "VirtualClock.h"
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// VirtualTimer
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void VirtualTimer::WaitUntil(LONGLONG hnsDeadline)
+{
+  LONGLONG hnsNow = m_hnsNow.load();
+
+  // Never move backward, even if another thread advanced the time.
+  while (hnsNow < hnsDeadline && !m_hnsNow.compare_exchange_weak(hnsNow, hnsDeadline))
+  {
+  }
+}
+
+void VirtualTimer::Advance(LONGLONG hnsDelta)
+{
+  m_hnsNow.fetch_add(hnsDelta);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// VirtualClock
+//
+///////////////////////////////////////////////////////////////////////////////
+
+HRESULT VirtualClock::CreateInstance(SchedulerTimer *pTimer, VirtualClock **ppClock)
+{
+  CheckPointer(pTimer, E_POINTER);
+  CheckPointer(ppClock, E_POINTER);
+
+  *ppClock = new VirtualClock(pTimer);
+  if (*ppClock == NULL)
+  {
+    return E_OUTOFMEMORY;
+  }
+  return S_OK;
+}
+
+VirtualClock::VirtualClock(SchedulerTimer *pTimer) :
+  m_pTimer(pTimer),
+  m_state(MFCLOCK_STATE_INVALID),
+  m_fRate(1.0f),
+  m_lDriftPpm(0),
+  m_hnsJitter(0),
+  m_dwRandom(1),
+  m_dwContinuityKey(0),
+  m_hnsAnchorClock(0),
+  m_hnsAnchorSystem(0)
+{
+  m_hnsAnchorSystem = m_pTimer->Now();
+}
+
+HRESULT VirtualClock::QueryInterface(REFIID riid, void ** ppv)
+{
+  CheckPointer(ppv, E_POINTER);
+
+  if (riid == __uuidof(IUnknown) || riid == __uuidof(IMFClock))
+  {
+    *ppv = static_cast<IMFClock*>(this);
+  }
+  else
+  {
+    *ppv = NULL;
+    return E_NOINTERFACE;
+  }
+
+  AddRef();
+  return S_OK;
+}
+
+ULONG VirtualClock::AddRef()
+{
+  return RefCountedObject::AddRef();
+}
+
+ULONG VirtualClock::Release()
+{
+  return RefCountedObject::Release();
+}
+
+HRESULT VirtualClock::GetClockCharacteristics(DWORD *pdwCharacteristics)
+{
+  CheckPointer(pdwCharacteristics, E_POINTER);
+
+  *pdwCharacteristics = MFCLOCK_CHARACTERISTICS_FLAG_FREQUENCY_10MHZ;
+  return S_OK;
+}
+
+HRESULT VirtualClock::GetCorrelatedTime(DWORD dwReserved, LONGLONG *pllClockTime, MFTIME *phnsSystemTime)
+{
+  CheckPointer(pllClockTime, E_POINTER);
+  CheckPointer(phnsSystemTime, E_POINTER);
+
+  AutoLock lock(m_lock);
+
+  LONGLONG hnsSystemTime = m_pTimer->Now();
+  LONGLONG hnsClockTime = ClockTimeAt(hnsSystemTime);
+
+  if (m_hnsJitter > 0 && m_state == MFCLOCK_STATE_RUNNING)
+  {
+    // Xorshift; good enough to scatter the reads.
+    m_dwRandom ^= m_dwRandom << 13;
+    m_dwRandom ^= m_dwRandom >> 17;
+    m_dwRandom ^= m_dwRandom << 5;
+
+    hnsClockTime += (LONGLONG)(m_dwRandom % (2 * m_hnsJitter + 1)) - m_hnsJitter;
+  }
+
+  *pllClockTime = hnsClockTime;
+  *phnsSystemTime = hnsSystemTime;
+  return S_OK;
+}
+
+HRESULT VirtualClock::GetContinuityKey(DWORD *pdwContinuityKey)
+{
+  CheckPointer(pdwContinuityKey, E_POINTER);
+
+  AutoLock lock(m_lock);
+  *pdwContinuityKey = m_dwContinuityKey;
+  return S_OK;
+}
+
+HRESULT VirtualClock::GetState(DWORD dwReserved, MFCLOCK_STATE *peClockState)
+{
+  CheckPointer(peClockState, E_POINTER);
+
+  AutoLock lock(m_lock);
+  *peClockState = m_state;
+  return S_OK;
+}
+
+HRESULT VirtualClock::GetProperties(MFCLOCK_PROPERTIES *pClockProperties)
+{
+  CheckPointer(pClockProperties, E_POINTER);
+
+  ZeroMemory(pClockProperties, sizeof(MFCLOCK_PROPERTIES));
+
+  pClockProperties->qwClockFrequency = MFCLOCK_FREQUENCY_HNS;
+  pClockProperties->dwClockTolerance = MFCLOCK_TOLERANCE_UNKNOWN;
+  pClockProperties->dwClockJitter = (DWORD)m_hnsJitter;
+  return S_OK;
+}
+
+HRESULT VirtualClock::Start()
+{
+  AutoLock lock(m_lock);
+
+  Reanchor();
+  m_state = MFCLOCK_STATE_RUNNING;
+  return S_OK;
+}
+
+HRESULT VirtualClock::Pause()
+{
+  AutoLock lock(m_lock);
+
+  if (m_state != MFCLOCK_STATE_RUNNING)
+  {
+    return MF_E_INVALIDREQUEST;
+  }
+
+  Reanchor();
+  m_state = MFCLOCK_STATE_PAUSED;
+  return S_OK;
+}
+
+HRESULT VirtualClock::Stop()
+{
+  AutoLock lock(m_lock);
+
+  m_hnsAnchorClock = 0;
+  m_hnsAnchorSystem = m_pTimer->Now();
+  m_state = MFCLOCK_STATE_STOPPED;
+  return S_OK;
+}
+
+HRESULT VirtualClock::Seek(LONGLONG hnsPosition)
+{
+  AutoLock lock(m_lock);
+
+  m_hnsAnchorClock = hnsPosition;
+  m_hnsAnchorSystem = m_pTimer->Now();
+  m_dwContinuityKey++;
+  return S_OK;
+}
+
+HRESULT VirtualClock::SetRate(float fRate)
+{
+  AutoLock lock(m_lock);
+
+  Reanchor();
+  m_fRate = fRate;
+  return S_OK;
+}
+
+void VirtualClock::SetDrift(LONG lPartsPerMillion)
+{
+  AutoLock lock(m_lock);
+
+  Reanchor();
+  m_lDriftPpm = lPartsPerMillion;
+}
+
+void VirtualClock::SetJitter(LONGLONG hnsJitter, DWORD dwSeed)
+{
+  AutoLock lock(m_lock);
+
+  m_hnsJitter = (hnsJitter > 0 ? hnsJitter : 0);
+  m_dwRandom = (dwSeed != 0 ? dwSeed : 1);
+}
+
+//-----------------------------------------------------------------------------
+// ClockTimeAt
+//
+// Returns the clock time at a given system time, without jitter.
+// Call with the lock held.
+//-----------------------------------------------------------------------------
+
+LONGLONG VirtualClock::ClockTimeAt(LONGLONG hnsSystemTime)
+{
+  if (m_state != MFCLOCK_STATE_RUNNING)
+  {
+    return m_hnsAnchorClock;
+  }
+
+  double dElapsed = (double)(hnsSystemTime - m_hnsAnchorSystem);
+  double dScale = m_fRate * (1.0 + m_lDriftPpm / 1000000.0);
+
+  return m_hnsAnchorClock + (LONGLONG)(dElapsed * dScale);
+}
+
+//-----------------------------------------------------------------------------
+// Reanchor
+//
+// Moves the anchor to the current time, so a change of rate or state only 
+// affects the clock from now on. Call with the lock held.
+//-----------------------------------------------------------------------------
+
+void VirtualClock::Reanchor()
+{
+  LONGLONG hnsNow = m_pTimer->Now();
+
+  m_hnsAnchorClock = ClockTimeAt(hnsNow);
+  m_hnsAnchorSystem = hnsNow;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// SchedulerRecorder
+//
+///////////////////////////////////////////////////////////////////////////////
+
+SchedulerRecorder::SchedulerRecorder(SchedulerTimer *pTimer, SchedulerCallback *pNext) :
+  m_pTimer(pTimer),
+  m_pNext(pNext)
+{
+}
+
+HRESULT SchedulerRecorder::PresentSample(IMFSample *pSample, LONGLONG llTarget, LONGLONG timeDelta, LONGLONG remainingInQueue, LONGLONG frameDurationDiv4)
+{
+  HRESULT hr = Record(llTarget, timeDelta, remainingInQueue, FALSE);
+
+  if (SUCCEEDED(hr) && m_pNext)
+  {
+    hr = m_pNext->PresentSample(pSample, llTarget, timeDelta, remainingInQueue, frameDurationDiv4);
+  }
+  return hr;
+}
+
+void SchedulerRecorder::OnSampleDropped(IMFSample *pSample, LONGLONG llTarget, LONGLONG timeDelta, LONGLONG remainingInQueue)
+{
+  (void)Record(llTarget, timeDelta, remainingInQueue, TRUE);
+
+  if (m_pNext)
+  {
+    m_pNext->OnSampleDropped(pSample, llTarget, timeDelta, remainingInQueue);
+  }
+}
+
+HRESULT SchedulerRecorder::GetTimeSinceVsync(LONGLONG *phnsSinceVsync)
+{
+  return m_pNext ? m_pNext->GetTimeSinceVsync(phnsSinceVsync) : E_NOTIMPL;
+}
+
+HRESULT SchedulerRecorder::PrepareSample(IMFSample *pSample)
+{
+  return m_pNext ? m_pNext->PrepareSample(pSample) : E_NOTIMPL;
+}
+
+void SchedulerRecorder::DiscardPrepared()
+{
+  if (m_pNext)
+  {
+    m_pNext->DiscardPrepared();
+  }
+}
+
+DWORD SchedulerRecorder::GetCount()
+{
+  AutoLock lock(m_lock);
+  return m_records.GetCount();
+}
+
+HRESULT SchedulerRecorder::GetRecord(DWORD index, SchedulerFrameRecord *pRecord)
+{
+  CheckPointer(pRecord, E_POINTER);
+
+  AutoLock lock(m_lock);
+
+  if (index >= m_records.GetCount())
+  {
+    return E_INVALIDARG;
+  }
+
+  *pRecord = m_records[index];
+  return S_OK;
+}
+
+void SchedulerRecorder::Clear()
+{
+  AutoLock lock(m_lock);
+  m_records.SetSize(0);
+}
+
+//-----------------------------------------------------------------------------
+// TraceRecords
+//
+// Writes one line per recorded frame to the debug log.
+//-----------------------------------------------------------------------------
+
+void SchedulerRecorder::TraceRecords()
+{
+  AutoLock lock(m_lock);
+
+  for (DWORD i = 0; i < m_records.GetCount(); i++)
+  {
+    const SchedulerFrameRecord& r = m_records[i];
+
+    TRACE((L"frame %u: sample=%I64d present=%I64d delta=%I64d queued=%I64d %s",
+      i, r.hnsSampleTime, r.hnsPresentTime, r.hnsDelta, r.cQueued, r.bDropped ? L"dropped" : L"presented"));
+  }
+}
+
+HRESULT SchedulerRecorder::Record(LONGLONG llTarget, LONGLONG timeDelta, LONGLONG remainingInQueue, BOOL bDropped)
+{
+  AutoLock lock(m_lock);
+
+  SchedulerFrameRecord r;
+
+  r.hnsSampleTime = llTarget;
+  r.hnsPresentTime = m_pTimer->Now();
+  r.hnsDelta = timeDelta;
+  r.cQueued = remainingInQueue;
+  r.bDropped = bDropped;
+
+  return m_records.Append(r);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// SimulatedPresenter
+//
+///////////////////////////////////////////////////////////////////////////////
+
+SimulatedPresenter::SimulatedPresenter(SchedulerTimer *pTimer, LONGLONG hnsRenderCost, LONGLONG hnsFlipCost, LONGLONG hnsVsyncInterval) :
+  m_pTimer(pTimer),
+  m_hnsRenderCost(hnsRenderCost),
+  m_hnsFlipCost(hnsFlipCost),
+  m_hnsVsyncInterval(hnsVsyncInterval),
+  m_pPreparedSample(NULL),
+  m_cFlipped(0),
+  m_cFlippedAhead(0),
+  m_cLate(0)
+{
+}
+
+HRESULT SimulatedPresenter::PresentSample(IMFSample *pSample, LONGLONG llTarget, LONGLONG timeDelta, LONGLONG remainingInQueue, LONGLONG frameDurationDiv4)
+{
+  LONGLONG hnsNow = m_pTimer->Now();
+  LONGLONG hnsDue = 0;
+  BOOL bReady = FALSE;
+
+  if (m_hnsVsyncInterval > 0)
+  {
+    // The frame must be flipped before the next refresh.
+    hnsDue = hnsNow - (hnsNow % m_hnsVsyncInterval) + m_hnsVsyncInterval;
+  }
+  else
+  {
+    // If the scheduler presented the sample early, it is not late until its
+    // presentation time.
+    hnsDue = hnsNow + (timeDelta > 0 ? timeDelta : 0);
+  }
+
+  {
+    AutoLock lock(m_lock);
+    bReady = (pSample != NULL && pSample == m_pPreparedSample);
+    m_pPreparedSample = NULL;
+  }
+
+  if (!bReady)
+  {
+    Spend(m_hnsRenderCost);
+  }
+  Spend(m_hnsFlipCost);
+
+  LONGLONG hnsLate = m_pTimer->Now() - hnsDue;
+  m_FlipLateness.Record(hnsLate);
+  if (hnsLate > 0)
+  {
+    m_cLate++;
+  }
+  m_cFlipped++;
+  if (bReady)
+  {
+    m_cFlippedAhead++;
+  }
+  return S_OK;
+}
+
+HRESULT SimulatedPresenter::GetTimeSinceVsync(LONGLONG *phnsSinceVsync)
+{
+  CheckPointer(phnsSinceVsync, E_POINTER);
+
+  if (m_hnsVsyncInterval <= 0)
+  {
+    return E_NOTIMPL;
+  }
+
+  *phnsSinceVsync = m_pTimer->Now() % m_hnsVsyncInterval;
+  return S_OK;
+}
+
+HRESULT SimulatedPresenter::PrepareSample(IMFSample *pSample)
+{
+  CheckPointer(pSample, E_POINTER);
+
+  Spend(m_hnsRenderCost);
+
+  AutoLock lock(m_lock);
+  m_pPreparedSample = pSample;
+  return S_OK;
+}
+
+void SimulatedPresenter::DiscardPrepared()
+{
+  AutoLock lock(m_lock);
+  m_pPreparedSample = NULL;
+}
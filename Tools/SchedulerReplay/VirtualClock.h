@@ -0,0 +1,198 @@
+/*
+ *      Copyright (C) 2014 Andrew Van Til
+ *      http://babgvant.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+// Stand-ins for the EVR's presentation clock and for the present engine, and
+// a recording callback, so the Scheduler can run without a playback graph or
+// a device. Built into the SchedulerReplay tool only, not into the presenter
+// DLL.
+
+//-----------------------------------------------------------------------------
+// VirtualTimer class
+//
+// SchedulerTimer that never sleeps. Time only moves when Advance is called,
+// or when the scheduler thread waits for a deadline, which jumps straight to
+// it. A scheduler that uses this timer runs as fast as it can.
+//-----------------------------------------------------------------------------
+
+class VirtualTimer : public SchedulerTimer
+{
+public:
+  VirtualTimer(LONGLONG hnsStart = 0) : m_hnsNow(hnsStart) { }
+
+  LONGLONG Now() { return m_hnsNow.load(); }
+  DWORD CoarseTimeout(LONGLONG hnsDeadline) { return 0; }
+  void WaitUntil(LONGLONG hnsDeadline);
+
+  void Advance(LONGLONG hnsDelta);
+
+private:
+  std::atomic<LONGLONG>   m_hnsNow;
+};
+
+
+//-----------------------------------------------------------------------------
+// VirtualClock class
+//
+// Presentation clock driven by a SchedulerTimer instead of the EVR. The rate,
+// drift, and jitter are settable, and the clock can be paused and seeked, so
+// the scheduler can be exercised without a playback graph.
+//
+// Clock time = anchor position + elapsed system time * rate * (1 + drift),
+// plus a uniformly distributed error of up to +/- the jitter on each read.
+//-----------------------------------------------------------------------------
+
+class VirtualClock : RefCountedObject, public IMFClock
+{
+public:
+  static HRESULT CreateInstance(SchedulerTimer *pTimer, VirtualClock **ppClock);
+
+  // IUnknown methods
+  STDMETHOD(QueryInterface)(REFIID riid, void ** ppv);
+  STDMETHOD_(ULONG, AddRef)();
+  STDMETHOD_(ULONG, Release)();
+
+  // IMFClock methods
+  STDMETHOD(GetClockCharacteristics)(DWORD *pdwCharacteristics);
+  STDMETHOD(GetCorrelatedTime)(DWORD dwReserved, LONGLONG *pllClockTime, MFTIME *phnsSystemTime);
+  STDMETHOD(GetContinuityKey)(DWORD *pdwContinuityKey);
+  STDMETHOD(GetState)(DWORD dwReserved, MFCLOCK_STATE *peClockState);
+  STDMETHOD(GetProperties)(MFCLOCK_PROPERTIES *pClockProperties);
+
+  // Control methods
+  HRESULT Start();
+  HRESULT Pause();
+  HRESULT Stop();
+  HRESULT Seek(LONGLONG hnsPosition);
+  HRESULT SetRate(float fRate);
+  void    SetDrift(LONG lPartsPerMillion);
+  void    SetJitter(LONGLONG hnsJitter, DWORD dwSeed);
+
+protected:
+  VirtualClock(SchedulerTimer *pTimer);
+
+  LONGLONG ClockTimeAt(LONGLONG hnsSystemTime);
+  void     Reanchor();
+
+  CritSec         m_lock;
+  SchedulerTimer  *m_pTimer;              // Source of system time; not owned.
+
+  MFCLOCK_STATE   m_state;
+  float           m_fRate;
+  LONG            m_lDriftPpm;            // Drift, in parts per million.
+  LONGLONG        m_hnsJitter;            // Maximum error added to each read.
+  DWORD           m_dwRandom;             // Jitter generator state.
+  DWORD           m_dwContinuityKey;
+
+  LONGLONG        m_hnsAnchorClock;       // Clock time at the anchor.
+  LONGLONG        m_hnsAnchorSystem;      // System time at the anchor.
+};
+
+
+//-----------------------------------------------------------------------------
+// SchedulerRecorder class
+//
+// SchedulerCallback that records what the scheduler decided for each sample,
+// then (optionally) forwards the call to another callback.
+//-----------------------------------------------------------------------------
+
+struct SchedulerFrameRecord
+{
+  LONGLONG  hnsSampleTime;      // Time stamp of the sample.
+  LONGLONG  hnsPresentTime;     // System time when the decision was made.
+  LONGLONG  hnsDelta;           // Time until the presentation time; negative if late.
+  LONGLONG  cQueued;            // Samples waiting behind this one.
+  BOOL      bDropped;
+};
+
+class SchedulerRecorder : public SchedulerCallback
+{
+public:
+  SchedulerRecorder(SchedulerTimer *pTimer, SchedulerCallback *pNext = NULL);
+
+  // SchedulerCallback methods
+  HRESULT PresentSample(IMFSample *pSample, LONGLONG llTarget, LONGLONG timeDelta, LONGLONG remainingInQueue, LONGLONG frameDurationDiv4);
+  void    OnSampleDropped(IMFSample *pSample, LONGLONG llTarget, LONGLONG timeDelta, LONGLONG remainingInQueue);
+  HRESULT GetTimeSinceVsync(LONGLONG *phnsSinceVsync);
+  HRESULT PrepareSample(IMFSample *pSample);
+  void    DiscardPrepared();
+
+  DWORD   GetCount();
+  HRESULT GetRecord(DWORD index, SchedulerFrameRecord *pRecord);
+  void    Clear();
+  void    TraceRecords();
+
+private:
+  HRESULT Record(LONGLONG llTarget, LONGLONG timeDelta, LONGLONG remainingInQueue, BOOL bDropped);
+
+  CritSec                               m_lock;
+  SchedulerTimer                        *m_pTimer;    // Not owned.
+  SchedulerCallback                     *m_pNext;     // Weak reference; may be NULL.
+  GrowableArray<SchedulerFrameRecord>   m_records;
+};
+
+
+//-----------------------------------------------------------------------------
+// SimulatedPresenter class
+//
+// SchedulerCallback that stands in for the present engine. Rendering a frame
+// costs hnsRenderCost and flipping it costs hnsFlipCost, spent waiting on the
+// timer (so with a VirtualTimer they take no real time). A frame rendered 
+// ahead by PrepareSample only pays for the flip when it is presented. If 
+// hnsVsyncInterval is not zero, the simulated display refreshes on that 
+// interval, starting at time 0, and GetTimeSinceVsync reports it.
+//
+// Records how late each flip finished. The deadline is the first vsync after
+// PresentSample was called, or without vsync, the time the scheduler 
+// presented the sample for.
+//-----------------------------------------------------------------------------
+
+class SimulatedPresenter : public SchedulerCallback
+{
+public:
+  SimulatedPresenter(SchedulerTimer *pTimer, LONGLONG hnsRenderCost, LONGLONG hnsFlipCost, LONGLONG hnsVsyncInterval = 0);
+
+  // SchedulerCallback methods
+  HRESULT PresentSample(IMFSample *pSample, LONGLONG llTarget, LONGLONG timeDelta, LONGLONG remainingInQueue, LONGLONG frameDurationDiv4);
+  HRESULT GetTimeSinceVsync(LONGLONG *phnsSinceVsync);
+  HRESULT PrepareSample(IMFSample *pSample);
+  void    DiscardPrepared();
+
+  DWORD   FramesFlipped() const { return m_cFlipped; }
+  DWORD   FramesFlippedAhead() const { return m_cFlippedAhead; }   // Rendered by PrepareSample.
+  DWORD   FramesLate() const { return m_cLate; }                    // Flipped after the deadline.
+  void    GetFlipLateness(EVRCPHistogramStats *pStats) const { m_FlipLateness.GetStats(pStats); }
+
+private:
+  void    Spend(LONGLONG hnsCost) { m_pTimer->WaitUntil(m_pTimer->Now() + hnsCost); }
+
+  SchedulerTimer      *m_pTimer;            // Not owned.
+  LONGLONG            m_hnsRenderCost;
+  LONGLONG            m_hnsFlipCost;
+  LONGLONG            m_hnsVsyncInterval;
+
+  CritSec             m_lock;
+  IMFSample           *m_pPreparedSample;   // Weak reference, only compared.
+
+  std::atomic<DWORD>  m_cFlipped;
+  std::atomic<DWORD>  m_cFlippedAhead;
+  std::atomic<DWORD>  m_cLate;
+  LatencyHistogram    m_FlipLateness;       // Written by the presenting thread.
+};
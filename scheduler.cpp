@@ -37,16 +37,15 @@
 #include "EVRPresenter.h"
 
  // ScheduleEvent
- // Messages for the scheduler thread.
+ // Requests for the scheduler thread. Requests made while the thread is busy
+ // are merged, and handled together the next time the thread wakes up.
 enum ScheduleEvent
 {
-  eTerminate = WM_USER,
-  eSchedule = WM_USER + 1,
-  eFlush = WM_USER + 2
+  eTerminate = 0x1,
+  eSchedule = 0x2,
+  eFlush = 0x4
 };
 
-const DWORD SCHEDULER_TIMEOUT = 5000;
-
 //-----------------------------------------------------------------------------
 // Constructor
 //-----------------------------------------------------------------------------
@@ -54,17 +53,45 @@ const DWORD SCHEDULER_TIMEOUT = 5000;
 Scheduler::Scheduler() :
   m_pCB(NULL),
   m_pClock(NULL),
-  m_dwThreadID(0),
   m_hSchedulerThread(NULL),
   m_hThreadReadyEvent(NULL),
-  m_hFlushEvent(NULL),
+  m_hWakeEvent(NULL),
+  m_lPendingEvents(0),
+  m_bSharedThread(false),
+  m_bServiced(FALSE),
+  m_bServiceFailed(FALSE),
+  m_bServiceYielded(FALSE),
+  m_hnsServiceDeadline(SCHEDULER_SLEEP_FOREVER),
+  m_dwMixerProcessor(MAXDWORD),
+  m_hnsLastSortedTime(0),
+  m_dwGeneration(0),
+  m_dwSortedGeneration(0),
   m_fRate(1.0f),
   m_LastSampleTime(0),
   m_PerFrameInterval(0),
   m_PerFrame_1_4th(0),
+  m_MediaTypeFrameInterval(0),
+  m_bDetectFrameRate(true),
   m_bUseMfTimeCalc(true),
-  m_iFrameDropThreshold(5)
+  m_bHighResolutionWait(true),
+  m_iFrameDropThreshold(5),
+  m_iFrameDropPolicy(EVRCP_FRAME_DROP_LATE_THRESHOLD),
+  m_pDropPolicy(&m_LateThresholdPolicy),
+  m_pTimer(&m_PrecisionTimer),
+  m_pTimerOverride(NULL),
+  m_bUseVsyncPlanner(true),
+  m_pPlannedSample(NULL),
+  m_hnsPlannedSampleTime(0),
+  m_hnsPlannedTime(0),
+  m_bPresentAhead(false),
+  m_pPreparedSample(NULL),
+  m_hnsPreparedSampleTime(0),
+  m_dwPreparedGeneration(0)
 {
+  m_ThreadPolicySettings.iPriority = EVRCP_THREAD_PRIORITY_NORMAL;
+  m_ThreadPolicySettings.bMmcss = false;
+  m_ThreadPolicySettings.dwAffinityMask = 0;
+  m_ThreadPolicySettings.bAvoidMixerCore = false;
 }
 
 
@@ -94,16 +121,180 @@ void Scheduler::SetFrameRate(const MFRatio& fps)
     // Convert to a duration.
     MFFrameRateToAverageTimePerFrame(fps.Numerator, fps.Denominator, &AvgTimePerFrame);
 
-    m_PerFrameInterval = (MFTIME)AvgTimePerFrame;
+    m_MediaTypeFrameInterval = (MFTIME)AvgTimePerFrame;
   }
   else
-    m_PerFrameInterval = (MFTIME)10000000.0 / ((double)fps.Numerator / fps.Denominator);
+    m_MediaTypeFrameInterval = (MFTIME)10000000.0 / ((double)fps.Numerator / fps.Denominator);
+
+  // New stream; forget the rate detected for the old one.
+  m_FrameRateDetector.Reset();
+  m_JitterBuffer.Reset();
+
+  SetFrameInterval(m_MediaTypeFrameInterval);
+}
+
+
+//-----------------------------------------------------------------------------
+// SetFrameInterval
+// Sets the frame duration used for scheduling. Call with m_schedCritSec held.
+//-----------------------------------------------------------------------------
+
+void Scheduler::SetFrameInterval(MFTIME hnsInterval)
+{
+  m_PerFrameInterval = hnsInterval;
 
   // Calculate 1/4th of this value, because we use it frequently.
   m_PerFrame_1_4th = m_PerFrameInterval / 4;
+
+  m_Planner.SetFrameInterval(m_PerFrameInterval);
+  m_Thinning.SetFrameInterval(m_PerFrameInterval);
 }
 
 
+//-----------------------------------------------------------------------------
+// SetFrameRateDetection
+// Turns the frame-rate detector on or off.
+//-----------------------------------------------------------------------------
+
+void Scheduler::SetFrameRateDetection(bool bDetectFrameRate)
+{
+  AutoLock lock(m_schedCritSec);
+
+  m_bDetectFrameRate = bDetectFrameRate;
+  m_FrameRateDetector.Reset();
+
+  SetFrameInterval(m_MediaTypeFrameInterval);
+}
+
+
+//-----------------------------------------------------------------------------
+// DetectFrameRate
+//
+// Feeds the time stamp of a sample that left the queue to the frame-rate 
+// detector. If the detector finds a steady rate that does not match the 
+// media type, the scheduler switches to it. Called on the scheduler thread.
+//
+// Only normal-rate playback is measured: during trick play the shown frames
+// are a thinned subset of the stream and their spacing is not its frame rate.
+//-----------------------------------------------------------------------------
+
+void Scheduler::DetectFrameRate(IMFSample *pSample)
+{
+  LONGLONG hnsTime = 0;
+
+  if (FAILED(pSample->GetSampleTime(&hnsTime)))
+  {
+    return;
+  }
+
+  AutoLock lock(m_schedCritSec);
+
+  if (!m_bDetectFrameRate || (m_fRate != 1.0f) || m_Thinning.IsActive())
+  {
+    return;
+  }
+
+  m_FrameRateDetector.AddSample(hnsTime);
+
+  MFTIME hnsInterval = m_MediaTypeFrameInterval;
+  EVRCPCadence cadence = m_FrameRateDetector.Cadence();
+
+  if (cadence == EVRCP_CADENCE_CONSTANT || cadence == EVRCP_CADENCE_TELECINE)
+  {
+    // Ignore differences that are only rounding (100 ppm).
+    LONGLONG hnsDetected = m_FrameRateDetector.FrameInterval();
+    if (_abs64(hnsDetected - m_MediaTypeFrameInterval) * 10000 > m_MediaTypeFrameInterval)
+    {
+      hnsInterval = hnsDetected;
+    }
+  }
+
+  if (hnsInterval != m_PerFrameInterval)
+  {
+    TRACE((L"Scheduler: frame interval %I64d -> %I64d (cadence %d)", m_PerFrameInterval, hnsInterval, cadence));
+    SetFrameInterval(hnsInterval);
+  }
+}
+
+
+//-----------------------------------------------------------------------------
+// GetDetectedFrameRate
+// Returns the detected frame rate in frames per second, or 0 if not known.
+//-----------------------------------------------------------------------------
+
+float Scheduler::GetDetectedFrameRate()
+{
+  AutoLock lock(m_schedCritSec);
+
+  LONGLONG hnsInterval = m_FrameRateDetector.FrameInterval();
+  if (hnsInterval == 0)
+  {
+    return 0.0f;
+  }
+  return (float)(10000000.0 / hnsInterval);
+}
+
+
+//-----------------------------------------------------------------------------
+// SetFrameDropPolicy
+// Selects the frame-drop policy (EVRCPFrameDropPolicy).
+//-----------------------------------------------------------------------------
+
+HRESULT Scheduler::SetFrameDropPolicy(int iPolicy)
+{
+  AutoLock lock(m_schedCritSec);
+
+  switch (iPolicy)
+  {
+  case EVRCP_FRAME_DROP_LATE_THRESHOLD:
+    m_pDropPolicy = &m_LateThresholdPolicy;
+    break;
+  case EVRCP_FRAME_DROP_QUEUE_DEPTH:
+    m_pDropPolicy = &m_QueueDepthPolicy;
+    break;
+  case EVRCP_FRAME_DROP_CATCH_UP:
+    m_pDropPolicy = &m_CatchUpPolicy;
+    break;
+  case EVRCP_FRAME_DROP_NEVER:
+    m_pDropPolicy = &m_NeverDropPolicy;
+    break;
+  default:
+    return E_INVALIDARG;
+  }
+
+  m_iFrameDropPolicy = iPolicy;
+  m_pDropPolicy->Reset();
+  return S_OK;
+}
+
+
+
+//-----------------------------------------------------------------------------
+// GetStats
+// Fills in the scheduler's histograms.
+//-----------------------------------------------------------------------------
+
+void Scheduler::GetStats(EVRCPStats *pStats)
+{
+  m_PresentLateness.GetStats(&pStats->histograms[EVRCP_HISTOGRAM_PRESENT_LATENESS]);
+  m_SleepOvershoot.GetStats(&pStats->histograms[EVRCP_HISTOGRAM_SLEEP_OVERSHOOT]);
+  m_QueueDepth.GetStats(&pStats->histograms[EVRCP_HISTOGRAM_QUEUE_DEPTH]);
+  m_PresentDuration.GetStats(&pStats->histograms[EVRCP_HISTOGRAM_PRESENT_DURATION]);
+  m_PrepareDuration.GetStats(&pStats->histograms[EVRCP_HISTOGRAM_PREPARE_DURATION]);
+
+  RobustStats lateness, queued;
+  {
+    AutoLock lock(m_schedCritSec);
+    m_LatenessWindow.GetStats(&lateness);
+    m_QueuedWindow.GetStats(&queued);
+  }
+  pStats->llLatenessMedian = lateness.llMedian;
+  pStats->llLatenessMad = lateness.llMad;
+  pStats->llLatenessP90 = lateness.llP90;
+  pStats->llQueuedMedian = queued.llMedian;
+  pStats->llQueuedMad = queued.llMad;
+}
+
 
 //-----------------------------------------------------------------------------
 // StartScheduler
@@ -120,10 +311,46 @@ HRESULT Scheduler::StartScheduler(IMFClock *pClock)
   }
 
   HRESULT hr = S_OK;
-  DWORD dwID = 0;
 
   CopyComPointer(m_pClock, pClock);
 
+  // Choose how the scheduler thread waits for presentation deadlines.
+  if (m_pTimerOverride)
+  {
+    m_pTimer = m_pTimerOverride;
+  }
+  else if (GetHighResolutionWait())
+  {
+    m_pTimer = &m_PrecisionTimer;
+  }
+  else
+  {
+    m_pTimer = &m_CoarseTimer;
+  }
+
+  m_ClockTracker.SetClock(pClock, m_pTimer);
+  m_ClockTracker.SetRate(GetClockRate());
+
+  // The timeline keeps its precise timer unless a test timer is set.
+  m_Timeline.SetTimer(m_pTimerOverride);
+
+  if (GetSharedThread())
+  {
+    // Run on the shared service thread. The thread and the wake event belong
+    // to the service.
+    m_lPendingEvents = 0;
+    m_hnsServiceDeadline = SCHEDULER_SLEEP_FOREVER;
+    m_bServiceFailed = FALSE;
+    m_bServiceYielded = FALSE;
+
+    ThreadPolicySettings policy;
+    GetThreadPolicy(&policy);
+
+    hr = SchedulerService::Attach(this, policy, &m_hSchedulerThread, &m_hWakeEvent);
+    m_bServiced = SUCCEEDED(hr);
+    return hr;
+  }
+
   // Set a high the timer resolution (ie, short timer period).
   timeBeginPeriod(1);
 
@@ -134,15 +361,16 @@ HRESULT Scheduler::StartScheduler(IMFClock *pClock)
     CHECK_HR(hr = HRESULT_FROM_WIN32(GetLastError()));
   }
 
-  // Create an event to wait for flush commands to complete.
-  m_hFlushEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
-  if (m_hFlushEvent == NULL)
+  // Create the event that wakes up the scheduler thread.
+  m_hWakeEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+  if (m_hWakeEvent == NULL)
   {
     CHECK_HR(hr = HRESULT_FROM_WIN32(GetLastError()));
   }
+  m_lPendingEvents = 0;
 
   // Create the scheduler thread.
-  m_hSchedulerThread = CreateThread(NULL, 0, SchedulerThreadProc, (LPVOID)this, 0, &dwID);
+  m_hSchedulerThread = CreateThread(NULL, 0, SchedulerThreadProc, (LPVOID)this, 0, NULL);
   if (m_hSchedulerThread == NULL)
   {
     CHECK_HR(hr = HRESULT_FROM_WIN32(GetLastError()));
@@ -161,8 +389,6 @@ HRESULT Scheduler::StartScheduler(IMFClock *pClock)
     CHECK_HR(hr = E_UNEXPECTED);
   }
 
-  m_dwThreadID = dwID;
-
 done:
 
   // Regardless success/failure, we are done using the "thread ready" event.
@@ -189,24 +415,45 @@ HRESULT Scheduler::StopScheduler()
     return S_OK;
   }
 
-  // Ask the scheduler thread to exit.
-  PostThreadMessage(m_dwThreadID, eTerminate, 0, 0);
+  if (m_bServiced)
+  {
+    // The service thread stops using this scheduler. The handles belong to
+    // the service.
+    SchedulerService::Detach(this);
+    m_bServiced = FALSE;
+    m_hSchedulerThread = NULL;
+    m_hWakeEvent = NULL;
+  }
+  else
+  {
+    // Ask the scheduler thread to exit.
+    Signal(eTerminate);
 
-  // Wait for the thread to exit.
-  WaitForSingleObject(m_hSchedulerThread, INFINITE);
+    // Wait for the thread to exit.
+    WaitForSingleObject(m_hSchedulerThread, INFINITE);
 
-  // Close handles.
-  CloseHandle(m_hSchedulerThread);
-  m_hSchedulerThread = NULL;
+    // Close handles.
+    CloseHandle(m_hSchedulerThread);
+    m_hSchedulerThread = NULL;
 
-  CloseHandle(m_hFlushEvent);
-  m_hFlushEvent = NULL;
+    CloseHandle(m_hWakeEvent);
+    m_hWakeEvent = NULL;
+
+    // Restore the timer resolution.
+    timeEndPeriod(1);
+  }
 
   // Discard samples.
   m_ScheduledSamples.Clear();
+  m_SortedSamples.Clear();
+
+  m_pPreparedSample = NULL;
+  if (m_pCB)
+  {
+    m_pCB->DiscardPrepared();
+  }
 
-  // Restore the timer resolution.
-  timeEndPeriod(1);
+  m_ClockTracker.SetClock(NULL, NULL);
 
   return S_OK;
 }
@@ -217,31 +464,37 @@ HRESULT Scheduler::StopScheduler()
 //
 // Flushes all samples that are queued for presentation.
 //
-// Note: This method is synchronous; ie., it waits for the flush operation to 
-// complete on the worker thread.
+// Note: This method does not wait for the worker thread. It starts a new
+// generation; samples queued before it are never presented, and the worker
+// thread releases them the next time it runs (it is woken up to do so). 
+// A sample that the worker thread is presenting at the time of the call can 
+// still reach the screen.
 //-----------------------------------------------------------------------------
 
 HRESULT Scheduler::Flush()
 {
   TRACE((L"Scheduler::Flush"));
 
-  if (m_hSchedulerThread == NULL)
+  m_dwGeneration++;
+
+  // The presentation time may jump; read the clock again on the next query.
+  m_ClockTracker.Invalidate();
+
   {
-    TRACE((L"No scheduler thread!"));
+    AutoLock lock(m_schedCritSec);
+    m_Thinning.Reset();
   }
 
-  if (m_hSchedulerThread)
+  // The ready buffer (if any) holds a sample from the old generation.
+  if (m_pCB)
   {
-    // Ask the scheduler thread to flush.
-    PostThreadMessage(m_dwThreadID, eFlush, 0, 0);
-
-    // Wait for the scheduler thread to signal the flush event,
-    // OR for the thread to terminate.
-    HANDLE objects[] = { m_hFlushEvent, m_hSchedulerThread };
-
-    WaitForMultipleObjects(ARRAY_SIZE(objects), objects, FALSE, SCHEDULER_TIMEOUT);
+    m_pCB->DiscardPrepared();
+  }
 
-    TRACE((L"Scheduler::Flush completed."));
+  if (m_hSchedulerThread)
+  {
+    // Wake the scheduler thread so it releases the old samples.
+    Signal(eFlush);
   }
 
   return S_OK;
@@ -256,6 +509,10 @@ HRESULT Scheduler::Flush()
 // pSample:     Pointer to the sample.
 // bPresentNow: If TRUE, the sample is presented immediately. Otherwise, the
 //              sample's time stamp is used to schedule the sample.
+//
+// m_ScheduledSamples has a single producer, so calls to ScheduleSample must
+// be serialized by the caller. The presenter only calls it with its object
+// lock held (DeliverSample, DeliverFrameStepSample, StartFrameStep).
 //-----------------------------------------------------------------------------
 
 HRESULT Scheduler::ScheduleSample(IMFSample *pSample, BOOL bPresentNow)
@@ -274,7 +531,7 @@ HRESULT Scheduler::ScheduleSample(IMFSample *pSample, BOOL bPresentNow)
   DWORD dwExitCode = 0;
 
   GetExitCodeThread(m_hSchedulerThread, &dwExitCode);
-  if (dwExitCode != STILL_ACTIVE)
+  if (dwExitCode != STILL_ACTIVE || m_bServiceFailed)
   {
     return E_FAIL;
   }
@@ -286,12 +543,18 @@ HRESULT Scheduler::ScheduleSample(IMFSample *pSample, BOOL bPresentNow)
   }
   else
   {
-    // Queue the sample and ask the scheduler thread to wake up.
-    hr = m_ScheduledSamples.Queue(pSample);
+    // Queue the sample. The scheduler thread only needs to be woken up if 
+    // the queue was empty. Otherwise it has not yet moved the earlier sample
+    // to its time-ordered queue, and will find this one when it does.
+    m_Timeline.Mark(FRAME_STAGE_SCHEDULE, pSample);
 
-    if (SUCCEEDED(hr))
+    // The arrival time goes with the sample; the scheduler thread reports it
+    // to the jitter buffer, so this path takes no lock.
+    hr = m_ScheduledSamples.Queue(pSample, m_dwGeneration, m_pTimer->Now());
+
+    if (SUCCEEDED(hr) && m_ScheduledSamples.Count() == 1)
     {
-      PostThreadMessage(m_dwThreadID, eSchedule, 0, 0);
+      Signal(eSchedule);
     }
   }
 
@@ -300,52 +563,162 @@ HRESULT Scheduler::ScheduleSample(IMFSample *pSample, BOOL bPresentNow)
   return hr;
 }
 
+//-----------------------------------------------------------------------------
+// SortIncomingSamples
+//
+// Moves samples from the lock-free queue to the time-ordered queue. Called
+// on the scheduler thread.
+//-----------------------------------------------------------------------------
+
+void Scheduler::SortIncomingSamples()
+{
+  IMFSample *pSample = NULL;
+  DWORD dwTag = 0;
+  LONGLONG hnsArrival = 0;
+  DWORD dwGeneration = m_dwGeneration;
+
+  if (dwGeneration != m_dwSortedGeneration)
+  {
+    // Flushed: Discard the samples from the old generation.
+    m_SortedSamples.Clear();
+    {
+      AutoLock lock(m_schedCritSec);
+      m_Planner.Reset();
+      m_pPlannedSample = NULL;
+      m_pDropPolicy->Reset();
+      m_LatenessWindow.Reset();
+      m_QueuedWindow.Reset();
+      m_FrameRateDetector.Discontinuity();
+    }
+    m_JitterBuffer.Discontinuity();
+    m_dwSortedGeneration = dwGeneration;
+  }
+
+  // For reverse playback, later time stamps come first.
+  m_SortedSamples.SetDescending(GetClockRate() < 0);
+
+  while (m_ScheduledSamples.Peek(&pSample, &dwTag, &hnsArrival) == S_OK)
+  {
+    LONGLONG hnsTime = 0;
+
+    if ((LONG)(dwTag - dwGeneration) > 0)
+    {
+      // Queued after a flush that happened since we started. Pick it up on
+      // the next pass, which clears the old samples first.
+      SAFE_RELEASE(pSample);
+      break;
+    }
+
+    if (dwTag != dwGeneration)
+    {
+      // Queued before a flush.
+      SAFE_RELEASE(pSample);
+      m_ScheduledSamples.PopFront();
+      continue;
+    }
+
+    // A sample without a time stamp goes after the samples before it.
+    if (SUCCEEDED(pSample->GetSampleTime(&hnsTime)))
+    {
+      m_hnsLastSortedTime = hnsTime;
+    }
+    else
+    {
+      hnsTime = m_hnsLastSortedTime;
+    }
+
+    m_Timeline.Mark(FRAME_STAGE_DEQUEUE, hnsTime);
+
+    HRESULT hr = m_SortedSamples.Queue(pSample, hnsTime);
+    SAFE_RELEASE(pSample);
+
+    if (FAILED(hr))
+    {
+      // Full. Leave the rest for later.
+      break;
+    }
+    m_ScheduledSamples.PopFront();
+
+    m_JitterBuffer.OnArrival(hnsArrival, m_PerFrameInterval);
+  }
+}
+
+
 //-----------------------------------------------------------------------------
 // ProcessSamplesInQueue
 //
 // Processes all the samples in the queue.
 //
-// plNextSleep: Receives the length of time the scheduler thread should sleep
-//              before it calls ProcessSamplesInQueue again.
+// phnsNextSleep: Receives the length of time the scheduler thread should
+//                sleep before it calls ProcessSamplesInQueue again, in 
+//                100-nanosecond units.
+// cMaxSamples:   Stop after presenting or dropping this many samples. The
+//                sleep time is then 1, so the caller comes back soon.
 //-----------------------------------------------------------------------------
 
-HRESULT Scheduler::ProcessSamplesInQueue(LONG *plNextSleep)
+HRESULT Scheduler::ProcessSamplesInQueue(LONGLONG *phnsNextSleep, DWORD cMaxSamples)
 {
   HRESULT hr = S_OK;
-  LONG lWait = 0;
+  LONGLONG hnsWait = 0;
   IMFSample *pSample = NULL;
+  DWORD cProcessed = 0;
 
   // Process samples until the queue is empty or until the wait time > 0.
 
-  // Note: Dequeue returns S_FALSE when the queue is empty.
-  while (m_ScheduledSamples.Dequeue(&pSample) == S_OK)
+  for (;;)
   {
+    // Pick up new samples first; one of them may be due before the current
+    // first sample.
+    SortIncomingSamples();
+
+    // Note: Peek returns S_FALSE when the queue is empty.
+    if (m_SortedSamples.Peek(&pSample) != S_OK)
+    {
+      break;
+    }
+
     // Process the next sample in the queue. If the sample is not ready
-    // for presentation. the value returned in lWait is > 0, which
-    // means the scheduler should sleep for that amount of time.
+    // for presentation. the value returned in hnsWait is > 0, which
+    // means the scheduler should sleep for that amount of time. The 
+    // sample stays at the front of the queue until then.
+
+    hr = ProcessSample(pSample, &hnsWait);
 
-    hr = ProcessSample(pSample, &lWait);
+    if (SUCCEEDED(hr) && hnsWait == 0)
+    {
+      DetectFrameRate(pSample);
+    }
     SAFE_RELEASE(pSample);
 
     if (FAILED(hr))
     {
       break;
     }
-    if (lWait > 0)
+    if (hnsWait > 0)
+    {
+      break;
+    }
+
+    // The sample was presented (or dropped).
+    m_SortedSamples.PopFront();
+
+    if (++cProcessed >= cMaxSamples)
     {
+      // Let the caller serve others first.
+      hnsWait = 1;
       break;
     }
   }
 
   // If the wait time is zero, it means we stopped because the queue is
   // empty (or an error occurred). Set the wait time to infinite; this will
-  // make the scheduler thread sleep until it gets another thread message.
-  if (lWait == 0)
+  // make the scheduler thread sleep until it gets another request.
+  if (hnsWait == 0)
   {
-    lWait = INFINITE;
+    hnsWait = SCHEDULER_SLEEP_FOREVER;
   }
 
-  *plNextSleep = lWait;
+  *phnsNextSleep = hnsWait;
   return hr;
 }
 
@@ -355,22 +728,26 @@ HRESULT Scheduler::ProcessSamplesInQueue(LONG *plNextSleep)
 //
 // Processes a sample.
 //
-// plNextSleep: Receives the length of time the scheduler thread should sleep.
+// phnsNextSleep: Receives the length of time the scheduler thread should 
+//                sleep, in 100-nanosecond units. If this value is > 0, the 
+//                sample was not presented.
 //-----------------------------------------------------------------------------
 
 
-HRESULT Scheduler::ProcessSample(IMFSample *pSample, LONG *plNextSleep)
+HRESULT Scheduler::ProcessSample(IMFSample *pSample, LONGLONG *phnsNextSleep)
 {
   HRESULT hr = S_OK;
 
   LONGLONG hnsPresentationTime = 0;
   LONGLONG hnsTimeNow = 0;
-  MFTIME   hnsSystemTime = 0;
 
   BOOL bPresentNow = TRUE;
-  LONG lNextSleep = 0;
+  LONGLONG hnsNextSleep = 0;
   LONGLONG hnsDelta = 0;
 
+  BOOL bTimed = FALSE;
+  FrameDropContext drop;
+
   if (m_pClock)
   {
     // Get the sample's time stamp. It is valid for a sample to
@@ -381,12 +758,16 @@ HRESULT Scheduler::ProcessSample(IMFSample *pSample, LONG *plNextSleep)
     // we don't need the clock time.)
     if (SUCCEEDED(hr))
     {
-      hr = m_pClock->GetCorrelatedTime(0, &hnsTimeNow, &hnsSystemTime);
+      hr = m_ClockTracker.GetTime(&hnsTimeNow);
     }
 
+    // During trick play, the sample is due at the slot it was picked for.
+    drop.bThinned = IsThinning();
+    LONGLONG hnsDueTime = drop.bThinned ? ThinningSlotTime(hnsPresentationTime) : hnsPresentationTime;
+
     // Calculate the time until the sample's presentation time. 
     // A negative value means the sample is late.
-    hnsDelta = hnsPresentationTime - hnsTimeNow;
+    hnsDelta = hnsDueTime - hnsTimeNow;
     float fCurrentRate = GetClockRate();
     if (fCurrentRate < 0)
     {
@@ -394,16 +775,54 @@ HRESULT Scheduler::ProcessSample(IMFSample *pSample, LONG *plNextSleep)
       hnsDelta = -hnsDelta;
     }
 
-    if (abs(fCurrentRate) > 2)
+    bTimed = TRUE;
+    drop.hnsDelta = hnsDelta;
+    drop.hnsFrameInterval = m_PerFrameInterval;
+    drop.fRate = fCurrentRate;
+    drop.cQueued = QueuedCount() - 1;
+    drop.bSuperseded = FALSE;
+
+    // A sample is stale if the one after it is already due as well.
+    LONGLONG hnsNextTime = 0;
+    if (m_SortedSamples.PeekNextTime(&hnsNextTime) == S_OK)
     {
-      if (abs(hnsDelta) > m_PerFrameInterval * GetFrameDropThreshold())
+      if (drop.bThinned)
       {
-        //TRACE((L"ProcessSample:  drop sample hnsDelta=%I64d m_PerFrameInterval=%I64d", hnsDelta, m_PerFrameInterval*10));
-        return hr;
+        hnsNextTime = ThinningSlotTime(hnsNextTime);
       }
+      LONGLONG hnsNextDelta = hnsNextTime - hnsTimeNow;
+      if (fCurrentRate < 0)
+      {
+        hnsNextDelta = -hnsNextDelta;
+      }
+      drop.bSuperseded = (hnsNextDelta <= 0);
+    }
+
+    drop.iThreshold = GetFrameDropThreshold();
+    drop.bDue = FALSE;
+    GetDueStats(&drop);
+
+    if (ShouldDropSample(drop))
+    {
+      m_pCB->OnSampleDropped(pSample, hnsPresentationTime, hnsDelta, drop.cQueued);
+      m_Timeline.Mark(FRAME_STAGE_DROP, hnsPresentationTime);
+      *phnsNextSleep = 0;
+      return hr;
     }
 
-    if (hnsDelta < -m_PerFrame_1_4th)
+    if (fCurrentRate == 1.0f && IsPlannerActive())
+    {
+      // Present when the planner says, so the frame lands on its vsync slot.
+      LONGLONG hnsNow = m_pTimer->Now();
+      LONGLONG hnsPresentTime = PlanSample(pSample, hnsPresentationTime, hnsNow + hnsDelta);
+
+      if (hnsPresentTime > hnsNow)
+      {
+        hnsNextSleep = hnsPresentTime - hnsNow;
+        bPresentNow = FALSE;
+      }
+    }
+    else if (hnsDelta < -m_PerFrame_1_4th)
     {
       // This sample is late. 
 //TRACE((L"ProcessSample: sample is late hnsDelta=%I64d", hnsDelta));
@@ -412,29 +831,78 @@ HRESULT Scheduler::ProcessSample(IMFSample *pSample, LONG *plNextSleep)
     else if (hnsDelta >(3 * m_PerFrame_1_4th))
     {
       // This sample is still too early. Go to sleep.
-      lNextSleep = MFTimeToMsec(hnsDelta - (3 * m_PerFrame_1_4th));
+      hnsNextSleep = hnsDelta - (3 * m_PerFrame_1_4th);
 
       // Adjust the sleep time for the clock rate. (The presentation clock runs
       // at m_fRate, but sleeping uses the system clock.)
-      lNextSleep = (LONG)(lNextSleep / fabsf(fCurrentRate));
+      hnsNextSleep = (LONGLONG)(hnsNextSleep / fabsf(fCurrentRate));
+
+      // Guard against rounding down to zero, which means "presented".
+      if (hnsNextSleep <= 0)
+      {
+        hnsNextSleep = 1;
+      }
 
       // Don't present yet.
       bPresentNow = FALSE;
     }
+
+    if (!bPresentNow && GetPresentAhead())
+    {
+      // Render the sample while we wait for it.
+      hnsNextSleep = PrepareAhead(pSample, hnsPresentationTime, hnsNextSleep);
+    }
   }
 
-  if (bPresentNow)
+  if (bPresentNow && bTimed)
   {
-    hr = m_pCB->PresentSample(pSample, hnsPresentationTime, hnsDelta, m_ScheduledSamples.Count(), m_PerFrame_1_4th);
+    // A late sample with nothing queued behind it means the queue ran dry.
+    if (hnsDelta < -m_PerFrame_1_4th && drop.cQueued == 0)
+    {
+      m_JitterBuffer.OnUnderrun();
+    }
+
+    // Last chance for the drop policy.
+    drop.bDue = TRUE;
+    if (ShouldDropSample(drop))
+    {
+      m_pCB->OnSampleDropped(pSample, hnsPresentationTime, hnsDelta, drop.cQueued);
+      m_Timeline.Mark(FRAME_STAGE_DROP, hnsPresentationTime);
+      bPresentNow = FALSE;
+    }
+    RecordDueSample(drop);
   }
-  else
+
+  if (bPresentNow && m_dwGeneration != m_dwSortedGeneration)
   {
-    // The sample is not ready yet. Return it to the queue.
-    hr = m_ScheduledSamples.PutBack(pSample);
+    // Flushed while we were looking at it.
+    bPresentNow = FALSE;
   }
 
+  if (bPresentNow)
+  {
+    // The sample is still at the front of the queue, so don't count it.
+    DWORD cQueued = QueuedCount() - 1;
+    LONGLONG hnsPresentStart = m_pTimer->Now();
+    LONGLONG hnsTimelineStart = m_Timeline.Start();
+
+    hr = m_pCB->PresentSample(pSample, hnsPresentationTime, hnsDelta, cQueued, m_PerFrame_1_4th);
 
-  *plNextSleep = lNextSleep;
+    m_Timeline.End(FRAME_STAGE_PRESENT, hnsPresentationTime, hnsTimelineStart);
+    m_PresentDuration.Record(m_pTimer->Now() - hnsPresentStart);
+    m_QueueDepth.Record(cQueued);
+    if (bTimed)
+    {
+      m_PresentLateness.Record(-hnsDelta);
+    }
+
+    if (IsPlannerActive())
+    {
+      ObserveVsync();
+    }
+  }
+
+  *phnsNextSleep = hnsNextSleep;
 
   return hr;
 }
@@ -465,68 +933,319 @@ DWORD WINAPI Scheduler::SchedulerThreadProc(LPVOID lpParameter)
 DWORD Scheduler::SchedulerThreadProcPrivate()
 {
   HRESULT hr = S_OK;
-  MSG     msg;
-  LONG    lWait = INFINITE;
+  LONGLONG hnsDeadline = SCHEDULER_SLEEP_FOREVER;  // When to process the queue again.
+  LONGLONG hnsWait = SCHEDULER_SLEEP_FOREVER;
   BOOL    bExitThread = FALSE;
 
-  // Force the system to create a message queue for this thread.
-  // (See MSDN documentation for PostThreadMessage.)
-  PeekMessage(&msg, NULL, WM_USER, WM_USER, PM_NOREMOVE);
+  // Apply the thread policy before anything is presented.
+  ThreadPolicySettings policy;
+  GetThreadPolicy(&policy);
+  HRESULT hrPolicy = m_ThreadPolicy.Apply(policy);
+  LOG_MSG_IF_FAILED(L"Scheduler: thread policy not fully applied", hrPolicy);
 
   // Signal to the scheduler that the thread is ready.
   SetEvent(m_hThreadReadyEvent);
 
   while (!bExitThread)
   {
-    // Wait for a thread message OR until the wait time expires.
-    DWORD dwResult = MsgWaitForMultipleObjects(0, NULL, FALSE, lWait, QS_POSTMESSAGE);
+    DWORD dwTimeout = INFINITE;
 
-    if (dwResult == WAIT_TIMEOUT)
+    if (hnsDeadline != SCHEDULER_SLEEP_FOREVER)
     {
-      // If we timed out, then process the samples in the queue
-      hr = ProcessSamplesInQueue(&lWait);
-      if (FAILED(hr))
-      {
-        bExitThread = TRUE;
-      }
+      dwTimeout = m_pTimer->CoarseTimeout(hnsDeadline);
     }
 
-    while (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE))
+    // Wait for a request OR until the coarse wait time expires.
+    DWORD dwResult = WaitForSingleObject(m_hWakeEvent, dwTimeout);
+
+    // Collect every request made since the last time we woke up.
+    LONG lEvents = m_lPendingEvents.exchange(0);
+
+    if (lEvents & eTerminate)
     {
-      BOOL bProcessSamples = TRUE;
+      TRACE((L"eTerminate"));
+      bExitThread = TRUE;
+      break;
+    }
 
-      switch (msg.message)
-      {
-      case eTerminate:
-        TRACE((L"eTerminate"));
-        bExitThread = TRUE;
-        break;
-
-      case eFlush:
-        // Flushing: Clear the sample queue and set the event.
-        m_ScheduledSamples.Clear();
-        lWait = INFINITE;
-        SetEvent(m_hFlushEvent);
-        break;
-
-      case eSchedule:
-        // Process as many samples as we can.
-        if (bProcessSamples)
-        {
-          hr = ProcessSamplesInQueue(&lWait);
-          if (FAILED(hr))
-          {
-            bExitThread = TRUE;
-          }
-          bProcessSamples = (lWait != INFINITE);
-        }
-        break;
-      } // switch  
-
-    } // while PeekMessage
+    if (lEvents & eFlush)
+    {
+      // Flushing: Processing the queue releases the old samples (see 
+      // SortIncomingSamples) and picks a new deadline.
+      lEvents |= eSchedule;
+    }
+
+    if (dwResult == WAIT_TIMEOUT)
+    {
+      // Finish waiting for the deadline.
+      m_pTimer->WaitUntil(hnsDeadline);
+      m_SleepOvershoot.Record(m_pTimer->Now() - hnsDeadline);
+    }
+    else if (!(lEvents & eSchedule))
+    {
+      // Nothing new to present; keep waiting for the same deadline.
+      continue;
+    }
+
+    m_ThreadPolicy.AvoidProcessor(m_dwMixerProcessor);
+
+    // Process as many samples as we can.
+    hr = ProcessSamplesInQueue(&hnsWait);
+    if (FAILED(hr))
+    {
+      bExitThread = TRUE;
+    }
+    hnsDeadline = NextDeadline(hnsWait);
 
   }  // while (!bExitThread)
 
+  m_ThreadPolicy.Revert();
+
   TRACE((L"Exit scheduler thread."));
   return (SUCCEEDED(hr) ? 0 : 1);
 }
+
+
+//-----------------------------------------------------------------------------
+// TimeUntilService
+//
+// Returns how long the SchedulerService thread can wait before this 
+// scheduler needs a turn: 0 if requests are pending, or 
+// SCHEDULER_SLEEP_FOREVER if there is nothing to do.
+//-----------------------------------------------------------------------------
+
+LONGLONG Scheduler::TimeUntilService()
+{
+  if (m_bServiceFailed)
+  {
+    return SCHEDULER_SLEEP_FOREVER;
+  }
+  if (m_lPendingEvents & (eSchedule | eFlush))
+  {
+    return 0;
+  }
+  if (m_hnsServiceDeadline == SCHEDULER_SLEEP_FOREVER)
+  {
+    return SCHEDULER_SLEEP_FOREVER;
+  }
+  return m_hnsServiceDeadline - m_pTimer->Now();
+}
+
+
+//-----------------------------------------------------------------------------
+// ServiceDeadline
+//
+// Returns the deadline the SchedulerService thread should finish waiting for
+// after its kernel wait, or zero if it should not wait. Pending requests are
+// handled at once, and with the coarse timer the kernel wait was the whole
+// wait.
+//-----------------------------------------------------------------------------
+
+LONGLONG Scheduler::ServiceDeadline()
+{
+  if ((m_lPendingEvents & (eSchedule | eFlush)) || m_hnsServiceDeadline == SCHEDULER_SLEEP_FOREVER ||
+      m_pTimer != &m_PrecisionTimer)
+  {
+    return 0;
+  }
+  return m_hnsServiceDeadline;
+}
+
+
+//-----------------------------------------------------------------------------
+// ServiceTurn
+//
+// One turn on the SchedulerService thread; the shared-thread equivalent of 
+// one pass through SchedulerThreadProcPrivate. Does nothing unless there is
+// a request or the deadline has passed.
+//-----------------------------------------------------------------------------
+
+void Scheduler::ServiceTurn()
+{
+  if (m_bServiceFailed)
+  {
+    return;
+  }
+
+  LONG lEvents = m_lPendingEvents.exchange(0);
+  LONGLONG hnsNow = m_pTimer->Now();
+  BOOL bDue = (m_hnsServiceDeadline != SCHEDULER_SLEEP_FOREVER) && (hnsNow >= m_hnsServiceDeadline);
+
+  if (!bDue && !(lEvents & (eSchedule | eFlush)))
+  {
+    return;
+  }
+
+  if (bDue && !m_bServiceYielded)
+  {
+    m_SleepOvershoot.Record(hnsNow - m_hnsServiceDeadline);
+  }
+
+  LONGLONG hnsWait = SCHEDULER_SLEEP_FOREVER;
+  HRESULT hr = ProcessSamplesInQueue(&hnsWait, SCHEDULER_SERVICE_TURN_SAMPLES);
+  if (FAILED(hr))
+  {
+    // Same as the scheduler thread exiting: ScheduleSample fails from now on.
+    m_bServiceFailed = TRUE;
+    m_hnsServiceDeadline = SCHEDULER_SLEEP_FOREVER;
+    return;
+  }
+
+  m_bServiceYielded = (hnsWait == 1);
+  m_hnsServiceDeadline = NextDeadline(hnsWait);
+}
+
+
+//-----------------------------------------------------------------------------
+// Signal
+//
+// Posts a request to the scheduler thread. Only the first request since the
+// thread last woke up sets the wake event, so a burst of requests costs a 
+// single wakeup.
+//-----------------------------------------------------------------------------
+
+void Scheduler::Signal(LONG lEvent)
+{
+  if (m_lPendingEvents.fetch_or(lEvent) == 0)
+  {
+    SetEvent(m_hWakeEvent);
+  }
+}
+
+
+//-----------------------------------------------------------------------------
+// NextDeadline
+//
+// Converts a sleep time returned by ProcessSamplesInQueue into an absolute 
+// deadline on the scheduler's timer.
+//-----------------------------------------------------------------------------
+
+LONGLONG Scheduler::NextDeadline(LONGLONG hnsSleep)
+{
+  if (hnsSleep == SCHEDULER_SLEEP_FOREVER)
+  {
+    return SCHEDULER_SLEEP_FOREVER;
+  }
+  return m_pTimer->Now() + hnsSleep;
+}
+
+
+//-----------------------------------------------------------------------------
+// PlanSample
+//
+// Returns the system time at which to present a sample, so that it appears
+// on the vsync the planner assigns to it. The sample stays at the front of the
+// queue until then, so the plan is made once and remembered.
+//
+// hnsDueTime: System time when the sample is due by its time stamp.
+//-----------------------------------------------------------------------------
+
+LONGLONG Scheduler::PlanSample(IMFSample *pSample, LONGLONG hnsPresentationTime, LONGLONG hnsDueTime)
+{
+  AutoLock lock(m_schedCritSec);
+
+  if (pSample != m_pPlannedSample || hnsPresentationTime != m_hnsPlannedSampleTime)
+  {
+    LONGLONG hnsVsync = m_Planner.PlanFrame(hnsDueTime);
+
+    // PresentEx shows the frame at the next vsync, so present half a refresh 
+    // interval before the assigned one.
+    m_hnsPlannedTime = hnsVsync - m_Planner.RefreshInterval() / 2;
+    m_pPlannedSample = pSample;
+    m_hnsPlannedSampleTime = hnsPresentationTime;
+  }
+
+  return m_hnsPlannedTime;
+}
+
+
+//-----------------------------------------------------------------------------
+// GetDueStats
+//
+// Fills in the statistics of the recent due samples for the drop policy.
+//-----------------------------------------------------------------------------
+
+void Scheduler::GetDueStats(FrameDropContext *pContext)
+{
+  AutoLock lock(m_schedCritSec);
+
+  pContext->bHaveStats = m_LatenessWindow.GetStats(&pContext->lateness);
+  m_QueuedWindow.GetStats(&pContext->queued);
+}
+
+
+//-----------------------------------------------------------------------------
+// RecordDueSample
+//
+// Adds a sample that came due (presented or dropped) to the statistics.
+//-----------------------------------------------------------------------------
+
+void Scheduler::RecordDueSample(const FrameDropContext& context)
+{
+  AutoLock lock(m_schedCritSec);
+
+  m_LatenessWindow.Add(-context.hnsDelta);
+  m_QueuedWindow.Add(context.cQueued);
+}
+
+
+//-----------------------------------------------------------------------------
+// PrepareAhead
+//
+// Hands a sample that is not due yet to the callback's render stage, once. 
+// Returns the sleep time, less the time the render stage took, so the flip 
+// still happens on time.
+//-----------------------------------------------------------------------------
+
+LONGLONG Scheduler::PrepareAhead(IMFSample *pSample, LONGLONG hnsPresentationTime, LONGLONG hnsNextSleep)
+{
+  if (pSample == m_pPreparedSample && hnsPresentationTime == m_hnsPreparedSampleTime &&
+      m_dwSortedGeneration == m_dwPreparedGeneration)
+  {
+    return hnsNextSleep;
+  }
+
+  // Don't try the same sample again, even if the callback failed.
+  m_pPreparedSample = pSample;
+  m_hnsPreparedSampleTime = hnsPresentationTime;
+  m_dwPreparedGeneration = m_dwSortedGeneration;
+
+  LONGLONG hnsStart = m_pTimer->Now();
+  LONGLONG hnsTimelineStart = m_Timeline.Start();
+  HRESULT hr = m_pCB->PrepareSample(pSample);
+  m_Timeline.End(FRAME_STAGE_PREPARE, hnsPresentationTime, hnsTimelineStart);
+  LONGLONG hnsDuration = m_pTimer->Now() - hnsStart;
+
+  if (FAILED(hr))
+  {
+    return hnsNextSleep;
+  }
+  m_PrepareDuration.Record(hnsDuration);
+
+  hnsNextSleep -= hnsDuration;
+  if (hnsNextSleep <= 0)
+  {
+    // Keep the sample at the front of the queue; look at it again right away.
+    hnsNextSleep = 1;
+  }
+  return hnsNextSleep;
+}
+
+
+//-----------------------------------------------------------------------------
+// ObserveVsync
+//
+// Feeds the time of the display's last vsync (if the callback can report it)
+// to the planner.
+//-----------------------------------------------------------------------------
+
+void Scheduler::ObserveVsync()
+{
+  LONGLONG hnsSinceVsync = 0;
+
+  if (SUCCEEDED(m_pCB->GetTimeSinceVsync(&hnsSinceVsync)))
+  {
+    AutoLock lock(m_schedCritSec);
+    m_Planner.OnVsync(m_pTimer->Now() - hnsSinceVsync);
+  }
+}
@@ -38,6 +38,13 @@
 
 struct SchedulerCallback;
 
+// Capacity of the scheduler's sample queue. Must be a power of two, and 
+// larger than the number of samples in the presenter's sample pool.
+const DWORD SCHEDULER_QUEUE_SIZE = 32;
+
+// Sleep time that means "wait until the next request".
+const LONGLONG SCHEDULER_SLEEP_FOREVER = MAXLONGLONG;
+
 //-----------------------------------------------------------------------------
 // Scheduler class
 //
@@ -48,9 +55,11 @@ struct SchedulerCallback;
 //
 // General design:
 // The scheduler generally receives samples before their presentation time. It
-// puts the samples on a queue and presents them in FIFO order on a worker 
-// thread. The scheduler communicates with the worker thread by posting thread
-// messages.
+// puts the samples on a lock-free queue. The worker thread moves them into a
+// time-ordered queue and presents them in presentation-time order, so samples
+// that arrive slightly out of order are still shown in order. The scheduler
+// communicates with the worker thread through a set of pending request flags
+// and a single wake event.
 //
 // The caller has the option of presenting samples immediately (for example,
 // for repaints). 
@@ -69,15 +78,94 @@ public:
 
   void SetFrameRate(const MFRatio& fps);
 
+  // Refresh rate of the display, in Hz. Used by the vsync planner.
+  void SetRefreshRate(UINT uRefreshRate)
+  {
+    AutoLock lock(m_schedCritSec);
+    m_Planner.SetRefreshRate(uRefreshRate);
+    m_Thinning.SetDisplayInterval(uRefreshRate ? 10000000 / uRefreshRate : 0);
+  }
+
+  // If true, frames played at normal rate are assigned to vsync slots by a 
+  // PresentPlanner, which gives a stable pulldown cadence.
+  bool GetUseVsyncPlanner()
+  {
+    AutoLock lock(m_schedCritSec);
+    return m_bUseVsyncPlanner;
+  }
+
+  void SetUseVsyncPlanner(bool bUseVsyncPlanner)
+  {
+    AutoLock lock(m_schedCritSec);
+    m_bUseVsyncPlanner = bUseVsyncPlanner;
+    m_Planner.Reset();
+  }
+
+  DWORD GetCadenceErrorsPerMinute()
+  {
+    AutoLock lock(m_schedCritSec);
+    return m_Planner.CadenceErrorsPerMinute();
+  }
+
   float GetClockRate() {
     AutoLock lock(m_schedCritSec);
     return m_fRate;
   }
   void SetClockRate(float fRate) {
     AutoLock lock(m_schedCritSec);
+    if (fRate != m_fRate)
+    {
+      // Intervals measured at the old rate do not carry over.
+      m_FrameRateDetector.Discontinuity();
+    }
     m_fRate = fRate;
+    m_Planner.Reset();
+    m_pDropPolicy->Reset();
+    m_ClockTracker.SetRate(fRate);
+    m_JitterBuffer.Discontinuity();
+    m_Thinning.SetRate(fRate);
+  }
+
+  // Trick play: Returns FALSE if the sample with this time stamp is not shown
+  // at the current rate, so the presenter can skip it before doing any more
+  // work on it. Can be called from any thread.
+  BOOL ShouldShowSample(LONGLONG hnsSampleTime)
+  {
+    AutoLock lock(m_schedCritSec);
+    return m_Thinning.SelectFrame(hnsSampleTime);
+  }
+  DWORD GetThinnedFrameCount()
+  {
+    AutoLock lock(m_schedCritSec);
+    return m_Thinning.FramesSkipped();
+  }
+
+  // Presentation time, extrapolated from the last reading of the clock.
+  // Fails if the scheduler is not running or there is no clock.
+  HRESULT GetClockTime(LONGLONG *phnsClockTime)
+  {
+    return m_ClockTracker.GetTime(phnsClockTime);
   }
 
+  // Called from the clock state sink. While the clock is not running, every
+  // query reads the clock.
+  void SetClockRunning(BOOL bRunning)
+  {
+    m_ClockTracker.SetRunning(bRunning);
+    m_JitterBuffer.Discontinuity();
+  }
+
+  // Number of samples the presenter should keep queued, from the recent 
+  // sample arrivals. Can be called from any thread.
+  DWORD GetTargetQueueDepth() { return m_JitterBuffer.TargetDepth(); }
+  void SetQueueDepthLimits(DWORD cMin, DWORD cMax) { m_JitterBuffer.SetLimits(cMin, cMax); }
+
+  // Latency histograms (EVRCPHistogram). Can be called from any thread.
+  void GetStats(EVRCPStats *pStats);
+
+  ULONGLONG GetClockQueryCount() { return m_ClockTracker.QueryCount(); }
+  ULONGLONG GetClockCallCount() { return m_ClockTracker.ClockCallCount(); }
+
   int GetFrameDropThreshold() {
     AutoLock lock(m_schedCritSec);
     return m_iFrameDropThreshold;
@@ -87,9 +175,33 @@ public:
     m_iFrameDropThreshold = iThreshold;
   }
 
+  // Selects which samples are dropped instead of presented 
+  // (EVRCPFrameDropPolicy).
+  int GetFrameDropPolicy() {
+    AutoLock lock(m_schedCritSec);
+    return m_iFrameDropPolicy;
+  }
+  HRESULT SetFrameDropPolicy(int iPolicy);
+
   const LONGLONG& LastSampleTime() const { return m_LastSampleTime; }
   const LONGLONG& FrameDuration() const { return m_PerFrameInterval; }
 
+  // If true, the frame rate is detected from the sample time stamps, and 
+  // overrides the media type's frame rate when they disagree.
+  bool GetFrameRateDetection()
+  {
+    AutoLock lock(m_schedCritSec);
+    return m_bDetectFrameRate;
+  }
+  void SetFrameRateDetection(bool bDetectFrameRate);
+
+  float GetDetectedFrameRate();
+  EVRCPCadence GetContentCadence()
+  {
+    AutoLock lock(m_schedCritSec);
+    return m_FrameRateDetector.Cadence();
+  }
+
   bool GetUseMfTimeCalc()
   {
     AutoLock lock(m_schedCritSec);
@@ -102,12 +214,99 @@ public:
     m_bUseMfTimeCalc = useMfTimeCalc;
   }
 
+  // If true, the scheduler thread sleeps until just before each deadline and
+  // then spins, instead of waking up with millisecond precision. Takes effect
+  // the next time the scheduler is started.
+  bool GetHighResolutionWait()
+  {
+    AutoLock lock(m_schedCritSec);
+    return m_bHighResolutionWait;
+  }
+
+  void SetHighResolutionWait(bool bHighResolutionWait)
+  {
+    AutoLock lock(m_schedCritSec);
+    m_bHighResolutionWait = bHighResolutionWait;
+  }
+
+  // Replaces the timer used by the scheduler thread (for example, with a 
+  // VirtualTimer). NULL restores the default timer. The timer is not owned.
+  // Takes effect the next time the scheduler is started.
+  void SetTimer(SchedulerTimer *pTimer)
+  {
+    AutoLock lock(m_schedCritSec);
+    m_pTimerOverride = pTimer;
+  }
+
+  // If true, the scheduler runs on the SchedulerService thread shared with 
+  // the other presenters in the process, instead of its own thread. Takes 
+  // effect the next time the scheduler is started.
+  bool GetSharedThread()
+  {
+    AutoLock lock(m_schedCritSec);
+    return m_bSharedThread;
+  }
+
+  void SetSharedThread(bool bSharedThread)
+  {
+    AutoLock lock(m_schedCritSec);
+    m_bSharedThread = bSharedThread;
+  }
+
+  // Priority, MMCSS and affinity of the scheduler thread. Takes effect the
+  // next time the scheduler is started. (The shared thread uses the policy
+  // of the scheduler that started it.)
+  void GetThreadPolicy(ThreadPolicySettings *pSettings)
+  {
+    AutoLock lock(m_schedCritSec);
+    *pSettings = m_ThreadPolicySettings;
+  }
+
+  HRESULT SetThreadPolicy(const ThreadPolicySettings& settings)
+  {
+    if (settings.iPriority < EVRCP_THREAD_PRIORITY_NORMAL || settings.iPriority > EVRCP_THREAD_PRIORITY_TIME_CRITICAL)
+    {
+      return E_INVALIDARG;
+    }
+    AutoLock lock(m_schedCritSec);
+    m_ThreadPolicySettings = settings;
+    return S_OK;
+  }
+
+  // Called from the thread that runs the mixer, with the processor it ran on.
+  void SetMixerProcessor(DWORD dwProcessor) { m_dwMixerProcessor = dwProcessor; }
+
+  // Called by SchedulerService on its thread.
+  LONGLONG TimeUntilService();
+  DWORD    ServiceCoarseTimeout() { return m_pTimer->CoarseTimeout(m_hnsServiceDeadline); }
+  LONGLONG ServiceDeadline();
+  void     ServiceTurn();
+
+  // If true, the next sample is handed to SchedulerCallback::PrepareSample
+  // as soon as the scheduler starts waiting for it, so only the flip is left
+  // for its presentation time.
+  bool GetPresentAhead()
+  {
+    AutoLock lock(m_schedCritSec);
+    return m_bPresentAhead;
+  }
+
+  void SetPresentAhead(bool bPresentAhead)
+  {
+    AutoLock lock(m_schedCritSec);
+    m_bPresentAhead = bPresentAhead;
+  }
+
+  // Per-frame stage times. Shared with the presenter and the present 
+  // engine, which record their own stages into it.
+  FrameTimeline *GetTimeline() { return &m_Timeline; }
+
   HRESULT StartScheduler(IMFClock *pClock);
   HRESULT StopScheduler();
 
   HRESULT ScheduleSample(IMFSample *pSample, BOOL bPresentNow);
-  HRESULT ProcessSamplesInQueue(LONG *plNextSleep);
-  HRESULT ProcessSample(IMFSample *pSample, LONG *plNextSleep);
+  HRESULT ProcessSamplesInQueue(LONGLONG *phnsNextSleep, DWORD cMaxSamples = MAXDWORD);
+  HRESULT ProcessSample(IMFSample *pSample, LONGLONG *phnsNextSleep);
   HRESULT Flush();
 
   // ThreadProc for the scheduler thread.
@@ -117,35 +316,142 @@ private:
   // non-static version of SchedulerThreadProc.
   DWORD SchedulerThreadProcPrivate();
 
+  LONGLONG NextDeadline(LONGLONG hnsSleep);
+  void     SortIncomingSamples();
+  void     SetFrameInterval(MFTIME hnsInterval);
+  void     DetectFrameRate(IMFSample *pSample);
+  DWORD    QueuedCount() const { return m_ScheduledSamples.Count() + m_SortedSamples.Count(); }
+  bool IsPlannerActive()
+  {
+    AutoLock lock(m_schedCritSec);
+    return m_bUseVsyncPlanner && m_Planner.IsActive();
+  }
+
+  BOOL IsThinning()
+  {
+    AutoLock lock(m_schedCritSec);
+    return m_Thinning.IsActive();
+  }
+
+  LONGLONG ThinningSlotTime(LONGLONG hnsSampleTime)
+  {
+    AutoLock lock(m_schedCritSec);
+    return m_Thinning.SlotTime(hnsSampleTime);
+  }
+
+  BOOL ShouldDropSample(const FrameDropContext& context)
+  {
+    AutoLock lock(m_schedCritSec);
+    return m_pDropPolicy->ShouldDrop(context);
+  }
+
+  void GetDueStats(FrameDropContext *pContext);
+  void RecordDueSample(const FrameDropContext& context);
+
+  LONGLONG PlanSample(IMFSample *pSample, LONGLONG hnsPresentationTime, LONGLONG hnsDueTime);
+  void     ObserveVsync();
+  LONGLONG PrepareAhead(IMFSample *pSample, LONGLONG hnsPresentationTime, LONGLONG hnsNextSleep);
+  void Signal(LONG lEvent);
+
 
 private:
-  ThreadSafeQueue<IMFSample>  m_ScheduledSamples;     // Samples waiting to be presented.
+  LockFreeQueue<IMFSample, SCHEDULER_QUEUE_SIZE> m_ScheduledSamples; // Samples not yet seen by the worker thread.
+  TimeOrderedQueue<IMFSample, SCHEDULER_QUEUE_SIZE> m_SortedSamples;  // Samples waiting to be presented. Worker thread only.
+  LONGLONG            m_hnsLastSortedTime;    // Time used for samples without a time stamp.
+  std::atomic<DWORD>  m_dwGeneration;         // Incremented by Flush. Samples are tagged with it.
+  DWORD               m_dwSortedGeneration;   // Generation of m_SortedSamples. Worker thread only.
 
   IMFClock            *m_pClock;  // Presentation clock. Can be NULL.
+  ClockTracker        m_ClockTracker;         // Extrapolates m_pClock.
   SchedulerCallback   *m_pCB;     // Weak reference; do not delete.
 
-  DWORD               m_dwThreadID;
   HANDLE              m_hSchedulerThread;
   HANDLE              m_hThreadReadyEvent;
-  HANDLE              m_hFlushEvent;
+  HANDLE              m_hWakeEvent;           // Wakes up the scheduler thread.
+  std::atomic<LONG>   m_lPendingEvents;       // ScheduleEvent flags not yet handled.
+
+  bool                m_bSharedThread;
+  BOOL                m_bServiced;            // Attached to the SchedulerService.
+  std::atomic<BOOL>   m_bServiceFailed;
+  BOOL                m_bServiceYielded;      // The last turn ran out of samples to process.
+  LONGLONG            m_hnsServiceDeadline;   // Service thread only.
+
+  ThreadPolicySettings m_ThreadPolicySettings;
+  ThreadPolicy        m_ThreadPolicy;         // Scheduler thread only.
+  std::atomic<DWORD>  m_dwMixerProcessor;
 
   float               m_fRate;                // Playback rate.
   MFTIME              m_PerFrameInterval;     // Duration of each frame.
   LONGLONG            m_PerFrame_1_4th;       // 1/4th of the frame duration.
+  MFTIME              m_MediaTypeFrameInterval; // Frame duration from the media type.
+  bool                m_bDetectFrameRate;
+  FrameRateDetector   m_FrameRateDetector;    // Protected by m_schedCritSec.
+  JitterBufferController m_JitterBuffer;
+  ThinningPlanner     m_Thinning;             // Protected by m_schedCritSec.
   MFTIME              m_LastSampleTime;       // Most recent sample time.
   bool				m_bUseMfTimeCalc;
+  bool				m_bHighResolutionWait;
   int					m_iFrameDropThreshold;
+  int                 m_iFrameDropPolicy;
+  FrameDropPolicy     *m_pDropPolicy;         // Protected by m_schedCritSec.
+  LateThresholdPolicy m_LateThresholdPolicy;
+  QueueDepthPolicy    m_QueueDepthPolicy;
+  CatchUpPolicy       m_CatchUpPolicy;
+  NeverDropPolicy     m_NeverDropPolicy;
+  RobustWindow        m_LatenessWindow;       // Lateness of due samples. Protected by m_schedCritSec.
+  RobustWindow        m_QueuedWindow;         // Queue depth behind due samples. Protected by m_schedCritSec.
   CritSec				m_schedCritSec;
+
+  SchedulerTimer      *m_pTimer;              // Timer used by the scheduler thread.
+  SchedulerTimer      *m_pTimerOverride;      // Set by SetTimer; not owned.
+  CoarseTimer         m_CoarseTimer;
+  PrecisionTimer      m_PrecisionTimer;
+
+  // Recorded on the scheduler thread.
+  LatencyHistogram    m_PresentLateness;
+  LatencyHistogram    m_SleepOvershoot;
+  LatencyHistogram    m_QueueDepth;
+  LatencyHistogram    m_PresentDuration;
+  LatencyHistogram    m_PrepareDuration;
+  FrameTimeline       m_Timeline;
+
+  bool                m_bUseVsyncPlanner;
+  PresentPlanner      m_Planner;              // Protected by m_schedCritSec.
+  IMFSample           *m_pPlannedSample;      // Sample that m_hnsPlannedTime is for. Weak reference, only compared.
+  LONGLONG            m_hnsPlannedSampleTime;
+  LONGLONG            m_hnsPlannedTime;       // When to present m_pPlannedSample (system time).
+
+  bool                m_bPresentAhead;
+  IMFSample           *m_pPreparedSample;     // Sample handed to PrepareSample. Weak reference, only compared.
+  LONGLONG            m_hnsPreparedSampleTime;
+  DWORD               m_dwPreparedGeneration;
 };
 
 
 //-----------------------------------------------------------------------------
 // SchedulerCallback
 //
-// Defines the callback method to present samples. 
+// Defines the callback method to present samples. OnSampleDropped is called
+// instead of PresentSample when the scheduler discards a sample.
+//
+// With present-ahead enabled, the scheduler calls PrepareSample for the next
+// sample while it waits for that sample's presentation time. The callback 
+// renders it into a ready buffer, and the PresentSample call for the same 
+// sample only has to flip. PresentSample must still work for a sample that
+// was not prepared (or whose ready buffer is stale), and a prepared sample 
+// may be dropped instead of presented. DiscardPrepared is called when the 
+// scheduler flushes or stops.
 //-----------------------------------------------------------------------------
 
 struct SchedulerCallback
 {
   virtual HRESULT PresentSample(IMFSample *pSample, LONGLONG llTarget, LONGLONG timeDelta, LONGLONG remainingInQueue, LONGLONG frameDurationDiv4) = 0;
+  virtual void OnSampleDropped(IMFSample *pSample, LONGLONG llTarget, LONGLONG timeDelta, LONGLONG remainingInQueue) { }
+
+  // Returns how long ago the display's last vsync started.
+  virtual HRESULT GetTimeSinceVsync(LONGLONG *phnsSinceVsync) { return E_NOTIMPL; }
+
+  // Present-ahead. E_NOTIMPL means the callback renders and flips in one step.
+  virtual HRESULT PrepareSample(IMFSample *pSample) { return E_NOTIMPL; }
+  virtual void DiscardPrepared() { }
 };
@@ -28,6 +28,9 @@
 #include <intsafe.h>
 #include <math.h>
 #include <cmath>
+#include <stdio.h>
+#include <atomic>
+#include <avrt.h>
 
 #include <mfapi.h>
 #include <mfidl.h>